@@ -0,0 +1,478 @@
+#include <arpa/inet.h>
+#include <algorithm>
+#include <string>
+#include "address_set.h"
+
+using namespace std;
+
+#define IPV4_BYTES	4
+#define IPV6_BYTES	16
+
+prefix_set::prefix_set(unsigned bits)
+	: bits(bits), root(-1)
+{
+}
+
+int32_t prefix_set::insert(int32_t node, const uint8_t *addr, unsigned depth, unsigned length)
+{
+	if (node != -1 && nodes[node].full) {
+		return node;
+	}
+
+	if (depth == length) {
+		// The subtrie below, if any, is left unreferenced.
+		if (node == -1) {
+			node = nodes.size();
+			nodes.push_back({ { -1, -1 }, true });
+		} else {
+			nodes[node] = { { -1, -1 }, true };
+		}
+
+		return node;
+	}
+
+	if (node == -1) {
+		node = nodes.size();
+		nodes.push_back({ { -1, -1 }, false });
+	}
+
+	int bit = (addr[depth / 8] >> (7 - depth % 8)) & 1;
+	int32_t child = insert(nodes[node].child[bit], addr, depth + 1, length);
+	type_trie_node &n = nodes[node];
+
+	n.child[bit] = child;
+
+	if (n.child[0] != -1 && n.child[1] != -1 && nodes[n.child[0]].full && nodes[n.child[1]].full) {
+		n = { { -1, -1 }, true };
+	}
+
+	return node;
+}
+
+void prefix_set::add(const uint8_t *addr, unsigned length)
+{
+	root = insert(root, addr, 0, min(length, bits));
+}
+
+void prefix_set::fill()
+{
+	nodes.assign(1, { { -1, -1 }, true });
+	root = 0;
+}
+
+void prefix_set::clear()
+{
+	nodes.clear();
+	root = -1;
+}
+
+bool prefix_set::contains(const uint8_t *addr) const
+{
+	int32_t node = root;
+
+	for (unsigned depth = 0; node != -1; depth++) {
+		if (nodes[node].full) {
+			return true;
+		}
+
+		if (depth == bits) {
+			break;
+		}
+
+		node = nodes[node].child[(addr[depth / 8] >> (7 - depth % 8)) & 1];
+	}
+
+	return false;
+}
+
+bool prefix_set::prefixes(unsigned length, size_t limit, vector<uint32_t> &out) const
+{
+	return root == -1 || collect(root, 0, 0, length, limit, out);
+}
+
+bool prefix_set::collect(int32_t node, unsigned depth, uint32_t value, unsigned length, size_t limit,
+	vector<uint32_t> &out) const
+{
+	if (depth == length) {
+		out.push_back(value);
+		return out.size() <= limit;
+	}
+
+	if (nodes[node].full) {
+		// All the prefixes below.
+		uint64_t count = 1ull << (length - depth);
+
+		if (out.size() + count > limit) {
+			return false;
+		}
+
+		for (uint64_t i = 0; i < count; i++) {
+			out.push_back((value << (length - depth)) | i);
+		}
+
+		return true;
+	}
+
+	for (int bit = 0; bit < 2; bit++) {
+		int32_t child = nodes[node].child[bit];
+
+		if (child != -1 && !collect(child, depth + 1, (value << 1) | bit, length, limit, out)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int32_t prefix_set::copy(const type_trie &from, int32_t node, type_trie &to)
+{
+	if (node == -1) {
+		return -1;
+	}
+
+	int32_t id = to.size();
+
+	to.push_back(from[node]);
+
+	if (!from[node].full) {
+		int32_t zero = copy(from, from[node].child[0], to);
+		int32_t one = copy(from, from[node].child[1], to);
+
+		to[id].child[0] = zero;
+		to[id].child[1] = one;
+	}
+
+	return id;
+}
+
+// Node over two subtries that were just appended to 'to', in this order.
+int32_t prefix_set::join(int32_t zero, int32_t one, type_trie &to)
+{
+	if (zero == -1 && one == -1) {
+		return -1;
+	}
+
+	if (zero != -1 && one != -1 && to[zero].full && to[one].full) {
+		// Both are single nodes at the end.
+		to.resize(zero);
+		to.push_back({ { -1, -1 }, true });
+		return zero;
+	}
+
+	to.push_back({ { zero, one }, false });
+
+	return to.size() - 1;
+}
+
+int32_t prefix_set::combine(const type_trie &a, int32_t na, const type_trie &b, int32_t nb,
+	bool unite, type_trie &to)
+{
+	if (unite) {
+		if (na == -1 || (nb != -1 && b[nb].full)) {
+			return copy(b, nb, to);
+		}
+
+		if (nb == -1 || a[na].full) {
+			return copy(a, na, to);
+		}
+	} else {
+		if (na == -1 || nb == -1) {
+			return -1;
+		}
+
+		if (a[na].full) {
+			return copy(b, nb, to);
+		}
+
+		if (b[nb].full) {
+			return copy(a, na, to);
+		}
+	}
+
+	int32_t zero = combine(a, a[na].child[0], b, b[nb].child[0], unite, to);
+	int32_t one = combine(a, a[na].child[1], b, b[nb].child[1], unite, to);
+
+	return join(zero, one, to);
+}
+
+int32_t prefix_set::invert(const type_trie &from, int32_t node, type_trie &to)
+{
+	if (node == -1) {
+		to.push_back({ { -1, -1 }, true });
+		return to.size() - 1;
+	}
+
+	if (from[node].full) {
+		return -1;
+	}
+
+	int32_t zero = invert(from, from[node].child[0], to);
+	int32_t one = invert(from, from[node].child[1], to);
+
+	return join(zero, one, to);
+}
+
+// Results are built into a new trie, which also drops unreferenced nodes.
+void prefix_set::unite(const prefix_set &other)
+{
+	type_trie res;
+
+	root = combine(nodes, root, other.nodes, other.root, true, res);
+	nodes.swap(res);
+}
+
+void prefix_set::intersect(const prefix_set &other)
+{
+	type_trie res;
+
+	root = combine(nodes, root, other.nodes, other.root, false, res);
+	nodes.swap(res);
+}
+
+void prefix_set::complement()
+{
+	type_trie res;
+
+	root = invert(nodes, root, res);
+	nodes.swap(res);
+}
+
+ip_set ip_set::any()
+{
+	ip_set res;
+
+	res.v4.fill();
+	res.v6.fill();
+
+	return res;
+}
+
+static bool parse_prefix_length(string_view s, unsigned max, unsigned &length)
+{
+	if (s.empty() || s.length() > 3) {
+		return false;
+	}
+
+	length = 0;
+
+	for (char c : s) {
+		if (c < '0' || c > '9') {
+			return false;
+		}
+
+		length = length * 10 + (c - '0');
+	}
+
+	return length <= max;
+}
+
+// Dotted IPv4 netmask; its ones must be contiguous.
+static bool parse_netmask(const string &s, unsigned &length)
+{
+	in_addr mask;
+
+	if (inet_pton(AF_INET, s.c_str(), &mask) != 1) {
+		return false;
+	}
+
+	uint32_t bits = ntohl(mask.s_addr);
+
+	length = 0;
+
+	while (length < 32 && (bits & (0x80000000U >> length))) {
+		length++;
+	}
+
+	return length == 32 || (bits << length) == 0;
+}
+
+bool ip_set::add(string_view literal)
+{
+	size_t slash = literal.find('/');
+	string addr(literal.substr(0, slash));
+	uint8_t bytes[IPV6_BYTES];
+	unsigned length;
+
+	if (addr.find(':') == string::npos) {
+		if (inet_pton(AF_INET, addr.c_str(), bytes) != 1) {
+			return false;
+		}
+
+		length = IPV4_BYTES * 8;
+
+		if (slash != string_view::npos) {
+			string_view mask = literal.substr(slash + 1);
+
+			if (!parse_prefix_length(mask, length, length) &&
+				(mask.find('.') == string_view::npos || !parse_netmask(string(mask), length))) {
+				return false;
+			}
+		}
+
+		v4.add(bytes, length);
+	} else {
+		if (inet_pton(AF_INET6, addr.c_str(), bytes) != 1) {
+			return false;
+		}
+
+		length = IPV6_BYTES * 8;
+
+		if (slash != string_view::npos && !parse_prefix_length(literal.substr(slash + 1), length, length)) {
+			return false;
+		}
+
+		v6.add(bytes, length);
+	}
+
+	return true;
+}
+
+void ip_set::unite(const ip_set &other)
+{
+	v4.unite(other.v4);
+	v6.unite(other.v6);
+}
+
+void ip_set::intersect(const ip_set &other)
+{
+	v4.intersect(other.v4);
+	v6.intersect(other.v6);
+}
+
+void ip_set::complement()
+{
+	v4.complement();
+	v6.complement();
+}
+
+port_set port_set::any()
+{
+	port_set res;
+
+	res.ranges.push_back({ 0, PORT_MAX });
+
+	return res;
+}
+
+static bool parse_port(string_view s, uint32_t &port)
+{
+	if (s.empty() || s.length() > 5) {
+		return false;
+	}
+
+	port = 0;
+
+	for (char c : s) {
+		if (c < '0' || c > '9') {
+			return false;
+		}
+
+		port = port * 10 + (c - '0');
+	}
+
+	return port <= PORT_MAX;
+}
+
+bool port_set::add(string_view literal)
+{
+	size_t colon = literal.find(':');
+	uint32_t low = 0;
+	uint32_t high = PORT_MAX;
+
+	if (colon == string_view::npos) {
+		if (!parse_port(literal, low)) {
+			return false;
+		}
+
+		high = low;
+	} else {
+		string_view first = literal.substr(0, colon);
+		string_view last = literal.substr(colon + 1);
+
+		// A lone ':' is not a range.
+		if ((first.empty() && last.empty()) ||
+			(!first.empty() && !parse_port(first, low)) ||
+			(!last.empty() && !parse_port(last, high)) || low > high) {
+			return false;
+		}
+	}
+
+	add(low, high);
+
+	return true;
+}
+
+void port_set::add(uint32_t low, uint32_t high)
+{
+	// First range that ends at or after low - 1, i.e. touches or follows.
+	auto it = lower_bound(ranges.begin(), ranges.end(), low,
+		[](const pair<uint32_t, uint32_t> &r, uint32_t port) { return r.second + 1 < port; });
+	auto last = it;
+
+	while (last != ranges.end() && last->first <= high + 1) {
+		low = min(low, last->first);
+		high = max(high, last->second);
+		++last;
+	}
+
+	it = ranges.erase(it, last);
+	ranges.insert(it, { low, high });
+}
+
+void port_set::unite(const port_set &other)
+{
+	for (const pair<uint32_t, uint32_t> &r : other.ranges) {
+		add(r.first, r.second);
+	}
+}
+
+void port_set::intersect(const port_set &other)
+{
+	vector<pair<uint32_t, uint32_t>> res;
+	size_t i = 0;
+	size_t j = 0;
+
+	while (i < ranges.size() && j < other.ranges.size()) {
+		uint32_t low = max(ranges[i].first, other.ranges[j].first);
+		uint32_t high = min(ranges[i].second, other.ranges[j].second);
+
+		if (low <= high) {
+			res.push_back({ low, high });
+		}
+
+		if (ranges[i].second < other.ranges[j].second) {
+			i++;
+		} else {
+			j++;
+		}
+	}
+
+	ranges.swap(res);
+}
+
+bool port_set::contains(uint32_t port) const
+{
+	auto it = upper_bound(ranges.begin(), ranges.end(), make_pair(port, UINT32_MAX));
+
+	return it != ranges.begin() && port <= prev(it)->second;
+}
+
+void port_set::complement()
+{
+	vector<pair<uint32_t, uint32_t>> res;
+	uint32_t next = 0;
+
+	for (const pair<uint32_t, uint32_t> &r : ranges) {
+		if (r.first > next) {
+			res.push_back({ next, r.first - 1 });
+		}
+
+		next = r.second + 1;
+	}
+
+	if (next <= PORT_MAX) {
+		res.push_back({ next, PORT_MAX });
+	}
+
+	ranges.swap(res);
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Sets of IP addresses and ports, the values of rule header fields.
+
+// Set of bit strings of a fixed width (32 for IPv4, 128 for IPv6) as a
+// binary radix trie of prefixes. A node covering all of its addresses is
+// a 'full' leaf; nodes whose two halves are full are folded into one, so
+// "0.0.0.0/1" plus "128.0.0.0/1" is a single full root. Empty subtries
+// are never stored.
+class prefix_set
+{
+public:
+	explicit prefix_set(unsigned bits);
+
+	// Add the addresses starting with the first 'length' bits of 'addr'
+	// (network byte order).
+	void add(const uint8_t *addr, unsigned length);
+	void fill();
+	void clear();
+	void unite(const prefix_set &other);
+	void intersect(const prefix_set &other);
+	void complement();
+	// 'addr' has 'bits' bits, network byte order.
+	bool contains(const uint8_t *addr) const;
+	// The distinct values of the first 'length' bits (at most 32) of the
+	// addresses, appended to 'out'. Returns false if there are more than
+	// 'limit'.
+	bool prefixes(unsigned length, size_t limit, std::vector<uint32_t> &out) const;
+
+	bool empty() const
+	{
+		return root == -1;
+	}
+
+	bool full() const
+	{
+		return root != -1 && nodes[root].full;
+	}
+
+	size_t size() const
+	{
+		return nodes.size();
+	}
+
+private:
+	typedef struct trie_node
+	{
+		int32_t child[2];
+		bool full;
+	} type_trie_node;
+
+	typedef std::vector<type_trie_node> type_trie;
+
+	int32_t insert(int32_t node, const uint8_t *addr, unsigned depth, unsigned length);
+	bool collect(int32_t node, unsigned depth, uint32_t value, unsigned length, size_t limit,
+		std::vector<uint32_t> &out) const;
+	static int32_t copy(const type_trie &from, int32_t node, type_trie &to);
+	static int32_t join(int32_t zero, int32_t one, type_trie &to);
+	static int32_t combine(const type_trie &a, int32_t na, const type_trie &b, int32_t nb,
+		bool unite, type_trie &to);
+	static int32_t invert(const type_trie &from, int32_t node, type_trie &to);
+
+	unsigned bits;
+	int32_t root;
+	type_trie nodes;
+};
+
+class ip_set
+{
+public:
+	ip_set() : v4(32), v6(128)
+	{
+	}
+
+	static ip_set any();
+
+	// Add a literal: an IPv4 or IPv6 address, optionally with a /prefix
+	// length (IPv4 also as a dotted netmask). Returns false if malformed.
+	bool add(std::string_view literal);
+	void unite(const ip_set &other);
+	void intersect(const ip_set &other);
+	void complement();
+	// 'addr' is 4 or 16 bytes, network byte order.
+	bool contains(const uint8_t *addr, bool ipv6) const
+	{
+		return ipv6 ? v6.contains(addr) : v4.contains(addr);
+	}
+
+	// See prefix_set::prefixes(); false as well if there are IPv6
+	// addresses.
+	bool ipv4_prefixes(unsigned length, size_t limit, std::vector<uint32_t> &out) const
+	{
+		return v6.empty() && v4.prefixes(length, limit, out);
+	}
+
+	bool empty() const
+	{
+		return v4.empty() && v6.empty();
+	}
+
+	bool full() const
+	{
+		return v4.full() && v6.full();
+	}
+
+private:
+	prefix_set v4;
+	prefix_set v6;
+};
+
+#define PORT_MAX	65535
+
+// Set of ports as sorted, disjoint and non-adjacent closed intervals.
+class port_set
+{
+public:
+	static port_set any();
+
+	// Add a literal: a port, or a range "lo:hi" with either end optional.
+	// Returns false if malformed.
+	bool add(std::string_view literal);
+	void add(uint32_t low, uint32_t high);
+	void unite(const port_set &other);
+	void intersect(const port_set &other);
+	void complement();
+	bool contains(uint32_t port) const;
+
+	bool empty() const
+	{
+		return ranges.empty();
+	}
+
+	bool full() const
+	{
+		return ranges.size() == 1 && ranges[0].first == 0 && ranges[0].second == PORT_MAX;
+	}
+
+	// Sorted, disjoint ranges.
+	const std::vector<std::pair<uint32_t, uint32_t>> &spans() const
+	{
+		return ranges;
+	}
+
+private:
+	std::vector<std::pair<uint32_t, uint32_t>> ranges;
+};
@@ -1,255 +1,447 @@
+#include <algorithm>
 #include <regex>
 #include <cstdio>
+#include <unordered_map>
 #include "arg_checkers.h"
+#include "arg_parsers.h"
+#include "pcre_parser.h"
+#include "string_utils.h"
 
 using namespace std;
 
-bool str_arg_checker(string opt, string arg, string &message)
+// Strip the surrounding quotes. Returns false if the value is not quoted.
+static bool unquote(string_view &arg)
 {
-	if ((arg[0] != '"') || (arg[arg.length() - 1] != '"')) {
-		message += "- Value of option '" + opt + "' must be enclosed in '\"'\n";
+	if ((arg.length() < 2) || (arg[0] != '"') || (arg[arg.length() - 1] != '"')) {
 		return false;
 	}
 
-	arg.erase(0, 1);
-	arg.erase(arg.length() - 1, 1);
+	arg = arg.substr(1, arg.length() - 2);
+
+	return true;
+}
+
+bool str_arg_checker(string_view opt, string_view arg, diag_list &diags)
+{
+	if (!unquote(arg)) {
+		report(diags, DIAG_NOT_QUOTED, opt, arg);
+		return false;
+	}
 
 	if (arg.empty()) {
-		message += "- Value of option '" + opt + "' is empty\n";
+		report(diags, DIAG_EMPTY_VALUE, opt, arg);
 		return false;
 	}
 
 	return true;
 }
 
-bool pcre_arg_checker(string opt, string arg, string &message)
+// content and uricontent: a quoted pattern, negated with a leading '!'.
+bool pattern_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	if ((arg[0] != '"') || (arg[arg.length() - 1] != '"')) {
-		message += "- Regular expression must be enclosed in '\"'\n";
-		return false;
+	string_view value = trim(arg);
+
+	if (!value.empty() && value[0] == '!') {
+		value = trim(value.substr(1));
 	}
 
-	arg.erase(0, 1);
-	arg.erase(arg.length() - 1, 1);
+	return str_arg_checker(opt, value, diags);
+}
 
-	if (arg.empty()) {
-		message += "- Regular expression is empty\n";
+bool pcre_arg_checker(string_view opt, string_view arg, diag_list &diags)
+{
+	return pcre_arg_checker(opt, arg, diags, nullptr);
+}
+
+bool pcre_arg_checker(string_view opt, string_view arg, diag_list &diags, diag_list *hazards)
+{
+	string_view value = trim(arg);
+
+	// Negated match: pcre:!"/.../"
+	if (!value.empty() && value[0] == '!') {
+		value = trim(value.substr(1));
+	}
+
+	if (!unquote(value)) {
+		report(diags, DIAG_PCRE_NOT_QUOTED, opt, arg);
 		return false;
 	}
 
-	try {
-		regex expr(arg);
+	if (value.empty()) {
+		report(diags, DIAG_PCRE_EMPTY, opt, arg);
+		return false;
 	}
-	catch (const exception &e) {
-		message += "- Invalid regular expression: " + arg + " (" + e.what() + ")\n";
+
+	pcre_expression expr;
+
+	if (!expr.parse(arg)) {
+		report(diags, DIAG_INVALID_PCRE, opt, value, expr.error());
 		return false;
 	}
 
+	if (hazards) {
+		expr.find_hazards(opt, *hazards);
+	}
+
 	return true;
 }
 
-bool uint_arg_checker(string opt, string arg, string &message)
+bool uint_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	if (count_if(arg.begin(), arg.end(), not1(ptr_fun(::isdigit)))) {
-		message += "- Invalid argument to '" + opt + "' option: " + arg + ". Must be a positive integer\n";
+	if (count_if(arg.begin(), arg.end(), [](unsigned char c) { return !isdigit(c); })) {
+		report(diags, DIAG_NOT_UINT, opt, arg);
 		return false;
 	}
 
 	return true;
 }
 
-static bool check_regex(string opt, string arg, string expr, string &message)
+typedef struct validator
 {
-	if (!regex_match(arg, regex(expr))) {
-		message += "- Invalid argument to '" + opt + "'\n";
-		return false;
+	const char *name;
+	const char *expr;
+} type_validator;
+
+// Argument grammars of the regex-checked options, keyed by option name.
+static const type_validator validators[] = {
+	{ "reference",         "^\\s*([\\w\\d]+)\\s*,\"?\\s*\"?\\s*([\\w\\d\\-_\\.\\/\\?\\=]+)\"?\\s*\"?" },
+	{ "fragoffset",        "^\\s*(?:(<|>))?\\s*(\\d+)" },
+	{ "fragbits",          "^\\s*(?:([\\+\\*!]))?\\s*([MDR]+)" },
+	{ "classtype",         "^\\s*([\\w[_\\w\\d\\-]*)\\s*$" },
+	{ "isdataat",          "^\\s*!?([^\\s,]+)\\s*(,\\s*relative)?\\s*(,\\s*rawbytes\\s*)?\\s*$" },
+	{ "ttl",               "^\\s*(\\d*)?\\s*([-<>=]+)?\\s*(\\d+)?\\s*$" },
+	{ "detection_filter",  "^\\s*(track|count|seconds)\\s+(by_src|by_dst|\\d+)\\s*,\\s*(track|count|seconds)"
+	                       "\\s+(by_src|by_dst|\\d+)\\s*,\\s*(track|count|seconds)\\s+(by_src|by_dst|\\d+)\\s*$" },
+	{ "tag",               "^\\s*(host|session)\\s*(,\\s*(\\d+)\\s*,\\s*(packets|bytes|seconds)\\s*(,\\s*(src|dst))?\\s*)?$" },
+	{ "dce_iface",         "^\\s*([\\d\\w]{8}-[\\d\\w]{4}-[\\d\\w]{4}-[\\d\\w]{4}"
+	                       "-[\\d\\w]{12})(?:\\s*,(<|>|=|!)(\\d{1,5}))?(?:\\s*,(any_frag))?\\s*$" },
+	{ "dce_opnum",         "^\\s*(\\d{1,5}(\\s*-\\s*\\d{1,5}\\s*)?)(,\\s*\\d{1,5}(\\s*-\\s*\\d{1,5})?\\s*)*$" },
+	{ "ssl_version",       "^\\s*(!?[\\w\\d.]+)\\s*,?\\s*(!?[\\w\\d.]+)?\\s*\\,?\\s*"
+	                       "(!?[\\w\\d.]+)?\\s*,?\\s*(!?[\\w\\d.]+)?\\s*,?\\s*(!?[\\w\\d.]+)?\\s*$" },
+	{ "ssl_state",         "^\\s*([_\\w\\d]+)(.*)$" },
+	{ "ssl_state_list",    "^(?:\\s*[|]\\s*([_\\w\\d]+))(.*)$" },
+	{ "tos",               "^\\s*(!?\\s*\\d{1,3}|!?\\s*[xX][0-9a-fA-F]{1,2})\\s*$" },
+	{ "flowbits",          "([a-z]+)(?:,(.*))?" },
+	{ "ip_proto",          "^\\s*([!<>]?)\\s*([^\\s]+)\\s*$" },
+	{ "ipopts",            "\\S\\w" },
+	{ "urilen",            "^(?:\\s*)(<|>)?(?:\\s*)(\\d{1,5})(?:\\s*)(?:(<>)(?:\\s*)"
+	                       "(\\d{1,5}))?\\s*(?:,\\s*(norm|raw))?\\s*$" },
+	{ "icode",             "^\\s*(<|>)?\\s*(\\d+)\\s*(?:<>\\s*(\\d+))?\\s*$" },
+	{ "itype",             "^\\s*(<|>)?\\s*(\\d+)\\s*(?:<>\\s*(\\d+))?\\s*$" },
+	{ "iprep",             "\\s*(any|src|dst|both)\\s*,\\s*([\\w\\d\\-_]+)\\s*,\\s*(<|>|=)\\s*,\\s*(12[0-7]|1[01]\\d|[1-9]\\d|[1-9])\\s*" },
+
+	{ nullptr, nullptr }
+};
+
+// Validators are compiled once, on first use, and shared afterwards.
+// Concurrent matching against a const std::regex is safe.
+static const regex &validator(const string &name)
+{
+	static const unordered_map<string, regex> compiled = [] {
+		unordered_map<string, regex> res;
+
+		for (size_t i = 0; validators[i].name != nullptr; i++) {
+			res.emplace(validators[i].name, regex(validators[i].expr, regex::optimize));
+		}
+
+		return res;
+	}();
+
+	return compiled.at(name);
+}
+
+static bool report_invalid_arg(string_view opt, string_view arg, diag_list &diags)
+{
+	report(diags, DIAG_INVALID_ARGUMENT, opt, arg);
+	return false;
+}
+
+static bool check_regex(string_view opt, string_view arg, const regex &expr, diag_list &diags)
+{
+	if (!regex_match(arg.begin(), arg.end(), expr)) {
+		return report_invalid_arg(opt, arg, diags);
 	}
 
 	return true;
 }
 
-bool reference_arg_checker(string opt, string arg, string &message)
+bool reference_arg_checker(string_view opt, string_view arg, diag_list &diags)
+{
+	static const regex &expr = validator("reference");
+
+	return check_regex(opt, arg, expr, diags);
+}
+
+bool fragoffset_arg_checker(string_view opt, string_view arg, diag_list &diags)
+{
+	static const regex &expr = validator("fragoffset");
+
+	return check_regex(opt, arg, expr, diags);
+}
+
+bool fragbits_arg_checker(string_view opt, string_view arg, diag_list &diags)
+{
+	static const regex &expr = validator("fragbits");
+
+	return check_regex(opt, arg, expr, diags);
+}
+
+bool classtype_arg_checker(string_view opt, string_view arg, diag_list &diags)
+{
+	static const regex &expr = validator("classtype");
+
+	return check_regex(opt, arg, expr, diags);
+}
+
+bool isdataat_arg_checker(string_view opt, string_view arg, diag_list &diags)
+{
+	static const regex &expr = validator("isdataat");
+
+	return check_regex(opt, arg, expr, diags);
+}
+
+bool ttl_arg_checker(string_view opt, string_view arg, diag_list &diags)
+{
+	static const regex &expr = validator("ttl");
+
+	return check_regex(opt, arg, expr, diags);
+}
+
+bool detection_filter_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "^\\s*([\\w\\d]+)\\s*,\"?\\s*\"?\\s*([\\w\\d\\-_\\.\\/\\?\\=]+)\"?\\s*\"?", message);
+	static const regex &expr = validator("detection_filter");
+
+	return check_regex(opt, arg, expr, diags);
 }
 
-bool fragoffset_arg_checker(string opt, string arg, string &message)
+bool threshold_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "^\\s*(?:(<|>))?\\s*(\\d+)", message);
+	type_threshold_args args;
+
+	if (!parse_threshold(arg, args)) {
+		return report_invalid_arg(opt, arg, diags);
+	}
+
+	return true;
 }
 
-bool fragbits_arg_checker(string opt, string arg, string &message)
+bool tag_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "^\\s*(?:([\\+\\*!]))?\\s*([MDR]+)", message);
+	static const regex &expr = validator("tag");
+
+	return check_regex(opt, arg, expr, diags);
 }
 
-bool classtype_arg_checker(string opt, string arg, string &message)
+bool flow_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "^\\s*([\\w[_\\w\\d\\-]*)\\s*$", message);
+	type_flow_args args;
+
+	if (!parse_flow(arg, args)) {
+		return report_invalid_arg(opt, arg, diags);
+	}
+
+	return true;
 }
 
-bool isdataat_arg_checker(string opt, string arg, string &message)
+bool dce_iface_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "^\\s*!?([^\\s,]+)\\s*(,\\s*relative)?\\s*(,\\s*rawbytes\\s*)?\\s*$", message);
+	static const regex &expr = validator("dce_iface");
+
+	return check_regex(opt, arg, expr, diags);
 }
 
-bool ttl_arg_checker(string opt, string arg, string &message)
+bool dce_opnum_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "^\\s*(\\d*)?\\s*([-<>=]+)?\\s*(\\d+)?\\s*$", message);
+	static const regex &expr = validator("dce_opnum");
+
+	return check_regex(opt, arg, expr, diags);
 }
 
-bool detection_filter_arg_checker(string opt, string arg, string &message)
+bool ssl_version_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(
-		opt,
-		arg,
-		"^\\s*(track|count|seconds)\\s+(by_src|by_dst|\\d+)\\s*,\\s*(track|count|seconds)"
-		"\\s+(by_src|by_dst|\\d+)\\s*,\\s*(track|count|seconds)\\s+(by_src|by_dst|\\d+)\\s*$",
-		message);
+	static const regex &expr = validator("ssl_version");
+
+	return check_regex(opt, arg, expr, diags);
 }
 
-bool threshold_arg_checker(string opt, string arg, string &message)
+bool ssl_state_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(
-		opt,
-		arg,
-		"^\\s*(track|type|count|seconds)\\s+(limit|both|threshold|by_dst|by_src|\\d+)\\s*,\\s*"
-		"(track|type|count|seconds)\\s+(limit|both|threshold|by_dst|by_src|\\d+)\\s*,\\s*"
-		"(track|type|count|seconds)\\s+(limit|both|threshold|by_dst|by_src|\\d+)\\s*,\\s*"
-		"(track|type|count|seconds)\\s+(limit|both|threshold|by_dst|by_src|\\d+)\\s*",
-		message);
+	static const regex &expr = validator("ssl_state");
+	static const regex &list_expr = validator("ssl_state_list");
+
+	return (check_regex(opt, arg, expr, diags) || check_regex(opt, arg, list_expr, diags));
 }
 
-bool tag_arg_checker(string opt, string arg, string &message)
+bool tos_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "^\\s*(host|session)\\s*(,\\s*(\\d+)\\s*,\\s*(packets|bytes|seconds)\\s*(,\\s*(src|dst))?\\s*)?$", message);
+	static const regex &expr = validator("tos");
+
+	return check_regex(opt, arg, expr, diags);
 }
 
-bool flow_arg_checker(string opt, string arg, string &message)
+bool flowbits_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "^\\s*([\\w_]+)\\s*(?:,\\s*([\\w_]+))?\\s*(?:,\\s*([\\w_]+))?\\s*$", message);
+	static const regex &expr = validator("flowbits");
+
+	return check_regex(opt, arg, expr, diags);
 }
 
-bool dce_iface_arg_checker(string opt, string arg, string &message)
+// offset and distance may be negative, depth and within are at least 1.
+static bool position_arg_checker(string_view opt, string_view arg, long min, diag_list &diags)
 {
-	return check_regex(
-		opt,
-		arg,
-		"^\\s*([\\d\\w]{8}-[\\d\\w]{4}-[\\d\\w]{4}-[\\d\\w]{4}"
-		"-[\\d\\w]{12})(?:\\s*,(<|>|=|!)(\\d{1,5}))?(?:\\s*,(any_frag))?\\s*$",
-		message);
+	long value;
+	bool variable;
+
+	if (!parse_position(arg, value, variable) || (!variable && (value < min || value > POSITION_MAX))) {
+		report(diags, DIAG_INVALID_POSITION, opt, arg, to_string(min) + " to " + to_string(POSITION_MAX));
+		return false;
+	}
+
+	return true;
 }
 
-bool dce_opnum_arg_checker(string opt, string arg, string &message)
+bool offset_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "^\\s*(\\d{1,5}(\\s*-\\s*\\d{1,5}\\s*)?)(,\\s*\\d{1,5}(\\s*-\\s*\\d{1,5})?\\s*)*$", message);
+	return position_arg_checker(opt, arg, -POSITION_MAX, diags);
 }
 
-bool ssl_version_arg_checker(string opt, string arg, string &message)
+bool depth_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(
-		opt,
-		arg,
-		"^\\s*(!?[\\w\\d.]+)\\s*,?\\s*(!?[\\w\\d.]+)?\\s*\\,?\\s*"
-		"(!?[\\w\\d.]+)?\\s*,?\\s*(!?[\\w\\d.]+)?\\s*,?\\s*(!?[\\w\\d.]+)?\\s*$",
-		message);
+	return position_arg_checker(opt, arg, 1, diags);
 }
 
-bool ssl_state_arg_checker(string opt, string arg, string &message)
+bool distance_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return (check_regex(opt, arg, "^\\s*([_\\w\\d]+)(.*)$", message) || check_regex(opt, arg, "^(?:\\s*[|]\\s*([_\\w\\d]+))(.*)$", message));
+	return position_arg_checker(opt, arg, -POSITION_MAX, diags);
 }
 
-bool tos_arg_checker(string opt, string arg, string &message)
+bool within_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "^\\s*(!?\\s*\\d{1,3}|!?\\s*[xX][0-9a-fA-F]{1,2})\\s*$", message);
+	return position_arg_checker(opt, arg, 1, diags);
 }
 
-bool flowbits_arg_checker(string opt, string arg, string &message)
+// Snort 3 content: the pattern, then modifiers separated by commas.
+bool content_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "([a-z]+)(?:,(.*))?", message);
+	string_view pattern, modifiers;
+
+	if (!parse_content(arg, pattern, modifiers)) {
+		return report_invalid_arg(opt, arg, diags);
+	}
+
+	if (!pattern_arg_checker(opt, pattern, diags)) {
+		return false;
+	}
+
+	while (!modifiers.empty()) {
+		string_view item = trim(next_token(modifiers, ","));
+		string_view value = item;
+		string_view name = next_token(value, " \t");
+
+		value = trim(value);
+
+		if (name == "nocase" || name == "fast_pattern") {
+			if (!value.empty()) {
+				return report_invalid_arg(opt, item, diags);
+			}
+		} else if (name == "offset" || name == "distance") {
+			if (!position_arg_checker(opt, value, -POSITION_MAX, diags)) {
+				return false;
+			}
+		} else if (name == "depth" || name == "within") {
+			if (!position_arg_checker(opt, value, 1, diags)) {
+				return false;
+			}
+		} else {
+			return report_invalid_arg(opt, item.empty() ? arg : item, diags);
+		}
+	}
+
+	return true;
 }
 
-bool dsize_arg_checker(string opt, string arg, string &message)
+bool dsize_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "^\\s*(<|>)?\\s*(\\d{1,5})\\s*(?:(<>)\\s*(\\d{1,5}))?\\s*$", message);
+	type_dsize_args args;
+
+	if (!parse_dsize(arg, args)) {
+		return report_invalid_arg(opt, arg, diags);
+	}
+
+	return true;
 }
 
-bool ip_proto_arg_checker(string opt, string arg, string &message)
+bool ip_proto_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "^\\s*([!<>]?)\\s*([^\\s]+)\\s*$", message);
+	static const regex &expr = validator("ip_proto");
+
+	return check_regex(opt, arg, expr, diags);
 }
 
-bool byte_jump_arg_checker(string opt, string arg, string &message)
+bool byte_jump_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(
-		opt,
-		arg,
-		"^\\s*"
-		"([^\\s,]+\\s*,\\s*[^\\s,]+)"
-		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
-		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
-		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
-		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
-		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
-		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
-		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
-		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
-		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
-		"\\s*$",
-		message);
+	type_byte_jump_args args;
+
+	if (!parse_byte_jump(arg, args)) {
+		return report_invalid_arg(opt, arg, diags);
+	}
+
+	return true;
 }
 
-bool byte_test_arg_checker(string opt, string arg, string &message)
+bool byte_test_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(
-		opt,
-		arg,
-		"^\\s*"
-		"([^\\s,]+)"
-		"\\s*,\\s*(\\!?)\\s*([^\\s,]*)"
-		"\\s*,\\s*([^\\s,]+)"
-		"\\s*,\\s*([^\\s,]+)"
-		"(?:\\s*,\\s*([^\\s,]+))?"
-		"(?:\\s*,\\s*([^\\s,]+))?"
-		"(?:\\s*,\\s*([^\\s,]+))?"
-		"(?:\\s*,\\s*([^\\s,]+))?"
-		"(?:\\s*,\\s*([^\\s,]+))?"
-		"\\s*$",
-		message);
+	type_byte_test_args args;
+
+	if (!parse_byte_test(arg, args)) {
+		return report_invalid_arg(opt, arg, diags);
+	}
+
+	return true;
 }
 
-bool ipopts_arg_checker(string opt, string arg, string &message)
+bool ipopts_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "\\S\\w", message);
+	static const regex &expr = validator("ipopts");
+
+	return check_regex(opt, arg, expr, diags);
 }
 
-bool urilen_arg_checker(string opt, string arg, string &message)
+bool urilen_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(
-		opt,
-		arg,
-		"^(?:\\s*)(<|>)?(?:\\s*)(\\d{1,5})(?:\\s*)(?:(<>)(?:\\s*)"
-		"(\\d{1,5}))?\\s*(?:,\\s*(norm|raw))?\\s*$",
-		message);
+	static const regex &expr = validator("urilen");
+
+	return check_regex(opt, arg, expr, diags);
 }
 
-bool icode_arg_checker(string opt, string arg, string &message)
+bool icode_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "^\\s*(<|>)?\\s*(\\d+)\\s*(?:<>\\s*(\\d+))?\\s*$", message);
+	static const regex &expr = validator("icode");
+
+	return check_regex(opt, arg, expr, diags);
 }
 
-bool itype_arg_checker(string opt, string arg, string &message)
+bool itype_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "^\\s*(<|>)?\\s*(\\d+)\\s*(?:<>\\s*(\\d+))?\\s*$", message);
+	static const regex &expr = validator("itype");
+
+	return check_regex(opt, arg, expr, diags);
 }
 
-bool flags_arg_checker(string opt, string arg, string &message)
+bool flags_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "^\\s*(?:([\\+\\*!]))?\\s*([SAPRFU120CE\\+\\*!]+)(?:\\s*,\\s*([SAPRFU12CE]+))?\\s*$", message);
+	type_flags_args args;
+
+	if (!parse_flags(arg, args)) {
+		return report_invalid_arg(opt, arg, diags);
+	}
+
+	return true;
 }
 
-bool iprep_arg_checker(string opt, string arg, string &message)
+bool iprep_arg_checker(string_view opt, string_view arg, diag_list &diags)
 {
-	return check_regex(opt, arg, "\\s*(any|src|dst|both)\\s*,\\s*([\\w\\d\\-_]+)\\s*,\\s*(<|>|=)\\s*,\\s*(12[0-7]|1[01]\\d|[1-9]\\d|[1-9])\\s*", message);
+	static const regex &expr = validator("iprep");
+
+	return check_regex(opt, arg, expr, diags);
 }
@@ -1,32 +1,43 @@
 #pragma once
-#include <string>
+#include <string_view>
+#include "diagnostic.h"
 
-bool str_arg_checker              (std::string opt, std::string arg, std::string &message);
-bool pcre_arg_checker             (std::string opt, std::string arg, std::string &message);
-bool reference_arg_checker        (std::string opt, std::string arg, std::string &message);
-bool uint_arg_checker             (std::string opt, std::string arg, std::string &message);
-bool fragoffset_arg_checker       (std::string opt, std::string arg, std::string &message);
-bool fragbits_arg_checker         (std::string opt, std::string arg, std::string &message);
-bool classtype_arg_checker        (std::string opt, std::string arg, std::string &message);
-bool isdataat_arg_checker         (std::string opt, std::string arg, std::string &message);
-bool ttl_arg_checker              (std::string opt, std::string arg, std::string &message);
-bool detection_filter_arg_checker (std::string opt, std::string arg, std::string &message);
-bool threshold_arg_checker        (std::string opt, std::string arg, std::string &message);
-bool tag_arg_checker              (std::string opt, std::string arg, std::string &message);
-bool flow_arg_checker             (std::string opt, std::string arg, std::string &message);
-bool dce_iface_arg_checker        (std::string opt, std::string arg, std::string &message);
-bool dce_opnum_arg_checker        (std::string opt, std::string arg, std::string &message);
-bool ssl_version_arg_checker      (std::string opt, std::string arg, std::string &message);
-bool ssl_state_arg_checker        (std::string opt, std::string arg, std::string &message);
-bool tos_arg_checker              (std::string opt, std::string arg, std::string &message);
-bool flowbits_arg_checker         (std::string opt, std::string arg, std::string &message);
-bool dsize_arg_checker            (std::string opt, std::string arg, std::string &message);
-bool ip_proto_arg_checker         (std::string opt, std::string arg, std::string &message);
-bool byte_jump_arg_checker        (std::string opt, std::string arg, std::string &message);
-bool byte_test_arg_checker        (std::string opt, std::string arg, std::string &message);
-bool ipopts_arg_checker           (std::string opt, std::string arg, std::string &message);
-bool urilen_arg_checker           (std::string opt, std::string arg, std::string &message);
-bool icode_arg_checker            (std::string opt, std::string arg, std::string &message);
-bool itype_arg_checker            (std::string opt, std::string arg, std::string &message);
-bool flags_arg_checker            (std::string opt, std::string arg, std::string &message);
-bool iprep_arg_checker            (std::string opt, std::string arg, std::string &message);
+bool str_arg_checker              (std::string_view opt, std::string_view arg, diag_list &diags);
+bool pattern_arg_checker          (std::string_view opt, std::string_view arg, diag_list &diags);
+bool content_arg_checker          (std::string_view opt, std::string_view arg, diag_list &diags);
+bool pcre_arg_checker             (std::string_view opt, std::string_view arg, diag_list &diags);
+// Same, the backtracking hazards of a valid expression (see
+// pcre_expression::find_hazards()) go to 'hazards' if not null.
+bool pcre_arg_checker             (std::string_view opt, std::string_view arg, diag_list &diags,
+	diag_list *hazards);
+bool reference_arg_checker        (std::string_view opt, std::string_view arg, diag_list &diags);
+bool uint_arg_checker             (std::string_view opt, std::string_view arg, diag_list &diags);
+bool fragoffset_arg_checker       (std::string_view opt, std::string_view arg, diag_list &diags);
+bool fragbits_arg_checker         (std::string_view opt, std::string_view arg, diag_list &diags);
+bool classtype_arg_checker        (std::string_view opt, std::string_view arg, diag_list &diags);
+bool isdataat_arg_checker         (std::string_view opt, std::string_view arg, diag_list &diags);
+bool ttl_arg_checker              (std::string_view opt, std::string_view arg, diag_list &diags);
+bool detection_filter_arg_checker (std::string_view opt, std::string_view arg, diag_list &diags);
+bool threshold_arg_checker        (std::string_view opt, std::string_view arg, diag_list &diags);
+bool tag_arg_checker              (std::string_view opt, std::string_view arg, diag_list &diags);
+bool flow_arg_checker             (std::string_view opt, std::string_view arg, diag_list &diags);
+bool dce_iface_arg_checker        (std::string_view opt, std::string_view arg, diag_list &diags);
+bool dce_opnum_arg_checker        (std::string_view opt, std::string_view arg, diag_list &diags);
+bool ssl_version_arg_checker      (std::string_view opt, std::string_view arg, diag_list &diags);
+bool ssl_state_arg_checker        (std::string_view opt, std::string_view arg, diag_list &diags);
+bool tos_arg_checker              (std::string_view opt, std::string_view arg, diag_list &diags);
+bool flowbits_arg_checker         (std::string_view opt, std::string_view arg, diag_list &diags);
+bool offset_arg_checker           (std::string_view opt, std::string_view arg, diag_list &diags);
+bool depth_arg_checker            (std::string_view opt, std::string_view arg, diag_list &diags);
+bool distance_arg_checker         (std::string_view opt, std::string_view arg, diag_list &diags);
+bool within_arg_checker           (std::string_view opt, std::string_view arg, diag_list &diags);
+bool dsize_arg_checker            (std::string_view opt, std::string_view arg, diag_list &diags);
+bool ip_proto_arg_checker         (std::string_view opt, std::string_view arg, diag_list &diags);
+bool byte_jump_arg_checker        (std::string_view opt, std::string_view arg, diag_list &diags);
+bool byte_test_arg_checker        (std::string_view opt, std::string_view arg, diag_list &diags);
+bool ipopts_arg_checker           (std::string_view opt, std::string_view arg, diag_list &diags);
+bool urilen_arg_checker           (std::string_view opt, std::string_view arg, diag_list &diags);
+bool icode_arg_checker            (std::string_view opt, std::string_view arg, diag_list &diags);
+bool itype_arg_checker            (std::string_view opt, std::string_view arg, diag_list &diags);
+bool flags_arg_checker            (std::string_view opt, std::string_view arg, diag_list &diags);
+bool iprep_arg_checker            (std::string_view opt, std::string_view arg, diag_list &diags);
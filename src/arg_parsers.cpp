@@ -0,0 +1,419 @@
+#include <cstring>
+#include "arg_parsers.h"
+#include "string_utils.h"
+
+using namespace std;
+
+// Same character classes as ECMAScript '\d' and '\w' in the "C" locale.
+static inline bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline bool is_word(char c)
+{
+	return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static size_t skip_spaces(string_view s, size_t pos)
+{
+	while (pos < s.length() && is_space(s[pos])) {
+		pos++;
+	}
+
+	return pos;
+}
+
+// Cut the next comma separated field off 'rest'. Returns false when
+// there is nothing left.
+static bool next_field(string_view &rest, bool &more, string_view &field)
+{
+	if (!more) {
+		return false;
+	}
+
+	size_t comma = rest.find(',');
+
+	if (comma == string_view::npos) {
+		field = trim(rest);
+		more = false;
+	} else {
+		field = trim(rest.substr(0, comma));
+		rest.remove_prefix(comma + 1);
+	}
+
+	return true;
+}
+
+// Non-empty field without whitespace (regex '[^\s,]+').
+static bool is_token(string_view s)
+{
+	if (s.empty()) {
+		return false;
+	}
+
+	for (char c : s) {
+		if (is_space(c)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool all_of_set(string_view s, const char *set)
+{
+	if (s.empty()) {
+		return false;
+	}
+
+	for (char c : s) {
+		if (!strchr(set, c) || c == '\0') {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static size_t span_of_set(string_view s, size_t pos, const char *set)
+{
+	while (pos < s.length() && s[pos] != '\0' && strchr(set, s[pos])) {
+		pos++;
+	}
+
+	return pos;
+}
+
+// Parse 1 to 5 decimal digits.
+static bool parse_short_uint(string_view s, size_t &pos, unsigned &value)
+{
+	size_t start = pos;
+
+	value = 0;
+
+	while (pos < s.length() && is_digit(s[pos])) {
+		value = value * 10 + (s[pos] - '0');
+		pos++;
+	}
+
+	return (pos > start) && (pos - start <= 5);
+}
+
+bool parse_byte_test(string_view arg, type_byte_test_args &args)
+{
+	string_view field;
+	bool more = true;
+	size_t n = 0;
+
+	args = type_byte_test_args();
+
+	while (next_field(arg, more, field)) {
+		if (n == 1) {
+			// Operator, optionally negated. May be empty.
+			if (!field.empty() && field[0] == '!') {
+				args.negated = true;
+				field = trim(field.substr(1));
+			}
+
+			if (!field.empty() && !is_token(field)) {
+				return false;
+			}
+
+			args.op = field;
+		} else if (!is_token(field)) {
+			return false;
+		} else if (n == 0) {
+			args.bytes = field;
+		} else if (n == 2) {
+			args.value = field;
+		} else if (n == 3) {
+			args.offset = field;
+		} else if (args.flags_count < BYTE_TEST_MAX_FLAGS) {
+			args.flags[args.flags_count++] = field;
+		} else {
+			return false;
+		}
+
+		n++;
+	}
+
+	return n >= 4;
+}
+
+bool parse_byte_jump(string_view arg, type_byte_jump_args &args)
+{
+	string_view field;
+	bool more = true;
+	size_t n = 0;
+
+	args = type_byte_jump_args();
+
+	while (next_field(arg, more, field)) {
+		if (n >= 2 + BYTE_JUMP_MAX_FLAGS) {
+			return false;
+		}
+
+		if (is_token(field)) {
+			if (n == 0) {
+				args.bytes = field;
+			} else if (n == 1) {
+				args.offset = field;
+			} else {
+				args.flags[args.flags_count++] = field;
+			}
+		} else if (n < 2 || field.empty()) {
+			return false;
+		} else {
+			// '(multiplier|post_offset)\s+[^\s,]+'
+			size_t sep = 0;
+
+			while (sep < field.length() && !is_space(field[sep])) {
+				sep++;
+			}
+
+			string_view name = field.substr(0, sep);
+			string_view value = trim(field.substr(sep));
+
+			if (!is_token(value)) {
+				return false;
+			}
+
+			if (name == "multiplier") {
+				args.multiplier = value;
+			} else if (name == "post_offset") {
+				args.post_offset = value;
+			} else {
+				return false;
+			}
+		}
+
+		n++;
+	}
+
+	return n >= 2;
+}
+
+bool parse_flow(string_view arg, type_flow_args &args)
+{
+	string_view field;
+	bool more = true;
+
+	args = type_flow_args();
+
+	while (next_field(arg, more, field)) {
+		if (args.options_count == FLOW_MAX_OPTIONS || field.empty()) {
+			return false;
+		}
+
+		for (char c : field) {
+			if (!is_word(c)) {
+				return false;
+			}
+		}
+
+		args.options[args.options_count++] = field;
+	}
+
+	return true;
+}
+
+bool parse_flags(string_view arg, type_flags_args &args)
+{
+	static const char *modifiers = "+*!";
+	static const char *flag_chars = "SAPRFU120CE+*!";
+	static const char *mask_chars = "SAPRFU12CE";
+
+	size_t pos = skip_spaces(arg, 0);
+	size_t end = span_of_set(arg, pos, flag_chars);
+
+	args = type_flags_args();
+
+	if (end == pos) {
+		return false;
+	}
+
+	string_view run = arg.substr(pos, end - pos);
+	size_t next = skip_spaces(arg, end);
+
+	if (next > end && next < arg.length() && arg[next] != '\0' && strchr(flag_chars, arg[next])) {
+		// Modifier separated from the flags by whitespace.
+		if (run.length() != 1 || !strchr(modifiers, run[0])) {
+			return false;
+		}
+
+		end = span_of_set(arg, next, flag_chars);
+		args.modifier = run[0];
+		args.flags = arg.substr(next, end - next);
+		next = skip_spaces(arg, end);
+	} else if (run.length() > 1 && strchr(modifiers, run[0])) {
+		args.modifier = run[0];
+		args.flags = run.substr(1);
+	} else {
+		args.flags = run;
+	}
+
+	if (next == arg.length()) {
+		return true;
+	}
+
+	if (arg[next] != ',') {
+		return false;
+	}
+
+	string_view mask = trim(arg.substr(next + 1));
+
+	if (!all_of_set(mask, mask_chars)) {
+		return false;
+	}
+
+	args.mask = mask;
+
+	return true;
+}
+
+bool parse_threshold(string_view arg, type_threshold_args &args)
+{
+	string_view field;
+	bool more = true;
+	size_t n = 0;
+
+	args = type_threshold_args();
+
+	while (next_field(arg, more, field)) {
+		size_t sep = 0;
+
+		while (sep < field.length() && !is_space(field[sep])) {
+			sep++;
+		}
+
+		string_view name = field.substr(0, sep);
+		string_view value = trim(field.substr(sep));
+
+		if (sep == field.length() || n == 4) {
+			return false;
+		}
+
+		bool numeric = !value.empty();
+
+		for (char c : value) {
+			numeric = numeric && is_digit(c);
+		}
+
+		if (!numeric && value != "limit" && value != "both" && value != "threshold" &&
+			value != "by_dst" && value != "by_src") {
+			return false;
+		}
+
+		if (name == "type") {
+			args.type = value;
+		} else if (name == "track") {
+			args.track = value;
+		} else if (name == "count") {
+			args.count = value;
+		} else if (name == "seconds") {
+			args.seconds = value;
+		} else {
+			return false;
+		}
+
+		n++;
+	}
+
+	return n == 4;
+}
+
+bool parse_dsize(string_view arg, type_dsize_args &args)
+{
+	size_t pos = skip_spaces(arg, 0);
+
+	args = type_dsize_args();
+
+	if (pos < arg.length() && (arg[pos] == '<' || arg[pos] == '>')) {
+		args.op = arg[pos++];
+		pos = skip_spaces(arg, pos);
+	}
+
+	if (!parse_short_uint(arg, pos, args.min)) {
+		return false;
+	}
+
+	pos = skip_spaces(arg, pos);
+
+	if (arg.substr(pos, 2) == "<>") {
+		pos = skip_spaces(arg, pos + 2);
+
+		if (!parse_short_uint(arg, pos, args.max)) {
+			return false;
+		}
+
+		args.range = true;
+		pos = skip_spaces(arg, pos);
+	}
+
+	return pos == arg.length();
+}
+
+bool parse_position(string_view arg, long &value, bool &variable)
+{
+	arg = trim(arg);
+	value = 0;
+	variable = false;
+
+	if (arg.empty()) {
+		return false;
+	}
+
+	// byte_extract variable names start with a letter.
+	if (arg[0] != '-' && !is_digit(arg[0])) {
+		variable = all_of_set(arg, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_");
+		return variable;
+	}
+
+	size_t pos = (arg[0] == '-') ? 1 : 0;
+	unsigned number;
+
+	if (!parse_short_uint(arg, pos, number) || pos != arg.length()) {
+		return false;
+	}
+
+	value = (arg[0] == '-') ? -long(number) : long(number);
+
+	return true;
+}
+
+bool parse_content(string_view arg, string_view &pattern, string_view &modifiers)
+{
+	size_t open = arg.find('"');
+	size_t close = open + 1;
+
+	pattern = arg;
+	modifiers = string_view();
+
+	if (open == string_view::npos) {
+		return true;
+	}
+
+	while (close < arg.length() && arg[close] != '"') {
+		close += (arg[close] == '\\') ? 2 : 1;
+	}
+
+	if (close >= arg.length()) {
+		return true;
+	}
+
+	string_view rest = trim(arg.substr(close + 1));
+
+	if (rest.empty()) {
+		return true;
+	}
+
+	if (rest[0] != ',') {
+		return false;
+	}
+
+	pattern = arg.substr(0, close + 1);
+	modifiers = rest.substr(1);
+
+	return true;
+}
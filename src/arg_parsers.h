@@ -0,0 +1,78 @@
+#pragma once
+#include <string_view>
+
+// Regex-free parsers for the most frequently used option arguments.
+// They accept exactly the grammar of the former validator regexes and
+// return views into the argument, so no allocation takes place.
+
+#define BYTE_TEST_MAX_FLAGS	5
+#define BYTE_JUMP_MAX_FLAGS	9
+#define FLOW_MAX_OPTIONS	3
+// Bound of the content positional modifiers (offset, depth, distance,
+// within).
+#define POSITION_MAX		65535
+
+typedef struct byte_test_args
+{
+	std::string_view bytes;
+	bool negated;
+	std::string_view op;
+	std::string_view value;
+	std::string_view offset;
+	std::string_view flags[BYTE_TEST_MAX_FLAGS];
+	size_t flags_count;
+} type_byte_test_args;
+
+typedef struct byte_jump_args
+{
+	std::string_view bytes;
+	std::string_view offset;
+	std::string_view multiplier;
+	std::string_view post_offset;
+	std::string_view flags[BYTE_JUMP_MAX_FLAGS];
+	size_t flags_count;
+} type_byte_jump_args;
+
+typedef struct flow_args
+{
+	std::string_view options[FLOW_MAX_OPTIONS];
+	size_t options_count;
+} type_flow_args;
+
+typedef struct flags_args
+{
+	char modifier;
+	std::string_view flags;
+	std::string_view mask;
+} type_flags_args;
+
+typedef struct threshold_args
+{
+	std::string_view type;
+	std::string_view track;
+	std::string_view count;
+	std::string_view seconds;
+} type_threshold_args;
+
+typedef struct dsize_args
+{
+	char op;
+	bool range;
+	unsigned min;
+	unsigned max;
+} type_dsize_args;
+
+bool parse_byte_test (std::string_view arg, type_byte_test_args &args);
+bool parse_byte_jump (std::string_view arg, type_byte_jump_args &args);
+bool parse_flow      (std::string_view arg, type_flow_args &args);
+bool parse_flags     (std::string_view arg, type_flags_args &args);
+bool parse_threshold (std::string_view arg, type_threshold_args &args);
+bool parse_dsize     (std::string_view arg, type_dsize_args &args);
+// Signed integer, or the name of a byte_extract variable ('variable' is
+// set and 'value' is 0).
+bool parse_position  (std::string_view arg, long &value, bool &variable);
+// Content with Snort 3 modifiers: the quoted pattern (with a leading '!'
+// if any) and the comma separated modifiers after it ("nocase, depth 4"),
+// empty if there are none. Returns false if something else follows the
+// pattern; 'pattern' is then the whole argument.
+bool parse_content   (std::string_view arg, std::string_view &pattern, std::string_view &modifiers);
@@ -0,0 +1,542 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+#include <boost/program_options.hpp>
+#include "content.h"
+#include "corpus_checker.h"
+#include "parallel.h"
+#include "parser_check.h"
+#include "report_writer.h"
+#include "rule_checker.h"
+#include "rule_generator.h"
+#include "rule_reader.h"
+#include "string_utils.h"
+
+// Rules per batch of the end-to-end run, same as dumbpig itself.
+#define BENCH_BATCH_SIZE	16384
+#define BENCH_CHUNK_SIZE	64
+
+// Every allocation of the process is counted, library code included.
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (void *p = malloc(size ? size : 1)) {
+		return p;
+	}
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+typedef struct micro_result
+{
+	std::string name;
+	size_t iterations;
+	double ns_per_op;
+	double allocs_per_op;
+} type_micro_result;
+
+typedef struct throughput_result
+{
+	size_t rules;
+	size_t bytes;
+	double seconds;
+	double rules_per_sec;
+	double mb_per_sec;
+	double allocs_per_rule;
+	size_t errors;
+	size_t warnings;
+} type_throughput_result;
+
+// Keeps results of benchmarked calls alive.
+static volatile size_t sink;
+
+static double seconds_since(bench_clock::time_point start)
+{
+	return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// Run op() in growing batches until a batch takes at least 'min_time'
+// seconds; the last batch is the measurement.
+template <typename Func>
+static type_micro_result run_micro(const std::string &name, double min_time, Func op)
+{
+	type_micro_result res = { name, 0, 0, 0 };
+	size_t iterations = 1;
+
+	for (;;) {
+		size_t allocs = allocations.load(std::memory_order_relaxed);
+		size_t acc = 0;
+		bench_clock::time_point start = bench_clock::now();
+
+		for (size_t i = 0; i < iterations; i++) {
+			acc += op(i);
+		}
+
+		double elapsed = seconds_since(start);
+
+		sink = sink + acc;
+
+		if (elapsed >= min_time || iterations >= (size_t(1) << 40)) {
+			res.iterations = iterations;
+			res.ns_per_op = elapsed * 1e9 / iterations;
+			res.allocs_per_op = double(allocations.load(std::memory_order_relaxed) - allocs) / iterations;
+			return res;
+		}
+
+		iterations *= (elapsed < min_time / 16) ? 8 : 2;
+	}
+}
+
+typedef struct sample_rule
+{
+	const char *name;
+	const char *text;
+} type_sample_rule;
+
+static const type_sample_rule sample_rules[] = {
+	{ "simple",     "alert tcp $HOME_NET any -> $EXTERNAL_NET 80 (msg:\"Simple\"; flow:to_server,established; "
+	                "content:\"GET\"; classtype:misc-activity; sid:1; rev:1;)" },
+	{ "http",       "alert tcp $EXTERNAL_NET any -> $HTTP_SERVERS $HTTP_PORTS (msg:\"WEB-ATTACK cmd\"; "
+	                "flow:to_server,established; content:\"/cmd.php\"; http_uri; nocase; fast_pattern; "
+	                "content:\"exec=\"; http_client_body; pcre:\"/cmd\\.php\\?[^\\r\\n]*exec=[^&]{32,}/Ui\"; "
+	                "reference:url,www.example.com/advisory/1; classtype:web-application-attack; sid:2; rev:3;)" },
+	{ "byte_tests", "alert tcp $HOME_NET any -> $EXTERNAL_NET 4444 (msg:\"CnC\"; flow:established,to_server; "
+	                "dsize:<300; content:\"|DE AD BE EF|\"; depth:16; byte_test:4,>,1000,0,relative,little; "
+	                "byte_jump:2,4,relative,align; flowbits:set,cnc; threshold: type limit, track by_src, "
+	                "count 1, seconds 60; classtype:trojan-activity; sid:3; rev:1;)" },
+	{ "semicolons", "alert tcp any any -> $HOME_NET 21 (msg:\"FTP \\\"x\\\"\\; quoted\"; flow:to_server,established; "
+	                "content:\"SITE EXEC;x\\;\"; nocase; metadata:policy balanced-ips drop; "
+	                "classtype:attempted-admin; sid:4; rev:1;)" },
+	{ "broken",     "alert ip any 80 -> any any (msg:\"Broken\"; frobnicate:3; flow:to_server established; sid:5;)" },
+	{ nullptr,      nullptr }
+};
+
+typedef struct sample_arg
+{
+	const char *option;
+	const char *arg;
+} type_sample_arg;
+
+// A valid argument for every option with a checker.
+static const type_sample_arg sample_args[] = {
+	{ "sid",              "2013504" },
+	{ "classtype",        "trojan-activity" },
+	{ "detection_filter", "track by_src, count 5, seconds 60" },
+	{ "logto",            "\"alerts.log\"" },
+	{ "reference",        "url,www.example.com/advisory/1" },
+	{ "tag",              "session,10,packets" },
+	{ "threshold",        "type limit, track by_src, count 1, seconds 60" },
+	{ "content",          "\"|00 01|GET /index.php\"" },
+	{ "ttl",              "<64" },
+	{ "pcre",             "\"/^GET\\s+\\/[a-z]{4,16}\\.php/i\"" },
+	{ "flow",             "to_server,established" },
+	{ "flowbits",         "set,http.session" },
+	{ "dsize",            ">100" },
+	{ "byte_test",        "4,>,1000,0,relative,little" },
+	{ "byte_jump",        "4,12,relative,align" },
+	{ "isdataat",         "50,relative" },
+	{ "ipopts",           "rr" },
+	{ "itype",            "8" },
+	{ "icode",            "0<>3" },
+	{ "flags",            "S,12" },
+	{ "urilen",           ">256" },
+	{ "fragbits",         "MD" },
+	{ "fragoffset",       ">0" },
+	{ "ip_proto",         "igmp" },
+	{ "dce_iface",        "4b324fc8-1670-01d3-1278-5a47bf6ee188" },
+	{ "dce_opnum",        "15-18" },
+	{ "ssl_version",      "tls1.0,tls1.2" },
+	{ "ssl_state",        "client_hello" },
+	{ "tos",              "!4" },
+	{ "iprep",            "src,CnC,>,100" },
+	{ nullptr,            nullptr }
+};
+
+static void micro_benchmarks(double min_time, std::vector<type_micro_result> &results)
+{
+	type_parsed_rule parsed;
+
+	for (size_t i = 0; sample_rules[i].name != nullptr; i++) {
+		std::string_view rule = sample_rules[i].text;
+
+		results.push_back(run_micro(std::string("process_rule/") + sample_rules[i].name, min_time,
+			[&](size_t) { return size_t(process_rule(rule, parsed) + 1); }));
+	}
+
+	diag_list diags;
+
+	for (size_t i = 0; sample_args[i].option != nullptr; i++) {
+		std::string_view opt = sample_args[i].option;
+		std::string_view arg = sample_args[i].arg;
+		ParseArgFunc checker = rule_options[find_option(opt)].arg_checker;
+
+		if (!checker(opt, arg, diags)) {
+			std::cerr << "Sample argument of '" << opt << "' does not pass its checker" << std::endl;
+		}
+
+		results.push_back(run_micro(std::string("arg_checker/") + sample_args[i].option, min_time,
+			[&](size_t) {
+				diags.clear();
+				return size_t(checker(opt, arg, diags));
+			}));
+	}
+
+	// Header and option list splitting, formerly my_split().
+	std::string_view header = "alert tcp $EXTERNAL_NET any -> $HTTP_SERVERS $HTTP_PORTS";
+
+	results.push_back(run_micro("next_token/header", min_time, [&](size_t) {
+		std::string_view rest = header;
+		size_t n = 0;
+
+		while (!next_token(rest, " \t").empty()) {
+			n++;
+		}
+
+		return n;
+	}));
+
+	std::vector<std::string> names;
+
+	for (size_t i = 0; rule_options[i].name != nullptr; i++) {
+		names.push_back(rule_options[i].name);
+	}
+
+	results.push_back(run_micro("find_option/known", min_time, [&](size_t i) {
+		return size_t(find_option(names[i % names.size()]));
+	}));
+
+	results.push_back(run_micro("find_option/unknown", min_time, [&](size_t) {
+		return size_t(find_option("frobnicate"));
+	}));
+
+	// A 1 KiB '|..|' block, shellcode style.
+	std::string hex = "\"|";
+
+	for (size_t i = 0; i < 1024; i++) {
+		static const char digits[] = "0123456789ABCDEF";
+
+		hex += digits[(i * 7) & 15];
+		hex += digits[i & 15];
+		hex += ' ';
+	}
+
+	hex += "|\"";
+
+	std::string bytes;
+	bool negated;
+
+	results.push_back(run_micro("decode_content/hex", min_time, [&](size_t) {
+		return size_t(decode_content(hex, bytes, negated)) + bytes.length();
+	}));
+}
+
+// Same pipeline as dumbpig: read, check in parallel, cross-rule checks
+// and text output, here written to /dev/null.
+static bool run_throughput(const std::string &filename, size_t bytes, unsigned jobs,
+	type_throughput_result &res)
+{
+	FILE *null = fopen("/dev/null", "w");
+	rule_reader input;
+
+	if (!null || !input.open(filename)) {
+		if (null) {
+			fclose(null);
+		}
+
+		return false;
+	}
+
+	size_t allocs = allocations.load(std::memory_order_relaxed);
+	bench_clock::time_point start = bench_clock::now();
+
+	{
+		const rule_checker checker;
+		report_writer output(FORMAT_TEXT, filename, null);
+		corpus_checker corpus;
+		std::vector<type_rule_line> rules;
+		std::vector<type_parsed_rule> reports;
+		type_rule_line rule;
+		bool eof = false;
+
+		res = type_throughput_result();
+		output.begin();
+
+		while (!eof) {
+			rules.clear();
+			input.release();
+
+			while (rules.size() < BENCH_BATCH_SIZE) {
+				if (!input.next(rule)) {
+					eof = true;
+					break;
+				}
+
+				rules.push_back(rule);
+			}
+
+			reports.resize(rules.size());
+
+			parallel_for(rules.size(), jobs, BENCH_CHUNK_SIZE, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					checker.check(rules[i].text, reports[i]);
+				}
+			});
+
+			for (size_t i = 0; i < rules.size(); i++) {
+				corpus.add(rules[i], reports[i]);
+				output.rule(rules[i], reports[i]);
+				res.errors += (reports[i].status == RULE_HAS_ERRORS);
+				res.warnings += (reports[i].status == RULE_HAS_WARNINGS);
+			}
+
+			res.rules += rules.size();
+		}
+
+		output.findings(corpus.finish());
+		output.end();
+	}
+
+	if (input.error()) {
+		fclose(null);
+		errno = input.error();
+		return false;
+	}
+
+	res.seconds = seconds_since(start);
+	res.bytes = bytes;
+	res.rules_per_sec = res.rules / res.seconds;
+	res.mb_per_sec = bytes / res.seconds / (1 << 20);
+	res.allocs_per_rule = double(allocations.load(std::memory_order_relaxed) - allocs) / res.rules;
+
+	fclose(null);
+
+	return true;
+}
+
+static bool write_file(const std::string &filename, const std::string &data)
+{
+	FILE *f = (filename == "-") ? stdout : fopen(filename.c_str(), "w");
+
+	if (!f) {
+		return false;
+	}
+
+	bool ok = fwrite(data.data(), 1, data.length(), f) == data.length();
+
+	if (f != stdout) {
+		ok = (fclose(f) == 0) && ok;
+	} else {
+		ok = (fflush(f) == 0) && ok;
+	}
+
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	namespace po = boost::program_options;
+	std::vector<size_t> sizes = { 1000, 100000, 1000000 };
+	std::string output = "-";
+	uint64_t seed = 1;
+	unsigned jobs = 1;
+	double min_time = 0.2;
+	size_t generate = 0;
+	size_t check = 0;
+	bool micro = true;
+	bool throughput = true;
+
+	po::options_description desc(
+		"dumbpig benchmarks: microbenchmarks and end-to-end throughput on\n"
+		"generated rule sets, results are written as JSON\n\n"
+		"Allowed options"
+	);
+
+	desc.add_options()
+		("help,h",
+			"produce help message")
+		("sizes",
+			po::value<std::vector<size_t>>()->multitoken(),
+			"rule set sizes of the throughput runs\n(default: 1000 100000 1000000)")
+		("seed",
+			po::value<uint64_t>(),
+			"seed of the rule generator (default: 1)")
+		("jobs,j",
+			po::value<unsigned>(),
+			"number of checker threads,\n0 means one per CPU core (default: 1)")
+		("min-time",
+			po::value<double>(),
+			"minimal time of a microbenchmark in seconds\n(default: 0.2)")
+		("output,o",
+			po::value<std::string>(),
+			"file for the results, dash (-) for stdout")
+		("no-micro",
+			"skip the microbenchmarks")
+		("no-throughput",
+			"skip the throughput runs")
+		("generate",
+			po::value<size_t>(),
+			"only write a generated rule set of this size\nto the output and exit")
+		("check-parsers",
+			po::value<size_t>(),
+			"only check this many random arguments per\nkeyword against the old argument regexes\nand exit, 3 on a mismatch")
+		;
+
+	try {
+		po::variables_map vm;
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+
+		if (vm.count("help")) {
+			std::cout << desc << std::endl;
+			return 0;
+		}
+
+		if (vm.count("sizes")) {
+			sizes = vm["sizes"].as<std::vector<size_t>>();
+		}
+
+		if (vm.count("seed")) {
+			seed = vm["seed"].as<uint64_t>();
+		}
+
+		if (vm.count("jobs")) {
+			jobs = effective_jobs(vm["jobs"].as<unsigned>());
+		}
+
+		if (vm.count("min-time")) {
+			min_time = vm["min-time"].as<double>();
+		}
+
+		if (vm.count("output")) {
+			output = vm["output"].as<std::string>();
+		}
+
+		if (vm.count("generate")) {
+			generate = vm["generate"].as<size_t>();
+		}
+
+		if (vm.count("check-parsers")) {
+			check = vm["check-parsers"].as<size_t>();
+		}
+
+		micro = !vm.count("no-micro");
+		throughput = !vm.count("no-throughput");
+	} catch (const std::exception &e) {
+		std::cout << e.what() << std::endl;
+		std::cout << "Use '-h' option for help" << std::endl;
+		return 1;
+	}
+
+	if (check) {
+		return check_parsers(check, seed, stdout) ? 3 : 0;
+	}
+
+	if (generate) {
+		std::string rules;
+
+		generate_rules(generate, seed, rules);
+
+		if (!write_file(output, rules)) {
+			std::cerr << "Failed to write '" << output << "': " << strerror(errno) << std::endl;
+			return 2;
+		}
+
+		return 0;
+	}
+
+	std::vector<type_micro_result> micro_results;
+	std::vector<type_throughput_result> throughput_results;
+
+	if (micro) {
+		micro_benchmarks(min_time, micro_results);
+	}
+
+	if (throughput) {
+		const char *tmpdir = getenv("TMPDIR");
+
+		for (size_t size : sizes) {
+			std::string rules;
+			std::string filename = std::string(tmpdir ? tmpdir : "/tmp") + "/dumbpig_bench.XXXXXX";
+			int fd = mkstemp(&filename[0]);
+
+			generate_rules(size, seed, rules);
+
+			if (fd < 0 || write(fd, rules.data(), rules.length()) != static_cast<ssize_t>(rules.length())) {
+				std::cerr << "Failed to write '" << filename << "': " << strerror(errno) << std::endl;
+				return 2;
+			}
+
+			close(fd);
+			throughput_results.push_back(type_throughput_result());
+
+			bool ok = run_throughput(filename, rules.length(), jobs, throughput_results.back());
+
+			unlink(filename.c_str());
+
+			if (!ok) {
+				std::cerr << "Failed to read '" << filename << "': " << strerror(errno) << std::endl;
+				return 2;
+			}
+		}
+	}
+
+	std::string json = "{\n  \"seed\": " + std::to_string(seed) + ",\n  \"jobs\": " +
+		std::to_string(jobs) + ",\n  \"micro\": [";
+
+	for (size_t i = 0; i < micro_results.size(); i++) {
+		const type_micro_result &r = micro_results[i];
+		char line[256];
+
+		snprintf(line, sizeof(line), "%s\n    {\"name\": \"%s\", \"iterations\": %zu, "
+			"\"ns_per_op\": %.1f, \"allocs_per_op\": %.2f}",
+			i ? "," : "", r.name.c_str(), r.iterations, r.ns_per_op, r.allocs_per_op);
+		json += line;
+	}
+
+	json += micro_results.empty() ? "],\n  \"throughput\": [" : "\n  ],\n  \"throughput\": [";
+
+	for (size_t i = 0; i < throughput_results.size(); i++) {
+		const type_throughput_result &r = throughput_results[i];
+		char line[512];
+
+		snprintf(line, sizeof(line), "%s\n    {\"rules\": %zu, \"bytes\": %zu, \"seconds\": %.3f, "
+			"\"rules_per_sec\": %.0f, \"mb_per_sec\": %.2f, \"allocs_per_rule\": %.2f, "
+			"\"errors\": %zu, \"warnings\": %zu}",
+			i ? "," : "", r.rules, r.bytes, r.seconds, r.rules_per_sec, r.mb_per_sec,
+			r.allocs_per_rule, r.errors, r.warnings);
+		json += line;
+	}
+
+	json += throughput_results.empty() ? "]\n}\n" : "\n  ]\n}\n";
+
+	if (!write_file(output, json)) {
+		std::cerr << "Failed to write '" << output << "': " << strerror(errno) << std::endl;
+		return 2;
+	}
+
+	return 0;
+}
@@ -0,0 +1,475 @@
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include "arg_parsers.h"
+#include "content.h"
+#include "string_utils.h"
+
+using namespace std;
+
+static constexpr int OPTION_CONTENT      = option_id("content");
+static constexpr int OPTION_URICONTENT   = option_id("uricontent");
+static constexpr int OPTION_NOCASE       = option_id("nocase");
+static constexpr int OPTION_FAST_PATTERN = option_id("fast_pattern");
+static constexpr int OPTION_DISTANCE     = option_id("distance");
+static constexpr int OPTION_WITHIN       = option_id("within");
+static constexpr int OPTION_DEPTH        = option_id("depth");
+static constexpr int OPTION_OFFSET       = option_id("offset");
+
+// Modifiers that need a preceding content.
+static const int content_modifiers[] = {
+	OPTION_NOCASE,
+	OPTION_FAST_PATTERN,
+	OPTION_DISTANCE,
+	OPTION_WITHIN,
+	OPTION_DEPTH,
+	OPTION_OFFSET,
+};
+
+#define POSITION_UNBOUNDED	LONG_MAX
+
+// Buffers with a known maximal length.
+typedef struct buffer_size
+{
+	const char *name;
+	long size;
+} type_buffer_size;
+
+static const type_buffer_size buffer_sizes[] = {
+	{ "http_stat_code", 3 },
+	{ nullptr,          0 }
+};
+
+// Offsets a content match may start at in its buffer.
+typedef struct match_range
+{
+	std::string_view buffer;
+	long lo;
+	long hi;
+	long length;
+} type_match_range;
+
+typedef struct buffer_alias
+{
+	const char *option;
+	const char *buffer;
+} type_buffer_alias;
+
+// Sticky buffers named differently from the content modifier for the
+// same buffer; others are named after their option.
+static const type_buffer_alias buffer_aliases[] = {
+	{ "pkt_data",           "" },
+	{ "http.uri",           "http_uri" },
+	{ "http.uri.raw",       "http_raw_uri" },
+	{ "http.method",        "http_method" },
+	{ "http.request_body",  "http_client_body" },
+	{ "http.response_body", "file_data" },
+	{ "file.data",          "file_data" },
+	{ "http.header",        "http_header" },
+	{ "http.header.raw",    "http_raw_header" },
+	{ "http.cookie",        "http_cookie" },
+	{ "http.user_agent",    "http_user_agent" },
+	{ "http.host",          "http_host" },
+	{ "http.stat_code",     "http_stat_code" },
+	{ "http.stat_msg",      "http_stat_msg" },
+	{ nullptr,              nullptr }
+};
+
+// Hex digits per chunk of a '|..|' block.
+#define HEX_CHUNK		64
+// Flags of non-digit characters in hex_table.
+#define HEX_SPACE		0x40
+#define HEX_BAD			0x80
+
+typedef struct hex_table
+{
+	uint8_t values[256];
+} type_hex_table;
+
+constexpr type_hex_table build_hex_table()
+{
+	type_hex_table table = {};
+
+	for (int c = 0; c < 256; c++) {
+		if (c >= '0' && c <= '9') {
+			table.values[c] = c - '0';
+		} else if (c >= 'a' && c <= 'f') {
+			table.values[c] = c - 'a' + 10;
+		} else if (c >= 'A' && c <= 'F') {
+			table.values[c] = c - 'A' + 10;
+		} else if (is_space(c)) {
+			table.values[c] = HEX_SPACE;
+		} else {
+			table.values[c] = HEX_BAD;
+		}
+	}
+
+	return table;
+}
+
+static constexpr type_hex_table hex_table = build_hex_table();
+
+// Contents of a '|..|' block. Whitespace may appear anywhere, even inside
+// a digit pair. Digits of a chunk are packed first, then paired.
+static bool decode_hex(string_view block, string &bytes)
+{
+	uint8_t nibbles[HEX_CHUNK + 1];
+	size_t pending = 0;
+	uint8_t flags = 0;
+
+	for (size_t i = 0; i < block.length(); i += HEX_CHUNK) {
+		size_t len = min(block.length() - i, size_t(HEX_CHUNK));
+		size_t n = pending;
+
+		for (size_t j = 0; j < len; j++) {
+			uint8_t v = hex_table.values[static_cast<unsigned char>(block[i + j])];
+
+			nibbles[n] = v;
+			n += !(v & HEX_SPACE);
+			flags |= v;
+		}
+
+		size_t base = bytes.length();
+
+		bytes.resize(base + n / 2);
+
+		for (size_t k = 0; k < n / 2; k++) {
+			bytes[base + k] = static_cast<char>(nibbles[2 * k] << 4 | nibbles[2 * k + 1]);
+		}
+
+		// An odd digit is carried over to the next chunk.
+		pending = n & 1;
+		nibbles[0] = nibbles[n - pending];
+	}
+
+	return !(flags & HEX_BAD) && !pending;
+}
+
+bool decode_content(string_view arg, string &bytes, bool &negated)
+{
+	arg = trim(arg);
+	negated = !arg.empty() && arg[0] == '!';
+
+	if (negated) {
+		arg = trim(arg.substr(1));
+	}
+
+	if (arg.length() < 2 || arg.front() != '"' || arg.back() != '"') {
+		return false;
+	}
+
+	arg = arg.substr(1, arg.length() - 2);
+	bytes.clear();
+
+	for (size_t i = 0; i < arg.length(); ) {
+		size_t special = arg.find_first_of("\\|", i);
+
+		if (special == string_view::npos) {
+			bytes.append(arg.substr(i));
+			break;
+		}
+
+		bytes.append(arg.substr(i, special - i));
+
+		if (arg[special] == '\\') {
+			if (special + 1 < arg.length()) {
+				bytes += arg[special + 1];
+			} else {
+				bytes += '\\';
+			}
+
+			i = special + 2;
+			continue;
+		}
+
+		size_t close = arg.find('|', special + 1);
+
+		if (close == string_view::npos || !decode_hex(arg.substr(special + 1, close - special - 1), bytes)) {
+			return false;
+		}
+
+		i = close + 1;
+	}
+
+	return true;
+}
+
+const type_content_match *select_fast_pattern(const vector<type_content_match> &contents)
+{
+	const type_content_match *longest = nullptr;
+
+	for (const type_content_match &content : contents) {
+		if (content.negated) {
+			continue;
+		}
+
+		if (content.fast_pattern) {
+			return &content;
+		}
+
+		if (!longest || content.bytes.length() > longest->bytes.length()) {
+			longest = &content;
+		}
+	}
+
+	return longest;
+}
+
+static void set_position(string_view arg, long &value, type_content_match &content)
+{
+	bool variable;
+
+	if (!parse_position(arg, value, variable) || variable) {
+		value = 0;
+		content.variable_position = true;
+	}
+}
+
+// Apply a modifier to the content it follows.
+static void apply_modifier(int id, string_view arg, type_content_match &content)
+{
+	if (id == OPTION_NOCASE) {
+		content.nocase = true;
+	} else if (id == OPTION_FAST_PATTERN) {
+		content.fast_pattern = true;
+	} else if (id == OPTION_DISTANCE) {
+		content.relative = true;
+		content.distance_arg = arg;
+		set_position(arg, content.distance, content);
+	} else if (id == OPTION_WITHIN) {
+		content.relative = true;
+		content.has_within = true;
+		content.within_arg = arg;
+		set_position(arg, content.within, content);
+	} else if (id == OPTION_DEPTH) {
+		content.has_depth = true;
+		content.depth_arg = arg;
+		set_position(arg, content.depth, content);
+	} else if (id == OPTION_OFFSET) {
+		content.has_offset = true;
+		content.offset_arg = arg;
+		set_position(arg, content.offset, content);
+	}
+}
+
+// Buffer a sticky buffer option selects, by the name of the Snort 2
+// modifier for the same buffer where there is one.
+static string_view sticky_buffer(const type_parsed_option &opt)
+{
+	for (size_t i = 0; buffer_aliases[i].option != nullptr; i++) {
+		if (opt.id == find_option(buffer_aliases[i].option)) {
+			return buffer_aliases[i].buffer;
+		}
+	}
+
+	return rule_options[opt.id].name;
+}
+
+void collect_contents(const type_parsed_rule &rule, vector<type_content_match> &contents)
+{
+	type_content_match *last = nullptr;
+	string_view sticky;
+
+	contents.clear();
+
+	for (size_t i = 0; i < rule.options.size(); i++) {
+		const type_parsed_option &opt = rule.options[i];
+
+		if (opt.id == OPTION_CONTENT || opt.id == OPTION_URICONTENT) {
+			string_view pattern, modifiers;
+
+			contents.push_back(type_content_match());
+			last = &contents.back();
+			last->option = i;
+			last->buffer = sticky;
+
+			if (!parse_content(opt.arg, pattern, modifiers) ||
+				!decode_content(pattern, last->bytes, last->negated)) {
+				contents.pop_back();
+				last = nullptr;
+				continue;
+			}
+
+			if (opt.id == OPTION_URICONTENT) {
+				last->buffer = "http_uri";
+			}
+
+			// Snort 3 modifiers: "abc", nocase, depth 4
+			while (!modifiers.empty()) {
+				string_view value = trim(next_token(modifiers, ","));
+				string_view name = next_token(value, " \t");
+
+				apply_modifier(find_option(name), trim(value), *last);
+			}
+
+			continue;
+		}
+
+		if (opt.buffer == BUFFER_STICKY) {
+			sticky = sticky_buffer(opt);
+			last = nullptr;
+			continue;
+		}
+
+		if (!last) {
+			continue;
+		}
+
+		if (opt.buffer == BUFFER_MODIFIER) {
+			last->buffer = opt.name;
+		} else {
+			apply_modifier(opt.id, opt.arg, *last);
+		}
+	}
+}
+
+void check_content_positions(const type_parsed_rule &rule, const vector<type_content_match> &contents,
+	diag_list &diags)
+{
+	bool seen_content = false;
+
+	for (const type_parsed_option &opt : rule.options) {
+		if (opt.id == OPTION_CONTENT || opt.id == OPTION_URICONTENT) {
+			seen_content = true;
+			continue;
+		}
+
+		if (!seen_content && find(begin(content_modifiers), end(content_modifiers), opt.id) !=
+			end(content_modifiers)) {
+			report(diags, DIAG_MODIFIER_WITHOUT_CONTENT, opt.name, opt.name);
+		}
+	}
+
+	// Last positive match per buffer, what relative modifiers refer to.
+	static thread_local vector<type_match_range> last;
+
+	last.clear();
+
+	for (const type_content_match &content : contents) {
+		string_view arg = rule.options[content.option].arg;
+		long length = content.bytes.length();
+		long lo = 0;
+		long hi = POSITION_UNBOUNDED;
+		string reason;
+
+		if (content.relative && (content.has_offset || content.has_depth)) {
+			report(diags, DIAG_MIXED_POSITIONS, "content", arg);
+			continue;
+		}
+
+		auto prev = find_if(last.begin(), last.end(),
+			[&](const type_match_range &r) { return r.buffer == content.buffer; });
+
+		if (content.variable_position) {
+			// Placed by byte_extract values, anywhere.
+		} else if (content.relative) {
+			long end_lo = (prev != last.end()) ? prev->lo + prev->length : 0;
+			long end_hi = (prev != last.end()) ? prev->hi : 0;
+
+			if (end_hi != POSITION_UNBOUNDED && prev != last.end()) {
+				end_hi += prev->length;
+			}
+
+			lo = max(0L, end_lo + content.distance);
+
+			if (!content.within_arg.empty() && content.within < length) {
+				reason = "within " + to_string(content.within) + " is shorter than the content";
+			} else if (!content.within_arg.empty() && end_hi != POSITION_UNBOUNDED) {
+				hi = end_hi + content.distance + content.within - length;
+			}
+		} else {
+			lo = max(0L, content.offset);
+
+			if (!content.depth_arg.empty() && content.depth < length) {
+				reason = "depth " + to_string(content.depth) + " is shorter than the content";
+			} else if (!content.depth_arg.empty()) {
+				hi = content.offset + content.depth - length;
+			}
+		}
+
+		for (size_t i = 0; reason.empty() && buffer_sizes[i].name != nullptr; i++) {
+			if (content.buffer == buffer_sizes[i].name && lo + length > buffer_sizes[i].size) {
+				reason = string(content.buffer) + " is only " + to_string(buffer_sizes[i].size) + " bytes long";
+			}
+		}
+
+		if (reason.empty() && hi < lo) {
+			reason = "its search window ends before the start of the buffer";
+		}
+
+		// A negated content that can't match always holds, it is not
+		// dead; either way it leaves the position of the previous match.
+		if (content.negated) {
+			continue;
+		}
+
+		if (!reason.empty()) {
+			report(diags, DIAG_CONTENT_NEVER_MATCHES, "content", arg, reason);
+			continue;
+		}
+
+		if (prev != last.end()) {
+			*prev = { content.buffer, lo, hi, length };
+		} else {
+			last.push_back({ content.buffer, lo, hi, length });
+		}
+	}
+}
+
+// 'inner' occurs in every match of 'outer'.
+static bool implied_by(const type_content_match &inner, const type_content_match &outer)
+{
+	if (!inner.nocase) {
+		return !outer.nocase && outer.bytes.find(inner.bytes) != string::npos;
+	}
+
+	auto equal = [](char a, char b) {
+		return tolower(static_cast<unsigned char>(a)) == tolower(static_cast<unsigned char>(b));
+	};
+
+	return search(outer.bytes.begin(), outer.bytes.end(), inner.bytes.begin(), inner.bytes.end(), equal) !=
+		outer.bytes.end();
+}
+
+void find_redundant_contents(const type_parsed_rule &rule, const vector<type_content_match> &contents,
+	diag_list &diags)
+{
+	for (size_t i = 0; i < contents.size(); i++) {
+		const type_content_match &inner = contents[i];
+
+		if (inner.negated || inner.fast_pattern || inner.relative || inner.has_offset || inner.has_depth) {
+			continue;
+		}
+
+		// The next content of the buffer may be placed relative to this one.
+		auto next = find_if(contents.begin() + i + 1, contents.end(),
+			[&](const type_content_match &c) { return c.buffer == inner.buffer; });
+
+		if (next != contents.end() && next->relative) {
+			continue;
+		}
+
+		// Reported against the longest content it occurs in.
+		const type_content_match *longest = nullptr;
+
+		for (size_t k = 0; k < contents.size(); k++) {
+			const type_content_match &outer = contents[k];
+
+			// Of two equal contents the second one is reported.
+			if (k == i || outer.negated || outer.buffer != inner.buffer ||
+				outer.bytes.length() < inner.bytes.length() ||
+				(outer.bytes.length() == inner.bytes.length() && k > i)) {
+				continue;
+			}
+
+			if ((!longest || outer.bytes.length() > longest->bytes.length()) && implied_by(inner, outer)) {
+				longest = &outer;
+			}
+		}
+
+		if (longest) {
+			report(diags, DIAG_REDUNDANT_CONTENT, rule.options[inner.option].name,
+				rule.options[inner.option].arg, string(rule.options[longest->option].arg));
+		}
+	}
+}
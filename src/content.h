@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include "rule_checker.h"
+
+// A 'content' or 'uricontent' match together with its modifiers: the
+// options that follow it (Snort 2, Suricata) or the ones after the
+// pattern in its argument (Snort 3: content:"abc", nocase).
+typedef struct content_match
+{
+	// Decoded bytes: no quotes, '|hex|' blocks and escapes resolved.
+	std::string bytes;
+	// Index of the content option in type_parsed_rule::options.
+	size_t option;
+	bool negated;
+	bool nocase;
+	bool fast_pattern;
+	// Placed relative to the previous match (distance or within).
+	bool relative;
+	bool has_within;
+	bool has_depth;
+	bool has_offset;
+	// Positional modifier arguments, empty if absent, and their values.
+	// Values are 0 for byte_extract variables, see 'variable_position'.
+	std::string_view offset_arg;
+	std::string_view depth_arg;
+	std::string_view distance_arg;
+	std::string_view within_arg;
+	long offset;
+	long depth;
+	long distance;
+	long within;
+	bool variable_position;
+	// Inspected buffer: empty for the packet payload, otherwise the name
+	// of the buffer modifier (e.g. "http_uri"), also for sticky buffers
+	// ('http.uri;' before the content) where there is one.
+	std::string_view buffer;
+} type_content_match;
+
+// Decode a content argument, with or without leading '!'. Returns false
+// on malformed hex blocks or quoting. Hex blocks are decoded in chunks
+// with table lookups and no branches per byte, so long '|..|' blocks
+// (shellcode, file magic) vectorize.
+bool decode_content(std::string_view arg, std::string &bytes, bool &negated);
+
+// All contents of a rule, in rule order. Contents that fail to decode
+// are skipped.
+void collect_contents(const type_parsed_rule &rule, std::vector<type_content_match> &contents);
+
+// Content the engine feeds to its multi-pattern matcher: the one marked
+// 'fast_pattern', otherwise the longest positive content. nullptr if
+// there is none.
+const type_content_match *select_fast_pattern(const std::vector<type_content_match> &contents);
+
+// Both take the rule's contents from collect_contents().
+//
+// Positional errors: modifiers without a content, absolute and relative
+// modifiers on one content, and positive contents that can never match. Each
+// content is modelled as the range of offsets its match may start at in
+// its buffer (with Snort semantics: depth counts from offset, within from
+// the end of the previous match in the same buffer plus distance).
+void check_content_positions(const type_parsed_rule &rule, const std::vector<type_content_match> &contents,
+	diag_list &diags);
+
+// Contents without a position of their own that occur inside another
+// content of the same buffer: any match of the latter matches them too.
+void find_redundant_contents(const type_parsed_rule &rule, const std::vector<type_content_match> &contents,
+	diag_list &diags);
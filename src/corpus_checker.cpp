@@ -0,0 +1,99 @@
+#include <algorithm>
+#include "corpus_checker.h"
+
+using namespace std;
+
+static string sid_string(uint32_t gid, uint32_t sid)
+{
+	return to_string(gid) + ":" + to_string(sid);
+}
+
+void corpus_checker::add_finding(type_diag_code code, const char *option, size_t line,
+	uint32_t sid, string detail)
+{
+	type_corpus_finding finding;
+
+	finding.line = line;
+	finding.sid = sid;
+	finding.diag.code = code;
+	finding.diag.option = option;
+	finding.diag.column = 0;
+	finding.diag.detail = move(detail);
+
+	findings.push_back(move(finding));
+}
+
+void corpus_checker::add(const type_rule_line &rule, const type_parsed_rule &report)
+{
+	if (report.sid) {
+		uint64_t key = (static_cast<uint64_t>(report.gid) << 32) | report.sid;
+		auto res = sids.insert({ key, { report.rev, rule.first_line } });
+		type_sid_entry &prev = res.first->second;
+
+		if (!res.second) {
+			string sid = sid_string(report.gid, report.sid);
+
+			if (prev.rev == report.rev) {
+				add_finding(DIAG_DUPLICATE_SID, "sid", rule.first_line, report.sid,
+					sid + " rev " + to_string(report.rev) + ", first defined at " +
+					describe_input_line(prev.line));
+			} else if (report.rev < prev.rev) {
+				add_finding(DIAG_STALE_REVISION, "rev", rule.first_line, report.sid,
+					sid + " has older rev " + to_string(report.rev) + " than rev " +
+					to_string(prev.rev) + " at " + describe_input_line(prev.line));
+			} else {
+				add_finding(DIAG_STALE_REVISION, "rev", prev.line, report.sid,
+					sid + " has older rev " + to_string(prev.rev) + " than rev " +
+					to_string(report.rev) + " at " + describe_input_line(rule.first_line));
+				prev = { report.rev, rule.first_line };
+			}
+		}
+	}
+
+	for (const type_flowbit_ref &ref : report.flowbits) {
+		// Unsetting neither sets nor checks the flowbit.
+		if (ref.op == FLOWBIT_UNSET) {
+			continue;
+		}
+
+		auto res = flowbits.insert({ string(ref.name), type_flowbit_entry() });
+		type_flowbit_entry &entry = res.first->second;
+
+		if (ref.op == FLOWBIT_ISSET || ref.op == FLOWBIT_ISNOTSET) {
+			if (!entry.check_line) {
+				entry.check_line = rule.first_line;
+				entry.check_sid = report.sid;
+			}
+		} else if (!entry.set_line) {
+			entry.set_line = rule.first_line;
+			entry.set_sid = report.sid;
+		}
+	}
+}
+
+vector<type_corpus_finding> corpus_checker::finish()
+{
+	for (const auto &it : flowbits) {
+		const type_flowbit_entry &entry = it.second;
+
+		if (!entry.set_line) {
+			add_finding(DIAG_FLOWBIT_NOT_SET, "flowbits", entry.check_line, entry.check_sid,
+				"'" + it.first + "'");
+		} else if (!entry.check_line) {
+			add_finding(DIAG_FLOWBIT_NOT_CHECKED, "flowbits", entry.set_line, entry.set_sid,
+				"'" + it.first + "'");
+		}
+	}
+
+	sort(findings.begin(), findings.end(),
+		[](const type_corpus_finding &a, const type_corpus_finding &b) {
+			if (a.line != b.line) {
+				return a.line < b.line;
+			}
+
+			return (a.diag.code != b.diag.code) ? a.diag.code < b.diag.code :
+				a.diag.detail < b.diag.detail;
+		});
+
+	return move(findings);
+}
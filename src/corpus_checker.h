@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "diagnostic.h"
+#include "rule_checker.h"
+#include "rule_reader.h"
+
+typedef struct corpus_finding
+{
+	// Line of the rule the finding is reported on.
+	size_t line;
+	uint32_t sid;
+	// Diagnostic text lives in 'detail', no views into rules are kept.
+	type_diagnostic diag;
+} type_corpus_finding;
+
+// Cross-rule checks over the whole rule set: duplicate SIDs, SIDs with
+// conflicting revisions and flowbits checked but never set (or set but
+// never checked). Rules are indexed by hash in one pass as they are
+// checked; the findings are available once all rules are added.
+class corpus_checker
+{
+public:
+	void add(const type_rule_line &rule, const type_parsed_rule &report);
+	// Sorted by line.
+	std::vector<type_corpus_finding> finish();
+
+private:
+	typedef struct sid_entry
+	{
+		uint32_t rev;
+		size_t line;
+	} type_sid_entry;
+
+	typedef struct flowbit_entry
+	{
+		size_t set_line;
+		uint32_t set_sid;
+		size_t check_line;
+		uint32_t check_sid;
+	} type_flowbit_entry;
+
+	void add_finding(type_diag_code code, const char *option, size_t line, uint32_t sid,
+		std::string detail);
+
+	// Keyed by gid << 32 | sid.
+	std::unordered_map<uint64_t, type_sid_entry> sids;
+	std::unordered_map<std::string, type_flowbit_entry> flowbits;
+	std::vector<type_corpus_finding> findings;
+};
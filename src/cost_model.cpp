@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <boost/algorithm/string.hpp>
+#include "arg_parsers.h"
+#include "content.h"
+#include "cost_model.h"
+#include "pcre_parser.h"
+
+using namespace std;
+
+static constexpr int OPTION_BYTE_JUMP = option_id("byte_jump");
+static constexpr int OPTION_BYTE_TEST = option_id("byte_test");
+static constexpr int OPTION_FLOW      = option_id("flow");
+static constexpr int OPTION_ISDATAAT  = option_id("isdataat");
+static constexpr int OPTION_PCRE      = option_id("pcre");
+
+// Share of the traffic a rule is considered for.
+#define EXPOSURE_IP		1.0
+#define EXPOSURE_ANY_PORTS	0.5
+#define EXPOSURE_ONE_PORT	0.1
+#define EXPOSURE_BOTH_PORTS	0.02
+#define EXPOSURE_ICMP		0.05
+// Factor for rules on literal host addresses rather than variables/any.
+#define EXPOSURE_HOSTS		0.01
+// Probabilities are cut at 2^-COST_MAX_BITS.
+#define COST_MAX_BITS		32
+// Fast patterns shorter than this are flagged.
+#define COST_SHORT_PATTERN_LEN	4
+// Unbounded relative contents in a row that are flagged.
+#define COST_RELATIVE_CHAIN_LEN	3
+#define COST_PCRE_ANCHORED	10.0
+#define COST_PCRE_UNANCHORED	40.0
+// Scale of the reported score.
+#define COST_SCALE		10000.0
+
+typedef struct cost_factor_name
+{
+	unsigned factor;
+	const char *name;
+} type_cost_factor_name;
+
+static const type_cost_factor_name factor_names[] = {
+	{ COST_IP_PROTO,          "ip protocol" },
+	{ COST_ANY_PORTS,         "any to any ports" },
+	{ COST_NO_DIRECTION,      "no flow direction" },
+	{ COST_NO_CONTENT,        "no content to prefilter on" },
+	{ COST_SHORT_PATTERN,     "short fast pattern" },
+	{ COST_WEAK_FAST_PATTERN, "fast_pattern on a less selective content" },
+	{ COST_UNANCHORED_PCRE,   "unanchored pcre" },
+	{ COST_RELATIVE_CHAIN,    "long relative content chain" },
+	{ 0,                      nullptr }
+};
+
+// Estimated information in a byte of a pattern, in bits. Text is far
+// more predictable than random data; NUL, space and 0xff are common.
+static double byte_bits(unsigned char c, bool nocase)
+{
+	if (c == 0x00 || c == 0x20 || c == 0xff) {
+		return 2;
+	}
+
+	if (isalpha(c)) {
+		return nocase ? 4 : 4.7;
+	}
+
+	if (isdigit(c)) {
+		return 3.5;
+	}
+
+	if (isprint(c)) {
+		return 5;
+	}
+
+	return 7;
+}
+
+double pattern_bits(const type_content_match &content)
+{
+	double bits = 0;
+
+	for (char c : content.bytes) {
+		bits += byte_bits(c, content.nocase);
+	}
+
+	return min(bits, double(COST_MAX_BITS));
+}
+
+// Literal addresses or lists of them, e.g. "[192.0.2.1,192.0.2.7]".
+static bool is_host_list(string_view addr)
+{
+	if (addr.empty() || addr[0] == '!') {
+		return false;
+	}
+
+	for (char c : addr) {
+		if (c == '$' || c == '!' || isalpha(static_cast<unsigned char>(c))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static double exposure(const type_parsed_rule &rule, unsigned &factors)
+{
+	double hosts = (is_host_list(rule.src_addr) || is_host_list(rule.dst_addr)) ? EXPOSURE_HOSTS : 1;
+
+	if (boost::iequals(rule.proto, "ip")) {
+		factors |= COST_IP_PROTO;
+		return EXPOSURE_IP * hosts;
+	}
+
+	if (boost::iequals(rule.proto, "icmp")) {
+		return EXPOSURE_ICMP * hosts;
+	}
+
+	bool src_any = boost::iequals(rule.src_port, "any");
+	bool dst_any = boost::iequals(rule.dst_port, "any");
+
+	if (src_any && dst_any) {
+		factors |= COST_ANY_PORTS;
+		return EXPOSURE_ANY_PORTS * hosts;
+	}
+
+	return hosts * ((src_any || dst_any) ? EXPOSURE_ONE_PORT : EXPOSURE_BOTH_PORTS);
+}
+
+static bool has_direction(string_view flow)
+{
+	type_flow_args args;
+
+	if (!parse_flow(flow, args)) {
+		return false;
+	}
+
+	for (size_t i = 0; i < args.options_count; i++) {
+		if (args.options[i] == "to_server" || args.options[i] == "to_client" ||
+			args.options[i] == "from_server" || args.options[i] == "from_client") {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Cost of a pcre once the fast pattern matched. Anchored ('^', /A) and
+// relative (/R) expressions are tried at one position only.
+static double pcre_cost(string_view arg, unsigned &factors)
+{
+	pcre_expression expr;
+
+	if (!expr.parse(arg)) {
+		return COST_PCRE_UNANCHORED;
+	}
+
+	bool anchored = expr.anchored() || (expr.flags() & PCRE_RELATIVE);
+
+	if (!anchored) {
+		factors |= COST_UNANCHORED_PCRE;
+	}
+
+	return (anchored ? COST_PCRE_ANCHORED : COST_PCRE_UNANCHORED) + expr.pattern().length() / 16.0;
+}
+
+void estimate_cost(const type_parsed_rule &rule, type_rule_cost &cost)
+{
+	vector<type_content_match> contents;
+	unsigned factors = 0;
+	double share = exposure(rule, factors);
+	double eval = 1;
+	bool directed = false;
+
+	collect_contents(rule, contents);
+
+	for (const type_parsed_option &opt : rule.options) {
+		if (opt.id == OPTION_FLOW) {
+			directed = directed || has_direction(opt.arg);
+		} else if (opt.id == OPTION_PCRE) {
+			eval += pcre_cost(opt.arg, factors);
+		} else if (opt.id == OPTION_BYTE_TEST || opt.id == OPTION_BYTE_JUMP || opt.id == OPTION_ISDATAAT) {
+			eval += 1;
+		}
+	}
+
+	if (!directed) {
+		factors |= COST_NO_DIRECTION;
+		share *= 2;
+	}
+
+	const type_content_match *fast = select_fast_pattern(contents);
+	const type_content_match *best = nullptr;
+	size_t chain = 0;
+
+	for (const type_content_match &content : contents) {
+		// Relative contents without 'within' are searched again for
+		// every match of the previous one.
+		chain = (content.relative && !content.has_within) ? chain + 1 : 0;
+		eval += 1 + content.bytes.length() / 32.0 + chain;
+
+		if (chain >= COST_RELATIVE_CHAIN_LEN) {
+			factors |= COST_RELATIVE_CHAIN;
+		}
+
+		if (content.negated) {
+			continue;
+		}
+
+		if (!best || pattern_bits(content) > pattern_bits(*best)) {
+			best = &content;
+		}
+	}
+
+	double probability = 1;
+
+	if (fast && fast->fast_pattern && pattern_bits(*fast) < pattern_bits(*best)) {
+		factors |= COST_WEAK_FAST_PATTERN;
+	}
+
+	if (fast) {
+		probability = pow(2.0, -pattern_bits(*fast));
+
+		if (fast->bytes.length() < COST_SHORT_PATTERN_LEN) {
+			factors |= COST_SHORT_PATTERN;
+		}
+	} else {
+		factors |= COST_NO_CONTENT;
+	}
+
+	cost.score = COST_SCALE * share * probability * eval;
+	cost.eval = eval;
+	cost.factors = factors;
+}
+
+string describe_cost_factors(unsigned factors)
+{
+	string res;
+
+	for (size_t i = 0; factor_names[i].name != nullptr; i++) {
+		if (factors & factor_names[i].factor) {
+			res += (res.empty() ? "" : ", ");
+			res += factor_names[i].name;
+		}
+	}
+
+	return res;
+}
+
+cost_ranking::cost_ranking(size_t top)
+	: top(top), total(0), top_share(0)
+{
+}
+
+void cost_ranking::add(size_t line, uint32_t sid, const type_rule_cost &cost)
+{
+	entries.push_back({ cost.score, cost.eval, line, sid, cost.factors });
+	total += cost.score;
+}
+
+vector<type_corpus_finding> cost_ranking::finish()
+{
+	vector<type_corpus_finding> findings;
+	size_t percent = (entries.size() + 99) / 100;
+	size_t count = min(entries.size(), max(top, percent));
+
+	partial_sort(entries.begin(), entries.begin() + count, entries.end(),
+		[](const type_entry &a, const type_entry &b) {
+			if (a.score != b.score) {
+				return a.score > b.score;
+			}
+
+			return (a.eval != b.eval) ? a.eval > b.eval : a.line < b.line;
+		});
+
+	double percent_total = 0;
+
+	for (size_t i = 0; i < percent && i < entries.size(); i++) {
+		percent_total += entries[i].score;
+	}
+
+	top_share = (total > 0) ? percent_total / total : 0;
+
+	for (size_t i = 0; i < top && i < entries.size(); i++) {
+		const type_entry &e = entries[i];
+		char buf[64];
+		string detail;
+
+		snprintf(buf, sizeof(buf), "%.0f (%.2g%% of the total)", e.score,
+			(total > 0) ? 100 * e.score / total : 0);
+		detail = buf;
+
+		if (e.factors) {
+			detail += ": " + describe_cost_factors(e.factors);
+		}
+
+		findings.push_back(type_corpus_finding());
+		findings.back().line = e.line;
+		findings.back().sid = e.sid;
+		findings.back().diag.code = DIAG_EXPENSIVE_RULE;
+		findings.back().diag.column = 0;
+		findings.back().diag.detail = move(detail);
+	}
+
+	return findings;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "content.h"
+#include "corpus_checker.h"
+#include "rule_checker.h"
+
+// Static estimate of the CPU a rule costs on the sensor, from its parsed
+// options. The score is in arbitrary units, proportional to
+//
+//   exposure x directions x (match probability x evaluation cost)
+//
+// - exposure: share of the traffic the rule is considered for (protocol,
+//   ports and literal host addresses);
+// - directions: 2 if the rule does not restrict the flow direction;
+// - match probability: how often the fast pattern (the explicit one or
+//   the longest content) matches, from the estimated entropy of its
+//   bytes; 1 without any content;
+// - evaluation cost: contents, relative chains, pcre (anchored or not)
+//   and byte tests run once the fast pattern matched.
+
+// Factors that made a rule expensive.
+#define COST_IP_PROTO		(1 << 0)
+#define COST_ANY_PORTS		(1 << 1)
+#define COST_NO_DIRECTION	(1 << 2)
+#define COST_NO_CONTENT		(1 << 3)
+#define COST_SHORT_PATTERN	(1 << 4)
+#define COST_WEAK_FAST_PATTERN	(1 << 5)
+#define COST_UNANCHORED_PCRE	(1 << 6)
+#define COST_RELATIVE_CHAIN	(1 << 7)
+
+typedef struct rule_cost
+{
+	double score;
+	// Evaluation cost alone; ranks rules of the same score, e.g. those
+	// without a content.
+	double eval;
+	unsigned factors;
+} type_rule_cost;
+
+void estimate_cost(const type_parsed_rule &rule, type_rule_cost &cost);
+
+// Estimated information in the bytes of a content, in bits, capped: the
+// higher, the less often it matches.
+double pattern_bits(const type_content_match &content);
+
+// Comma separated description of COST_* factors.
+std::string describe_cost_factors(unsigned factors);
+
+// Ranks the corpus by estimated cost.
+class cost_ranking
+{
+public:
+	explicit cost_ranking(size_t top);
+
+	void add(size_t line, uint32_t sid, const type_rule_cost &cost);
+	// The 'top' most expensive rules, most expensive first, as
+	// DIAG_EXPENSIVE_RULE findings.
+	std::vector<type_corpus_finding> finish();
+	// Share of the total cost taken by the most expensive 1% of rules,
+	// valid after finish().
+	double top_percent_share() const
+	{
+		return top_share;
+	}
+
+private:
+	typedef struct entry
+	{
+		double score;
+		double eval;
+		size_t line;
+		uint32_t sid;
+		unsigned factors;
+	} type_entry;
+
+	size_t top;
+	std::vector<type_entry> entries;
+	double total;
+	double top_share;
+};
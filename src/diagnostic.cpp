@@ -0,0 +1,123 @@
+#include "diagnostic.h"
+
+using namespace std;
+
+const type_diag_info diag_infos[DIAG_CODES_COUNT] = {
+	{ "DP001", SEVERITY_ERROR,   "Bad rule: expected 'action proto src_addr src_port direction dst_addr dst_port (options)'" },
+	{ "DP002", SEVERITY_ERROR,   "Rule options must be enclosed in '(' and ')'" },
+	{ "DP003", SEVERITY_ERROR,   "Unterminated quoted string at column %c" },
+	{ "DP004", SEVERITY_ERROR,   "Unterminated '|' hex block at column %c" },
+	{ "DP005", SEVERITY_ERROR,   "Backslash at the end of rule options at column %c" },
+
+	{ "DP101", SEVERITY_ERROR,   "Unknown option: %o" },
+	{ "DP102", SEVERITY_ERROR,   "Option '%o' may be specified only once" },
+	{ "DP103", SEVERITY_ERROR,   "Option '%o' requires an argument" },
+	{ "DP104", SEVERITY_ERROR,   "Invalid argument to '%o'" },
+	{ "DP105", SEVERITY_ERROR,   "Invalid argument to '%o' option: %w. Must be a positive integer" },
+	{ "DP106", SEVERITY_ERROR,   "Value of option '%o' must be enclosed in '\"'" },
+	{ "DP107", SEVERITY_ERROR,   "Value of option '%o' is empty" },
+	{ "DP108", SEVERITY_ERROR,   "Regular expression must be enclosed in '\"'" },
+	{ "DP109", SEVERITY_ERROR,   "Regular expression is empty" },
+	{ "DP110", SEVERITY_ERROR,   "Invalid regular expression: %w (%d)" },
+	{ "DP111", SEVERITY_ERROR,   "Invalid argument to '%o' option: %w. Must be an integer from %d or a byte_extract variable" },
+
+	{ "DP201", SEVERITY_ERROR,   "IP protocol with port numbers - invalid syntax. IP protocol has no port numbers, consider using TCP or UDP" },
+	{ "DP202", SEVERITY_ERROR,   "No SID number. Please add 'sid' keyword" },
+	{ "DP203", SEVERITY_ERROR,   "No revision number. Please add 'rev' keyword" },
+	{ "DP204", SEVERITY_ERROR,   "No classification specified. Please add 'classtype' keyword for correct classification and priority rating" },
+	{ "DP205", SEVERITY_ERROR,   "ICMP options on non-ICMP rule" },
+	{ "DP206", SEVERITY_ERROR,   "Content modifier '%o' without a preceding 'content'" },
+	{ "DP207", SEVERITY_ERROR,   "Content %w mixes absolute (offset, depth) and relative (distance, within) modifiers" },
+	{ "DP208", SEVERITY_ERROR,   "Content %w can never match: %d" },
+	{ "DP209", SEVERITY_ERROR,   "%w in the %d matches nothing - the rule can never match" },
+	{ "DP210", SEVERITY_ERROR,   "Invalid %d: %w" },
+	{ "DP211", SEVERITY_ERROR,   "Unknown variable %w in the %d" },
+
+	{ "DP301", SEVERITY_WARNING, "Rule without port numbers - it'll be really slow" },
+	{ "DP302", SEVERITY_WARNING, "IP rule without content match - it's better to use firewall for this" },
+	{ "DP303", SEVERITY_WARNING, "TCP/UDP rule without deep packet checks - it's better to use firewall for this" },
+	{ "DP304", SEVERITY_WARNING, "TCP protocol without flow checking. Consider adding 'flow' keyword to provide better state tracking" },
+	{ "DP305", SEVERITY_WARNING, "IP protocol with flow checking - consider changing protocol to TCP or UDP" },
+	{ "DP306", SEVERITY_WARNING, "PCRE matching without 'content' or 'uricontent' keywords - it'll cause a performance hit" },
+	{ "DP307", SEVERITY_WARNING, "Nested quantifiers in pcre: %w%d - the matcher may backtrack exponentially" },
+	{ "DP308", SEVERITY_WARNING, "Alternatives matching the same text under a quantifier in pcre: %w%d - the matcher may backtrack exponentially" },
+	{ "DP309", SEVERITY_WARNING, "Unanchored pcre starting with %w - it's matched again from every offset of the buffer" },
+	{ "DP310", SEVERITY_WARNING, "Quantifiers over the same characters in a row in pcre: %w%d - the matcher may backtrack polynomially" },
+	{ "DP311", SEVERITY_WARNING, "Content %w is redundant, it occurs in %d in the same buffer" },
+	{ "DP312", SEVERITY_WARNING, "%w in the %d covers everything - use 'any'" },
+	{ "DP313", SEVERITY_WARNING, "Negation %w in the %d has no effect" },
+
+	{ "DP401", SEVERITY_ERROR,   "Duplicate SID %d" },
+	{ "DP402", SEVERITY_ERROR,   "SID %d" },
+	{ "DP403", SEVERITY_WARNING, "Flowbit %d is checked but never set - the rule can't match as intended" },
+	{ "DP404", SEVERITY_WARNING, "Flowbit %d is set but never checked - wasted work on every flow" },
+
+	{ "DP501", SEVERITY_WARNING, "Expensive rule, estimated cost %d" },
+	{ "DP502", SEVERITY_WARNING, "Expensive rule on the replayed capture: %d" },
+
+	{ "DP601", SEVERITY_WARNING, "Fast pattern shared by many rules: %d" },
+	{ "DP602", SEVERITY_WARNING, "Short fast pattern: %d" },
+	{ "DP603", SEVERITY_WARNING, "Fast pattern inside a common fast pattern: %d" },
+
+	{ "DP701", SEVERITY_WARNING, "Duplicate of the rule at %d - it matches the same traffic" },
+	{ "DP702", SEVERITY_WARNING, "Subsumed by the rule at %d - it matches a subset of that rule's traffic" },
+
+	{ "DP801", SEVERITY_WARNING, "Rewritten for performance: %d" },
+};
+
+void report(diag_list &diags, type_diag_code code, string_view option,
+	string_view where, string detail)
+{
+	diags.push_back(type_diagnostic());
+
+	type_diagnostic &diag = diags.back();
+
+	diag.code = code;
+	diag.option = option;
+	diag.where = where;
+	diag.column = 0;
+	diag.detail = move(detail);
+}
+
+static string expand(const char *format, string_view option, string_view where,
+	string_view detail, string_view column)
+{
+	string text;
+
+	for (const char *p = format; *p; p++) {
+		if (*p != '%' || !p[1]) {
+			text += *p;
+			continue;
+		}
+
+		switch (*++p) {
+		case 'o':
+			text += option;
+			break;
+		case 'w':
+			text += where;
+			break;
+		case 'd':
+			text += detail;
+			break;
+		case 'c':
+			text += column;
+			break;
+		default:
+			text += *p;
+		}
+	}
+
+	return text;
+}
+
+string format_diagnostic(const type_diagnostic &diag)
+{
+	return expand(diag_infos[diag.code].format, diag.option, diag.where, diag.detail,
+		to_string(diag.column));
+}
+
+string describe_diagnostic(type_diag_code code)
+{
+	return expand(diag_infos[code].format, "<option>", "<value>", "<details>", "<column>");
+}
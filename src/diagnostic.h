@@ -0,0 +1,120 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define SEVERITY_ERROR		0
+#define SEVERITY_WARNING	1
+
+// Diagnostic codes, indexes into the diagnostic description table.
+typedef enum diag_code
+{
+	// Rule syntax
+	DIAG_BAD_RULE,
+	DIAG_OPTIONS_NOT_ENCLOSED,
+	DIAG_UNTERMINATED_QUOTE,
+	DIAG_UNTERMINATED_HEX,
+	DIAG_DANGLING_ESCAPE,
+
+	// Options and their arguments
+	DIAG_UNKNOWN_OPTION,
+	DIAG_DUPLICATE_OPTION,
+	DIAG_MISSING_ARGUMENT,
+	DIAG_INVALID_ARGUMENT,
+	DIAG_NOT_UINT,
+	DIAG_NOT_QUOTED,
+	DIAG_EMPTY_VALUE,
+	DIAG_PCRE_NOT_QUOTED,
+	DIAG_PCRE_EMPTY,
+	DIAG_INVALID_PCRE,
+	DIAG_INVALID_POSITION,
+
+	// Rule level errors
+	DIAG_IP_WITH_PORTS,
+	DIAG_NO_SID,
+	DIAG_NO_REV,
+	DIAG_NO_CLASSTYPE,
+	DIAG_ICMP_OPTION,
+	DIAG_MODIFIER_WITHOUT_CONTENT,
+	DIAG_MIXED_POSITIONS,
+	DIAG_CONTENT_NEVER_MATCHES,
+	DIAG_EMPTY_HEADER,
+	DIAG_INVALID_HEADER,
+	DIAG_UNKNOWN_VARIABLE,
+
+	// Performance warnings
+	DIAG_NO_PORTS,
+	DIAG_IP_NO_CONTENT,
+	DIAG_NO_DEEP_CHECKS,
+	DIAG_TCP_NO_FLOW,
+	DIAG_IP_WITH_FLOW,
+	DIAG_PCRE_NO_CONTENT,
+	DIAG_PCRE_NESTED_QUANTIFIERS,
+	DIAG_PCRE_OVERLAPPING_ALTERNATION,
+	DIAG_PCRE_LEADING_DOT_STAR,
+	DIAG_PCRE_ADJACENT_QUANTIFIERS,
+	DIAG_REDUNDANT_CONTENT,
+	DIAG_HEADER_ANY,
+	DIAG_USELESS_NEGATION,
+
+	// Cross-rule checks
+	DIAG_DUPLICATE_SID,
+	DIAG_STALE_REVISION,
+	DIAG_FLOWBIT_NOT_SET,
+	DIAG_FLOWBIT_NOT_CHECKED,
+
+	// Cost model
+	DIAG_EXPENSIVE_RULE,
+	DIAG_MEASURED_COST,
+
+	// Fast pattern analysis
+	DIAG_SHARED_FAST_PATTERN,
+	DIAG_SHORT_FAST_PATTERN,
+	DIAG_FAST_PATTERN_SUBSTRING,
+
+	// Duplicates and subsumption
+	DIAG_DUPLICATE_RULE,
+	DIAG_SUBSUMED_RULE,
+
+	// Rewrites
+	DIAG_REWRITTEN,
+
+	DIAG_CODES_COUNT
+} type_diag_code;
+
+typedef struct diag_info
+{
+	const char *id;
+	int severity;
+	// %o - option name, %w - offending text, %d - detail, %c - column
+	const char *format;
+} type_diag_info;
+
+extern const type_diag_info diag_infos[DIAG_CODES_COUNT];
+
+typedef struct diagnostic
+{
+	type_diag_code code;
+	// Option name as written in the rule, may be empty.
+	std::string_view option;
+	// Offending text; a view into the checked rule.
+	std::string_view where;
+	// 1-based column of 'where' within the rule, 0 if unknown.
+	size_t column;
+	std::string detail;
+} type_diagnostic;
+
+typedef std::vector<type_diagnostic> diag_list;
+
+void report(diag_list &diags, type_diag_code code, std::string_view option,
+	std::string_view where, std::string detail = std::string());
+
+inline int diag_severity(const type_diagnostic &diag)
+{
+	return diag_infos[diag.code].severity;
+}
+
+// Human readable text of a diagnostic, without the leading "- ".
+std::string format_diagnostic(const type_diagnostic &diag);
+// Generic description of a diagnostic code with placeholders.
+std::string describe_diagnostic(type_diag_code code);
@@ -1,16 +1,69 @@
 #include <string>
+#include <string_view>
 #include <cstdio>
-#include <fstream>
+#include <cstring>
 #include <cerrno>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <vector>
+#include <boost/preprocessor/stringize.hpp>
 #include <boost/program_options.hpp>
-#include <boost/algorithm/string.hpp>
 #include "rule_checker.h"
+#include "rule_reader.h"
+#include "report_writer.h"
+#include "corpus_checker.h"
+#include "cost_model.h"
+#include "pattern_index.h"
+#include "pcap_reader.h"
+#include "replay_profiler.h"
+#include "duplicate_index.h"
+#include "parallel.h"
+#include "result_cache.h"
+#include "rule_config.h"
+#include "rule_fixer.h"
+#include "rule_vars.h"
+#include "stats.h"
+#ifdef DUMBPIG_WATCH
+#include "watch_server.h"
+#endif
+
+// Rules are read and checked in batches of this size; output of a batch
+// is written once all of its rules are checked, in input order.
+#define RULES_BATCH_SIZE	16384
+#define RULES_CHUNK_SIZE	64
+#define CACHE_MISS		SIZE_MAX
+// Default of --socket.
+#define WATCH_SOCKET		"dumbpig.sock"
+// Default of --fast-patterns.
+#define FAST_PATTERN_SHARED	10
+// Default of --pcap-top.
+#define PCAP_TOP		20
 
 int main(int argc, char **argv)
 {
 	namespace po = boost::program_options;
 	std::string filename;
+	std::string config_file;
+	std::string cache_dir;
+	std::vector<std::string> vars_files;
+	unsigned jobs = 1;
+	int format = FORMAT_TEXT;
+	int dialect = DIALECT_ANY;
+	size_t rank_cost = 0;
+	size_t fast_patterns = 0;
+	bool duplicates = false;
+	std::string pcap_file;
+	size_t pcap_top = PCAP_TOP;
+	std::string fix_file;
+#ifdef DUMBPIG_WATCH
+	std::vector<std::string> watch_dirs;
+	std::string socket_path = WATCH_SOCKET;
+#endif
+#ifdef DUMBPIG_STATS
+	bool stats = false;
+	size_t slowest = 0;
+#endif
 
 	po::options_description desc(
 		"A simple dumbpig-like snort/suricata rules checker\n\n"
@@ -23,6 +76,60 @@ int main(int argc, char **argv)
 		("filename,f",
 			po::value<std::string>(),
 			"rules file name,\nuse dash (-) for stdin")
+		("config",
+			po::value<std::string>(),
+			"snort.conf or suricata.yaml of a deployment;\nits variables are loaded and the rule files\nit includes are checked")
+		("jobs,j",
+			po::value<unsigned>(),
+			"number of checker threads,\n0 means one per CPU core (default: 1)")
+		("format",
+			po::value<std::string>(),
+			"output format: text, jsonl or sarif\n(default: text)")
+		("dialect",
+			po::value<std::string>(),
+			"rule language: snort2, snort3 or suricata;\nonly its options are known (default: the\noptions of all of them)")
+		("rank-cost",
+			po::value<size_t>(),
+			"rank rules by estimated CPU cost and list\nthe N most expensive ones")
+		("fast-patterns",
+			po::value<size_t>()->implicit_value(FAST_PATTERN_SHARED),
+			"analyze fast patterns over all rules; report\npatterns shared by at least N rules (default: "
+			BOOST_PP_STRINGIZE(FAST_PATTERN_SHARED) ")")
+		("duplicates",
+			"report rules that duplicate or are subsumed\nby another rule, whatever their sid")
+		("pcap",
+			po::value<std::string>(),
+			"replay a pcap file against the rules and\nreport the rules taking the most time")
+		("pcap-top",
+			po::value<size_t>(),
+			"number of rules listed by --pcap (default: "
+			BOOST_PP_STRINGIZE(PCAP_TOP) ")")
+		("fix",
+			po::value<std::string>(),
+			"write the rules to a file in input order,\nrewritten for performance where possible;\n"
+			"dash (-) for stdout, the report then goes\nto stderr")
+		("vars",
+			po::value<std::vector<std::string>>()->composing(),
+			"snort.conf or suricata.yaml style file of\naddress and port variables; may be repeated")
+		("cache",
+			po::value<std::string>(),
+			"directory of the result cache; unchanged\nrules are not checked again")
+#ifdef DUMBPIG_WATCH
+		("watch",
+			po::value<std::vector<std::string>>()->composing(),
+			"keep running, watch *.rules files in a\ndirectory (may be repeated) and serve\nresults on --socket")
+		("socket",
+			po::value<std::string>(),
+			"Unix socket of --watch (default: "
+			WATCH_SOCKET ")")
+#endif
+#ifdef DUMBPIG_STATS
+		("stats",
+			"print time spent per phase and per option\nto stderr")
+		("slowest",
+			po::value<size_t>(),
+			"print the N slowest rules to stderr")
+#endif
 		;
 
 	try {
@@ -38,40 +145,443 @@ int main(int argc, char **argv)
 		if (vm.count("filename")) {
 			filename = vm["filename"].as<std::string>();
 		}
+
+		if (vm.count("config")) {
+			config_file = vm["config"].as<std::string>();
+		}
+
+		if (vm.count("jobs")) {
+			jobs = effective_jobs(vm["jobs"].as<unsigned>());
+		}
+
+		if (vm.count("rank-cost")) {
+			rank_cost = vm["rank-cost"].as<size_t>();
+		}
+
+		if (vm.count("fast-patterns")) {
+			fast_patterns = vm["fast-patterns"].as<size_t>();
+		}
+
+		duplicates = vm.count("duplicates");
+
+		if (vm.count("pcap")) {
+			pcap_file = vm["pcap"].as<std::string>();
+		}
+
+		if (vm.count("pcap-top")) {
+			pcap_top = vm["pcap-top"].as<size_t>();
+		}
+
+		if (vm.count("fix")) {
+			fix_file = vm["fix"].as<std::string>();
+		}
+
+		if (vm.count("vars")) {
+			vars_files = vm["vars"].as<std::vector<std::string>>();
+		}
+
+		if (vm.count("cache")) {
+			cache_dir = vm["cache"].as<std::string>();
+		}
+
+#ifdef DUMBPIG_WATCH
+		if (vm.count("watch")) {
+			watch_dirs = vm["watch"].as<std::vector<std::string>>();
+		}
+
+		if (vm.count("socket")) {
+			socket_path = vm["socket"].as<std::string>();
+		}
+#endif
+
+#ifdef DUMBPIG_STATS
+		stats = vm.count("stats");
+
+		if (vm.count("slowest")) {
+			slowest = vm["slowest"].as<size_t>();
+		}
+#endif
+
+		if (vm.count("format")) {
+			format = find_format(vm["format"].as<std::string>());
+
+			if (format < 0) {
+				throw po::invalid_option_value(vm["format"].as<std::string>());
+			}
+		}
+
+		if (vm.count("dialect")) {
+			dialect = find_dialect(vm["dialect"].as<std::string>());
+
+			if (dialect < 0) {
+				throw po::invalid_option_value(vm["dialect"].as<std::string>());
+			}
+		}
 	} catch (const std::exception &e) {
 		std::cout << e.what() << std::endl;
 		std::cout << "Use '-h' option for help" << std::endl;
 		return 1;
 	}
 
-	std::istream *p_input = &std::cin;
-	std::ifstream in_file;
+#ifdef DUMBPIG_STATS
+	if (stats || slowest) {
+		stats_enable(slowest);
+	}
+#endif
+
+	rule_vars vars;
+	type_checker_config config;
+	std::vector<std::string> inputs;
+
+	if (!config_file.empty()) {
+		rule_config deployment;
+
+		if (!deployment.load(config_file, vars)) {
+			std::cerr << "Failed to open file '" << config_file << "': " << strerror(errno) << std::endl;
+			return 2;
+		}
+
+		for (const std::string &problem : deployment.problems()) {
+			std::cerr << problem << std::endl;
+		}
+
+		if (deployment.rule_files().empty()) {
+			std::cerr << "No rule files included from '" << config_file << "'" << std::endl;
+			return 2;
+		}
+
+		inputs = deployment.rule_files();
+	}
+
+	// Explicit --vars override the variables of the configuration.
+	for (const std::string &name : vars_files) {
+		if (!vars.load(name)) {
+			std::cerr << "Failed to open file '" << name << "': " << strerror(errno) << std::endl;
+			return 2;
+		}
+	}
+
+	for (const std::string &problem : vars.problems()) {
+		std::cerr << problem << std::endl;
+	}
+
+	if (!vars_files.empty() || !config_file.empty()) {
+		config.vars = &vars;
+	}
+
+	config.dialect = dialect;
+
+	const rule_checker checker(config);
+
+#ifdef DUMBPIG_WATCH
+	if (!watch_dirs.empty()) {
+		watch_server server(checker, format, jobs);
+
+		for (const std::string &dir : watch_dirs) {
+			if (!server.watch(dir)) {
+				std::cerr << "Failed to watch directory '" << dir << "': " << strerror(errno) << std::endl;
+				return 2;
+			}
+		}
+
+		if (!server.listen(socket_path)) {
+			std::cerr << "Failed to listen on '" << socket_path << "': " << strerror(errno) << std::endl;
+			return 2;
+		}
+
+		std::cerr << "Listening on " << socket_path << std::endl;
+
+		return server.run() ? 0 : 2;
+	}
+#endif
+
+	if (config_file.empty() || !filename.empty()) {
+		inputs.insert(inputs.begin(), filename);
+	}
+
+	// Several input files are read one after the other, numbering their
+	// lines as one input; a batch may span several files, so small files
+	// are checked together and large ones are split across threads.
+	std::vector<std::unique_ptr<rule_reader>> readers;
+	size_t input = 0;
+	// Input lines of the files before the current one.
+	size_t base = 0;
 
-	if (filename != "-") {
-		in_file.open(filename.c_str(), std::ifstream::in);
+	for (const std::string &name : inputs) {
+		readers.push_back(std::make_unique<rule_reader>());
+		// --fix writes out the whole input, disabled rules included.
+		readers.back()->keep_comments(!fix_file.empty());
 
-		if (!in_file) {
-			std::cerr << "Failed to open file '" << filename.c_str() << ": "
+		if (!readers.back()->open(name)) {
+			std::cerr << "Failed to open file '" << name.c_str() << ": "
 				<< strerror(errno) << std::endl;
 			return 2;
 		}
+	}
+
+	if (inputs.size() > 1 || !config_file.empty()) {
+		add_input_file(inputs[0], 0);
+	}
+
+	result_cache cache(checker.config());
+
+	if (!cache_dir.empty() && !cache.open(cache_dir)) {
+		std::cerr << "Failed to open cache directory '" << cache_dir << "': "
+			<< strerror(errno) << std::endl;
+		return 2;
+	}
+
+	pcap_reader pcap;
+
+	if (!pcap_file.empty() && !pcap.open(pcap_file)) {
+		std::cerr << "Failed to open capture '" << pcap_file << "': " << pcap.error() << std::endl;
+		return 2;
+	}
+
+	FILE *fix_out = nullptr;
+
+	if (fix_file == "-") {
+		fix_out = stdout;
+	} else if (!fix_file.empty() && !(fix_out = fopen(fix_file.c_str(), "w"))) {
+		std::cerr << "Failed to open file '" << fix_file << "': " << strerror(errno) << std::endl;
+		return 2;
+	}
+
+	std::vector<type_rule_line> rules;
+	std::vector<type_parsed_rule> reports;
+	// Cache entry of each rule of the batch, or CACHE_MISS.
+	std::vector<size_t> cached;
+	std::vector<type_rule_cost> costs;
+	cost_ranking ranking(rank_cost);
+	pattern_index patterns(fast_patterns);
+	duplicate_index forms;
+	replay_profiler profiler(checker.config().vars, pcap_top);
+	const rule_fixer fixer(checker);
+	// Rewrite of each rule of the batch, empty if it is kept as it is.
+	std::vector<type_rule_fix> fixes;
+	// Comments and blank lines of the batch for --fix, each with the
+	// index of the rule it comes before.
+	std::vector<std::pair<size_t, std::string_view>> comments;
+	std::unique_ptr<output_buffer> fixed;
+	report_writer output(format, config_file.empty() ? filename : config_file, fix_out == stdout ? stderr : stdout);
+	corpus_checker corpus;
+	type_rule_line rule;
+	bool eof = false;
+	// A read error ends the input; what was read is still checked.
+	bool read_failed = false;
+
+	if (fix_out) {
+		fixed = std::make_unique<output_buffer>(fix_out);
+	}
+
+	rules.reserve(RULES_BATCH_SIZE);
+	output.begin();
+
+	while (!eof) {
+		rules.clear();
+		comments.clear();
+
+		// Rules of the previous batch are not used anymore, nor are the
+		// files they were read from.
+		for (size_t i = 0; i < input; i++) {
+			readers[i].reset();
+		}
+
+		readers[input]->release();
+
+		while (rules.size() < RULES_BATCH_SIZE) {
+			STATS_START(read_start);
+
+			if (!readers[input]->next(rule)) {
+				if (int err = readers[input]->error()) {
+					std::cerr << "Failed to read file '" << inputs[input] << "': " << strerror(err) << std::endl;
+					read_failed = true;
+					eof = true;
+					break;
+				}
+
+				if (input + 1 == readers.size()) {
+					eof = true;
+					break;
+				}
+
+				base += readers[input]->lines();
+				add_input_file(inputs[++input], base);
+				continue;
+			}
+
+			STATS_LAP(PHASE_READ, read_start);
+
+			if (rule.comment) {
+				comments.emplace_back(rules.size(), rule.text);
+				continue;
+			}
+
+			rule.first_line += base;
+			rule.last_line += base;
+			rules.push_back(rule);
+		}
+
+		reports.resize(rules.size());
+		cached.assign(rules.size(), CACHE_MISS);
+		costs.resize(rank_cost ? rules.size() : 0);
+		fixes.resize(fix_out ? rules.size() : 0);
+
+		parallel_for(rules.size(), jobs, RULES_CHUNK_SIZE, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				STATS_START(rule_start);
+
+				if (cache_dir.empty() || !cache.lookup(rules[i].text, reports[i], cached[i])) {
+					checker.check(rules[i].text, reports[i]);
+				}
+
+				if (rank_cost && reports[i].status != RULE_HAS_ERRORS) {
+					estimate_cost(reports[i], costs[i]);
+				}
+
+				if (fix_out) {
+					STATS_FIX_START(fix_start);
+					fixer.fix(reports[i], fixes[i]);
+					STATS_FIX_END(fix_start);
+				}
+
+				STATS_RULE(rules[i].first_line, rule_start);
+			}
+		});
+
+		if (!cache_dir.empty()) {
+			for (size_t i = 0; i < rules.size(); i++) {
+				if (cached[i] == CACHE_MISS) {
+					cache.store(rules[i].text, reports[i]);
+				} else {
+					cache.keep(cached[i]);
+				}
+			}
+		}
+
+		// Cross-rule indexing runs alongside the output of the batch.
+		std::future<void> indexed = std::async(jobs > 1 ? std::launch::async : std::launch::deferred, [&]() {
+			for (size_t i = 0; i < rules.size(); i++) {
+				corpus.add(rules[i], reports[i]);
 
-		p_input = &in_file;
+				if (fast_patterns && reports[i].status != RULE_HAS_ERRORS) {
+					patterns.add(rules[i].first_line, reports[i].sid, reports[i]);
+				}
+
+				if (duplicates && reports[i].status != RULE_HAS_ERRORS) {
+					forms.add(rules[i].first_line, reports[i].sid, reports[i]);
+				}
+
+				if (!pcap_file.empty() && reports[i].status != RULE_HAS_ERRORS) {
+					profiler.add(rules[i].first_line, reports[i].sid, reports[i]);
+				}
+			}
+		});
+
+		auto comment = comments.begin();
+
+		for (size_t i = 0; i < rules.size(); i++) {
+			STATS_START(output_start);
+			output.rule(rules[i], reports[i], (fix_out && !fixes[i].text.empty()) ? &fixes[i] : nullptr);
+
+			if (fix_out) {
+				for (; comment != comments.end() && comment->first == i; ++comment) {
+					*fixed << comment->second << '\n';
+				}
+
+				*fixed << (fixes[i].text.empty() ? rules[i].text : std::string_view(fixes[i].text)) << '\n';
+			}
+			STATS_LAP(PHASE_OUTPUT, output_start);
+		}
+
+		for (; comment != comments.end(); ++comment) {
+			*fixed << comment->second << '\n';
+		}
+
+		indexed.get();
+
+		for (size_t i = 0; rank_cost && i < rules.size(); i++) {
+			if (reports[i].status != RULE_HAS_ERRORS) {
+				ranking.add(rules[i].first_line, reports[i].sid, costs[i]);
+			}
+		}
+	}
+
+	output.findings(corpus.finish());
+
+	if (rank_cost) {
+		std::vector<type_corpus_finding> ranked = ranking.finish();
+		char title[128];
+
+		snprintf(title, sizeof(title), "Most expensive rules (the top 1%% of rules take %.1f%% of the total cost)",
+			100 * ranking.top_percent_share());
+		output.section(title, ranked);
+	}
+
+	if (fast_patterns) {
+		std::vector<type_corpus_finding> found = patterns.finish();
+		char title[256];
+
+		snprintf(title, sizeof(title), "Fast patterns (%zu distinct in %zu rules; Aho-Corasick automaton "
+			"of %zu states, %zu KiB sparse, %zu KiB as a full table)", patterns.patterns(),
+			patterns.rules(), patterns.states(), patterns.memory() >> 10, patterns.dfa_memory() >> 10);
+		output.section(title, found);
 	}
 
-	std::string message;
-	std::string rule_str;
+	if (duplicates) {
+		std::vector<type_corpus_finding> found = forms.finish();
+		char title[256];
 
-	while(std::getline(*p_input, rule_str)) {
-		boost::trim(rule_str);
-		if (rule_str[0] == '#' || rule_str.empty()) {
-			continue;
+		snprintf(title, sizeof(title), "Duplicate and subsumed rules (%zu duplicates, %zu subsumed; "
+			"%zu rule pairs compared)", forms.duplicates(), forms.subsumed(), forms.comparisons());
+		output.section(title, found);
+	}
+
+	if (!pcap_file.empty()) {
+		profiler.run(pcap, jobs);
+
+		std::vector<type_corpus_finding> found = profiler.finish();
+		char title[256];
+
+		snprintf(title, sizeof(title), "Measured cost on %s (%zu packets, %.1f MiB of payload in %.2f s; "
+			"%zu of %zu rules evaluated, %zu with unresolved headers skipped)", pcap_file.c_str(),
+			profiler.packets(), profiler.payload_bytes() / 1048576.0, profiler.seconds(),
+			profiler.evaluated(), profiler.rules(), profiler.skipped());
+		output.section(title, found);
+	}
+
+	output.end();
+
+	if (fix_out) {
+		fixed->flush();
+
+		bool failed = ferror(fix_out);
+
+		if (fix_out != stdout && fclose(fix_out) != 0) {
+			failed = true;
 		}
 
-		process_rule(rule_str, message);
-		std::cout << "Rule: " << rule_str << std::endl;
-		std::cout << message << "\n" << std::endl;
+		if (failed) {
+			std::cerr << "Failed to write file '" << fix_file << "': " << strerror(errno) << std::endl;
+			return 2;
+		}
+	}
+
+	if (!cache_dir.empty()) {
+		if (!cache.save()) {
+			std::cerr << "Failed to update cache in '" << cache_dir << "': "
+				<< strerror(errno) << std::endl;
+		}
+
+		std::cerr << "Cache: " << cache.hits() << " hits, " << cache.misses()
+			<< " misses" << std::endl;
+	}
+
+#ifdef DUMBPIG_STATS
+	if (stats || slowest) {
+		stats_report(stderr, stats);
 	}
+#endif
 
-	return 0;
+	return read_failed ? 2 : 0;
 }
@@ -0,0 +1,467 @@
+#include <algorithm>
+#include <cctype>
+#include <boost/algorithm/string.hpp>
+#include "arg_parsers.h"
+#include "content.h"
+#include "duplicate_index.h"
+#include "hash.h"
+#include "string_utils.h"
+
+using namespace std;
+
+// Seeds of the two hashes of a form.
+#define FORM_KEY_SEED		0
+#define FORM_CHECK_SEED		0x5bd1e995
+
+static constexpr int OPTION_CONTENT    = option_id("content");
+static constexpr int OPTION_URICONTENT = option_id("uricontent");
+static constexpr int OPTION_PCRE       = option_id("pcre");
+static constexpr int OPTION_FLOW       = option_id("flow");
+static constexpr int OPTION_DISTANCE   = option_id("distance");
+static constexpr int OPTION_WITHIN     = option_id("within");
+static constexpr int OPTION_FAST_PATTERN = option_id("fast_pattern");
+static constexpr int OPTION_FLOWBITS   = option_id("flowbits");
+static constexpr int OPTION_FLOWINT    = option_id("flowint");
+static constexpr int OPTION_XBITS      = option_id("xbits");
+static constexpr int OPTION_NOALERT    = option_id("noalert");
+
+// Options that don't change what a rule matches.
+static const int ignored_options[] = {
+	option_id("classtype"),
+	option_id("fast_pattern"),
+	option_id("gid"),
+	option_id("logto"),
+	option_id("metadata"),
+	option_id("msg"),
+	option_id("priority"),
+	option_id("reference"),
+	option_id("rev"),
+	option_id("sid"),
+	option_id("tag"),
+};
+
+// Options starting a positional constraint.
+static const int chain_options[] = {
+	OPTION_CONTENT,
+	OPTION_URICONTENT,
+	OPTION_PCRE,
+	option_id("byte_jump"),
+	option_id("byte_test"),
+	option_id("isdataat"),
+};
+
+// Modifiers of the preceding positional constraint, besides buffer
+// modifiers (BUFFER_MODIFIER).
+static const int modifier_options[] = {
+	OPTION_DISTANCE,
+	OPTION_WITHIN,
+	option_id("depth"),
+	option_id("nocase"),
+	option_id("offset"),
+	option_id("rawbytes"),
+};
+
+// Options selecting the buffer of the constraints after them.
+static const int sticky_options[] = {
+	option_id("dce_stub_data"),
+	option_id("file_data"),
+};
+
+template <size_t N>
+static bool is_one_of(int id, const int (&ids)[N])
+{
+	return find(begin(ids), end(ids), id) != end(ids);
+}
+
+// Comma separated items trimmed; sorted for options where their order
+// doesn't matter.
+static string normalize_arg(const type_parsed_option &opt)
+{
+	vector<string> items;
+
+	boost::split(items, opt.arg, boost::is_any_of(","));
+
+	for (string &item : items) {
+		item = string(trim(item));
+	}
+
+	if (opt.id == OPTION_FLOW) {
+		for (string &item : items) {
+			boost::to_lower(item);
+		}
+
+		sort(items.begin(), items.end());
+	}
+
+	return boost::join(items, ",");
+}
+
+// 'any' in lower case, no spaces, list items sorted (nested lists too).
+static string normalize_field(string_view field)
+{
+	if (boost::iequals(field, "any")) {
+		return "any";
+	}
+
+	string text;
+
+	for (char c : field) {
+		if (!is_space(c)) {
+			text += c;
+		}
+	}
+
+	bool negated = !text.empty() && text[0] == '!';
+	string_view list = string_view(text).substr(negated);
+
+	if (list.length() < 2 || list.front() != '[' || list.back() != ']') {
+		return text;
+	}
+
+	vector<string> items;
+	int nesting = 0;
+
+	list = list.substr(1, list.length() - 2);
+
+	for (size_t i = 0, start = 0; i <= list.length(); i++) {
+		if (i < list.length()) {
+			nesting += (list[i] == '[') - (list[i] == ']');
+
+			if (list[i] != ',' || nesting) {
+				continue;
+			}
+		}
+
+		string_view item = list.substr(start, i - start);
+		bool item_negated = !item.empty() && item[0] == '!';
+
+		items.push_back((item_negated ? "!" : "") + normalize_field(item.substr(item_negated)));
+		start = i + 1;
+	}
+
+	sort(items.begin(), items.end());
+
+	return (negated ? "![" : "[") + boost::join(items, ",") + "]";
+}
+
+// Sets flow state or keeps the rule from alerting: flowbits and xbits
+// other than checks, flowint assignments, noalert.
+static bool changes_state(const type_parsed_option &opt)
+{
+	string_view arg = opt.arg;
+	string_view op = trim(next_token(arg, ","));
+
+	if (opt.id == OPTION_FLOWBITS || opt.id == OPTION_XBITS) {
+		return op != "isset" && op != "isnotset";
+	}
+
+	if (opt.id == OPTION_FLOWINT) {
+		op = trim(next_token(arg, ","));
+
+		return op == "=" || op == "+" || op == "-";
+	}
+
+	return opt.id == OPTION_NOALERT;
+}
+
+static bool is_relative(const type_parsed_option &opt)
+{
+	if (opt.id == OPTION_PCRE) {
+		string_view arg = trim(opt.arg);
+		size_t end = arg.rfind('/');
+
+		return end != string_view::npos && arg.find('R', end) != string_view::npos;
+	}
+
+	vector<string> items;
+
+	boost::split(items, opt.arg, boost::is_any_of(","));
+
+	for (const string &item : items) {
+		if (trim(item) == "relative") {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void canonical_form(const type_parsed_rule &rule, type_canonical_rule &form)
+{
+	vector<type_content_match> contents;
+	const type_content_match *fast;
+	const type_content_match *content = nullptr;
+	string_view sticky;
+	string previous;
+	string head;
+	vector<string> modifiers;
+	bool relative = false;
+	size_t fast_option;
+
+	form.header[FORM_ACTION] = boost::to_lower_copy(string(rule.action));
+	form.header[FORM_PROTO] = boost::to_lower_copy(string(rule.proto));
+	form.header[FORM_DIRECTION] = string(rule.direction);
+	form.header[FORM_SRC_ADDR] = normalize_field(rule.src_addr);
+	form.header[FORM_SRC_PORT] = normalize_field(rule.src_port);
+	form.header[FORM_DST_ADDR] = normalize_field(rule.dst_addr);
+	form.header[FORM_DST_PORT] = normalize_field(rule.dst_port);
+	form.constraints.clear();
+	form.fast.clear();
+	form.stateful = false;
+
+	if (rule.direction == "<>" && make_pair(form.header[FORM_SRC_ADDR], form.header[FORM_SRC_PORT]) >
+		make_pair(form.header[FORM_DST_ADDR], form.header[FORM_DST_PORT])) {
+		swap(form.header[FORM_SRC_ADDR], form.header[FORM_DST_ADDR]);
+		swap(form.header[FORM_SRC_PORT], form.header[FORM_DST_PORT]);
+	}
+
+	collect_contents(rule, contents);
+	fast = select_fast_pattern(contents);
+	fast_option = fast ? fast->option : SIZE_MAX;
+
+	auto contents_it = contents.begin();
+	bool is_fast = false;
+
+	auto flush = [&]() {
+		if (head.empty()) {
+			return;
+		}
+
+		string text = string(sticky) + '\0' + head;
+
+		if (content) {
+			string bytes = content->bytes;
+
+			if (content->nocase) {
+				boost::to_lower(bytes);
+			}
+
+			text += '\0';
+			text += content->negated ? "!" : "";
+			text += bytes;
+		}
+
+		sort(modifiers.begin(), modifiers.end());
+
+		for (const string &modifier : modifiers) {
+			text += '\0' + modifier;
+		}
+
+		if (relative) {
+			text = previous + '\1' + text;
+		}
+
+		if (is_fast) {
+			form.fast = text;
+		}
+
+		form.constraints.push_back(text);
+		previous = move(text);
+		head.clear();
+		modifiers.clear();
+		content = nullptr;
+		relative = false;
+		is_fast = false;
+	};
+
+	for (size_t i = 0; i < rule.options.size(); i++) {
+		const type_parsed_option &opt = rule.options[i];
+
+		if (is_one_of(opt.id, ignored_options)) {
+			continue;
+		}
+
+		if (is_one_of(opt.id, chain_options)) {
+			flush();
+
+			if (opt.id == OPTION_CONTENT || opt.id == OPTION_URICONTENT) {
+				while (contents_it != contents.end() && contents_it->option < i) {
+					++contents_it;
+				}
+
+				// Contents that don't decode have no form of their own.
+				if (contents_it != contents.end() && contents_it->option == i) {
+					content = &*contents_it;
+				}
+
+				head = "content";
+				is_fast = (i == fast_option);
+
+				if (opt.id == OPTION_URICONTENT) {
+					modifiers.push_back("http_uri");
+				}
+
+				string_view pattern, inline_modifiers;
+
+				// Snort 3 modifiers, as if they were options.
+				if (parse_content(opt.arg, pattern, inline_modifiers)) {
+					while (!inline_modifiers.empty()) {
+						string_view value = trim(next_token(inline_modifiers, ","));
+						string_view name = next_token(value, " \t");
+						int id = find_option(name);
+
+						if (id != OPTION_FAST_PATTERN) {
+							modifiers.push_back(string(name) + (trim(value).empty() ? string() : ':' + string(trim(value))));
+							relative = relative || id == OPTION_DISTANCE || id == OPTION_WITHIN;
+						}
+					}
+				}
+			} else {
+				// Commas in a regular expression are not separators.
+				head = string(opt.name) + ':' + (opt.id == OPTION_PCRE ? string(trim(opt.arg)) : normalize_arg(opt));
+				relative = is_relative(opt);
+			}
+
+			continue;
+		}
+
+		if (is_one_of(opt.id, sticky_options) || opt.buffer == BUFFER_STICKY) {
+			flush();
+			sticky = opt.name;
+			continue;
+		}
+
+		if ((is_one_of(opt.id, modifier_options) || opt.buffer == BUFFER_MODIFIER) && !head.empty()) {
+			modifiers.push_back(string(opt.name) + (opt.has_arg ? ':' + normalize_arg(opt) : string()));
+			relative = relative || opt.id == OPTION_DISTANCE || opt.id == OPTION_WITHIN;
+			continue;
+		}
+
+		form.stateful = form.stateful || changes_state(opt);
+		form.constraints.push_back(string(opt.name) + (opt.has_arg ? ':' + normalize_arg(opt) : string()));
+	}
+
+	flush();
+	sort(form.constraints.begin(), form.constraints.end());
+	form.constraints.erase(unique(form.constraints.begin(), form.constraints.end()), form.constraints.end());
+}
+
+static uint64_t field_hash(const string &field)
+{
+	return (field == "any") ? 0 : hash_string(field);
+}
+
+void duplicate_index::add(size_t line, uint32_t sid, const type_parsed_rule &rule)
+{
+	type_canonical_rule form;
+	type_form_entry entry;
+
+	canonical_form(rule, form);
+
+	entry.line = line;
+	entry.sid = sid;
+	entry.kind = hash_string(form.header[FORM_ACTION] + ' ' + form.header[FORM_PROTO] + ' ' +
+		form.header[FORM_DIRECTION]);
+	entry.fields[0] = field_hash(form.header[FORM_SRC_ADDR]);
+	entry.fields[1] = field_hash(form.header[FORM_SRC_PORT]);
+	entry.fields[2] = field_hash(form.header[FORM_DST_ADDR]);
+	entry.fields[3] = field_hash(form.header[FORM_DST_PORT]);
+	entry.first = constraints.size();
+	entry.count = form.constraints.size();
+	entry.signature = 0;
+	entry.stateful = form.stateful;
+
+	uint64_t key = hash_mix(FORM_KEY_SEED);
+
+	entry.check = hash_mix(FORM_CHECK_SEED);
+
+	for (const string &field : form.header) {
+		key = hash_step(key, hash_string(field, FORM_KEY_SEED));
+		entry.check = hash_step(entry.check, hash_string(field, FORM_CHECK_SEED));
+	}
+
+	for (const string &constraint : form.constraints) {
+		constraints.push_back(hash_string(constraint));
+		entry.signature |= 1ULL << (constraints.back() & 63);
+		key = hash_step(key, hash_string(constraint, FORM_KEY_SEED));
+		entry.check = hash_step(entry.check, hash_string(constraint, FORM_CHECK_SEED));
+	}
+
+	auto it = forms.emplace(key, entries.size());
+
+	if (!it.second && entries[it.first->second].check == entry.check) {
+		// Only the first of the duplicates takes part in subsumption.
+		constraints.resize(entry.first);
+		add_finding(DIAG_DUPLICATE_RULE, entry, entries[it.first->second]);
+		duplicates_count++;
+		return;
+	}
+
+	sort(constraints.begin() + entry.first, constraints.end());
+
+	if (!form.fast.empty()) {
+		by_fast[hash_step(entry.kind, hash_string(form.fast))].push_back(entries.size());
+	}
+
+	entries.push_back(entry);
+}
+
+bool duplicate_index::covers(const type_form_entry &a, const type_form_entry &b) const
+{
+	if (a.kind != b.kind || a.count > b.count || (a.signature & ~b.signature)) {
+		return false;
+	}
+
+	for (size_t i = 0; i < 4; i++) {
+		if (a.fields[i] != 0 && a.fields[i] != b.fields[i]) {
+			return false;
+		}
+	}
+
+	return includes(constraints.begin() + b.first, constraints.begin() + b.first + b.count,
+		constraints.begin() + a.first, constraints.begin() + a.first + a.count);
+}
+
+void duplicate_index::add_finding(type_diag_code code, const type_form_entry &rule,
+	const type_form_entry &other)
+{
+	findings.push_back(type_corpus_finding());
+	findings.back().line = rule.line;
+	findings.back().sid = rule.sid;
+	findings.back().diag.code = code;
+	findings.back().diag.column = 0;
+	findings.back().diag.detail = describe_input_line(other.line) + " (sid " + to_string(other.sid) + ")";
+}
+
+vector<type_corpus_finding> duplicate_index::finish()
+{
+	for (uint32_t b = 0; b < entries.size(); b++) {
+		const type_form_entry &rule = entries[b];
+		const type_form_entry *by = nullptr;
+
+		// Dropping it would change the flow state other rules see.
+		if (rule.stateful) {
+			continue;
+		}
+
+		for (uint32_t i = rule.first; i < rule.first + rule.count; i++) {
+			auto it = by_fast.find(hash_step(rule.kind, constraints[i]));
+
+			if (it == by_fast.end()) {
+				continue;
+			}
+
+			for (uint32_t a : it->second) {
+				if (a == b || (by && entries[a].line > by->line)) {
+					continue;
+				}
+
+				comparisons_count++;
+
+				if (covers(entries[a], rule)) {
+					by = &entries[a];
+				}
+			}
+		}
+
+		if (by) {
+			add_finding(DIAG_SUBSUMED_RULE, rule, *by);
+			subsumed_count++;
+		}
+	}
+
+	stable_sort(findings.begin(), findings.end(),
+		[](const type_corpus_finding &a, const type_corpus_finding &b) { return a.line < b.line; });
+
+	return findings;
+}
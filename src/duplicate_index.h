@@ -0,0 +1,110 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "corpus_checker.h"
+#include "rule_checker.h"
+
+// Rules that add nothing to a rule set: exact duplicates of another rule
+// (whatever their sid, msg or option order) and rules subsumed by another
+// one, i.e. matching a subset of the traffic it matches.
+
+// Header fields of a canonical form.
+#define FORM_ACTION		0
+#define FORM_PROTO		1
+#define FORM_DIRECTION		2
+#define FORM_SRC_ADDR		3
+#define FORM_SRC_PORT		4
+#define FORM_DST_ADDR		5
+#define FORM_DST_PORT		6
+#define FORM_HEADER_FIELDS	7
+
+// Canonical form of a rule: what it matches, not how it is written.
+//
+// - Header fields lower case 'any', without spaces, list items sorted;
+//   the two sides of a '<>' rule in a fixed order.
+// - Metadata (msg, sid, rev, classtype, reference, ...) and fast_pattern
+//   left out.
+// - Each content, pcre, byte_test, byte_jump and isdataat with its
+//   modifiers is one constraint: decoded bytes (folded if nocase),
+//   modifiers sorted, uricontent as content plus http_uri, and the
+//   sticky buffer (file_data) in effect. A relative one also includes the
+//   constraint it is relative to, so its position is kept.
+// - Any other option is a constraint of its own, order doesn't matter.
+typedef struct canonical_rule
+{
+	std::string header[FORM_HEADER_FIELDS];
+	// Sorted, no duplicates.
+	std::vector<std::string> constraints;
+	// Constraint of the fast pattern content, empty if none.
+	std::string fast;
+	// Sets flowbits, xbits or a flowint, or has noalert: the rule does
+	// more than match.
+	bool stateful;
+} type_canonical_rule;
+
+void canonical_form(const type_parsed_rule &rule, type_canonical_rule &form);
+
+// Exact duplicates are found by hashing the canonical forms as rules are
+// added. Rule A subsumes rule B if they have the same action, protocol
+// and direction, each address and port of A is 'any' or the same as B's,
+// and every constraint of A is also one of B. B then contains A's fast
+// pattern constraint, so rules are indexed by it and only rules sharing
+// one of B's constraints are compared with B. Rules without a content are
+// not considered as subsuming others, stateful rules as subsumed.
+class duplicate_index
+{
+public:
+	void add(size_t line, uint32_t sid, const type_parsed_rule &rule);
+	// Sorted by line.
+	std::vector<type_corpus_finding> finish();
+
+	// Valid after finish().
+	size_t duplicates() const
+	{
+		return duplicates_count;
+	}
+
+	size_t subsumed() const
+	{
+		return subsumed_count;
+	}
+
+	// Rule pairs compared for subsumption.
+	size_t comparisons() const
+	{
+		return comparisons_count;
+	}
+
+private:
+	// Constraints and fields as hashes; a field hashes to 0 if 'any'.
+	typedef struct form_entry
+	{
+		size_t line;
+		uint32_t sid;
+		uint64_t kind;
+		uint64_t fields[4];
+		// Second hash of the whole form, to tell collisions apart.
+		uint64_t check;
+		// One bit per constraint, to rule out most pairs cheaply.
+		uint64_t signature;
+		// Range in 'constraints', sorted.
+		uint32_t first;
+		uint32_t count;
+		bool stateful;
+	} type_form_entry;
+
+	bool covers(const type_form_entry &a, const type_form_entry &b) const;
+	void add_finding(type_diag_code code, const type_form_entry &rule, const type_form_entry &other);
+
+	std::unordered_map<uint64_t, uint32_t> forms;
+	std::vector<type_form_entry> entries;
+	std::vector<uint64_t> constraints;
+	// Rules by kind and fast pattern constraint.
+	std::unordered_map<uint64_t, std::vector<uint32_t>> by_fast;
+	std::vector<type_corpus_finding> findings;
+	size_t duplicates_count = 0;
+	size_t subsumed_count = 0;
+	size_t comparisons_count = 0;
+};
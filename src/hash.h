@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// Fast non-cryptographic 64-bit hash, eight bytes per step. Good
+// enough to key caches and hash tables, not to resist attackers.
+
+#define HASH_MULTIPLIER		0x9e3779b97f4a7c15ULL
+
+inline uint64_t hash_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+
+	return h;
+}
+
+inline uint64_t hash_step(uint64_t h, uint64_t v)
+{
+	h ^= hash_mix(v);
+	h = (h << 27) | (h >> 37);
+
+	return h * HASH_MULTIPLIER;
+}
+
+inline uint64_t hash_bytes(const void *data, size_t length, uint64_t seed = 0)
+{
+	const unsigned char *p = static_cast<const unsigned char *>(data);
+	uint64_t h = seed ^ (length * HASH_MULTIPLIER);
+	uint64_t v;
+
+	for (; length >= sizeof(v); length -= sizeof(v), p += sizeof(v)) {
+		memcpy(&v, p, sizeof(v));
+		h = hash_step(h, v);
+	}
+
+	if (length) {
+		v = 0;
+		memcpy(&v, p, length);
+		h = hash_step(h, v);
+	}
+
+	return hash_mix(h);
+}
+
+inline uint64_t hash_string(std::string_view s, uint64_t seed = 0)
+{
+	return hash_bytes(s.data(), s.length(), seed);
+}
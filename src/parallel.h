@@ -0,0 +1,58 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Run func(begin, end) over [0, count) on 'jobs' threads, the calling
+// thread included. Work is handed out in chunks of 'grain' items from a
+// shared counter, so threads that finish early pick up the remaining
+// chunks. func must not touch shared mutable state.
+template <typename Func>
+void parallel_for(size_t count, unsigned jobs, size_t grain, Func func)
+{
+	if (jobs <= 1 || count <= grain) {
+		if (count) {
+			func(0, count);
+		}
+
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+
+	auto worker = [&]() {
+		for (;;) {
+			size_t begin = next.fetch_add(grain);
+
+			if (begin >= count) {
+				break;
+			}
+
+			func(begin, std::min(begin + grain, count));
+		}
+	};
+
+	std::vector<std::thread> threads;
+	size_t chunks = (count + grain - 1) / grain;
+
+	for (unsigned i = 1; i < jobs && i < chunks; i++) {
+		threads.emplace_back(worker);
+	}
+
+	worker();
+
+	for (std::thread &t : threads) {
+		t.join();
+	}
+}
+
+// Number of worker threads for a '--jobs' value, 0 meaning all cores.
+inline unsigned effective_jobs(unsigned jobs)
+{
+	if (jobs == 0) {
+		jobs = std::thread::hardware_concurrency();
+	}
+
+	return std::max(jobs, 1u);
+}
@@ -0,0 +1,152 @@
+#include <regex>
+#include <string>
+#include <string_view>
+#include "arg_parsers.h"
+#include "parser_check.h"
+#include "rule_generator.h"
+
+using namespace std;
+
+// Mismatches printed per keyword.
+#define SHOWN_MISMATCHES	5
+// One argument in this many gets a stray character inserted or a
+// character removed.
+#define MUTATION_RATE		4
+
+typedef bool (*parse_func)(string_view arg);
+
+typedef struct parser_case
+{
+	const char *keyword;
+	// The validator pattern of the keyword before arg_parsers.cpp.
+	const char *expr;
+	parse_func parse;
+	// Tokens arguments are made of, and how many at most.
+	const char *tokens[24];
+	size_t max_tokens;
+} type_parser_case;
+
+static const type_parser_case cases[] = {
+	{ "byte_test",
+		"^\\s*"
+		"([^\\s,]+)"
+		"\\s*,\\s*(\\!?)\\s*([^\\s,]*)"
+		"\\s*,\\s*([^\\s,]+)"
+		"\\s*,\\s*([^\\s,]+)"
+		"(?:\\s*,\\s*([^\\s,]+))?"
+		"(?:\\s*,\\s*([^\\s,]+))?"
+		"(?:\\s*,\\s*([^\\s,]+))?"
+		"(?:\\s*,\\s*([^\\s,]+))?"
+		"(?:\\s*,\\s*([^\\s,]+))?"
+		"\\s*$",
+		[](string_view arg) { type_byte_test_args args; return parse_byte_test(arg, args); },
+		{ "1", "4", "0", "-3", "!", "<", ">", "=", "!=", "&", "^", "<=", "0x0F", "relative", "big",
+		  "little", "string", "hex", "dec", "oct", "dce", "var", "", nullptr }, 11 },
+	{ "byte_jump",
+		"^\\s*"
+		"([^\\s,]+\\s*,\\s*[^\\s,]+)"
+		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
+		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
+		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
+		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
+		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
+		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
+		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
+		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
+		"(?:\\s*,\\s*((?:multiplier|post_offset)\\s+[^\\s,]+|[^\\s,]+))?"
+		"\\s*$",
+		[](string_view arg) { type_byte_jump_args args; return parse_byte_jump(arg, args); },
+		{ "4", "12", "0", "-2", "relative", "multiplier 2", "multiplier", "post_offset -1",
+		  "post_offset  4", "big", "little", "string", "dec", "align", "from_beginning", "from_end",
+		  "dce", "", nullptr }, 12 },
+	{ "flow",
+		"^\\s*([\\w_]+)\\s*(?:,\\s*([\\w_]+))?\\s*(?:,\\s*([\\w_]+))?\\s*$",
+		[](string_view arg) { type_flow_args args; return parse_flow(arg, args); },
+		{ "established", "to_server", "to_client", "from_server", "from_client", "stateless",
+		  "no_stream", "only_stream", "not_established", "x-y", "a b", "", nullptr }, 4 },
+	{ "flags",
+		"^\\s*(?:([\\+\\*!]))?\\s*([SAPRFU120CE\\+\\*!]+)(?:\\s*,\\s*([SAPRFU12CE]+))?\\s*$",
+		[](string_view arg) { type_flags_args args; return parse_flags(arg, args); },
+		{ "S", "SA", "A+", "!R", "*", "+", "12", "0", "CE", "F", "P", "U", "x", "", nullptr }, 3 },
+	{ "threshold",
+		"^\\s*(track|type|count|seconds)\\s+(limit|both|threshold|by_dst|by_src|\\d+)\\s*,\\s*"
+		"(track|type|count|seconds)\\s+(limit|both|threshold|by_dst|by_src|\\d+)\\s*,\\s*"
+		"(track|type|count|seconds)\\s+(limit|both|threshold|by_dst|by_src|\\d+)\\s*,\\s*"
+		"(track|type|count|seconds)\\s+(limit|both|threshold|by_dst|by_src|\\d+)\\s*",
+		[](string_view arg) { type_threshold_args args; return parse_threshold(arg, args); },
+		{ "type limit", "type both", "type threshold", "track by_src", "track by_dst", "count 10",
+		  "seconds 60", "count", "seconds  1", "type", "track by_any", "", nullptr }, 4 },
+	{ "dsize",
+		"^\\s*(<|>)?\\s*(\\d{1,5})\\s*(?:(<>)\\s*(\\d{1,5}))?\\s*$",
+		[](string_view arg) { type_dsize_args args; return parse_dsize(arg, args); },
+		{ "<", ">", "<>", "0", "100", "65535", "99999", "123456", "x", "", nullptr }, 4 },
+};
+
+static const char *separators[] = { ",", ", ", " ,", " , ", " ", "\t,", ",,", "" };
+static const char *padding[] = { "", "", " ", "\t", "  " };
+static const char strays[] = " ,!<>=-+*0aS\t\r";
+
+static void random_argument(const type_parser_case &c, random_source &rng, string &arg)
+{
+	size_t tokens = 0;
+	size_t n = 1 + rng.below(c.max_tokens);
+
+	while (c.tokens[tokens] != nullptr) {
+		tokens++;
+	}
+
+	arg = rng.pick(padding);
+
+	for (size_t i = 0; i < n; i++) {
+		if (i) {
+			// Mostly well formed lists.
+			arg += rng.below(2) ? string(",") : string(rng.pick(separators));
+		}
+
+		arg += c.tokens[rng.below(tokens)];
+	}
+
+	arg += rng.pick(padding);
+
+	if (!arg.empty() && rng.below(MUTATION_RATE) == 0) {
+		size_t pos = rng.below(arg.length());
+
+		if (rng.below(2)) {
+			arg.insert(pos, 1, strays[rng.below(sizeof(strays) - 1)]);
+		} else {
+			arg.erase(pos, 1);
+		}
+	}
+}
+
+size_t check_parsers(size_t count, uint64_t seed, FILE *out)
+{
+	random_source rng(seed);
+	size_t total = 0;
+	string arg;
+
+	for (const type_parser_case &c : cases) {
+		regex expr(c.expr);
+		size_t mismatches = 0;
+
+		for (size_t i = 0; i < count; i++) {
+			random_argument(c, rng, arg);
+
+			bool expected = regex_match(arg, expr);
+
+			if (c.parse(arg) == expected) {
+				continue;
+			}
+
+			if (++mismatches <= SHOWN_MISMATCHES) {
+				fprintf(out, "%s: '%s' is %s by the regex only\n", c.keyword, arg.c_str(),
+					expected ? "accepted" : "rejected");
+			}
+		}
+
+		fprintf(out, "%s: %zu arguments, %zu mismatches\n", c.keyword, count, mismatches);
+		total += mismatches;
+	}
+
+	return total;
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+
+// Differential check of the regex-free argument parsers (arg_parsers.h)
+// against the validator regexes they replaced: 'count' random arguments
+// per keyword, built from the keyword's own tokens, separators and a few
+// stray characters, must be accepted or rejected by both alike. The
+// first mismatches are printed to 'out'. Returns the number of
+// mismatches. The arguments depend on 'seed' only.
+size_t check_parsers(size_t count, uint64_t seed, FILE *out);
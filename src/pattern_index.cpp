@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include "content.h"
+#include "pattern_index.h"
+
+using namespace std;
+
+#define AC_ROOT		0
+
+// Printable bytes as they are, the rest as Snort style |hex|.
+static string format_pattern(const string &bytes)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	string res = "\"";
+	bool in_hex = false;
+
+	for (unsigned char c : bytes) {
+		bool printable = isprint(c) && c != '|' && c != '"' && c != '\\';
+
+		if (printable == in_hex) {
+			res += '|';
+			in_hex = !in_hex;
+		} else if (in_hex) {
+			res += ' ';
+		}
+
+		if (printable) {
+			res += c;
+		} else {
+			res += hex[c >> 4];
+			res += hex[c & 15];
+		}
+	}
+
+	return res + (in_hex ? "|\"" : "\"");
+}
+
+pattern_index::pattern_index(size_t shared)
+	: shared(shared), rules_count(0)
+{
+}
+
+void pattern_index::add(size_t line, uint32_t sid, const type_parsed_rule &rule)
+{
+	vector<type_content_match> contents;
+
+	collect_contents(rule, contents);
+
+	const type_content_match *fast = select_fast_pattern(contents);
+
+	if (!fast || fast->bytes.empty()) {
+		return;
+	}
+
+	string bytes = fast->bytes;
+
+	if (fast->nocase) {
+		transform(bytes.begin(), bytes.end(), bytes.begin(),
+			[](unsigned char c) { return tolower(c); });
+	}
+
+	string key = string(fast->buffer) + '\0' + (fast->nocase ? 'i' : 'c') + bytes;
+	auto it = ids.emplace(move(key), infos.size());
+
+	if (it.second) {
+		infos.push_back({ move(bytes), string(fast->buffer), fast->nocase, 0, line, sid, -1 });
+	}
+
+	infos[it.first->second].count++;
+	rules_count++;
+}
+
+int32_t pattern_index::child(int32_t node, uint8_t byte) const
+{
+	for (int32_t c = nodes[node].first_child; c != -1; c = nodes[c].next_sibling) {
+		if (nodes[c].byte == byte) {
+			return c;
+		}
+
+		if (nodes[c].byte > byte) {
+			break;
+		}
+	}
+
+	return -1;
+}
+
+int32_t pattern_index::add_child(int32_t node, uint8_t byte)
+{
+	int32_t id = nodes.size();
+	int32_t *link = &nodes[node].first_child;
+
+	while (*link != -1 && nodes[*link].byte < byte) {
+		link = &nodes[*link].next_sibling;
+	}
+
+	int32_t next = *link;
+
+	// push_back may move the nodes, 'link' is not used after it.
+	*link = id;
+	nodes.push_back({ -1, next, AC_ROOT, -1, -1, byte });
+
+	return id;
+}
+
+void pattern_index::build()
+{
+	nodes.clear();
+	nodes.push_back({ -1, -1, -1, -1, -1, 0 });
+
+	for (size_t i = 0; i < infos.size(); i++) {
+		int32_t node = AC_ROOT;
+
+		for (unsigned char c : infos[i].bytes) {
+			int32_t next = child(node, c);
+
+			node = (next != -1) ? next : add_child(node, c);
+		}
+
+		infos[i].next = nodes[node].pattern;
+		nodes[node].pattern = i;
+	}
+
+	// Breadth first, so fail targets are finished before they are used.
+	deque<int32_t> queue;
+
+	for (int32_t c = nodes[AC_ROOT].first_child; c != -1; c = nodes[c].next_sibling) {
+		queue.push_back(c);
+	}
+
+	while (!queue.empty()) {
+		int32_t node = queue.front();
+
+		queue.pop_front();
+
+		for (int32_t c = nodes[node].first_child; c != -1; c = nodes[c].next_sibling) {
+			int32_t f = nodes[node].fail;
+			int32_t target = -1;
+
+			while (f != -1 && (target = child(f, nodes[c].byte)) == -1) {
+				f = nodes[f].fail;
+			}
+
+			nodes[c].fail = (target != -1) ? target : AC_ROOT;
+
+			int32_t fail = nodes[c].fail;
+
+			nodes[c].output = (nodes[fail].pattern != -1) ? fail : nodes[fail].output;
+			queue.push_back(c);
+		}
+	}
+}
+
+size_t pattern_index::memory() const
+{
+	return nodes.size() * sizeof(type_ac_node);
+}
+
+size_t pattern_index::dfa_memory() const
+{
+	return nodes.size() * 256 * sizeof(int32_t);
+}
+
+string pattern_index::describe(const type_pattern_info &info) const
+{
+	string res = format_pattern(info.bytes);
+
+	if (info.nocase) {
+		res += " nocase";
+	}
+
+	if (!info.buffer.empty()) {
+		res += " in " + info.buffer;
+	}
+
+	return res;
+}
+
+vector<type_corpus_finding> pattern_index::finish()
+{
+	vector<type_corpus_finding> findings;
+
+	auto add_finding = [&](type_diag_code code, const type_pattern_info &info, string detail) {
+		findings.push_back(type_corpus_finding());
+		findings.back().line = info.first_line;
+		findings.back().sid = info.first_sid;
+		findings.back().diag.code = code;
+		findings.back().diag.option = "content";
+		findings.back().diag.column = 0;
+		findings.back().diag.detail = move(detail);
+	};
+
+	build();
+
+	auto rules = [](size_t count) {
+		return to_string(count) + (count == 1 ? " rule" : " rules");
+	};
+
+	for (const type_pattern_info &info : infos) {
+		if (info.count >= shared) {
+			add_finding(DIAG_SHARED_FAST_PATTERN, info, describe(info) + " (" + rules(info.count) + ")");
+		}
+
+		if (info.bytes.length() < FAST_PATTERN_SHORT_LEN) {
+			add_finding(DIAG_SHORT_FAST_PATTERN, info, describe(info) + " (" + rules(info.count) + ") is only " +
+				to_string(info.bytes.length()) + " bytes long");
+		}
+	}
+
+	// Patterns found inside the common ones, reported once each, against
+	// the most common container.
+	vector<int64_t> container(infos.size(), -1);
+
+	for (size_t q = 0; q < infos.size(); q++) {
+		const type_pattern_info &common = infos[q];
+
+		if (common.count < shared) {
+			continue;
+		}
+
+		string folded = common.bytes;
+
+		transform(folded.begin(), folded.end(), folded.begin(),
+			[](unsigned char c) { return tolower(c); });
+
+		// Case sensitive patterns must match the bytes as they are, nocase
+		// ones any case of them.
+		for (int pass = 0; pass < 2; pass++) {
+			const string &text = pass ? folded : common.bytes;
+			int32_t state = AC_ROOT;
+
+			for (unsigned char c : text) {
+				int32_t next;
+
+				while ((next = child(state, c)) == -1 && state != AC_ROOT) {
+					state = nodes[state].fail;
+				}
+
+				state = (next != -1) ? next : AC_ROOT;
+
+				for (int32_t n = (nodes[state].pattern != -1) ? state : nodes[state].output; n != -1;
+					n = nodes[n].output) {
+					for (int32_t p = nodes[n].pattern; p != -1; p = infos[p].next) {
+						if (size_t(p) == q || infos[p].nocase != (pass == 1) ||
+							infos[p].buffer != common.buffer) {
+							continue;
+						}
+
+						if (container[p] == -1 || infos[container[p]].count < common.count) {
+							container[p] = q;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	for (size_t p = 0; p < infos.size(); p++) {
+		if (container[p] == -1) {
+			continue;
+		}
+
+		const type_pattern_info &common = infos[container[p]];
+
+		add_finding(DIAG_FAST_PATTERN_SUBSTRING, infos[p], describe(infos[p]) + " (" +
+			rules(infos[p].count) + ") occurs in " + describe(common) + " (" +
+			rules(common.count) + ", " + describe_input_line(common.first_line) + ")");
+	}
+
+	stable_sort(findings.begin(), findings.end(),
+		[](const type_corpus_finding &a, const type_corpus_finding &b) { return a.line < b.line; });
+
+	return findings;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "corpus_checker.h"
+#include "rule_checker.h"
+
+// Corpus-wide index of effective fast patterns (see select_fast_pattern).
+// Patterns are keyed by inspected buffer, case handling and decoded
+// bytes; nocase patterns are folded to lower case. Distinct patterns go
+// into an Aho-Corasick automaton, the structure the engines' multi
+// pattern matchers are built on, which finds the patterns contained in
+// the most common ones and gives an estimate of the matcher's size.
+//
+// Reported:
+// - patterns used as fast pattern by at least 'shared' rules;
+// - patterns shorter than FAST_PATTERN_SHORT_LEN bytes;
+// - patterns occurring inside a pattern shared by at least 'shared'
+//   rules, so their rules are evaluated on every match of it.
+
+#define FAST_PATTERN_SHORT_LEN	4
+
+class pattern_index
+{
+public:
+	explicit pattern_index(size_t shared);
+
+	void add(size_t line, uint32_t sid, const type_parsed_rule &rule);
+	// Findings sorted by line.
+	std::vector<type_corpus_finding> finish();
+
+	// Valid after finish().
+	size_t rules() const
+	{
+		return rules_count;
+	}
+
+	size_t patterns() const
+	{
+		return infos.size();
+	}
+
+	size_t states() const
+	{
+		return nodes.size();
+	}
+
+	// Bytes of the automaton as built here (sparse transitions).
+	size_t memory() const;
+	// Bytes of the same automaton as a full 256-way transition table.
+	size_t dfa_memory() const;
+
+private:
+	typedef struct pattern_info
+	{
+		std::string bytes;
+		std::string buffer;
+		bool nocase;
+		size_t count;
+		size_t first_line;
+		uint32_t first_sid;
+		// Next pattern with the same bytes (in another buffer or with
+		// other case handling), ending at the same node, or -1.
+		int32_t next;
+	} type_pattern_info;
+
+	// Trie node; children are a sibling list sorted by byte.
+	typedef struct ac_node
+	{
+		int32_t first_child;
+		int32_t next_sibling;
+		int32_t fail;
+		// First pattern ending here (see pattern_info::next), or -1.
+		int32_t pattern;
+		// Nearest node on the fail chain that ends a pattern, or -1.
+		int32_t output;
+		uint8_t byte;
+	} type_ac_node;
+
+	int32_t child(int32_t node, uint8_t byte) const;
+	int32_t add_child(int32_t node, uint8_t byte);
+	void build();
+	std::string describe(const type_pattern_info &info) const;
+
+	size_t shared;
+	size_t rules_count;
+	std::unordered_map<std::string, size_t> ids;
+	std::vector<type_pattern_info> infos;
+	std::vector<type_ac_node> nodes;
+};
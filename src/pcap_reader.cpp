@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pcap_reader.h"
+
+using namespace std;
+
+#define PCAP_MAGIC		0xa1b2c3d4
+#define PCAP_MAGIC_NS		0xa1b23c4d
+#define PCAP_MAGIC_SWAPPED	0xd4c3b2a1
+#define PCAP_MAGIC_NS_SWAPPED	0x4d3cb2a1
+#define PCAPNG_MAGIC		0x0a0d0d0a
+#define PCAP_HEADER_SIZE	24
+#define PCAP_RECORD_SIZE	16
+
+// Link types.
+#define LINK_NULL		0
+#define LINK_ETHERNET		1
+#define LINK_RAW_OLD		12
+#define LINK_RAW_OPENBSD	14
+#define LINK_RAW		101
+#define LINK_LOOP		108
+#define LINK_LINUX_SLL		113
+#define LINK_IPV4		228
+#define LINK_IPV6		229
+#define LINK_LINUX_SLL2		276
+
+#define ETHERTYPE_IPV4		0x0800
+#define ETHERTYPE_IPV6		0x86dd
+#define ETHERTYPE_VLAN		0x8100
+#define ETHERTYPE_QINQ		0x88a8
+#define ETHERTYPE_QINQ_OLD	0x9100
+#define ETHERNET_HEADER_SIZE	14
+#define VLAN_TAG_SIZE		4
+#define SLL_HEADER_SIZE		16
+#define SLL2_HEADER_SIZE	20
+#define LOOP_HEADER_SIZE	4
+
+#define IPV4_HEADER_SIZE	20
+#define IPV6_HEADER_SIZE	40
+#define TCP_HEADER_SIZE		20
+#define UDP_HEADER_SIZE		8
+#define ICMP_HEADER_SIZE	8
+
+// Mapped pages behind the reader are dropped in steps of this size.
+#define MAP_RELEASE_STEP	(64 << 20)
+
+static uint16_t be16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+pcap_reader::pcap_reader()
+	: fd(-1), map(nullptr), map_size(0), map_released(0), pos(0), swapped(false), link_type(0),
+	records_count(0)
+{
+}
+
+pcap_reader::~pcap_reader()
+{
+	if (map) {
+		munmap(const_cast<uint8_t *>(map), map_size);
+	}
+
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+uint32_t pcap_reader::u32(const uint8_t *p) const
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return swapped ? __builtin_bswap32(v) : v;
+}
+
+bool pcap_reader::open(const string &filename)
+{
+	struct stat st;
+
+	if ((fd = ::open(filename.c_str(), O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+		err = strerror(errno);
+		return false;
+	}
+
+	if (!S_ISREG(st.st_mode) || static_cast<size_t>(st.st_size) < PCAP_HEADER_SIZE) {
+		err = "not a pcap file";
+		return false;
+	}
+
+	void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if (addr == MAP_FAILED) {
+		err = strerror(errno);
+		return false;
+	}
+
+	map = static_cast<const uint8_t *>(addr);
+	map_size = st.st_size;
+	madvise(addr, map_size, MADV_SEQUENTIAL);
+
+	uint32_t magic;
+
+	memcpy(&magic, map, sizeof(magic));
+
+	if (magic == PCAPNG_MAGIC) {
+		err = "pcapng is not supported, convert the capture with 'editcap -F pcap'";
+		return false;
+	}
+
+	if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NS && magic != PCAP_MAGIC_SWAPPED &&
+		magic != PCAP_MAGIC_NS_SWAPPED) {
+		err = "not a pcap file";
+		return false;
+	}
+
+	swapped = (magic == PCAP_MAGIC_SWAPPED || magic == PCAP_MAGIC_NS_SWAPPED);
+	link_type = u32(map + 20) & 0xffff;
+
+	switch (link_type) {
+	case LINK_NULL:
+	case LINK_ETHERNET:
+	case LINK_RAW_OLD:
+	case LINK_RAW_OPENBSD:
+	case LINK_RAW:
+	case LINK_LOOP:
+	case LINK_LINUX_SLL:
+	case LINK_IPV4:
+	case LINK_IPV6:
+	case LINK_LINUX_SLL2:
+		break;
+	default:
+		err = "unsupported link type " + to_string(link_type);
+		return false;
+	}
+
+	pos = PCAP_HEADER_SIZE;
+
+	return true;
+}
+
+bool pcap_reader::next(type_packet &packet)
+{
+	while (pos + PCAP_RECORD_SIZE <= map_size) {
+		size_t len = u32(map + pos + 8);
+
+		if (len > map_size - pos - PCAP_RECORD_SIZE) {
+			return false;
+		}
+
+		const uint8_t *data = map + pos + PCAP_RECORD_SIZE;
+
+		pos += PCAP_RECORD_SIZE + len;
+		records_count++;
+
+		if (decode(data, len, packet)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void pcap_reader::release()
+{
+	if (pos - map_released >= MAP_RELEASE_STEP) {
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t end = pos / page * page;
+
+		madvise(const_cast<uint8_t *>(map) + map_released, end - map_released, MADV_DONTNEED);
+		map_released = end;
+	}
+}
+
+bool pcap_reader::decode(const uint8_t *data, size_t len, type_packet &packet) const
+{
+	size_t header;
+	uint16_t type;
+
+	switch (link_type) {
+	case LINK_ETHERNET:
+		header = ETHERNET_HEADER_SIZE;
+
+		if (len < header) {
+			return false;
+		}
+
+		type = be16(data + header - 2);
+
+		while ((type == ETHERTYPE_VLAN || type == ETHERTYPE_QINQ || type == ETHERTYPE_QINQ_OLD) &&
+			len >= header + VLAN_TAG_SIZE) {
+			header += VLAN_TAG_SIZE;
+			type = be16(data + header - 2);
+		}
+
+		break;
+	case LINK_LINUX_SLL:
+		header = SLL_HEADER_SIZE;
+		type = (len >= header) ? be16(data + 14) : 0;
+		break;
+	case LINK_LINUX_SLL2:
+		header = SLL2_HEADER_SIZE;
+		type = (len >= header) ? be16(data) : 0;
+		break;
+	case LINK_NULL:
+	case LINK_LOOP:
+		// The address family differs between systems for IPv6, the IP
+		// version tells.
+		return len > LOOP_HEADER_SIZE && decode_ip(data + LOOP_HEADER_SIZE, len - LOOP_HEADER_SIZE, packet);
+	default:
+		return decode_ip(data, len, packet);
+	}
+
+	if (type != ETHERTYPE_IPV4 && type != ETHERTYPE_IPV6) {
+		return false;
+	}
+
+	return len > header && decode_ip(data + header, len - header, packet);
+}
+
+bool pcap_reader::decode_ip(const uint8_t *data, size_t len, type_packet &packet) const
+{
+	size_t header;
+	size_t total;
+
+	if (len < 1) {
+		return false;
+	}
+
+	if ((data[0] >> 4) == 4) {
+		header = (data[0] & 0x0f) * 4;
+
+		// Not the first fragment.
+		if (len < IPV4_HEADER_SIZE || header < IPV4_HEADER_SIZE || (be16(data + 6) & 0x1fff)) {
+			return false;
+		}
+
+		total = be16(data + 2);
+		packet.ipv6 = false;
+		packet.proto = data[9];
+		memcpy(packet.src_addr, data + 12, 4);
+		memcpy(packet.dst_addr, data + 16, 4);
+	} else if ((data[0] >> 4) == 6) {
+		if (len < IPV6_HEADER_SIZE) {
+			return false;
+		}
+
+		total = IPV6_HEADER_SIZE + be16(data + 4);
+		header = IPV6_HEADER_SIZE;
+		packet.ipv6 = true;
+		packet.proto = data[6];
+		memcpy(packet.src_addr, data + 8, 16);
+		memcpy(packet.dst_addr, data + 24, 16);
+
+		for (;;) {
+			if (packet.proto == IPPROTO_HOPOPTS || packet.proto == IPPROTO_ROUTING ||
+				packet.proto == IPPROTO_DSTOPTS) {
+				if (len < header + 2) {
+					return false;
+				}
+
+				packet.proto = data[header];
+				header += (data[header + 1] + 1) * 8;
+			} else if (packet.proto == IPPROTO_FRAGMENT) {
+				if (len < header + 8 || (be16(data + header + 2) & 0xfff8)) {
+					return false;
+				}
+
+				packet.proto = data[header];
+				header += 8;
+			} else if (packet.proto == IPPROTO_AH) {
+				if (len < header + 2) {
+					return false;
+				}
+
+				packet.proto = data[header];
+				header += (data[header + 1] + 2) * 4;
+			} else {
+				break;
+			}
+		}
+	} else {
+		return false;
+	}
+
+	// Captures may be cut short (snaplen) or padded (Ethernet minimum).
+	// A total length of 0 is left by segmentation offload.
+	if (total) {
+		len = min(len, total);
+	}
+
+	if (header > len) {
+		return false;
+	}
+
+	packet.src_port = 0;
+	packet.dst_port = 0;
+	data += header;
+	len -= header;
+
+	switch (packet.proto) {
+	case IPPROTO_TCP:
+		header = (len >= TCP_HEADER_SIZE) ? (data[12] >> 4) * 4 : 0;
+
+		if (header < TCP_HEADER_SIZE || header > len) {
+			return false;
+		}
+
+		packet.src_port = be16(data);
+		packet.dst_port = be16(data + 2);
+		break;
+	case IPPROTO_UDP:
+		header = UDP_HEADER_SIZE;
+
+		if (len < header) {
+			return false;
+		}
+
+		packet.src_port = be16(data);
+		packet.dst_port = be16(data + 2);
+		break;
+	case IPPROTO_ICMP:
+	case IPPROTO_ICMPV6:
+		header = ICMP_HEADER_SIZE;
+
+		if (len < header) {
+			return false;
+		}
+
+		break;
+	default:
+		header = 0;
+	}
+
+	packet.payload = string_view(reinterpret_cast<const char *>(data + header), len - header);
+
+	return true;
+}
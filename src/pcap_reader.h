@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Reader of capture files in the classic pcap format (not pcapng), in
+// either byte order, with micro or nanosecond timestamps. The file is
+// memory mapped and packets are decoded down to their payload, without
+// reassembly or defragmentation:
+//
+// - links: Ethernet (VLAN tags skipped), Linux cooked v1 and v2, BSD
+//   loopback and raw IP;
+// - IPv4 and IPv6, extension headers skipped; fragments other than the
+//   first are skipped;
+// - TCP, UDP, ICMP and ICMPv6 payloads after their header, the IP
+//   payload for other protocols.
+typedef struct packet
+{
+	bool ipv6;
+	// IP protocol number.
+	uint8_t proto;
+	// 4 or 16 bytes, network byte order.
+	uint8_t src_addr[16];
+	uint8_t dst_addr[16];
+	// 0 for protocols without ports.
+	uint16_t src_port;
+	uint16_t dst_port;
+	// View into the capture.
+	std::string_view payload;
+} type_packet;
+
+class pcap_reader
+{
+public:
+	pcap_reader();
+	~pcap_reader();
+
+	pcap_reader(const pcap_reader &) = delete;
+	pcap_reader &operator=(const pcap_reader &) = delete;
+
+	// Map the file and check its header. On failure error() tells why.
+	bool open(const std::string &filename);
+	// Next packet with an IP payload; records that don't decode are
+	// skipped. false at the end of the capture or on a truncated record.
+	bool next(type_packet &packet);
+	// Packets returned so far are not used anymore.
+	void release();
+
+	const std::string &error() const
+	{
+		return err;
+	}
+
+	// Records read so far, decoded or not.
+	size_t records() const
+	{
+		return records_count;
+	}
+
+private:
+	uint32_t u32(const uint8_t *p) const;
+	bool decode(const uint8_t *data, size_t len, type_packet &packet) const;
+	bool decode_ip(const uint8_t *data, size_t len, type_packet &packet) const;
+
+	int fd;
+	const uint8_t *map;
+	size_t map_size;
+	size_t map_released;
+	size_t pos;
+	bool swapped;
+	uint32_t link_type;
+	size_t records_count;
+	std::string err;
+};
@@ -0,0 +1,1777 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include "pcre_parser.h"
+#include "string_utils.h"
+
+using namespace std;
+
+// Deepest group nesting accepted, as PCRE.
+#define RX_MAX_DEPTH		250
+// Largest {n,m} bound, as PCRE.
+#define RX_MAX_BOUND		65535
+// Widths above this count as unbounded.
+#define RX_MAX_WIDTH		(1L << 24)
+// Outer quantifiers with at least this many iterations are checked for
+// nested quantifiers.
+#define RX_HAZARD_REPEATS	10
+// Classes matching this many bytes or more count as '.'.
+#define RX_ANY_BYTES		255
+
+typedef struct modifier_flag
+{
+	char modifier;
+	unsigned flag;
+} type_modifier_flag;
+
+static const type_modifier_flag modifier_flags[] = {
+	{ 'i', PCRE_CASELESS },
+	{ 's', PCRE_DOTALL },
+	{ 'm', PCRE_MULTILINE },
+	{ 'x', PCRE_EXTENDED },
+	{ 'A', PCRE_ANCHORED },
+	{ 'E', PCRE_DOLLAR_ENDONLY },
+	{ 'G', PCRE_UNGREEDY },
+	{ 'R', PCRE_RELATIVE },
+	// Inspected buffer and match limits, no effect on the expression.
+	{ 'U', 0 }, { 'I', 0 }, { 'P', 0 }, { 'H', 0 }, { 'D', 0 }, { 'M', 0 },
+	{ 'C', 0 }, { 'K', 0 }, { 'S', 0 }, { 'Y', 0 }, { 'B', 0 }, { 'O', 0 },
+	// Suricata only.
+	{ 'Q', 0 }, { 'V', 0 }, { 'W', 0 }, { 'Z', 0 },
+	{ 0,   0 }
+};
+
+typedef struct posix_class
+{
+	const char *name;
+	int (*test)(int);
+} type_posix_class;
+
+static int is_ascii(int c)
+{
+	return c < 0x80;
+}
+
+static int is_word(int c)
+{
+	return isalnum(c) || c == '_';
+}
+
+static const type_posix_class posix_classes[] = {
+	{ "alnum",  isalnum },
+	{ "alpha",  isalpha },
+	{ "ascii",  is_ascii },
+	{ "blank",  isblank },
+	{ "cntrl",  iscntrl },
+	{ "digit",  isdigit },
+	{ "graph",  isgraph },
+	{ "lower",  islower },
+	{ "print",  isprint },
+	{ "punct",  ispunct },
+	{ "space",  isspace },
+	{ "upper",  isupper },
+	{ "word",   is_word },
+	{ "xdigit", isxdigit },
+	{ nullptr,  nullptr }
+};
+
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+
+	c = tolower(static_cast<unsigned char>(c));
+
+	return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+static type_byte_set test_set(int (*test)(int))
+{
+	type_byte_set set;
+
+	for (int c = 0; c < 256; c++) {
+		if (test(c)) {
+			set.set(c);
+		}
+	}
+
+	return set;
+}
+
+// \d \w \s \h \v
+static type_byte_set escape_set(char c)
+{
+	type_byte_set set;
+
+	switch (c) {
+	case 'd':
+		return test_set(isdigit);
+	case 'w':
+		return test_set(is_word);
+	case 's':
+		return test_set(isspace);
+	case 'h':
+		set.set('\t');
+		set.set(' ');
+		set.set(0xa0);
+		break;
+	case 'v':
+		for (int b = '\n'; b <= '\r'; b++) {
+			set.set(b);
+		}
+
+		set.set(0x85);
+		break;
+	}
+
+	return set;
+}
+
+// Add the other case of the letters in the set.
+static void fold_case(type_byte_set &set)
+{
+	for (int c = 'a'; c <= 'z'; c++) {
+		if (set[c] || set[toupper(c)]) {
+			set.set(c);
+			set.set(toupper(c));
+		}
+	}
+}
+
+static bool is_lookaround(int kind)
+{
+	return kind >= RX_LOOKAHEAD && kind <= RX_NEG_LOOKBEHIND;
+}
+
+bool pcre_expression::split(string_view arg)
+{
+	arg = trim(arg);
+	neg = !arg.empty() && arg[0] == '!';
+
+	if (neg) {
+		arg = trim(arg.substr(1));
+	}
+
+	if (arg.length() < 2 || arg.front() != '"' || arg.back() != '"') {
+		err = "expression must be enclosed in '\"'";
+		return false;
+	}
+
+	arg = arg.substr(1, arg.length() - 2);
+
+	char close;
+	size_t start;
+
+	if (!arg.empty() && arg[0] == '/') {
+		close = '/';
+		start = 1;
+	} else if (arg.length() > 1 && arg[0] == 'm' && !isalnum(static_cast<unsigned char>(arg[1])) &&
+		arg[1] != '\\' && !is_space(arg[1])) {
+		static const char pairs[] = "(){}[]<>";
+		const char *pair = strchr(pairs, arg[1]);
+
+		close = (pair && (pair - pairs) % 2 == 0) ? pair[1] : arg[1];
+		start = 2;
+	} else {
+		err = "expression must start with '/' or 'm<delimiter>'";
+		return false;
+	}
+
+	size_t end = arg.rfind(close);
+
+	if (end == string_view::npos || end < start) {
+		err = string("missing terminating '") + close + "' delimiter";
+		return false;
+	}
+
+	pat = arg.substr(start, end - start);
+	mods = arg.substr(end + 1);
+	pattern_flags = 0;
+
+	for (char c : mods) {
+		size_t i = 0;
+
+		while (modifier_flags[i].modifier != 0 && modifier_flags[i].modifier != c) {
+			i++;
+		}
+
+		if (modifier_flags[i].modifier == 0) {
+			err = string("unknown modifier '") + c + "'";
+			return false;
+		}
+
+		pattern_flags |= modifier_flags[i].flag;
+	}
+
+	return true;
+}
+
+bool pcre_expression::parse(string_view arg)
+{
+	err.clear();
+	tree.clear();
+	byte_sets.clear();
+	group_names.clear();
+	named_refs.clear();
+	numbered_refs.clear();
+	groups_count = 0;
+	top = -1;
+	quoting = false;
+	pos = 0;
+
+	if (!split(arg)) {
+		return false;
+	}
+
+	cur_flags = pattern_flags;
+	top = parse_alternation(0);
+
+	if (!err.empty()) {
+		return false;
+	}
+
+	if (pos < pat.length()) {
+		fail(pos, "unmatched closing parenthesis");
+		return false;
+	}
+
+	// Backreferences may point forward, check them once all groups are known.
+	for (const auto &ref : numbered_refs) {
+		if (ref.first > groups_count) {
+			fail(ref.second, "reference to non-existent subpattern");
+			return false;
+		}
+	}
+
+	for (const type_named_ref &ref : named_refs) {
+		if (find(group_names.begin(), group_names.end(), ref.name) == group_names.end()) {
+			fail(ref.offset, "reference to non-existent subpattern");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void pcre_expression::fail(size_t offset, const string &message)
+{
+	if (err.empty()) {
+		err = message + " at offset " + to_string(offset);
+	}
+}
+
+int pcre_expression::add_node(int type, size_t offset)
+{
+	tree.push_back({ type, 0, 0, 0, -1, -1, -1, static_cast<uint32_t>(offset),
+		static_cast<uint32_t>(pos - offset) });
+
+	return tree.size() - 1;
+}
+
+int pcre_expression::add_chars(const type_byte_set &set, size_t offset)
+{
+	int node = add_node(RX_CHARS, offset);
+
+	tree[node].set = byte_sets.size();
+	byte_sets.push_back(set);
+
+	return node;
+}
+
+int pcre_expression::add_char(unsigned char c, size_t offset)
+{
+	type_byte_set set;
+
+	set.set(c);
+
+	if (cur_flags & PCRE_CASELESS) {
+		fold_case(set);
+	}
+
+	return add_chars(set, offset);
+}
+
+void pcre_expression::set_children(int node, const vector<int> &children)
+{
+	for (size_t i = 0; i < children.size(); i++) {
+		if (i == 0) {
+			tree[node].first_child = children[i];
+		} else {
+			tree[children[i - 1]].next_sibling = children[i];
+		}
+	}
+}
+
+bool pcre_expression::at(size_t offset, char c) const
+{
+	return offset < pat.length() && pat[offset] == c;
+}
+
+// Whitespace and '#' comments are ignored with /x, outside classes.
+void pcre_expression::skip_extended()
+{
+	if (!(cur_flags & PCRE_EXTENDED) || quoting) {
+		return;
+	}
+
+	while (pos < pat.length()) {
+		if (is_space(pat[pos])) {
+			pos++;
+		} else if (pat[pos] == '#') {
+			while (pos < pat.length() && pat[pos] != '\n') {
+				pos++;
+			}
+		} else {
+			break;
+		}
+	}
+}
+
+int pcre_expression::parse_alternation(int depth)
+{
+	size_t start = pos;
+	vector<int> branches;
+
+	branches.push_back(parse_concat(depth));
+
+	while (err.empty() && at(pos, '|')) {
+		pos++;
+		branches.push_back(parse_concat(depth));
+	}
+
+	if (!err.empty()) {
+		return -1;
+	}
+
+	if (branches.size() == 1) {
+		return branches[0];
+	}
+
+	int node = add_node(RX_ALTERNATION, start);
+
+	set_children(node, branches);
+
+	return node;
+}
+
+int pcre_expression::parse_concat(int depth)
+{
+	size_t start = pos;
+	vector<int> items;
+
+	for (;;) {
+		skip_extended();
+
+		if (pos >= pat.length() || (!quoting && (pat[pos] == '|' || pat[pos] == ')'))) {
+			break;
+		}
+
+		int atom = parse_atom(depth);
+
+		if (!err.empty()) {
+			return -1;
+		}
+
+		// Inline flags, comments, \Q and \E.
+		if (atom == -1) {
+			continue;
+		}
+
+		atom = parse_quantifier(atom);
+
+		if (!err.empty()) {
+			return -1;
+		}
+
+		items.push_back(atom);
+	}
+
+	if (items.size() == 1) {
+		return items[0];
+	}
+
+	int node = add_node(items.empty() ? RX_EMPTY : RX_CONCAT, start);
+
+	set_children(node, items);
+
+	return node;
+}
+
+int pcre_expression::parse_atom(int depth)
+{
+	size_t start = pos;
+	unsigned char c = pat[pos];
+
+	if (quoting) {
+		if (c == '\\' && at(pos + 1, 'E')) {
+			quoting = false;
+			pos += 2;
+			return -1;
+		}
+
+		pos++;
+
+		// A quantifier right after \E applies to the last quoted byte.
+		if (at(pos, '\\') && at(pos + 1, 'E')) {
+			quoting = false;
+			pos += 2;
+		}
+
+		return add_char(c, start);
+	}
+
+	switch (c) {
+	case '(':
+		return parse_group(depth);
+	case '[':
+		return parse_class();
+	case '\\':
+		return parse_escape();
+	case '.': {
+		type_byte_set set;
+
+		set.set();
+
+		if (!(cur_flags & PCRE_DOTALL)) {
+			set.reset('\n');
+		}
+
+		pos++;
+
+		return add_chars(set, start);
+	}
+	case '^':
+	case '$': {
+		pos++;
+
+		int node = add_node(RX_ANCHOR, start);
+
+		if (c == '^') {
+			tree[node].kind = (cur_flags & PCRE_MULTILINE) ? RX_LINE_START : RX_START;
+		} else if (cur_flags & PCRE_MULTILINE) {
+			tree[node].kind = RX_LINE_END;
+		} else {
+			tree[node].kind = (cur_flags & PCRE_DOLLAR_ENDONLY) ? RX_END_ONLY : RX_END;
+		}
+
+		return node;
+	}
+	case '*':
+	case '+':
+	case '?':
+		fail(pos, "nothing to repeat");
+		return -1;
+	case '{': {
+		size_t end = pos;
+		int min, max;
+
+		if (parse_bounds(end, min, max)) {
+			fail(start, "nothing to repeat");
+			return -1;
+		}
+
+		// Not a quantifier, a literal '{'.
+		break;
+	}
+	}
+
+	pos++;
+
+	return add_char(c, start);
+}
+
+int pcre_expression::parse_quantifier(int atom)
+{
+	skip_extended();
+
+	if (quoting || pos >= pat.length()) {
+		return atom;
+	}
+
+	int min, max;
+
+	switch (pat[pos]) {
+	case '*':
+		min = 0;
+		max = RX_UNBOUNDED;
+		pos++;
+		break;
+	case '+':
+		min = 1;
+		max = RX_UNBOUNDED;
+		pos++;
+		break;
+	case '?':
+		min = 0;
+		max = 1;
+		pos++;
+		break;
+	case '{':
+		if (!parse_bounds(pos, min, max)) {
+			return atom;
+		}
+
+		if (!err.empty()) {
+			return -1;
+		}
+
+		break;
+	default:
+		return atom;
+	}
+
+	int kind = (cur_flags & PCRE_UNGREEDY) ? RX_LAZY : RX_GREEDY;
+
+	if (at(pos, '?')) {
+		kind = (kind == RX_LAZY) ? RX_GREEDY : RX_LAZY;
+		pos++;
+	} else if (at(pos, '+')) {
+		kind = RX_POSSESSIVE;
+		pos++;
+	}
+
+	if (at(pos, '*') || at(pos, '+') || at(pos, '?')) {
+		fail(pos, "nothing to repeat");
+		return -1;
+	}
+
+	int node = add_node(RX_REPEAT, tree[atom].offset);
+
+	tree[node].kind = kind;
+	tree[node].min = min;
+	tree[node].max = max;
+	tree[node].first_child = atom;
+
+	return node;
+}
+
+// {n}, {n,} or {n,m} at 'offset'. Returns false if the text is not a
+// quantifier (then it's literal), otherwise moves 'offset' past it.
+bool pcre_expression::parse_bounds(size_t &offset, int &min, int &max)
+{
+	size_t p = offset + 1;
+
+	auto number = [&](int &value) {
+		size_t first = p;
+		long v = 0;
+
+		while (p < pat.length() && isdigit(static_cast<unsigned char>(pat[p]))) {
+			v = std::min(v * 10 + (pat[p++] - '0'), long(RX_MAX_BOUND) + 1);
+		}
+
+		value = v;
+
+		return p > first;
+	};
+
+	if (!number(min)) {
+		return false;
+	}
+
+	max = min;
+
+	if (at(p, ',') && (p++, !number(max))) {
+		max = RX_UNBOUNDED;
+	}
+
+	if (!at(p, '}')) {
+		return false;
+	}
+
+	if (min > RX_MAX_BOUND || max > RX_MAX_BOUND) {
+		fail(offset, "number too big in {} quantifier");
+	} else if (max != RX_UNBOUNDED && max < min) {
+		fail(offset, "numbers out of order in {} quantifier");
+	}
+
+	offset = p + 1;
+
+	return true;
+}
+
+int pcre_expression::parse_group(int depth)
+{
+	size_t start = pos;
+	int kind = RX_CAPTURE;
+	string_view name;
+
+	if (depth >= RX_MAX_DEPTH) {
+		fail(start, "parentheses are too deeply nested");
+		return -1;
+	}
+
+	pos++;
+
+	// Verbs and start of pattern options: (*UTF8), (*SKIP), ...
+	if (at(pos, '*')) {
+		size_t close = pat.find(')', pos);
+
+		if (close == string_view::npos) {
+			fail(start, "(*VERB) not terminated");
+			return -1;
+		}
+
+		pos = close + 1;
+
+		return -1;
+	}
+
+	if (!at(pos, '?')) {
+		int node = add_node(RX_GROUP, start);
+
+		tree[node].min = ++groups_count;
+
+		return parse_group_body(node, depth);
+	}
+
+	pos++;
+
+	char c = (pos < pat.length()) ? pat[pos] : 0;
+	char next = at(pos + 1, '=') ? '=' : (at(pos + 1, '!') ? '!' : 0);
+
+	if (c == ':' || c == '|') {
+		kind = RX_NON_CAPTURE;
+		pos++;
+	} else if (c == '>') {
+		kind = RX_ATOMIC;
+		pos++;
+	} else if (c == '=' || c == '!') {
+		kind = (c == '=') ? RX_LOOKAHEAD : RX_NEG_LOOKAHEAD;
+		pos++;
+	} else if (c == '<' && next) {
+		kind = (next == '=') ? RX_LOOKBEHIND : RX_NEG_LOOKBEHIND;
+		pos += 2;
+	} else if (c == '<' || c == '\'' || (c == 'P' && at(pos + 1, '<'))) {
+		// Named group: (?<name>...), (?'name'...), (?P<name>...)
+		pos += (c == 'P') ? 2 : 1;
+
+		if (!parse_name(c == '\'' ? '\'' : '>', name)) {
+			return -1;
+		}
+	} else if (c == 'P' && (at(pos + 1, '=') || at(pos + 1, '>'))) {
+		// (?P=name) backreference, (?P>name) subroutine call
+		bool call = at(pos + 1, '>');
+
+		pos += 2;
+
+		if (!parse_name(')', name)) {
+			return -1;
+		}
+
+		int node = add_node(call ? RX_RECURSE : RX_BACKREF, start);
+
+		if (!call) {
+			named_refs.push_back({ name, start });
+		}
+
+		return node;
+	} else if (c == '&') {
+		pos++;
+
+		if (!parse_name(')', name)) {
+			return -1;
+		}
+
+		return add_node(RX_RECURSE, start);
+	} else if (c == '#') {
+		size_t close = pat.find(')', pos);
+
+		if (close == string_view::npos) {
+			fail(start, "missing ) after comment");
+			return -1;
+		}
+
+		pos = close + 1;
+
+		return -1;
+	} else if (c == '(') {
+		// Conditional group: the condition is an assertion or a reference
+		// to a group, recursion or DEFINE.
+		if (at(pos + 1, '?') && (at(pos + 2, '=') || at(pos + 2, '!') || at(pos + 2, '<'))) {
+			if (parse_group(depth + 1) == -1) {
+				fail(pos, "assertion expected after (?(");
+				return -1;
+			}
+		} else {
+			size_t close = pat.find(')', pos);
+
+			if (close == string_view::npos) {
+				fail(start, "malformed number or name after (?(");
+				return -1;
+			}
+
+			pos = close + 1;
+		}
+
+		int node = add_node(RX_GROUP, start);
+
+		tree[node].kind = RX_CONDITIONAL;
+
+		if (parse_group_body(node, depth) == -1) {
+			return -1;
+		}
+
+		int body = tree[node].first_child;
+		int branches = 0;
+
+		if (tree[body].type == RX_ALTERNATION) {
+			for (int b = tree[body].first_child; b != -1; b = tree[b].next_sibling) {
+				branches++;
+			}
+		}
+
+		if (branches > 2) {
+			fail(start, "conditional group contains more than two branches");
+			return -1;
+		}
+
+		return node;
+	} else {
+		// Recursion (?R), (?1), (?+1), (?-1) or inline flags (?i-s) and
+		// (?i-s:...)
+		size_t p = pos + ((c == '+' || c == '-') ? 1 : 0);
+		size_t digits = p;
+
+		if (c == 'R') {
+			p++;
+		}
+
+		while (p < pat.length() && isdigit(static_cast<unsigned char>(pat[p]))) {
+			p++;
+		}
+
+		if ((c == 'R' || p > digits) && at(p, ')')) {
+			pos = p + 1;
+			return add_node(RX_RECURSE, start);
+		}
+
+		unsigned on = 0;
+		unsigned off = 0;
+		bool minus = false;
+
+		for (; pos < pat.length() && pat[pos] != ')' && pat[pos] != ':'; pos++) {
+			unsigned flag = 0;
+
+			switch (pat[pos]) {
+			case 'i':
+				flag = PCRE_CASELESS;
+				break;
+			case 'm':
+				flag = PCRE_MULTILINE;
+				break;
+			case 's':
+				flag = PCRE_DOTALL;
+				break;
+			case 'x':
+				flag = PCRE_EXTENDED;
+				break;
+			case 'U':
+				flag = PCRE_UNGREEDY;
+				break;
+			case 'J':
+			case 'X':
+				break;
+			case '-':
+				if (!minus) {
+					minus = true;
+					continue;
+				}
+				// fall through
+			default:
+				fail(pos, "unrecognized character after (? or (?-");
+				return -1;
+			}
+
+			(minus ? off : on) |= flag;
+		}
+
+		if (pos >= pat.length()) {
+			fail(start, "missing )");
+			return -1;
+		}
+
+		unsigned flags = (cur_flags | on) & ~off;
+
+		// (?i) applies up to the end of the enclosing group.
+		if (pat[pos++] == ')') {
+			cur_flags = flags;
+			return -1;
+		}
+
+		unsigned saved = cur_flags;
+		int node = add_node(RX_GROUP, start);
+
+		tree[node].kind = RX_NON_CAPTURE;
+		cur_flags = flags;
+		node = parse_group_body(node, depth);
+		cur_flags = saved;
+
+		return node;
+	}
+
+	int node = add_node(RX_GROUP, start);
+
+	tree[node].kind = kind;
+
+	if (kind == RX_CAPTURE) {
+		tree[node].min = ++groups_count;
+		group_names.resize(groups_count + 1);
+		group_names[groups_count] = name;
+	}
+
+	return parse_group_body(node, depth);
+}
+
+int pcre_expression::parse_group_body(int node, int depth)
+{
+	unsigned saved = cur_flags;
+	int body = parse_alternation(depth + 1);
+
+	cur_flags = saved;
+
+	if (!err.empty()) {
+		return -1;
+	}
+
+	if (!at(pos, ')')) {
+		fail(tree[node].offset, "missing )");
+		return -1;
+	}
+
+	pos++;
+	tree[node].first_child = body;
+	tree[node].length = pos - tree[node].offset;
+
+	// PCRE needs each top level branch of a lookbehind to have a fixed
+	// length.
+	if (tree[node].kind == RX_LOOKBEHIND || tree[node].kind == RX_NEG_LOOKBEHIND) {
+		bool alternation = tree[body].type == RX_ALTERNATION;
+
+		for (int b = alternation ? tree[body].first_child : body; b != -1;
+			b = alternation ? tree[b].next_sibling : -1) {
+			long min, max;
+
+			width(b, min, max);
+
+			if (min != max) {
+				fail(tree[node].offset, "lookbehind assertion is not fixed length");
+				return -1;
+			}
+		}
+	}
+
+	return node;
+}
+
+bool pcre_expression::parse_name(char terminator, string_view &name)
+{
+	size_t start = pos;
+
+	while (pos < pat.length() && (isalnum(static_cast<unsigned char>(pat[pos])) || pat[pos] == '_')) {
+		pos++;
+	}
+
+	name = pat.substr(start, pos - start);
+
+	if (!name.empty() && isdigit(static_cast<unsigned char>(name[0]))) {
+		fail(start, "group name must start with a non-digit");
+		return false;
+	}
+
+	if (name.empty() || !at(pos, terminator)) {
+		fail(start, "syntax error in subpattern name (missing terminator)");
+		return false;
+	}
+
+	pos++;
+
+	return true;
+}
+
+int pcre_expression::parse_escape()
+{
+	size_t start = pos;
+
+	if (pos + 1 >= pat.length()) {
+		fail(pos, "\\ at end of pattern");
+		return -1;
+	}
+
+	char c = pat[pos + 1];
+	type_byte_set set;
+	int node;
+
+	pos += 2;
+
+	if (parse_class_escape(c, set)) {
+		return err.empty() ? add_chars(set, start) : -1;
+	}
+
+	switch (c) {
+	case 'b':
+	case 'B':
+	case 'A':
+	case 'G':
+	case 'z':
+	case 'Z':
+		node = add_node(RX_ANCHOR, start);
+
+		if (c == 'b' || c == 'B') {
+			tree[node].kind = (c == 'b') ? RX_WORD_BOUNDARY : RX_NOT_WORD_BOUNDARY;
+		} else if (c == 'z' || c == 'Z') {
+			tree[node].kind = (c == 'z') ? RX_END_ONLY : RX_END;
+		} else {
+			tree[node].kind = RX_START;
+		}
+
+		return node;
+	case 'K':
+		return add_node(RX_EMPTY, start);
+	case 'Q':
+		quoting = true;
+		return -1;
+	case 'E':
+		return -1;
+	case 'g': {
+		// \g<name> and \g'name' are subroutine calls.
+		if (at(pos, '<') || at(pos, '\'')) {
+			size_t close = pat.find(at(pos, '<') ? '>' : '\'', pos + 1);
+
+			if (close == string_view::npos) {
+				fail(start, "\\g is not followed by a braced, angle-bracketed, or quoted name/number or by a plain number");
+				return -1;
+			}
+
+			pos = close + 1;
+
+			return add_node(RX_RECURSE, start);
+		}
+
+		// \gN, \g-N, \g{N}, \g{-N}, \g{name}
+		bool braced = at(pos, '{');
+		pos += braced ? 1 : 0;
+		bool relative = at(pos, '-');
+		pos += (relative || at(pos, '+')) ? 1 : 0;
+		size_t digits = pos;
+		int n = 0;
+
+		while (pos < pat.length() && isdigit(static_cast<unsigned char>(pat[pos])) && n <= RX_MAX_BOUND) {
+			n = n * 10 + (pat[pos++] - '0');
+		}
+
+		if (pos == digits) {
+			string_view name;
+
+			if (!braced || !parse_name('}', name)) {
+				fail(start, "a numbered reference must not be zero");
+				return -1;
+			}
+
+			node = add_node(RX_BACKREF, start);
+			named_refs.push_back({ name, start });
+
+			return node;
+		}
+
+		if (braced && !at(pos++, '}')) {
+			fail(start, "\\g is not followed by a braced, angle-bracketed, or quoted name/number or by a plain number");
+			return -1;
+		}
+
+		n = relative ? groups_count - n + 1 : n;
+
+		if (n <= 0) {
+			fail(start, "reference to non-existent subpattern");
+			return -1;
+		}
+
+		node = add_node(RX_BACKREF, start);
+		tree[node].min = n;
+		numbered_refs.push_back({ n, start });
+
+		return node;
+	}
+	case 'k': {
+		char terminator = at(pos, '<') ? '>' : (at(pos, '\'') ? '\'' : (at(pos, '{') ? '}' : 0));
+		string_view name;
+
+		if (!terminator) {
+			fail(start, "\\k is not followed by a braced, angle-bracketed, or quoted name");
+			return -1;
+		}
+
+		pos++;
+
+		if (!parse_name(terminator, name)) {
+			return -1;
+		}
+
+		node = add_node(RX_BACKREF, start);
+		named_refs.push_back({ name, start });
+
+		return node;
+	}
+	}
+
+	// \1 to \9 are backreferences, \10 and up only if there are that many
+	// groups so far, otherwise octal.
+	if (c >= '1' && c <= '9') {
+		size_t p = pos - 1;
+		int n = 0;
+
+		while (p < pat.length() && isdigit(static_cast<unsigned char>(pat[p])) && n <= RX_MAX_BOUND) {
+			n = n * 10 + (pat[p++] - '0');
+		}
+
+		if (n < 10 || n <= groups_count) {
+			pos = p;
+			node = add_node(RX_BACKREF, start);
+			tree[node].min = n;
+			numbered_refs.push_back({ n, start });
+
+			return node;
+		}
+	}
+
+	int value;
+
+	pos = start + 1;
+
+	if (!parse_char_escape(value)) {
+		return -1;
+	}
+
+	return add_char(value, start);
+}
+
+// Escapes of a single byte, 'pos' is at the character after '\'.
+bool pcre_expression::parse_char_escape(int &value)
+{
+	size_t start = pos - 1;
+	char c = pat[pos++];
+
+	switch (c) {
+	case 'a':
+		value = '\a';
+		return true;
+	case 'e':
+		value = 0x1b;
+		return true;
+	case 'f':
+		value = '\f';
+		return true;
+	case 'n':
+		value = '\n';
+		return true;
+	case 'r':
+		value = '\r';
+		return true;
+	case 't':
+		value = '\t';
+		return true;
+	case 'c':
+		if (pos >= pat.length()) {
+			fail(start, "\\c at end of pattern");
+			return false;
+		}
+
+		value = toupper(static_cast<unsigned char>(pat[pos++])) ^ 0x40;
+		return true;
+	case 'x':
+	case 'o': {
+		int base = (c == 'x') ? 16 : 8;
+		long v = 0;
+
+		if (at(pos, '{')) {
+			size_t close = pat.find('}', pos);
+			size_t p = pos + 1;
+
+			for (; p < close && p < pat.length(); p++) {
+				int d = hex_digit(pat[p]);
+
+				if (d < 0 || d >= base) {
+					break;
+				}
+
+				v = std::min(v * base + d, 0x100L);
+			}
+
+			if (close == string_view::npos || p != close || p == pos + 1) {
+				fail(start, c == 'x' ? "malformed \\x{} escape" : "malformed \\o{} escape");
+				return false;
+			}
+
+			pos = close + 1;
+		} else if (c == 'o') {
+			fail(start, "missing opening brace after \\o");
+			return false;
+		} else {
+			for (int i = 0; i < 2 && pos < pat.length() && hex_digit(pat[pos]) >= 0; i++) {
+				v = v * 16 + hex_digit(pat[pos++]);
+			}
+		}
+
+		if (v > 0xff) {
+			fail(start, "character value in \\x{} or \\o{} is too large");
+			return false;
+		}
+
+		value = v;
+		return true;
+	}
+	}
+
+	if (c >= '0' && c <= '7') {
+		value = c - '0';
+
+		for (int i = 0; i < 2 && pos < pat.length() && pat[pos] >= '0' && pat[pos] <= '7'; i++) {
+			value = value * 8 + (pat[pos++] - '0');
+		}
+
+		if (value > 0xff) {
+			fail(start, "octal value is greater than \\377 in 8-bit non-UTF mode");
+			return false;
+		}
+
+		return true;
+	}
+
+	// Escaped punctuation and unknown letters stand for themselves.
+	value = static_cast<unsigned char>(c);
+
+	return true;
+}
+
+// \d \D \w \W \s \S \h \H \v \V \N \R \p{..} \P{..}; 'pos' is past the
+// letter. Returns false for other escapes.
+bool pcre_expression::parse_class_escape(char c, type_byte_set &set)
+{
+	switch (c) {
+	case 'd':
+	case 'w':
+	case 's':
+	case 'h':
+	case 'v':
+		set = escape_set(c);
+		return true;
+	case 'D':
+	case 'W':
+	case 'S':
+	case 'H':
+	case 'V':
+		set = ~escape_set(tolower(c));
+		return true;
+	case 'N':
+		set.set();
+		set.reset('\n');
+		return true;
+	case 'R':
+		// A newline sequence; its first byte is enough here.
+		set = escape_set('v');
+		return true;
+	case 'p':
+	case 'P':
+		break;
+	default:
+		return false;
+	}
+
+	// Unicode properties, approximated on the ASCII range.
+	size_t start = pos - 2;
+	string_view name;
+
+	if (at(pos, '{')) {
+		size_t close = pat.find('}', pos);
+
+		if (close == string_view::npos) {
+			fail(start, "malformed \\P or \\p sequence");
+			return true;
+		}
+
+		name = pat.substr(pos + 1, close - pos - 1);
+		pos = close + 1;
+	} else if (pos < pat.length()) {
+		name = pat.substr(pos++, 1);
+	}
+
+	bool negate = (c == 'P');
+
+	if (!name.empty() && name[0] == '^') {
+		negate = !negate;
+		name.remove_prefix(1);
+	}
+
+	if (name.empty()) {
+		fail(start, "malformed \\P or \\p sequence");
+		return true;
+	}
+
+	if (name == "Lu") {
+		set = test_set(isupper);
+	} else if (name == "Ll") {
+		set = test_set(islower);
+	} else if (name[0] == 'L') {
+		set = test_set(isalpha);
+	} else if (name[0] == 'N') {
+		set = test_set(isdigit);
+	} else if (name[0] == 'Z') {
+		set = test_set(isspace);
+	} else if (name[0] == 'P' || name[0] == 'S') {
+		set = test_set(ispunct);
+	} else if (name[0] == 'C') {
+		set = test_set(iscntrl);
+	} else {
+		set.set();
+	}
+
+	if (negate) {
+		set.flip();
+	}
+
+	return true;
+}
+
+// One member of a class at 'pos': returns the byte, or -1 if a class
+// escape was added to 'set' (or on error), -2 for \Q and \E.
+int pcre_expression::parse_class_byte(type_byte_set &set)
+{
+	char c = pat[pos];
+
+	if (c != '\\') {
+		pos++;
+		return static_cast<unsigned char>(c);
+	}
+
+	if (pos + 1 >= pat.length()) {
+		fail(pos, "\\ at end of pattern");
+		return -1;
+	}
+
+	char e = pat[pos + 1];
+	type_byte_set escape;
+
+	pos += 2;
+
+	if (e != 'N' && e != 'R' && parse_class_escape(e, escape)) {
+		set |= escape;
+		return -1;
+	}
+
+	if (e == 'b') {
+		return '\b';
+	}
+
+	if (e == 'Q' || e == 'E') {
+		return -2;
+	}
+
+	int value;
+
+	pos--;
+
+	return parse_char_escape(value) ? value : -1;
+}
+
+int pcre_expression::parse_class()
+{
+	size_t start = pos;
+	type_byte_set set;
+	bool negate = at(++pos, '^');
+	bool first = true;
+
+	pos += negate ? 1 : 0;
+
+	for (;;) {
+		if (pos >= pat.length()) {
+			fail(start, "missing terminating ] for character class");
+			return -1;
+		}
+
+		char c = pat[pos];
+
+		// ']' right after '[' or '[^' is a member.
+		if (c == ']' && !first) {
+			pos++;
+			break;
+		}
+
+		first = false;
+
+		// [:name:] and [:^name:]
+		if (c == '[' && at(pos + 1, ':')) {
+			size_t p = pos + 2;
+			bool complement = at(p, '^');
+
+			p += complement ? 1 : 0;
+
+			size_t name_start = p;
+
+			while (p < pat.length() && isalpha(static_cast<unsigned char>(pat[p]))) {
+				p++;
+			}
+
+			if (at(p, ':') && at(p + 1, ']')) {
+				string_view name = pat.substr(name_start, p - name_start);
+				size_t i = 0;
+
+				while (posix_classes[i].name && name != posix_classes[i].name) {
+					i++;
+				}
+
+				if (!posix_classes[i].name) {
+					fail(pos, "unknown POSIX class name");
+					return -1;
+				}
+
+				type_byte_set posix = test_set(posix_classes[i].test);
+
+				set |= complement ? ~posix : posix;
+				pos = p + 2;
+				continue;
+			}
+		}
+
+		int lo = parse_class_byte(set);
+
+		if (!err.empty()) {
+			return -1;
+		}
+
+		if (lo < 0) {
+			continue;
+		}
+
+		if (!at(pos, '-') || pos + 1 >= pat.length() || pat[pos + 1] == ']') {
+			set.set(lo);
+			continue;
+		}
+
+		size_t dash = pos++;
+		type_byte_set other;
+		int hi = parse_class_byte(other);
+
+		if (!err.empty()) {
+			return -1;
+		}
+
+		// [a-\d]: the '-' is a member.
+		if (hi < 0) {
+			set.set(lo);
+			set.set('-');
+			set |= other;
+			continue;
+		}
+
+		if (hi < lo) {
+			fail(dash, "range out of order in character class");
+			return -1;
+		}
+
+		for (int b = lo; b <= hi; b++) {
+			set.set(b);
+		}
+	}
+
+	if (cur_flags & PCRE_CASELESS) {
+		fold_case(set);
+	}
+
+	if (negate) {
+		set.flip();
+	}
+
+	return add_chars(set, start);
+}
+
+string_view pcre_expression::span(int node) const
+{
+	return pat.substr(tree[node].offset, tree[node].length);
+}
+
+bool pcre_expression::starts_anchored(int node) const
+{
+	const type_regex_node &n = tree[node];
+
+	switch (n.type) {
+	case RX_ANCHOR:
+		return n.kind == RX_START;
+	case RX_CONCAT:
+		return starts_anchored(n.first_child);
+	case RX_GROUP:
+		return !is_lookaround(n.kind) && n.kind != RX_CONDITIONAL && starts_anchored(n.first_child);
+	case RX_ALTERNATION:
+		for (int c = n.first_child; c != -1; c = tree[c].next_sibling) {
+			if (!starts_anchored(c)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+bool pcre_expression::anchored() const
+{
+	return (pattern_flags & PCRE_ANCHORED) || (top != -1 && starts_anchored(top));
+}
+
+bool pcre_expression::nullable(int node) const
+{
+	const type_regex_node &n = tree[node];
+
+	switch (n.type) {
+	case RX_CHARS:
+	case RX_RECURSE:
+		return false;
+	case RX_CONCAT:
+		for (int c = n.first_child; c != -1; c = tree[c].next_sibling) {
+			if (!nullable(c)) {
+				return false;
+			}
+		}
+
+		return true;
+	case RX_ALTERNATION:
+		for (int c = n.first_child; c != -1; c = tree[c].next_sibling) {
+			if (nullable(c)) {
+				return true;
+			}
+		}
+
+		return false;
+	case RX_GROUP:
+		return is_lookaround(n.kind) || n.kind == RX_CONDITIONAL || nullable(n.first_child);
+	case RX_REPEAT:
+		return n.min == 0 || nullable(n.first_child);
+	}
+
+	return true;
+}
+
+// Bytes a match of the node can start with.
+void pcre_expression::first_bytes(int node, type_byte_set &set) const
+{
+	const type_regex_node &n = tree[node];
+
+	switch (n.type) {
+	case RX_CHARS:
+		set |= byte_sets[n.set];
+		break;
+	case RX_CONCAT:
+		for (int c = n.first_child; c != -1; c = tree[c].next_sibling) {
+			first_bytes(c, set);
+
+			if (!nullable(c)) {
+				break;
+			}
+		}
+
+		break;
+	case RX_ALTERNATION:
+		for (int c = n.first_child; c != -1; c = tree[c].next_sibling) {
+			first_bytes(c, set);
+		}
+
+		break;
+	case RX_GROUP:
+		if (!is_lookaround(n.kind)) {
+			first_bytes(n.first_child, set);
+		}
+
+		break;
+	case RX_REPEAT:
+		if (n.max != 0) {
+			first_bytes(n.first_child, set);
+		}
+
+		break;
+	}
+}
+
+// Shortest and longest match of the node, max -1 if unbounded.
+void pcre_expression::width(int node, long &min, long &max) const
+{
+	const type_regex_node &n = tree[node];
+	long child_min, child_max;
+
+	min = max = 0;
+
+	switch (n.type) {
+	case RX_CHARS:
+		min = max = 1;
+		break;
+	case RX_BACKREF:
+	case RX_RECURSE:
+		max = -1;
+		break;
+	case RX_CONCAT:
+		for (int c = n.first_child; c != -1; c = tree[c].next_sibling) {
+			width(c, child_min, child_max);
+			min = std::min(min + child_min, RX_MAX_WIDTH);
+			max = (max == -1 || child_max == -1 || max + child_max > RX_MAX_WIDTH) ? -1 : max + child_max;
+		}
+
+		break;
+	case RX_ALTERNATION:
+	case RX_GROUP:
+		if (n.type == RX_GROUP && is_lookaround(n.kind)) {
+			break;
+		}
+
+		min = RX_MAX_WIDTH;
+
+		for (int c = n.first_child; c != -1; c = tree[c].next_sibling) {
+			width(c, child_min, child_max);
+			min = std::min(min, child_min);
+			max = (max == -1 || child_max == -1) ? -1 : std::max(max, child_max);
+		}
+
+		break;
+	case RX_REPEAT:
+		width(n.first_child, child_min, child_max);
+		min = std::min(child_min * n.min, RX_MAX_WIDTH);
+
+		if (child_max == 0) {
+			max = 0;
+		} else if (n.max == RX_UNBOUNDED || child_max == -1 || child_max * n.max > RX_MAX_WIDTH) {
+			max = -1;
+		} else {
+			max = child_max * n.max;
+		}
+
+		break;
+	}
+}
+
+// The node is a plain sequence of bytes sets, e.g. "ab[cd]".
+bool pcre_expression::simple_sequence(int node, vector<int> &sets) const
+{
+	const type_regex_node &n = tree[node];
+
+	switch (n.type) {
+	case RX_CHARS:
+		sets.push_back(n.set);
+		return true;
+	case RX_CONCAT:
+		for (int c = n.first_child; c != -1; c = tree[c].next_sibling) {
+			if (tree[c].type != RX_CHARS) {
+				return false;
+			}
+
+			sets.push_back(tree[c].set);
+		}
+
+		return true;
+	case RX_GROUP:
+		return (n.kind == RX_CAPTURE || n.kind == RX_NON_CAPTURE) && simple_sequence(n.first_child, sets);
+	}
+
+	return false;
+}
+
+// Two branches can match the same prefix. For plain sequences this is
+// checked byte by byte, otherwise on the first byte only.
+bool pcre_expression::branches_overlap(int a, int b) const
+{
+	vector<int> seq_a, seq_b;
+
+	if (simple_sequence(a, seq_a) && simple_sequence(b, seq_b)) {
+		size_t len = min(seq_a.size(), seq_b.size());
+
+		for (size_t i = 0; i < len; i++) {
+			if ((byte_sets[seq_a[i]] & byte_sets[seq_b[i]]).none()) {
+				return false;
+			}
+		}
+
+		return len > 0;
+	}
+
+	type_byte_set first_a, first_b;
+
+	first_bytes(a, first_a);
+	first_bytes(b, first_b);
+
+	return (first_a & first_b).any();
+}
+
+static void report_once(diag_list &diags, type_diag_code code, string_view opt, string_view where)
+{
+	for (const type_diagnostic &diag : diags) {
+		if (diag.code == code && diag.where.data() == where.data()) {
+			return;
+		}
+	}
+
+	report(diags, code, opt, where);
+}
+
+// 'outer' is the closest enclosing quantifier that may repeat many times,
+// 'tail' tells whether the rest of its body after 'node' can match empty.
+void pcre_expression::walk_hazards(int node, int outer, bool tail, bool atomic, string_view opt,
+	diag_list &diags) const
+{
+	const type_regex_node &n = tree[node];
+
+	auto backtracks = [&](int r) {
+		return tree[r].type == RX_REPEAT && tree[r].max == RX_UNBOUNDED &&
+			tree[r].kind != RX_POSSESSIVE && !atomic;
+	};
+
+	switch (n.type) {
+	case RX_CONCAT: {
+		vector<int> children;
+
+		for (int c = n.first_child; c != -1; c = tree[c].next_sibling) {
+			children.push_back(c);
+		}
+
+		// Unbounded quantifiers with only empty matches between them.
+		for (size_t i = 0; i < children.size(); i++) {
+			if (!backtracks(children[i])) {
+				continue;
+			}
+
+			type_byte_set first;
+
+			first_bytes(children[i], first);
+
+			for (size_t j = i + 1; j < children.size(); j++) {
+				type_byte_set next;
+
+				if (backtracks(children[j])) {
+					first_bytes(children[j], next);
+
+					if ((first & next).any()) {
+						size_t begin = tree[children[i]].offset;
+						size_t end = tree[children[j]].offset + tree[children[j]].length;
+
+						report_once(diags, DIAG_PCRE_ADJACENT_QUANTIFIERS, opt, pat.substr(begin, end - begin));
+					}
+
+					break;
+				}
+
+				if (!nullable(children[j])) {
+					break;
+				}
+			}
+		}
+
+		bool rest = tail;
+
+		for (size_t i = children.size(); i-- > 0; ) {
+			walk_hazards(children[i], outer, rest, atomic, opt, diags);
+			rest = rest && nullable(children[i]);
+		}
+
+		break;
+	}
+	case RX_ALTERNATION:
+		for (int c = n.first_child; c != -1; c = tree[c].next_sibling) {
+			walk_hazards(c, outer, tail, atomic, opt, diags);
+		}
+
+		break;
+	case RX_GROUP:
+		if (is_lookaround(n.kind)) {
+			walk_hazards(n.first_child, -1, true, atomic, opt, diags);
+		} else {
+			walk_hazards(n.first_child, outer, tail, atomic || n.kind == RX_ATOMIC, opt, diags);
+		}
+
+		break;
+	case RX_REPEAT: {
+		bool many = (n.max == RX_UNBOUNDED || n.max >= RX_HAZARD_REPEATS) &&
+			n.kind != RX_POSSESSIVE && !atomic;
+
+		if (backtracks(node) && outer != -1 && tail) {
+			type_byte_set inner, body;
+
+			first_bytes(n.first_child, inner);
+			first_bytes(tree[outer].first_child, body);
+
+			if ((inner & body).any()) {
+				report_once(diags, DIAG_PCRE_NESTED_QUANTIFIERS, opt, span(outer));
+			}
+		}
+
+		if (backtracks(node)) {
+			int body = n.first_child;
+
+			while (tree[body].type == RX_GROUP &&
+				(tree[body].kind == RX_CAPTURE || tree[body].kind == RX_NON_CAPTURE)) {
+				body = tree[body].first_child;
+			}
+
+			if (tree[body].type == RX_ALTERNATION) {
+				for (int a = tree[body].first_child; a != -1; a = tree[a].next_sibling) {
+					for (int b = tree[a].next_sibling; b != -1; b = tree[b].next_sibling) {
+						if (branches_overlap(a, b)) {
+							report_once(diags, DIAG_PCRE_OVERLAPPING_ALTERNATION, opt, span(node));
+						}
+					}
+				}
+			}
+		}
+
+		if (many) {
+			walk_hazards(n.first_child, node, true, atomic, opt, diags);
+		} else {
+			walk_hazards(n.first_child, outer, tail, atomic || n.kind == RX_POSSESSIVE, opt, diags);
+		}
+
+		break;
+	}
+	}
+}
+
+void pcre_expression::find_hazards(string_view opt, diag_list &diags) const
+{
+	if (top == -1) {
+		return;
+	}
+
+	if (!anchored()) {
+		int node = top;
+
+		while (tree[node].type == RX_CONCAT || (tree[node].type == RX_GROUP &&
+			(tree[node].kind == RX_CAPTURE || tree[node].kind == RX_NON_CAPTURE || tree[node].kind == RX_ATOMIC))) {
+			node = tree[node].first_child;
+		}
+
+		const type_regex_node &n = tree[node];
+
+		if (n.type == RX_REPEAT && n.max == RX_UNBOUNDED && tree[n.first_child].type == RX_CHARS &&
+			byte_sets[tree[n.first_child].set].count() >= RX_ANY_BYTES) {
+			report(diags, DIAG_PCRE_LEADING_DOT_STAR, opt, span(node));
+		}
+	}
+
+	diag_list found;
+
+	walk_hazards(top, -1, true, false, opt, found);
+
+	// Each kind once, at its first place, with the number of others.
+	size_t count[DIAG_CODES_COUNT] = {};
+
+	for (const type_diagnostic &diag : found) {
+		count[diag.code]++;
+	}
+
+	for (type_diagnostic &diag : found) {
+		if (!count[diag.code]) {
+			continue;
+		}
+
+		if (count[diag.code] > 1) {
+			diag.detail = " (and " + to_string(count[diag.code] - 1) + " more)";
+		}
+
+		count[diag.code] = 0;
+		diags.push_back(move(diag));
+	}
+}
@@ -0,0 +1,213 @@
+#pragma once
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "diagnostic.h"
+
+// Parser for the argument of the 'pcre' option:
+//
+//   [!]"/<regex>/<modifiers>"   or   [!]"m<delim><regex><delim><modifiers>"
+//
+// The expression is parsed with PCRE syntax (lookarounds, atomic groups,
+// possessive and lazy quantifiers, inline flags, named groups, \Q..\E,
+// ...) into a small AST. Modifiers are the PCRE ones (i s m x A E G) plus
+// the Snort/Suricata buffer and relative ones (R U I P H D M C K S Y B O
+// Q V W Z).
+
+// Node types.
+#define RX_EMPTY		0
+// One byte out of a set: literal, class, '.' or a class escape.
+#define RX_CHARS		1
+#define RX_ANCHOR		2
+#define RX_BACKREF		3
+// Subroutine call or recursion: (?R), (?1), (?&name), \g<name>.
+#define RX_RECURSE		4
+#define RX_CONCAT		5
+#define RX_ALTERNATION		6
+#define RX_GROUP		7
+#define RX_REPEAT		8
+
+// Group kinds.
+#define RX_CAPTURE		0
+#define RX_NON_CAPTURE		1
+#define RX_ATOMIC		2
+#define RX_LOOKAHEAD		3
+#define RX_NEG_LOOKAHEAD	4
+#define RX_LOOKBEHIND		5
+#define RX_NEG_LOOKBEHIND	6
+#define RX_CONDITIONAL		7
+
+// Anchor kinds.
+#define RX_START		0	// ^ without /m, \A, \G
+#define RX_LINE_START		1	// ^ with /m
+#define RX_END			2	// $ without /m or /E, \Z
+#define RX_END_ONLY		3	// \z, $ with /E
+#define RX_LINE_END		4	// $ with /m
+#define RX_WORD_BOUNDARY	5
+#define RX_NOT_WORD_BOUNDARY	6
+
+// Repeat kinds.
+#define RX_GREEDY		0
+#define RX_LAZY			1
+#define RX_POSSESSIVE		2
+
+#define RX_UNBOUNDED		-1
+
+// Modifier flags.
+#define PCRE_CASELESS		0x01	// i
+#define PCRE_DOTALL		0x02	// s
+#define PCRE_MULTILINE		0x04	// m
+#define PCRE_EXTENDED		0x08	// x
+#define PCRE_ANCHORED		0x10	// A
+#define PCRE_DOLLAR_ENDONLY	0x20	// E
+#define PCRE_UNGREEDY		0x40	// G
+#define PCRE_RELATIVE		0x80	// R
+
+typedef std::bitset<256> type_byte_set;
+
+typedef struct regex_node
+{
+	int type;
+	// Group, anchor or repeat kind.
+	int kind;
+	// RX_REPEAT: bounds, max may be RX_UNBOUNDED. Capturing groups and
+	// backreferences: group number in 'min' (0 if by name).
+	int min;
+	int max;
+	int first_child;
+	int next_sibling;
+	// RX_CHARS: index into pcre_expression::sets().
+	int set;
+	// Span in the pattern.
+	uint32_t offset;
+	uint32_t length;
+} type_regex_node;
+
+class pcre_expression
+{
+public:
+	// Parse a complete 'pcre' argument, quotes included. Returns false on
+	// malformed quoting, delimiters, modifiers or expression; error()
+	// tells why.
+	bool parse(std::string_view arg);
+
+	// Report constructs that make a backtracking matcher slow:
+	// - nested quantifiers where an iteration of the outer one can end
+	//   with the inner one and start again with the same bytes, (a+)+;
+	// - alternations under an unbounded quantifier whose branches can
+	//   match the same prefix, (a|ab)*;
+	// - an unanchored expression starting with '.*', tried again at
+	//   every offset of the buffer;
+	// - unbounded quantifiers in a row over overlapping bytes, \d+\d+.
+	// Possessive quantifiers and atomic groups don't backtrack and are
+	// not reported. Each kind is reported once, at its first place, with
+	// the number of other places.
+	void find_hazards(std::string_view opt, diag_list &diags) const;
+
+	// Anchored to the start of the buffer (/A or a leading '^').
+	bool anchored() const;
+
+	const std::string &error() const
+	{
+		return err;
+	}
+
+	bool negated() const
+	{
+		return neg;
+	}
+
+	std::string_view pattern() const
+	{
+		return pat;
+	}
+
+	std::string_view modifiers() const
+	{
+		return mods;
+	}
+
+	unsigned flags() const
+	{
+		return pattern_flags;
+	}
+
+	int root() const
+	{
+		return top;
+	}
+
+	const std::vector<type_regex_node> &nodes() const
+	{
+		return tree;
+	}
+
+	const std::vector<type_byte_set> &sets() const
+	{
+		return byte_sets;
+	}
+
+	int groups() const
+	{
+		return groups_count;
+	}
+
+private:
+	typedef struct named_ref
+	{
+		std::string_view name;
+		size_t offset;
+	} type_named_ref;
+
+	bool split(std::string_view arg);
+	void fail(size_t offset, const std::string &message);
+	int add_node(int type, size_t offset);
+	int add_chars(const type_byte_set &set, size_t offset);
+	int add_char(unsigned char c, size_t offset);
+	void set_children(int node, const std::vector<int> &children);
+	bool at(size_t offset, char c) const;
+	void skip_extended();
+
+	int parse_alternation(int depth);
+	int parse_concat(int depth);
+	int parse_atom(int depth);
+	int parse_quantifier(int atom);
+	bool parse_bounds(size_t &offset, int &min, int &max);
+	int parse_group(int depth);
+	int parse_group_body(int node, int depth);
+	bool parse_name(char terminator, std::string_view &name);
+	int parse_escape();
+	bool parse_char_escape(int &value);
+	bool parse_class_escape(char c, type_byte_set &set);
+	int parse_class_byte(type_byte_set &set);
+	int parse_class();
+
+	bool starts_anchored(int node) const;
+	bool nullable(int node) const;
+	void first_bytes(int node, type_byte_set &set) const;
+	void width(int node, long &min, long &max) const;
+	bool simple_sequence(int node, std::vector<int> &sets) const;
+	bool branches_overlap(int a, int b) const;
+	void walk_hazards(int node, int outer, bool tail, bool atomic, std::string_view opt,
+		diag_list &diags) const;
+	std::string_view span(int node) const;
+
+	std::string err;
+	bool neg = false;
+	std::string_view pat;
+	std::string_view mods;
+	unsigned pattern_flags = 0;
+	// Flags in effect at the parse position, changed by (?i) etc.
+	unsigned cur_flags = 0;
+	bool quoting = false;
+	size_t pos = 0;
+	int top = -1;
+	int groups_count = 0;
+	std::vector<type_regex_node> tree;
+	std::vector<type_byte_set> byte_sets;
+	std::vector<std::string_view> group_names;
+	std::vector<type_named_ref> named_refs;
+	std::vector<std::pair<int, size_t>> numbered_refs;
+};
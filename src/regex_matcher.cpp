@@ -0,0 +1,354 @@
+#include <cstdint>
+#include "regex_matcher.h"
+#include "rule_checker.h"
+
+using namespace std;
+
+// Continuation kinds.
+// Then the next sibling of 'node' in a sequence.
+#define CONT_SIBLING		0
+// Then iteration 'count' + 1 of repeat 'node', the last one started at
+// 'start'.
+#define CONT_REPEAT		1
+// Then close capturing group 'node' opened at 'start'.
+#define CONT_CAPTURE		2
+// Done: store the end (lookarounds, atomic groups, the whole search).
+#define CONT_ACCEPT		3
+
+// Longest lookbehind tried; PCRE's limit on a lookbehind's length.
+#define LOOKBEHIND_MAX		65535
+
+#define UNSET			SIZE_MAX
+
+static bool is_word_byte(char c)
+{
+	return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+regex_matcher::regex_matcher(const pcre_expression &expr)
+	: tree(expr.nodes()), sets(expr.sets()), root(expr.root()), groups(expr.groups()),
+	anchored(expr.anchored()), caseless(expr.flags() & PCRE_CASELESS), is_supported(false),
+	first(nullptr)
+{
+	if (root == -1 || !(is_supported = check_supported(root))) {
+		return;
+	}
+
+	// A byte the match must start with lets most start offsets be
+	// skipped, as PCRE does.
+	for (int node = root; node != -1;) {
+		const type_regex_node &n = tree[node];
+
+		if (n.type == RX_CHARS) {
+			first = &sets[n.set];
+			break;
+		}
+
+		bool descend = n.type == RX_CONCAT || (n.type == RX_REPEAT && n.min > 0) ||
+			(n.type == RX_GROUP && (n.kind == RX_CAPTURE || n.kind == RX_NON_CAPTURE || n.kind == RX_ATOMIC));
+
+		node = descend ? n.first_child : -1;
+	}
+}
+
+bool regex_matcher::check_supported(int node) const
+{
+	const type_regex_node &n = tree[node];
+
+	if (n.type == RX_RECURSE || (n.type == RX_BACKREF && n.min == 0) ||
+		(n.type == RX_GROUP && n.kind == RX_CONDITIONAL)) {
+		return false;
+	}
+
+	for (int child = n.first_child; child != -1; child = tree[child].next_sibling) {
+		if (!check_supported(child)) {
+			return false;
+		}
+
+		// Only sequences and alternations have siblings as children.
+		if (n.type != RX_CONCAT && n.type != RX_ALTERNATION) {
+			break;
+		}
+	}
+
+	return true;
+}
+
+int regex_matcher::search(string_view subject, size_t start, size_t &end) const
+{
+	if (!is_supported) {
+		return REGEX_NO_MATCH;
+	}
+
+	type_search_state st = { subject, {}, 0, 0, false };
+	type_continuation accept = { CONT_ACCEPT, -1, 0, 0, nullptr, &end, UNSET };
+
+	for (size_t pos = start; pos <= subject.length(); pos++) {
+		if (first && !anchored) {
+			while (pos < subject.length() && !first->test(static_cast<unsigned char>(subject[pos]))) {
+				pos++;
+			}
+
+			if (pos == subject.length()) {
+				break;
+			}
+		}
+
+		st.captures.assign(groups + 1, { UNSET, UNSET });
+
+		if (run(root, pos, &accept, st)) {
+			return REGEX_MATCH;
+		}
+
+		if (st.aborted) {
+			return REGEX_LIMIT;
+		}
+
+		if (anchored) {
+			break;
+		}
+	}
+
+	return REGEX_NO_MATCH;
+}
+
+bool regex_matcher::anchor(int kind, size_t pos, const type_search_state &st) const
+{
+	string_view s = st.subject;
+
+	switch (kind) {
+	case RX_START:
+		return pos == 0;
+	case RX_LINE_START:
+		return pos == 0 || s[pos - 1] == '\n';
+	case RX_END:
+		return pos == s.length() || (pos + 1 == s.length() && s[pos] == '\n');
+	case RX_END_ONLY:
+		return pos == s.length();
+	case RX_LINE_END:
+		return pos == s.length() || s[pos] == '\n';
+	}
+
+	bool before = pos > 0 && is_word_byte(s[pos - 1]);
+	bool after = pos < s.length() && is_word_byte(s[pos]);
+
+	return (before != after) == (kind == RX_WORD_BOUNDARY);
+}
+
+bool regex_matcher::run(int node, size_t pos, const type_continuation *k, type_search_state &st) const
+{
+	if (++st.steps > REGEX_STEP_LIMIT || st.depth >= REGEX_DEPTH_LIMIT) {
+		st.aborted = true;
+		return false;
+	}
+
+	const type_regex_node &n = tree[node];
+	string_view s = st.subject;
+	bool res = false;
+
+	st.depth++;
+
+	switch (n.type) {
+	case RX_EMPTY:
+		res = next(pos, k, st);
+		break;
+	case RX_CHARS:
+		res = pos < s.length() && sets[n.set].test(static_cast<unsigned char>(s[pos])) && next(pos + 1, k, st);
+		break;
+	case RX_ANCHOR:
+		res = anchor(n.kind, pos, st) && next(pos, k, st);
+		break;
+	case RX_BACKREF: {
+		// An unset group fails, as in PCRE.
+		pair<size_t, size_t> group = (n.min <= groups) ? st.captures[n.min] : make_pair(UNSET, UNSET);
+		size_t len = group.second - group.first;
+
+		if (group.first == UNSET || group.second == UNSET || s.length() - pos < len) {
+			break;
+		}
+
+		for (size_t i = 0; i < len; i++) {
+			char a = s[group.first + i];
+			char b = s[pos + i];
+
+			if (a != b && !(caseless && fold_case(a) == fold_case(b))) {
+				len = UNSET;
+				break;
+			}
+		}
+
+		res = len != UNSET && next(pos + len, k, st);
+		break;
+	}
+	case RX_CONCAT: {
+		int child = n.first_child;
+
+		if (tree[child].next_sibling == -1) {
+			res = run(child, pos, k, st);
+		} else {
+			type_continuation c = { CONT_SIBLING, tree[child].next_sibling, 0, 0, k, nullptr, UNSET };
+
+			res = run(child, pos, &c, st);
+		}
+
+		break;
+	}
+	case RX_ALTERNATION:
+		for (int child = n.first_child; child != -1 && !res && !st.aborted; child = tree[child].next_sibling) {
+			res = run(child, pos, k, st);
+		}
+
+		break;
+	case RX_GROUP:
+		res = run_group(node, pos, k, st);
+		break;
+	case RX_REPEAT:
+		res = repeat(node, 0, pos, k, st);
+		break;
+	}
+
+	st.depth--;
+
+	return res;
+}
+
+bool regex_matcher::run_group(int node, size_t pos, const type_continuation *k, type_search_state &st) const
+{
+	const type_regex_node &n = tree[node];
+	size_t end;
+	type_continuation accept = { CONT_ACCEPT, -1, 0, 0, nullptr, &end, UNSET };
+
+	switch (n.kind) {
+	case RX_CAPTURE: {
+		type_continuation c = { CONT_CAPTURE, n.min, 0, pos, k, nullptr, UNSET };
+
+		return run(n.first_child, pos, &c, st);
+	}
+	case RX_ATOMIC:
+		// Matched once, never backtracked into.
+		return run(n.first_child, pos, &accept, st) && next(end, k, st);
+	case RX_LOOKAHEAD:
+		return run(n.first_child, pos, &accept, st) && next(pos, k, st);
+	case RX_NEG_LOOKAHEAD:
+		return !run(n.first_child, pos, &accept, st) && !st.aborted && next(pos, k, st);
+	case RX_LOOKBEHIND:
+	case RX_NEG_LOOKBEHIND: {
+		bool found = false;
+
+		accept.required = pos;
+
+		// Branches have fixed lengths; any start ending here will do.
+		for (size_t start = pos + 1; start-- > 0 && pos - start <= LOOKBEHIND_MAX && !found && !st.aborted;) {
+			found = run(n.first_child, start, &accept, st);
+		}
+
+		return !st.aborted && found == (n.kind == RX_LOOKBEHIND) && next(pos, k, st);
+	}
+	}
+
+	return run(n.first_child, pos, k, st);
+}
+
+bool regex_matcher::repeat(int node, int count, size_t pos, const type_continuation *k, type_search_state &st) const
+{
+	const type_regex_node &n = tree[node];
+	bool more = n.max == RX_UNBOUNDED || count < n.max;
+
+	// A repeated byte set ('.*', '\d+', '[^;]*'): the run of matching
+	// bytes is measured once and the lengths are tried without
+	// recursing per iteration.
+	if (count == 0 && tree[n.first_child].type == RX_CHARS) {
+		const type_byte_set &set = sets[tree[n.first_child].set];
+		size_t left = st.subject.length() - pos;
+		size_t limit = (n.max == RX_UNBOUNDED) ? left : min(left, static_cast<size_t>(n.max));
+		size_t len = 0;
+		size_t min = n.min;
+
+		while (len < limit && set.test(static_cast<unsigned char>(st.subject[pos + len]))) {
+			len++;
+		}
+
+		if (len < min) {
+			return false;
+		}
+
+		if (n.kind == RX_POSSESSIVE) {
+			return next(pos + len, k, st);
+		}
+
+		for (size_t i = 0; i <= len - min && !st.aborted; i++) {
+			if (next(pos + ((n.kind == RX_LAZY) ? min + i : len - i), k, st)) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	if (n.kind == RX_POSSESSIVE) {
+		size_t end;
+		type_continuation accept = { CONT_ACCEPT, -1, 0, 0, nullptr, &end, UNSET };
+
+		while (more && run(n.first_child, pos, &accept, st) && end != pos) {
+			pos = end;
+			count++;
+			more = n.max == RX_UNBOUNDED || count < n.max;
+		}
+
+		return !st.aborted && count >= n.min && next(pos, k, st);
+	}
+
+	type_continuation c = { CONT_REPEAT, node, count + 1, pos, k, nullptr, UNSET };
+
+	if (n.kind == RX_LAZY) {
+		return (count >= n.min && next(pos, k, st)) || (!st.aborted && more && run(n.first_child, pos, &c, st));
+	}
+
+	return (more && run(n.first_child, pos, &c, st)) || (!st.aborted && count >= n.min && next(pos, k, st));
+}
+
+bool regex_matcher::next(size_t pos, const type_continuation *k, type_search_state &st) const
+{
+	switch (k->kind) {
+	case CONT_SIBLING: {
+		int sibling = tree[k->node].next_sibling;
+
+		if (sibling == -1) {
+			return run(k->node, pos, k->next, st);
+		}
+
+		type_continuation c = { CONT_SIBLING, sibling, 0, 0, k->next, nullptr, UNSET };
+
+		return run(k->node, pos, &c, st);
+	}
+	case CONT_REPEAT:
+		// An iteration matching nothing ends the loop once the minimum
+		// is reached, as in PCRE.
+		if (pos == k->start && k->count >= tree[k->node].min) {
+			return next(pos, k->next, st);
+		}
+
+		return repeat(k->node, k->count, pos, k->next, st);
+	case CONT_CAPTURE: {
+		pair<size_t, size_t> saved = st.captures[k->node];
+
+		st.captures[k->node] = { k->start, pos };
+
+		if (next(pos, k->next, st)) {
+			return true;
+		}
+
+		st.captures[k->node] = saved;
+
+		return false;
+	}
+	}
+
+	if (k->required != UNSET && pos != k->required) {
+		return false;
+	}
+
+	*k->end = pos;
+
+	return true;
+}
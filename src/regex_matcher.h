@@ -0,0 +1,81 @@
+#pragma once
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "pcre_parser.h"
+
+// Search results.
+#define REGEX_NO_MATCH		0
+#define REGEX_MATCH		1
+// Gave up, like PCRE does past its match limit.
+#define REGEX_LIMIT		2
+
+// Steps (nodes tried) allowed per search, and nesting of the matcher's
+// recursion; past either the search gives up with REGEX_LIMIT.
+#define REGEX_STEP_LIMIT	200000
+#define REGEX_DEPTH_LIMIT	4000
+
+// Backtracking matcher over the AST of a parsed 'pcre' expression,
+// working the way PCRE does: each start offset in turn (only the first
+// if anchored), alternatives and quantifier iterations tried in order and
+// undone on failure. Case and '.' are already resolved in the byte sets
+// of the AST. Conditional groups, subroutine calls and backreferences by
+// name are not supported.
+//
+// A const matcher keeps no state and can be shared by any number of
+// threads. The expression must outlive it.
+class regex_matcher
+{
+public:
+	explicit regex_matcher(const pcre_expression &expr);
+
+	bool supported() const
+	{
+		return is_supported;
+	}
+
+	// Search 'subject' from 'start'. On a match 'end' is its end offset.
+	int search(std::string_view subject, size_t start, size_t &end) const;
+
+private:
+	// What to match after the current node.
+	typedef struct continuation
+	{
+		int kind;
+		int node;
+		int count;
+		size_t start;
+		const continuation *next;
+		// CONT_ACCEPT: where to store the end, and the end it must have
+		// (or SIZE_MAX).
+		size_t *end;
+		size_t required;
+	} type_continuation;
+
+	typedef struct search_state
+	{
+		std::string_view subject;
+		// Start and end of each capturing group, SIZE_MAX if unset.
+		std::vector<std::pair<size_t, size_t>> captures;
+		size_t steps;
+		unsigned depth;
+		bool aborted;
+	} type_search_state;
+
+	bool run(int node, size_t pos, const type_continuation *k, type_search_state &st) const;
+	bool run_group(int node, size_t pos, const type_continuation *k, type_search_state &st) const;
+	bool repeat(int node, int count, size_t pos, const type_continuation *k, type_search_state &st) const;
+	bool next(size_t pos, const type_continuation *k, type_search_state &st) const;
+	bool anchor(int kind, size_t pos, const type_search_state &st) const;
+	bool check_supported(int node) const;
+
+	const std::vector<type_regex_node> &tree;
+	const std::vector<type_byte_set> &sets;
+	int root;
+	int groups;
+	bool anchored;
+	bool caseless;
+	bool is_supported;
+	// Bytes a match can start with, or nullptr if any.
+	const type_byte_set *first;
+};
@@ -0,0 +1,534 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <netinet/in.h>
+#include <boost/algorithm/string.hpp>
+#include "content.h"
+#include "parallel.h"
+#include "replay_profiler.h"
+
+using namespace std;
+
+#define REPLAY_BATCH_SIZE	8192
+#define REPLAY_CHUNK_SIZE	32
+// Bytes of the fast pattern prefix the prefilter looks for.
+#define PREFIX_LENGTH		4
+#define PREFIX_BITMAP_BITS	16
+// Rules are indexed apart for TCP, UDP, ICMP and other protocols.
+#define PROTO_CLASS_TCP		0
+#define PROTO_CLASS_UDP		1
+#define PROTO_CLASS_ICMP	2
+#define PROTO_CLASS_OTHER	3
+// Most destination ports a rule is indexed by; past it the rule is a
+// candidate for any port.
+#define PORT_GROUP_MAX		64
+// Same for the source networks of that length.
+#define SOURCE_PREFIX_LENGTH	16
+#define SOURCE_GROUP_MAX	64
+// Contents and pcres tried per evaluation, against occurrences of
+// contents with relative ones after them multiplying.
+#define CHAIN_STEP_LIMIT	100000
+
+static constexpr int OPTION_PCRE = option_id("pcre");
+
+typedef struct proto_name
+{
+	const char *name;
+	uint8_t protos[2];
+	size_t count;
+} type_proto_name;
+
+// Protocols of the rule header; application layer ones stand for their
+// usual transport. Anything else matches any IP packet.
+static const type_proto_name proto_names[] = {
+	{ "tcp",  { IPPROTO_TCP, 0 },                1 },
+	{ "udp",  { IPPROTO_UDP, 0 },                1 },
+	{ "icmp", { IPPROTO_ICMP, IPPROTO_ICMPV6 },  2 },
+	{ "http", { IPPROTO_TCP, 0 },                1 },
+	{ "ftp",  { IPPROTO_TCP, 0 },                1 },
+	{ "smtp", { IPPROTO_TCP, 0 },                1 },
+	{ "tls",  { IPPROTO_TCP, 0 },                1 },
+	{ "ssh",  { IPPROTO_TCP, 0 },                1 },
+	{ "imap", { IPPROTO_TCP, 0 },                1 },
+	{ "smb",  { IPPROTO_TCP, 0 },                1 },
+	{ "dns",  { IPPROTO_TCP, IPPROTO_UDP },      2 },
+	{ "ntp",  { IPPROTO_UDP, 0 },                1 },
+	{ "dhcp", { IPPROTO_UDP, 0 },                1 },
+	{ "tftp", { IPPROTO_UDP, 0 },                1 },
+	{ nullptr, { 0, 0 },                         0 }
+};
+
+// pcre modifiers selecting a buffer, as the content modifiers.
+static const pair<char, const char *> pcre_buffers[] = {
+	{ 'U', "http_uri" },
+	{ 'I', "http_raw_uri" },
+	{ 'P', "http_client_body" },
+	{ 'H', "http_header" },
+	{ 'D', "http_raw_header" },
+	{ 'M', "http_method" },
+	{ 'C', "http_cookie" },
+	{ 'K', "http_raw_cookie" },
+	{ 'S', "http_stat_code" },
+	{ 'Y', "http_stat_msg" },
+};
+
+static uint32_t prefix_key(const char *p)
+{
+	uint32_t key = 0;
+
+	for (size_t i = 0; i < PREFIX_LENGTH; i++) {
+		key |= static_cast<uint32_t>(static_cast<unsigned char>(fold_case(p[i]))) << (8 * i);
+	}
+
+	return key;
+}
+
+static int proto_class(uint8_t proto)
+{
+	switch (proto) {
+	case IPPROTO_TCP:
+		return PROTO_CLASS_TCP;
+	case IPPROTO_UDP:
+		return PROTO_CLASS_UDP;
+	case IPPROTO_ICMP:
+	case IPPROTO_ICMPV6:
+		return PROTO_CLASS_ICMP;
+	}
+
+	return PROTO_CLASS_OTHER;
+}
+
+static size_t prefix_bit(uint32_t key)
+{
+	return (key * 2654435761u) >> (32 - PREFIX_BITMAP_BITS);
+}
+
+// First occurrence at or after 'from' ending by 'stop', or -1.
+static long find_content(string_view s, long from, long stop, const string &bytes, bool nocase)
+{
+	long n = bytes.length();
+
+	if (from + n > stop) {
+		return -1;
+	}
+
+	if (!nocase) {
+		size_t p = s.substr(0, stop).find(bytes, from);
+
+		return (p == string_view::npos) ? -1 : static_cast<long>(p);
+	}
+
+	// 'bytes' is folded already.
+	for (long p = from; p + n <= stop; p++) {
+		long i = 0;
+
+		while (i < n && fold_case(s[p + i]) == bytes[i]) {
+			i++;
+		}
+
+		if (i == n) {
+			return p;
+		}
+	}
+
+	return -1;
+}
+
+replay_profiler::replay_profiler(const rule_vars *vars, size_t top)
+	: vars(vars), top(top), prefix_bits((1 << PREFIX_BITMAP_BITS) / 64)
+{
+}
+
+void replay_profiler::add(size_t line, uint32_t sid, const type_parsed_rule &rule)
+{
+	type_replay_rule r;
+	vector<type_content_match> contents;
+
+	r.line = line;
+	r.sid = sid;
+	r.bidirectional = rule.direction == "<>";
+
+	if (!resolve_header(rule, vars, r.header)) {
+		skipped_count++;
+		return;
+	}
+
+	for (size_t i = 0; proto_names[i].name != nullptr; i++) {
+		if (boost::iequals(rule.proto, proto_names[i].name)) {
+			r.protos.assign(proto_names[i].protos, proto_names[i].protos + proto_names[i].count);
+		}
+	}
+
+	collect_contents(rule, contents);
+
+	auto content = contents.begin();
+
+	for (size_t i = 0; i < rule.options.size(); i++) {
+		type_replay_element e = {};
+
+		if (content != contents.end() && content->option == i) {
+			e.buffer = string(content->buffer);
+			e.negated = content->negated;
+			e.relative = content->relative;
+			e.bytes = content->bytes;
+			e.nocase = content->nocase;
+
+			// byte_extract variables: only the order is known.
+			if (!content->variable_position) {
+				e.has_offset = content->has_offset;
+				e.has_depth = content->has_depth;
+				e.has_within = content->has_within;
+				e.offset = content->offset;
+				e.depth = content->depth;
+				e.distance = content->distance;
+				e.within = content->within;
+			}
+
+			if (e.nocase) {
+				transform(e.bytes.begin(), e.bytes.end(), e.bytes.begin(), fold_case);
+			}
+
+			++content;
+		} else if (rule.options[i].id == OPTION_PCRE) {
+			e.arg = make_unique<string>(rule.options[i].arg);
+			e.expr = make_unique<pcre_expression>();
+
+			if (!e.expr->parse(*e.arg)) {
+				continue;
+			}
+
+			e.matcher = make_unique<regex_matcher>(*e.expr);
+			e.negated = e.expr->negated();
+			e.relative = e.expr->flags() & PCRE_RELATIVE;
+
+			for (const auto &buffer : pcre_buffers) {
+				if (e.expr->modifiers().find(buffer.first) != string_view::npos) {
+					e.buffer = buffer.second;
+				}
+			}
+		} else {
+			continue;
+		}
+
+		e.prev = -1;
+
+		for (int k = r.elements.size() - 1; k >= 0 && e.prev == -1; k--) {
+			if (!r.elements[k].negated && r.elements[k].buffer == e.buffer) {
+				e.prev = k;
+			}
+		}
+
+		if (e.relative && e.prev != -1) {
+			r.elements[e.prev].anchor = true;
+		}
+
+		r.elements.push_back(move(e));
+	}
+
+	const type_content_match *fast = select_fast_pattern(contents);
+	uint32_t index = compiled.size();
+	bool classes[PROTO_CLASSES] = {};
+	// Destination ports, only when they always apply.
+	size_t ports = SIZE_MAX;
+	vector<uint32_t> sources;
+	bool by_sources = !r.bidirectional && r.header.src_addr.ipv4_prefixes(SOURCE_PREFIX_LENGTH,
+		SOURCE_GROUP_MAX, sources);
+
+	if (!r.bidirectional && !r.protos.empty() && all_of(r.protos.begin(), r.protos.end(), [](uint8_t proto) {
+		return proto == IPPROTO_TCP || proto == IPPROTO_UDP;
+	})) {
+		ports = 0;
+
+		for (const auto &span : r.header.dst_port.spans()) {
+			ports += span.second - span.first + 1;
+		}
+	}
+
+	for (int c = 0; c < PROTO_CLASSES; c++) {
+		classes[c] = r.protos.empty();
+	}
+
+	for (uint8_t proto : r.protos) {
+		classes[proto_class(proto)] = true;
+	}
+
+	for (int c = 0; c < PROTO_CLASSES; c++) {
+		if (!classes[c]) {
+			continue;
+		}
+
+		if (fast && fast->bytes.length() >= PREFIX_LENGTH) {
+			uint32_t key = prefix_key(fast->bytes.data());
+
+			by_prefix[c][key].push_back(index);
+			prefix_bits[prefix_bit(key) / 64] |= 1ull << (prefix_bit(key) % 64);
+		} else if (ports <= PORT_GROUP_MAX) {
+			for (const auto &span : r.header.dst_port.spans()) {
+				for (uint32_t port = span.first; port <= span.second; port++) {
+					by_port[c][port].push_back(index);
+				}
+			}
+		} else if (by_sources) {
+			for (uint32_t source : sources) {
+				by_source[c][source].push_back(index);
+			}
+		} else {
+			always[c].push_back(index);
+		}
+	}
+
+	compiled.push_back(move(r));
+}
+
+bool replay_profiler::header_matches(const type_replay_rule &rule, const type_packet &packet) const
+{
+	if (!rule.protos.empty() && find(rule.protos.begin(), rule.protos.end(), packet.proto) == rule.protos.end()) {
+		return false;
+	}
+
+	// Ports only count for protocols that have them.
+	bool ports = packet.proto == IPPROTO_TCP || packet.proto == IPPROTO_UDP;
+	const type_header_sets &h = rule.header;
+
+	if (h.src_addr.contains(packet.src_addr, packet.ipv6) && h.dst_addr.contains(packet.dst_addr, packet.ipv6) &&
+		(!ports || (h.src_port.contains(packet.src_port) && h.dst_port.contains(packet.dst_port)))) {
+		return true;
+	}
+
+	return rule.bidirectional && h.src_addr.contains(packet.dst_addr, packet.ipv6) &&
+		h.dst_addr.contains(packet.src_addr, packet.ipv6) &&
+		(!ports || (h.src_port.contains(packet.dst_port) && h.dst_port.contains(packet.src_port)));
+}
+
+// Match the elements from 'index' on, backtracking over occurrences of
+// the ones later elements are relative to.
+bool replay_profiler::match(const type_replay_rule &rule, size_t index, type_eval_state &st) const
+{
+	if (index == rule.elements.size()) {
+		return true;
+	}
+
+	if (++st.steps > CHAIN_STEP_LIMIT) {
+		st.limit = true;
+		return false;
+	}
+
+	const type_replay_element &e = rule.elements[index];
+	long len = st.payload.length();
+	long base = (e.relative && e.prev != -1) ? st.ends[e.prev] : 0;
+
+	if (e.matcher) {
+		size_t end = base;
+		// Unsupported constructs: taken as matching.
+		int res = e.matcher->supported() ? e.matcher->search(st.payload, base, end) : REGEX_MATCH;
+
+		if (res == REGEX_LIMIT) {
+			st.limit = true;
+			return false;
+		}
+
+		if (e.negated) {
+			return res == REGEX_NO_MATCH && match(rule, index + 1, st);
+		}
+
+		st.ends[index] = end;
+
+		return res == REGEX_MATCH && match(rule, index + 1, st);
+	}
+
+	long start;
+	long stop;
+
+	if (e.relative) {
+		start = base + e.distance;
+		stop = e.has_within ? start + e.within : len;
+	} else {
+		start = e.has_offset ? e.offset : 0;
+		stop = e.has_depth ? start + e.depth : len;
+	}
+
+	start = max(start, 0l);
+	stop = min(stop, len);
+
+	for (long p = find_content(st.payload, start, stop, e.bytes, e.nocase); p != -1;
+		p = find_content(st.payload, p + 1, stop, e.bytes, e.nocase)) {
+		if (e.negated) {
+			return false;
+		}
+
+		st.ends[index] = p + e.bytes.length();
+
+		if (match(rule, index + 1, st)) {
+			return true;
+		}
+
+		// Other occurrences only matter to relative elements.
+		if (!e.anchor || st.limit) {
+			return false;
+		}
+	}
+
+	return e.negated && match(rule, index + 1, st);
+}
+
+void replay_profiler::evaluate(const type_packet &packet, vector<uint32_t> &candidates,
+	vector<pair<uint32_t, type_rule_totals>> &samples) const
+{
+	string_view payload = packet.payload;
+	type_eval_state st = { payload, {}, 0, false };
+	int c = proto_class(packet.proto);
+
+	candidates = always[c];
+
+	if (c == PROTO_CLASS_TCP || c == PROTO_CLASS_UDP) {
+		auto it = by_port[c].find(packet.dst_port);
+
+		if (it != by_port[c].end()) {
+			candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+		}
+	}
+
+	if (!packet.ipv6) {
+		uint32_t addr = (packet.src_addr[0] << 24) | (packet.src_addr[1] << 16) | (packet.src_addr[2] << 8) |
+			packet.src_addr[3];
+		auto it = by_source[c].find(addr >> (32 - SOURCE_PREFIX_LENGTH));
+
+		if (it != by_source[c].end()) {
+			candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+		}
+	}
+
+	for (size_t i = 0; i + PREFIX_LENGTH <= payload.length(); i++) {
+		uint32_t key = prefix_key(payload.data() + i);
+		size_t bit = prefix_bit(key);
+
+		if (!(prefix_bits[bit / 64] & (1ull << (bit % 64)))) {
+			continue;
+		}
+
+		auto it = by_prefix[c].find(key);
+
+		if (it != by_prefix[c].end()) {
+			candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+		}
+	}
+
+	sort(candidates.begin(), candidates.end());
+	candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+	for (uint32_t index : candidates) {
+		const type_replay_rule &rule = compiled[index];
+
+		if (!header_matches(rule, packet)) {
+			continue;
+		}
+
+		st.ends.assign(rule.elements.size(), 0);
+		st.steps = 0;
+		st.limit = false;
+
+		auto start = chrono::steady_clock::now();
+		bool matched = match(rule, 0, st);
+		auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+
+		samples.push_back({ index, { static_cast<uint64_t>(ns), 1, matched, st.limit } });
+	}
+}
+
+void replay_profiler::run(pcap_reader &pcap, unsigned jobs)
+{
+	auto start = chrono::steady_clock::now();
+	vector<type_packet> batch;
+	// Samples of each chunk of the batch, merged once it is done.
+	vector<vector<pair<uint32_t, type_rule_totals>>> chunk_samples;
+	type_packet packet;
+	bool eof = false;
+
+	totals.assign(compiled.size(), { 0, 0, 0, 0 });
+	batch.reserve(REPLAY_BATCH_SIZE);
+
+	while (!eof) {
+		batch.clear();
+		pcap.release();
+
+		while (batch.size() < REPLAY_BATCH_SIZE) {
+			if (!pcap.next(packet)) {
+				eof = true;
+				break;
+			}
+
+			batch.push_back(packet);
+			bytes_count += packet.payload.length();
+		}
+
+		packets_count += batch.size();
+		chunk_samples.assign((batch.size() + REPLAY_CHUNK_SIZE - 1) / REPLAY_CHUNK_SIZE, {});
+
+		parallel_for(batch.size(), jobs, REPLAY_CHUNK_SIZE, [&](size_t begin, size_t end) {
+			vector<uint32_t> candidates;
+			vector<pair<uint32_t, type_rule_totals>> &samples = chunk_samples[begin / REPLAY_CHUNK_SIZE];
+
+			for (size_t i = begin; i < end; i++) {
+				evaluate(batch[i], candidates, samples);
+			}
+		});
+
+		for (const auto &samples : chunk_samples) {
+			for (const auto &sample : samples) {
+				type_rule_totals &t = totals[sample.first];
+
+				t.ns += sample.second.ns;
+				t.evaluations += sample.second.evaluations;
+				t.matches += sample.second.matches;
+				t.limit_hits += sample.second.limit_hits;
+			}
+		}
+	}
+
+	wall_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+vector<type_corpus_finding> replay_profiler::finish()
+{
+	vector<type_corpus_finding> findings;
+	vector<uint32_t> order;
+	uint64_t total_ns = 0;
+
+	for (uint32_t i = 0; i < totals.size(); i++) {
+		if (totals[i].evaluations) {
+			order.push_back(i);
+			total_ns += totals[i].ns;
+		}
+	}
+
+	evaluated_count = order.size();
+
+	size_t count = min(order.size(), top);
+
+	partial_sort(order.begin(), order.begin() + count, order.end(), [this](uint32_t a, uint32_t b) {
+		return totals[a].ns > totals[b].ns || (totals[a].ns == totals[b].ns && a < b);
+	});
+
+	for (size_t i = 0; i < count; i++) {
+		const type_rule_totals &t = totals[order[i]];
+		char buf[256];
+
+		snprintf(buf, sizeof(buf), "%.3f ms (%.1f%% of the time in rules) in %llu evaluations, "
+			"%.2f us each, %llu matches", t.ns / 1e6, total_ns ? 100.0 * t.ns / total_ns : 0,
+			static_cast<unsigned long long>(t.evaluations), t.ns / 1e3 / t.evaluations,
+			static_cast<unsigned long long>(t.matches));
+
+		findings.push_back(type_corpus_finding());
+		findings.back().line = compiled[order[i]].line;
+		findings.back().sid = compiled[order[i]].sid;
+		findings.back().diag.code = DIAG_MEASURED_COST;
+		findings.back().diag.column = 0;
+		findings.back().diag.detail = buf;
+
+		if (t.limit_hits) {
+			findings.back().diag.detail += ", " + to_string(t.limit_hits) + " gave up at the match limit";
+		}
+	}
+
+	return findings;
+}
@@ -0,0 +1,160 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "corpus_checker.h"
+#include "pcap_reader.h"
+#include "pcre_parser.h"
+#include "regex_matcher.h"
+#include "rule_checker.h"
+#include "rule_vars.h"
+
+// Protocol classes the rules are indexed by: TCP, UDP, ICMP and others.
+#define PROTO_CLASSES		4
+
+// Replay of a capture against the rules, measuring what each rule costs
+// on real traffic rather than estimating it (see cost_model.h).
+//
+// Rules are evaluated per packet, without flow state, the way an engine
+// does: a prefilter on the fast pattern selects the rules whose pattern
+// may occur in the payload (rules without a usable one are grouped by
+// destination port or source network), then the header (protocol,
+// addresses and ports, both ways for '<>'), then the contents with
+// offset/depth/distance/within and the pcres in rule order, trying further occurrences of a content
+// when a later one is relative to it. Every buffer is the packet payload
+// and other options (flow, flowbits, byte_test, ...) are not evaluated,
+// so rules may match more often than in an engine.
+//
+// Each evaluation past the header is timed; packets are evaluated in
+// batches spread over threads.
+class replay_profiler
+{
+public:
+	// 'vars' resolve the rule headers, see resolve_header().
+	replay_profiler(const rule_vars *vars, size_t top);
+
+	// Compile a rule for matching; all it needs is copied. Rules whose
+	// header doesn't resolve are skipped.
+	void add(size_t line, uint32_t sid, const type_parsed_rule &rule);
+	void run(pcap_reader &pcap, unsigned jobs);
+	// The 'top' rules taking the most time, most expensive first, as
+	// DIAG_MEASURED_COST findings.
+	std::vector<type_corpus_finding> finish();
+
+	size_t packets() const
+	{
+		return packets_count;
+	}
+
+	size_t payload_bytes() const
+	{
+		return bytes_count;
+	}
+
+	// Wall time of run().
+	double seconds() const
+	{
+		return wall_seconds;
+	}
+
+	size_t rules() const
+	{
+		return compiled.size();
+	}
+
+	size_t skipped() const
+	{
+		return skipped_count;
+	}
+
+	// Rules evaluated at least once, valid after finish().
+	size_t evaluated() const
+	{
+		return evaluated_count;
+	}
+
+private:
+	// A content or pcre.
+	typedef struct replay_element
+	{
+		std::string buffer;
+		bool negated;
+		bool relative;
+		// Previous positive element in the same buffer, what a relative
+		// one is placed after; -1 for the start of the buffer.
+		int prev;
+		// A later element is relative to this one: other occurrences are
+		// tried if the rest of the rule fails.
+		bool anchor;
+		// Content.
+		std::string bytes;
+		bool nocase;
+		bool has_offset;
+		bool has_depth;
+		bool has_within;
+		long offset;
+		long depth;
+		long distance;
+		long within;
+		// pcre, whose expression keeps views into 'arg'.
+		std::unique_ptr<std::string> arg;
+		std::unique_ptr<pcre_expression> expr;
+		std::unique_ptr<regex_matcher> matcher;
+	} type_replay_element;
+
+	typedef struct replay_rule
+	{
+		size_t line;
+		uint32_t sid;
+		// IP protocols, empty for any.
+		std::vector<uint8_t> protos;
+		bool bidirectional;
+		type_header_sets header;
+		std::vector<type_replay_element> elements;
+	} type_replay_rule;
+
+	typedef struct rule_totals
+	{
+		uint64_t ns;
+		uint64_t evaluations;
+		uint64_t matches;
+		uint64_t limit_hits;
+	} type_rule_totals;
+
+	typedef struct eval_state
+	{
+		std::string_view payload;
+		std::vector<size_t> ends;
+		size_t steps;
+		bool limit;
+	} type_eval_state;
+
+	bool header_matches(const type_replay_rule &rule, const type_packet &packet) const;
+	bool match(const type_replay_rule &rule, size_t index, type_eval_state &st) const;
+	void evaluate(const type_packet &packet, std::vector<uint32_t> &candidates,
+		std::vector<std::pair<uint32_t, type_rule_totals>> &samples) const;
+
+	const rule_vars *vars;
+	size_t top;
+	std::vector<type_replay_rule> compiled;
+	// Prefilter, per protocol class: rules by the first 4 bytes (folded)
+	// of their fast pattern, with a bitmap over them to skip most payload
+	// offsets cheaply. Rules without one are candidates for every packet
+	// to their destination ports if there are few of them, as in the port
+	// groups of an engine, else from their source IPv4 networks (/16) if
+	// there are few of them (address lists, as in an IP reputation
+	// lookup), or else for every packet.
+	std::unordered_map<uint32_t, std::vector<uint32_t>> by_prefix[PROTO_CLASSES];
+	std::vector<uint64_t> prefix_bits;
+	std::unordered_map<uint32_t, std::vector<uint32_t>> by_port[PROTO_CLASSES];
+	std::unordered_map<uint32_t, std::vector<uint32_t>> by_source[PROTO_CLASSES];
+	std::vector<uint32_t> always[PROTO_CLASSES];
+	std::vector<type_rule_totals> totals;
+	size_t packets_count = 0;
+	size_t bytes_count = 0;
+	size_t skipped_count = 0;
+	size_t evaluated_count = 0;
+	double wall_seconds = 0;
+};
@@ -0,0 +1,326 @@
+#include "report_writer.h"
+
+using namespace std;
+
+#define OUTPUT_BUFFER_SIZE	(1 << 16)
+
+static const char *format_names[] = { "text", "jsonl", "sarif", nullptr };
+
+int find_format(const string &name)
+{
+	for (int i = 0; format_names[i] != nullptr; i++) {
+		if (name == format_names[i]) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+output_buffer::output_buffer(FILE *out)
+	: out(out)
+{
+	buf.reserve(OUTPUT_BUFFER_SIZE * 2);
+}
+
+output_buffer::~output_buffer()
+{
+	flush();
+}
+
+output_buffer &output_buffer::operator<<(string_view s)
+{
+	buf.append(s.data(), s.length());
+
+	if (buf.length() >= OUTPUT_BUFFER_SIZE) {
+		flush();
+	}
+
+	return *this;
+}
+
+output_buffer &output_buffer::operator<<(char c)
+{
+	buf += c;
+	return *this;
+}
+
+output_buffer &output_buffer::operator<<(size_t n)
+{
+	return *this << string_view(to_string(n));
+}
+
+void output_buffer::flush()
+{
+	if (!buf.empty()) {
+		fwrite(buf.data(), 1, buf.length(), out);
+		buf.clear();
+	}
+
+	fflush(out);
+}
+
+report_writer::report_writer(int format, const string &filename, FILE *out)
+	: format(format), filename(filename == "-" ? "stdin" : filename), out(out), first_result(true),
+	current_file(nullptr)
+{
+}
+
+void report_writer::json_string(string_view s)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	out << '"';
+
+	for (char c : s) {
+		switch (c) {
+		case '"':
+			out << "\\\"";
+			break;
+		case '\\':
+			out << "\\\\";
+			break;
+		case '\n':
+			out << "\\n";
+			break;
+		case '\r':
+			out << "\\r";
+			break;
+		case '\t':
+			out << "\\t";
+			break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				out << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+			} else {
+				out << c;
+			}
+		}
+	}
+
+	out << '"';
+}
+
+void report_writer::begin()
+{
+	if (format != FORMAT_SARIF) {
+		return;
+	}
+
+	out << "{\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\",\"version\":\"2.1.0\","
+		"\"runs\":[{\"tool\":{\"driver\":{\"name\":\"dumbpig\",\"rules\":[";
+
+	for (size_t i = 0; i < DIAG_CODES_COUNT; i++) {
+		out << (i ? "," : "") << "{\"id\":\"" << diag_infos[i].id << "\",\"shortDescription\":{\"text\":";
+		json_string(describe_diagnostic(static_cast<type_diag_code>(i)));
+		out << "}}";
+	}
+
+	out << "]}},\"results\":[";
+}
+
+void report_writer::rule(const type_rule_line &rule, const type_parsed_rule &report, const type_rule_fix *fix)
+{
+	if (format == FORMAT_TEXT) {
+		size_t line = rule.first_line;
+		const string *file = locate_input_line(line);
+
+		// Inputs of several files: a heading per file.
+		if (file && file != current_file) {
+			out << "File: " << *file << "\n\n";
+			current_file = file;
+		}
+
+		out << "Rule: " << rule.text << '\n';
+
+		for (size_t i = 0; i < report.diags.size(); i++) {
+			out << (i ? "\n- " : "- ") << format_diagnostic(report.diags[i]);
+		}
+
+		if (fix) {
+			rewritten(rule, report, *fix);
+		}
+
+		out << "\n\n";
+		return;
+	}
+
+	for (const type_diagnostic &diag : report.diags) {
+		diagnostic(rule.first_line, report.sid, diag);
+	}
+
+	if (fix) {
+		rewritten(rule, report, *fix);
+	}
+}
+
+// Diff style in the text format, the rewritten rule in the JSON ones (a
+// SARIF fix replacing the rule's lines).
+void report_writer::rewritten(const type_rule_line &rule, const type_parsed_rule &report, const type_rule_fix &fix)
+{
+	type_diagnostic diag = { DIAG_REWRITTEN, string_view(), string_view(), 0, fix.summary };
+	size_t line = rule.first_line;
+	const string *file = locate_input_line(line);
+
+	if (format == FORMAT_TEXT) {
+		out << (report.diags.empty() ? "- " : "\n- ") << format_diagnostic(diag) << "\n  -" << rule.text
+			<< "\n  +" << fix.text;
+	} else if (format == FORMAT_JSONL) {
+		jsonl_diagnostic(file ? *file : filename, line, report.sid, diag, &fix.text);
+	} else {
+		sarif_result(file ? *file : filename, line, report.sid, diag, &rule, &fix);
+	}
+}
+
+void report_writer::findings(const vector<type_corpus_finding> &findings)
+{
+	if (format == FORMAT_TEXT) {
+		if (!findings.empty()) {
+			out << "Cross-rule checks:\n";
+		}
+
+		for (const type_corpus_finding &finding : findings) {
+			text_finding(finding);
+		}
+
+		return;
+	}
+
+	for (const type_corpus_finding &finding : findings) {
+		diagnostic(finding.line, finding.sid, finding.diag);
+	}
+}
+
+void report_writer::section(const string &title, const vector<type_corpus_finding> &section_findings)
+{
+	if (format != FORMAT_TEXT) {
+		findings(section_findings);
+		return;
+	}
+
+	out << title << ":\n";
+
+	for (const type_corpus_finding &finding : section_findings) {
+		text_finding(finding);
+	}
+}
+
+void report_writer::text_finding(const type_corpus_finding &finding)
+{
+	size_t line = finding.line;
+	const string *file = locate_input_line(line);
+
+	if (file) {
+		out << "- " << *file << ':' << line;
+	} else {
+		out << "- Line " << line;
+	}
+
+	out << ": " << format_diagnostic(finding.diag) << '\n';
+}
+
+void report_writer::diagnostic(size_t line, uint32_t sid, const type_diagnostic &diag)
+{
+	const string *file = locate_input_line(line);
+
+	if (format == FORMAT_JSONL) {
+		jsonl_diagnostic(file ? *file : filename, line, sid, diag);
+	} else {
+		sarif_result(file ? *file : filename, line, sid, diag);
+	}
+}
+
+void report_writer::jsonl_diagnostic(const string &file, size_t line, uint32_t sid, const type_diagnostic &diag,
+	const string *fix)
+{
+	out << "{\"file\":";
+	json_string(file);
+	out << ",\"line\":" << line << ",\"column\":" << diag.column
+		<< ",\"code\":\"" << diag_infos[diag.code].id << "\",\"severity\":\""
+		<< (diag_severity(diag) == SEVERITY_ERROR ? "error" : "warning") << "\",\"option\":";
+
+	if (diag.option.empty()) {
+		out << "null";
+	} else {
+		json_string(diag.option);
+	}
+
+	out << ",\"sid\":";
+
+	if (sid) {
+		out << static_cast<size_t>(sid);
+	} else {
+		out << "null";
+	}
+
+	out << ",\"message\":";
+	json_string(format_diagnostic(diag));
+
+	if (fix) {
+		out << ",\"fix\":";
+		json_string(*fix);
+	}
+
+	out << "}\n";
+}
+
+void report_writer::sarif_result(const string &file, size_t line, uint32_t sid, const type_diagnostic &diag,
+	const type_rule_line *rule, const type_rule_fix *fix)
+{
+	out << (first_result ? "" : ",") << "{\"ruleId\":\"" << diag_infos[diag.code].id
+		<< "\",\"level\":\"" << (diag_severity(diag) == SEVERITY_ERROR ? "error" : "warning")
+		<< "\",\"message\":{\"text\":";
+	json_string(format_diagnostic(diag));
+	out << "},\"locations\":[{\"physicalLocation\":{\"artifactLocation\":{\"uri\":";
+	json_string(file);
+	out << "},\"region\":{\"startLine\":" << line;
+
+	if (diag.column) {
+		out << ",\"startColumn\":" << diag.column;
+	}
+
+	out << "}}}]";
+
+	// The rewritten rule replaces all of its lines.
+	if (fix) {
+		size_t last_line = rule->last_line;
+
+		locate_input_line(last_line);
+		out << ",\"fixes\":[{\"description\":{\"text\":";
+		json_string(fix->summary);
+		out << "},\"artifactChanges\":[{\"artifactLocation\":{\"uri\":";
+		json_string(file);
+		out << "},\"replacements\":[{\"deletedRegion\":{\"startLine\":" << line << ",\"endLine\":" << last_line
+			<< "},\"insertedContent\":{\"text\":";
+		json_string(fix->text);
+		out << "}}]}]}]";
+	}
+
+	out << ",\"properties\":{\"option\":";
+
+	if (diag.option.empty()) {
+		out << "null";
+	} else {
+		json_string(diag.option);
+	}
+
+	out << ",\"sid\":";
+
+	if (sid) {
+		out << static_cast<size_t>(sid);
+	} else {
+		out << "null";
+	}
+
+	out << "}}";
+	first_result = false;
+}
+
+void report_writer::end()
+{
+	if (format == FORMAT_SARIF) {
+		out << "]}]}\n";
+	}
+
+	out.flush();
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "corpus_checker.h"
+#include "rule_checker.h"
+#include "rule_fixer.h"
+#include "rule_reader.h"
+
+#define FORMAT_TEXT	0
+#define FORMAT_JSONL	1
+#define FORMAT_SARIF	2
+
+// Format ID by name or -1.
+int find_format(const std::string &name);
+
+// Output buffer flushed in large blocks, not per rule.
+class output_buffer
+{
+public:
+	explicit output_buffer(FILE *out);
+	~output_buffer();
+
+	output_buffer &operator<<(std::string_view s);
+	output_buffer &operator<<(char c);
+	output_buffer &operator<<(size_t n);
+	void flush();
+
+private:
+	FILE *out;
+	std::string buf;
+};
+
+// Rules and findings are reported on input lines; with several input
+// files (see add_input_file()) each is reported with its file.
+class report_writer
+{
+public:
+	report_writer(int format, const std::string &filename, FILE *out = stdout);
+
+	void begin();
+	// 'fix' is the rule's rewrite, if any: reported as DIAG_REWRITTEN
+	// with the rule before and after it.
+	void rule(const type_rule_line &rule, const type_parsed_rule &report, const type_rule_fix *fix = nullptr);
+	void findings(const std::vector<type_corpus_finding> &findings);
+	// Findings of an optional analysis; the text format prints them under
+	// 'title'.
+	void section(const std::string &title, const std::vector<type_corpus_finding> &findings);
+	void end();
+
+private:
+	void json_string(std::string_view s);
+	void text_finding(const type_corpus_finding &finding);
+	// 'line' is an input line, see add_input_file().
+	void diagnostic(size_t line, uint32_t sid, const type_diagnostic &diag);
+	// 'fix' is the rewritten rule of DIAG_REWRITTEN.
+	void jsonl_diagnostic(const std::string &file, size_t line, uint32_t sid, const type_diagnostic &diag,
+		const std::string *fix = nullptr);
+	void sarif_result(const std::string &file, size_t line, uint32_t sid, const type_diagnostic &diag,
+		const type_rule_line *rule = nullptr, const type_rule_fix *fix = nullptr);
+	void rewritten(const type_rule_line &rule, const type_parsed_rule &report, const type_rule_fix &fix);
+
+	int format;
+	std::string filename;
+	output_buffer out;
+	bool first_result;
+	// File of the last rule printed, inputs of several files only.
+	const std::string *current_file;
+};
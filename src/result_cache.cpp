@@ -0,0 +1,489 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hash.h"
+#include "result_cache.h"
+#include "rule_vars.h"
+
+using namespace std;
+
+#define CACHE_MAGIC		"DPCACHE1"
+// Bump when the record layout changes.
+#define CACHE_FORMAT_VERSION	2
+// Seeds of the two independent rule hashes.
+#define CACHE_KEY_SEED		0
+#define CACHE_CHECK_SEED	0x5bd1e995
+// Entries of the old file not used by this run are carried over only
+// while the cache stays below this size.
+#define CACHE_MAX_ENTRIES	(1 << 21)
+// Offset of a view that does not point into the rule.
+#define SPAN_NONE		UINT32_MAX
+
+// Everything that changes check results: the option table of the
+// dialect, the diagnostics table, the checker revision and its
+// configuration.
+static uint64_t checker_version(const type_checker_config &config)
+{
+	uint64_t h = hash_mix(CACHE_FORMAT_VERSION);
+
+	h = hash_step(h, RULE_CHECKER_REVISION);
+	h = hash_step(h, config.performance_checks);
+	h = hash_step(h, config.vars ? config.vars->hash() : 0);
+	h = hash_step(h, config.dialect);
+
+	const type_rule_options *options = dialect_tables[config.dialect].options;
+
+	for (size_t i = 0; i < RULE_OPTIONS_COUNT; i++) {
+		h = hash_step(h, options[i].name ? hash_string(options[i].name) : 0);
+		h = hash_step(h, options[i].args_required | (options[i].only_once << 1) |
+			((options[i].arg_checker != nullptr) << 2) | (options[i].buffer << 3));
+	}
+
+	for (size_t i = 0; i < DIAG_CODES_COUNT; i++) {
+		h = hash_step(h, hash_string(diag_infos[i].id));
+		h = hash_step(h, hash_string(diag_infos[i].format));
+		h = hash_step(h, diag_infos[i].severity);
+	}
+
+	return hash_mix(h);
+}
+
+static void put_u32(string &out, uint32_t value)
+{
+	out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// Views are stored relative to the rule they point into.
+static bool put_span(string &out, string_view text, string_view v)
+{
+	if (v.data() == nullptr) {
+		put_u32(out, SPAN_NONE);
+		put_u32(out, 0);
+		return true;
+	}
+
+	if (v.data() < text.data() || v.data() + v.length() > text.data() + text.length()) {
+		return false;
+	}
+
+	put_u32(out, v.data() - text.data());
+	put_u32(out, v.length());
+
+	return true;
+}
+
+typedef struct record_reader
+{
+	const char *pos;
+	const char *end;
+	string_view text;
+
+	bool u32(uint32_t &value)
+	{
+		if (end - pos < static_cast<ptrdiff_t>(sizeof(value))) {
+			return false;
+		}
+
+		memcpy(&value, pos, sizeof(value));
+		pos += sizeof(value);
+
+		return true;
+	}
+
+	bool span(string_view &v)
+	{
+		uint32_t offset, length;
+
+		if (!u32(offset) || !u32(length)) {
+			return false;
+		}
+
+		if (offset == SPAN_NONE) {
+			v = string_view();
+			return true;
+		}
+
+		if (offset > text.length() || length > text.length() - offset) {
+			return false;
+		}
+
+		v = text.substr(offset, length);
+
+		return true;
+	}
+
+	bool bytes(size_t length, string &s)
+	{
+		if (static_cast<size_t>(end - pos) < length) {
+			return false;
+		}
+
+		s.assign(pos, length);
+		pos += length;
+
+		return true;
+	}
+} type_record_reader;
+
+static bool serialize(string_view text, const type_parsed_rule &rule, string &out)
+{
+	string_view header[] = { rule.action, rule.proto, rule.src_addr, rule.src_port,
+		rule.direction, rule.dst_addr, rule.dst_port };
+	bool ok = true;
+
+	put_u32(out, rule.status);
+	put_u32(out, rule.sid);
+	put_u32(out, rule.gid);
+	put_u32(out, rule.rev);
+
+	for (string_view v : header) {
+		ok = ok && put_span(out, text, v);
+	}
+
+	put_u32(out, rule.options.size());
+
+	for (const type_parsed_option &opt : rule.options) {
+		put_u32(out, opt.id | (opt.has_arg << 16) | (opt.buffer << 17));
+		ok = ok && put_span(out, text, opt.name) && put_span(out, text, opt.arg);
+		put_u32(out, opt.offset);
+		put_u32(out, opt.arg_offset);
+	}
+
+	put_u32(out, rule.flowbits.size());
+
+	for (const type_flowbit_ref &ref : rule.flowbits) {
+		put_u32(out, ref.op);
+		ok = ok && put_span(out, text, ref.name);
+	}
+
+	put_u32(out, rule.diags.size());
+
+	for (const type_diagnostic &diag : rule.diags) {
+		put_u32(out, diag.code);
+		ok = ok && put_span(out, text, diag.option) && put_span(out, text, diag.where);
+		put_u32(out, diag.column);
+		put_u32(out, diag.detail.length());
+		out += diag.detail;
+	}
+
+	return ok;
+}
+
+static bool deserialize(type_record_reader &in, type_parsed_rule &rule)
+{
+	string_view *header[] = { &rule.action, &rule.proto, &rule.src_addr, &rule.src_port,
+		&rule.direction, &rule.dst_addr, &rule.dst_port };
+	uint32_t status, count, value;
+
+	rule.text = in.text;
+	rule.options.clear();
+	rule.flowbits.clear();
+	rule.diags.clear();
+
+	if (!in.u32(status) || !in.u32(rule.sid) || !in.u32(rule.gid) || !in.u32(rule.rev)) {
+		return false;
+	}
+
+	rule.status = static_cast<int32_t>(status);
+
+	for (string_view *v : header) {
+		if (!in.span(*v)) {
+			return false;
+		}
+	}
+
+	if (!in.u32(count)) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		type_parsed_option opt;
+
+		if (!in.u32(value) || !in.span(opt.name) || !in.span(opt.arg) ||
+			!in.u32(opt.offset) || !in.u32(opt.arg_offset)) {
+			return false;
+		}
+
+		opt.id = value & 0xffff;
+		opt.has_arg = (value >> 16) & 1;
+		opt.buffer = value >> 17;
+
+		if (opt.id >= static_cast<int>(RULE_OPTIONS_COUNT)) {
+			return false;
+		}
+
+		rule.options.push_back(opt);
+	}
+
+	if (!in.u32(count)) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		type_flowbit_ref ref;
+		uint32_t op;
+
+		if (!in.u32(op) || !in.span(ref.name)) {
+			return false;
+		}
+
+		ref.op = op;
+		rule.flowbits.push_back(ref);
+	}
+
+	if (!in.u32(count)) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		type_diagnostic diag;
+		uint32_t column, length;
+
+		if (!in.u32(value) || value >= DIAG_CODES_COUNT || !in.span(diag.option) ||
+			!in.span(diag.where) || !in.u32(column) || !in.u32(length) ||
+			!in.bytes(length, diag.detail)) {
+			return false;
+		}
+
+		diag.code = static_cast<type_diag_code>(value);
+		diag.column = column;
+		rule.diags.push_back(move(diag));
+	}
+
+	return in.pos == in.end;
+}
+
+result_cache::result_cache(const type_checker_config &config)
+	: version(checker_version(config)), fd(-1), map(nullptr), map_size(0), entries(nullptr),
+	entries_count(0), records(nullptr), hits_count(0), misses_count(0)
+{
+}
+
+result_cache::~result_cache()
+{
+	close();
+}
+
+void result_cache::close()
+{
+	if (map) {
+		munmap(const_cast<char *>(map), map_size);
+		map = nullptr;
+	}
+
+	if (fd >= 0) {
+		::close(fd);
+		fd = -1;
+	}
+
+	entries = nullptr;
+	entries_count = 0;
+	records = nullptr;
+}
+
+bool result_cache::open(const string &dir)
+{
+	struct stat st;
+
+	close();
+
+	if (stat(dir.c_str(), &st) < 0) {
+		return false;
+	}
+
+	if (!S_ISDIR(st.st_mode)) {
+		errno = ENOTDIR;
+		return false;
+	}
+
+	path = dir + "/" CACHE_FILE_NAME;
+	fd = ::open(path.c_str(), O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(type_cache_header)) {
+		close();
+		return true;
+	}
+
+	void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+	if (addr == MAP_FAILED) {
+		close();
+		return true;
+	}
+
+	map = static_cast<const char *>(addr);
+	map_size = st.st_size;
+
+	const type_cache_header *header = reinterpret_cast<const type_cache_header *>(map);
+	size_t available = map_size - sizeof(type_cache_header);
+
+	if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != version ||
+		header->entries_count > available / sizeof(type_cache_entry) ||
+		header->records_size != available - header->entries_count * sizeof(type_cache_entry)) {
+		close();
+		return true;
+	}
+
+	entries = reinterpret_cast<const type_cache_entry *>(map + sizeof(type_cache_header));
+	entries_count = header->entries_count;
+	records = reinterpret_cast<const char *>(entries + entries_count);
+	kept.assign(entries_count, false);
+
+	return true;
+}
+
+bool result_cache::lookup(string_view rule, type_parsed_rule &result, size_t &entry) const
+{
+	uint64_t key = hash_string(rule, CACHE_KEY_SEED);
+	const type_cache_entry *end = entries + entries_count;
+	const type_cache_entry *it = lower_bound(entries, end, key,
+		[](const type_cache_entry &e, uint64_t k) { return e.key < k; });
+
+	if (it == end || it->key != key || it->text_length != rule.length() ||
+		it->check != hash_string(rule, CACHE_CHECK_SEED)) {
+		return false;
+	}
+
+	size_t records_size = map_size - (records - map);
+
+	if (it->offset > records_size || it->size > records_size - it->offset) {
+		return false;
+	}
+
+	type_record_reader in = { records + it->offset, records + it->offset + it->size, rule };
+
+	if (!deserialize(in, result)) {
+		return false;
+	}
+
+	entry = it - entries;
+
+	return true;
+}
+
+void result_cache::keep(size_t entry)
+{
+	kept[entry] = true;
+	hits_count++;
+}
+
+void result_cache::store(string_view rule, const type_parsed_rule &result)
+{
+	uint64_t key = hash_string(rule, CACHE_KEY_SEED);
+
+	misses_count++;
+
+	if (rule.length() >= SPAN_NONE || !added_keys.insert(key).second) {
+		return;
+	}
+
+	size_t offset = added_records.size();
+
+	if (!serialize(rule, result, added_records)) {
+		added_records.resize(offset);
+		return;
+	}
+
+	added.push_back({ key, hash_string(rule, CACHE_CHECK_SEED), offset,
+		static_cast<uint32_t>(added_records.size() - offset), static_cast<uint32_t>(rule.length()) });
+}
+
+bool result_cache::save()
+{
+	if (path.empty() || added.empty()) {
+		return true;
+	}
+
+	// Entries used by this run first, then the rest of the old file while
+	// there is room.
+	vector<type_cache_entry> index;
+	vector<const char *> sources;
+
+	for (int pass = 0; pass < 2; pass++) {
+		for (size_t i = 0; i < entries_count; i++) {
+			if (kept[i] != (pass == 0) || added_keys.count(entries[i].key)) {
+				continue;
+			}
+
+			if (pass == 1 && index.size() + added.size() >= CACHE_MAX_ENTRIES) {
+				break;
+			}
+
+			index.push_back(entries[i]);
+			sources.push_back(records + entries[i].offset);
+		}
+	}
+
+	for (const type_cache_entry &e : added) {
+		index.push_back(e);
+		sources.push_back(added_records.data() + e.offset);
+	}
+
+	// Sort by key, keeping the record sources alongside.
+	vector<size_t> order(index.size());
+
+	for (size_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+
+	sort(order.begin(), order.end(), [&](size_t a, size_t b) { return index[a].key < index[b].key; });
+
+	type_cache_header header;
+	vector<type_cache_entry> sorted;
+	uint64_t offset = 0;
+
+	memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+	header.version = version;
+	header.entries_count = index.size();
+	sorted.reserve(index.size());
+
+	for (size_t i : order) {
+		sorted.push_back(index[i]);
+		sorted.back().offset = offset;
+		offset += index[i].size;
+	}
+
+	header.records_size = offset;
+
+	string tmp = path + ".XXXXXX";
+	int tmp_fd = mkstemp(&tmp[0]);
+
+	if (tmp_fd < 0) {
+		return false;
+	}
+
+	FILE *out = fdopen(tmp_fd, "wb");
+
+	if (!out) {
+		::close(tmp_fd);
+		unlink(tmp.c_str());
+		return false;
+	}
+
+	bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+		fwrite(sorted.data(), sizeof(type_cache_entry), sorted.size(), out) == sorted.size();
+
+	for (size_t j = 0; ok && j < order.size(); j++) {
+		size_t i = order[j];
+
+		ok = fwrite(sources[i], 1, index[i].size, out) == index[i].size;
+	}
+
+	ok = (fclose(out) == 0) && ok;
+
+	if (!ok || chmod(tmp.c_str(), 0644) < 0 || rename(tmp.c_str(), path.c_str()) < 0) {
+		int err = errno;
+
+		unlink(tmp.c_str());
+		errno = err;
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include "rule_checker.h"
+
+// On-disk cache of check results, keyed by a hash of the rule text and
+// the checker version.
+//
+// File layout (native byte order):
+//   header       - type_cache_header
+//   index        - entries_count x type_cache_entry, sorted by key
+//   records      - serialized type_parsed_rule, text views stored as
+//                  offsets into the rule
+//
+// The file is replaced atomically (temporary file and rename), so
+// concurrent runs sharing a directory always see a complete file; the
+// last writer wins.
+
+#define CACHE_FILE_NAME		"dumbpig.cache"
+
+typedef struct cache_header
+{
+	char magic[8];
+	uint64_t version;
+	uint64_t entries_count;
+	uint64_t records_size;
+} type_cache_header;
+
+typedef struct cache_entry
+{
+	uint64_t key;
+	// Second, independent hash of the rule, guards against key collisions.
+	uint64_t check;
+	uint64_t offset;
+	uint32_t size;
+	uint32_t text_length;
+} type_cache_entry;
+
+class result_cache
+{
+public:
+	explicit result_cache(const type_checker_config &config);
+	~result_cache();
+
+	result_cache(const result_cache &) = delete;
+	result_cache &operator=(const result_cache &) = delete;
+
+	// Map the cache file of 'dir'. A missing, damaged or outdated file
+	// gives an empty cache; false is returned only if 'dir' is unusable.
+	bool open(const std::string &dir);
+
+	// Fill 'result' for 'rule' from the cache. Safe to call from several
+	// threads. 'entry' identifies the hit for keep().
+	bool lookup(std::string_view rule, type_parsed_rule &result, size_t &entry) const;
+
+	// Carry a cached entry over to the next cache file.
+	void keep(size_t entry);
+	// Add a freshly checked rule.
+	void store(std::string_view rule, const type_parsed_rule &result);
+
+	// Write the updated cache file if anything changed.
+	bool save();
+
+	size_t hits() const
+	{
+		return hits_count;
+	}
+
+	size_t misses() const
+	{
+		return misses_count;
+	}
+
+private:
+	void close();
+
+	std::string path;
+	uint64_t version;
+	int fd;
+	const char *map;
+	size_t map_size;
+	const type_cache_entry *entries;
+	size_t entries_count;
+	const char *records;
+
+	std::vector<bool> kept;
+	std::vector<type_cache_entry> added;
+	std::unordered_set<uint64_t> added_keys;
+	std::string added_records;
+	size_t hits_count;
+	size_t misses_count;
+};
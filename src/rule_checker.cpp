@@ -1,201 +1,427 @@
-#include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string.hpp>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <iostream>
 
+#include "content.h"
+#include "parallel.h"
+#include "pcre_parser.h"
 #include "rule_checker.h"
-#include <boost/tokenizer.hpp>
+#include "rule_lexer.h"
+#include "rule_vars.h"
+#include "stats.h"
+#include "string_utils.h"
 
 using namespace std;
 
-static vector<string> my_split(string str, string separators, size_t max_tokens, char cat_sym = ' ')
-{
-	vector<string> toks;
-	boost::split(toks, str, boost::is_any_of(separators), boost::token_compress_on);
-
-	if (toks.size() > max_tokens) {
-		for (size_t i = max_tokens; i < toks.size(); i++) {
-			toks[max_tokens - 1] += cat_sym + toks[i];
-		}
-
-		toks.erase(toks.begin() + max_tokens, toks.end());
-	}
-
-	return toks;
-}
+#define RULE_HEADER_FIELDS	7
+// Rules per work item of a batch check.
+#define RULES_CHUNK_SIZE	64
+
+static constexpr int OPTION_BYTE_TEST  = option_id("byte_test");
+static constexpr int OPTION_CLASSTYPE  = option_id("classtype");
+static constexpr int OPTION_CONTENT    = option_id("content");
+static constexpr int OPTION_DSIZE      = option_id("dsize");
+static constexpr int OPTION_FLAGS      = option_id("flags");
+static constexpr int OPTION_FLOW       = option_id("flow");
+static constexpr int OPTION_FLOWBITS   = option_id("flowbits");
+static constexpr int OPTION_GID        = option_id("gid");
+static constexpr int OPTION_ICODE      = option_id("icode");
+static constexpr int OPTION_IP_PROTO   = option_id("ip_proto");
+static constexpr int OPTION_PCRE       = option_id("pcre");
+static constexpr int OPTION_REV        = option_id("rev");
+static constexpr int OPTION_SID        = option_id("sid");
+static constexpr int OPTION_URICONTENT = option_id("uricontent");
 
 // Perform some checks and notify a user if rule is not good enough.
-static int analyze_rule(const string proto, string src_port, string dst_port,
-		const vector<string> configured, string &message)
+static int analyze_rule(string_view proto, string_view dst_port, const type_header_info &header,
+		string_view options, const type_configured_options &configured, diag_list &diags)
 {
 	int res = RULE_OK;
 
 	if ((boost::iequals(proto, "tcp") || boost::iequals(proto, "udp")) &&
-		(boost::iequals(src_port, "any") && boost::iequals(dst_port, "any"))) {
-		message = "- Rule without port numbers - it'll be really slow\n";
+		(header.src_port_any && header.dst_port_any)) {
+		report(diags, DIAG_NO_PORTS, string_view(), dst_port);
 		res = RULE_HAS_WARNINGS;
 	}
 
 	if (boost::iequals(proto, "ip") &&
-		(find(configured.begin(), configured.end(), "content")    == configured.end()) &&
-		(find(configured.begin(), configured.end(), "uricontent") == configured.end()) &&
-		(find(configured.begin(), configured.end(), "pcre")       == configured.end()) &&
-		(find(configured.begin(), configured.end(), "ip_proto")   == configured.end())) {
-		message += "- IP rule without content match - it's better to use firewall for this\n";
+		!configured.has(OPTION_CONTENT) &&
+		!configured.has(OPTION_URICONTENT) &&
+		!configured.has(OPTION_PCRE) &&
+		!configured.has(OPTION_IP_PROTO)) {
+		report(diags, DIAG_IP_NO_CONTENT, string_view(), options);
 		res = RULE_HAS_WARNINGS;
 	}
 
 	if ((boost::iequals(proto, "tcp") || boost::iequals(proto, "udp")) &&
-		(find(configured.begin(), configured.end(), "content")    == configured.end()) &&
-		(find(configured.begin(), configured.end(), "uricontent") == configured.end()) &&
-		(find(configured.begin(), configured.end(), "byte_test")  == configured.end()) &&
-		(find(configured.begin(), configured.end(), "dsize")      == configured.end()) &&
-		(find(configured.begin(), configured.end(), "flags")      == configured.end())) {
-		message += "- TCP/UDP rule without deep packet checks - it's better to use firewall for this\n";
+		!configured.has(OPTION_CONTENT) &&
+		!configured.has(OPTION_URICONTENT) &&
+		!configured.has(OPTION_BYTE_TEST) &&
+		!configured.has(OPTION_DSIZE) &&
+		!configured.has(OPTION_FLAGS)) {
+		report(diags, DIAG_NO_DEEP_CHECKS, string_view(), options);
 		res = RULE_HAS_WARNINGS;
 	}
 
 	if (boost::iequals(proto, "tcp") &&
-		(find(configured.begin(), configured.end(), "flow") == configured.end())) {
-		message += "- TCP protocol without flow checking. Consider adding 'flow' keyword to provide better state tracking\n";
+		!configured.has(OPTION_FLOW)) {
+		report(diags, DIAG_TCP_NO_FLOW, string_view(), options);
 		res = RULE_HAS_WARNINGS;
 	}
 
 	if (boost::iequals(proto, "ip") &&
-		(find(configured.begin(), configured.end(), "flow") != configured.end())) {
-		message += "- IP protocol with flow checking - consider changing protocol to TCP or UDP\n";
+		configured.has(OPTION_FLOW)) {
+		report(diags, DIAG_IP_WITH_FLOW, string_view(), proto);
 		res = RULE_HAS_WARNINGS;
 	}
 
-	if ((find(configured.begin(), configured.end(), "pcre") != configured.end()) &&
-		(find(configured.begin(), configured.end(), "pcre") == configured.end()) &&
-		(find(configured.begin(), configured.end(), "pcre") == configured.end())) {
-		message += "- PCRE matching without 'content' or 'uricontent' keywords - it'll cause a performance hit\n";
+	if (configured.has(OPTION_PCRE) &&
+		!configured.has(OPTION_CONTENT) &&
+		!configured.has(OPTION_URICONTENT)) {
+		report(diags, DIAG_PCRE_NO_CONTENT, string_view(), options);
 		res = RULE_HAS_WARNINGS;
 	}
 
 	return res;
 }
 
-static int parse_and_analyze_rule_options(const string proto, const string src_port,
-	const string dst_port, string str, string &message)
+// Scratch buffers of check_options() and analyze(), per thread so that
+// their capacity carries over from rule to rule.
+typedef struct check_workspace
 {
+	diag_list hazards;
+	diag_list warnings;
+	vector<type_content_match> contents;
+} type_check_workspace;
+
+static thread_local type_check_workspace workspace;
+
+static const type_diag_code lex_diags[] = {
+	DIAG_BAD_RULE,			// LEX_OK, not used
+	DIAG_UNTERMINATED_QUOTE,
+	DIAG_UNTERMINATED_HEX,
+	DIAG_DANGLING_ESCAPE,
+};
+
+static uint32_t parse_uint32(string_view arg)
+{
+	uint64_t value = 0;
+
+	for (char c : arg) {
+		if (c < '0' || c > '9' || value > UINT32_MAX) {
+			return 0;
+		}
+
+		value = value * 10 + (c - '0');
+	}
+
+	return (value > UINT32_MAX) ? 0 : static_cast<uint32_t>(value);
+}
+
+typedef struct flowbit_op
+{
+	const char *name;
+	int op;
+} type_flowbit_op;
+
+static const type_flowbit_op flowbit_ops[] = {
+	{ "set",      FLOWBIT_SET },
+	{ "setx",     FLOWBIT_SET },
+	{ "toggle",   FLOWBIT_TOGGLE },
+	{ "unset",    FLOWBIT_UNSET },
+	{ "isset",    FLOWBIT_ISSET },
+	{ "isnotset", FLOWBIT_ISNOTSET },
+	{ nullptr,    0 }
+};
+
+// Remember which flowbits the rule sets and checks. Names may be
+// combined with '&' or '|'; 'noalert' and 'reset' carry no names.
+static void collect_flowbits(string_view arg, vector<type_flowbit_ref> &flowbits)
+{
+	string_view op_name = trim(next_token(arg, ","));
+	string_view names = trim(next_token(arg, ","));
+
+	for (size_t i = 0; flowbit_ops[i].name != nullptr; i++) {
+		if (op_name != flowbit_ops[i].name) {
+			continue;
+		}
+
+		while (!names.empty()) {
+			string_view name = trim(next_token(names, "&|"));
+
+			if (!name.empty()) {
+				flowbits.push_back({ flowbit_ops[i].op, name });
+			}
+		}
+
+		break;
+	}
+}
+
+static const char *dialect_names[DIALECTS_COUNT] = { nullptr, "snort2", "snort3", "suricata" };
+
+int find_dialect(string_view name)
+{
+	for (int i = 0; i < DIALECTS_COUNT; i++) {
+		if (dialect_names[i] && name == dialect_names[i]) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+rule_checker::rule_checker(const type_checker_config &config) : cfg(config)
+{
+	switch (cfg.dialect) {
+	case DIALECT_SNORT2:
+		check_dialect_options = &rule_checker::check_options<DIALECT_SNORT2>;
+		break;
+	case DIALECT_SNORT3:
+		check_dialect_options = &rule_checker::check_options<DIALECT_SNORT3>;
+		break;
+	case DIALECT_SURICATA:
+		check_dialect_options = &rule_checker::check_options<DIALECT_SURICATA>;
+		break;
+	default:
+		cfg.dialect = DIALECT_ANY;
+		check_dialect_options = &rule_checker::check_options<DIALECT_ANY>;
+		break;
+	}
+}
+
+template <int dialect>
+int rule_checker::check_options(string_view str, type_parsed_rule &result) const
+{
+	constexpr const type_rule_options *options_table = dialect_tables[dialect].options;
+
+	string_view rule = result.text;
+	diag_list &diags = result.diags;
+	string_view options = str;
+
 	// No options.
 	if (str.empty()) {
 		return RULE_OK;
 	}
 
 	if ((str[0] != '(') || (str[str.length() - 1] != ')')) {
-		message += "- Rule options must be enclosed in '(' and ')'\n";
+		report(diags, DIAG_OPTIONS_NOT_ENCLOSED, string_view(), str);
 		return RULE_HAS_ERRORS;
 	}
 
 	// Remove surrounding braces.
-	str.erase(0, 1);
-	str.erase(str.length() - 1, 1);
-
-	vector<string> options;
-	vector<string> configured;
+	str = str.substr(1, str.length() - 2);
 
-	boost::split(options, str, boost::is_any_of(";"), boost::token_compress_on);
+	type_configured_options configured = {};
+	// Backtracking hazards of the pcres, found while checking them.
+	diag_list &hazards = workspace.hazards;
+	diag_list *pcre_hazards = cfg.performance_checks ? &hazards : nullptr;
+	option_lexer lexer(rule, str);
+	type_option_span opt;
 
-	bool found = false;
+	hazards.clear();
+	STATS_START(lap);
 
-	for (const string &opt : options) {
-		vector<string> subopts = my_split(opt, ":", 2, ':');
-		boost::trim(subopts[0]);
+	while (lexer.next(opt)) {
+		STATS_START(option_start);
+		int id = find_option(dialect_tables[dialect], opt.name);
 
-		if (subopts[0].empty()) {
+		if (id == OPTION_UNKNOWN) {
+			report(diags, DIAG_UNKNOWN_OPTION, opt.name, opt.name);
 			continue;
 		}
 
-		if (subopts.size() > 1) {
-			boost::trim(subopts[1]);
-		}
+		const type_rule_options &props = options_table[id];
 
-		for (size_t j = 0; rule_options[j].name != nullptr; j++) {
-			if (boost::iequals(rule_options[j].name, subopts[0])) {
-				if ((find(configured.begin(), configured.end(), subopts[0]) != configured.end()) &&
-					rule_options[j].only_once) {
-					message += "- Option '" + subopts[0] + "' may be specified only once\n";
-				}
+		result.options.push_back({ id, opt.name, opt.arg, opt.has_arg,
+			static_cast<uint32_t>(opt.offset), static_cast<uint32_t>(opt.arg_offset), props.buffer });
 
-				if (rule_options[j].args_required && (subopts.size() < 2)) {
-					message += "- Option '" + subopts[0] + "' requires an argument\n";
-				} else if (rule_options[j].arg_checker) {
-					rule_options[j].arg_checker(subopts[0], subopts[1], message);
-				}
+		if (configured.has(id) && props.only_once) {
+			report(diags, DIAG_DUPLICATE_OPTION, opt.name, opt.name);
+		}
 
-				configured.push_back(subopts[0]);
-				found = true;
-				break;
+		if (props.args_required && !opt.has_arg) {
+			report(diags, DIAG_MISSING_ARGUMENT, opt.name, opt.name);
+		} else if (props.arg_checker) {
+			bool valid = (id == OPTION_PCRE) ? pcre_arg_checker(opt.name, opt.arg, diags, pcre_hazards) :
+				props.arg_checker(opt.name, opt.arg, diags);
+
+			if (valid) {
+				if (id == OPTION_SID) {
+					result.sid = parse_uint32(opt.arg);
+				} else if (id == OPTION_GID) {
+					result.gid = parse_uint32(opt.arg);
+				} else if (id == OPTION_REV) {
+					result.rev = parse_uint32(opt.arg);
+				} else if (id == OPTION_FLOWBITS) {
+					collect_flowbits(opt.arg, result.flowbits);
+				}
 			}
 		}
 
-		if (!found) {
-			message += "- Unknown option: " + subopts[0] + "\n";
-		}
+		configured.add(id);
+		STATS_OPTION(id, option_start);
+	}
 
-		found = false;
+	if (lexer.error() != LEX_OK) {
+		report(diags, lex_diags[lexer.error()], string_view(), rule.substr(lexer.error_offset(), 1));
+		return RULE_HAS_ERRORS;
 	}
 
-	if (boost::iequals(proto, "ip") && (!boost::iequals(src_port, "any") ||
-		!boost::iequals(dst_port, "any"))) {
-		message += "- IP protocol with port numbers - invalid syntax. IP protocol has no port numbers, consider using TCP or UDP\n";
+	STATS_LAP(PHASE_CHECK, lap);
+
+	int res = analyze(options, configured, hazards, result);
+
+	STATS_LAP(PHASE_ANALYZE, lap);
+
+	return res;
+}
+
+int rule_checker::analyze(string_view options, const type_configured_options &configured,
+	const diag_list &hazards, type_parsed_rule &result) const
+{
+	string_view proto = result.proto;
+	diag_list &diags = result.diags;
+	diag_list &warnings = workspace.warnings;
+	vector<type_content_match> &contents = workspace.contents;
+	type_header_info header;
+
+	warnings.clear();
+
+	check_header(result, cfg.vars, header, diags, warnings);
+
+	if (boost::iequals(proto, "ip") && (!header.src_port_any || !header.dst_port_any)) {
+		report(diags, DIAG_IP_WITH_PORTS, string_view(), proto);
 	}
 
-	if (find(configured.begin(), configured.end(), "sid") == configured.end()) {
-		message += "- No SID number. Please add 'sid' keyword\n";
+	if (!configured.has(OPTION_SID)) {
+		report(diags, DIAG_NO_SID, string_view(), options);
 	}
 
-	if (find(configured.begin(), configured.end(), "rev") == configured.end()) {
-		message += "- No revision number. Please add 'rev' keyword\n";
+	if (!configured.has(OPTION_REV)) {
+		report(diags, DIAG_NO_REV, string_view(), options);
 	}
 
-	if (find(configured.begin(), configured.end(), "classtype") == configured.end()) {
-		message += "- No classification specified. Please add 'classtype' keyword for correct classification and priority rating\n";
+	if (!configured.has(OPTION_CLASSTYPE)) {
+		report(diags, DIAG_NO_CLASSTYPE, string_view(), options);
 	}
 
-	if (!boost::iequals(proto, "icmp") && (find(configured.begin(), configured.end(), "icode") != configured.end())) {
-		message += "- ICMP options on non-ICMP rule\n";
+	if (!boost::iequals(proto, "icmp") && configured.has(OPTION_ICODE)) {
+		report(diags, DIAG_ICMP_OPTION, string_view(), proto);
 	}
 
-	if (message.length()) {
+	collect_contents(result, contents);
+	check_content_positions(result, contents, diags);
+
+	if (!diags.empty()) {
 		return RULE_HAS_ERRORS;
 	}
 
-	return analyze_rule(proto, src_port, dst_port, configured, message);
+	if (!cfg.performance_checks) {
+		return RULE_OK;
+	}
+
+	int res = analyze_rule(proto, result.dst_port, header, options, configured, diags);
+	size_t count = diags.size();
+
+	diags.insert(diags.end(), warnings.begin(), warnings.end());
+	diags.insert(diags.end(), hazards.begin(), hazards.end());
+	find_redundant_contents(result, contents, diags);
+
+	return (diags.size() > count) ? RULE_HAS_WARNINGS : res;
 }
 
-int process_rule(const string rule, string &message)
+int rule_checker::check(string_view rule, type_parsed_rule &result) const
 {
+	result.text = rule;
+	result.action = result.proto = result.src_addr = result.src_port = string_view();
+	result.direction = result.dst_addr = result.dst_port = string_view();
+	result.options.clear();
+	result.sid = 0;
+	result.gid = 1;
+	result.rev = 0;
+	result.diags.clear();
+	result.flowbits.clear();
+
 	if (rule.empty()) {
-		return RULE_HAS_ERRORS;
+		return result.status = RULE_HAS_ERRORS;
+	}
+
+	STATS_START(lap);
+	string_view toks[RULE_HEADER_FIELDS];
+	string_view rest = rule;
+
+	for (size_t i = 0; i < RULE_HEADER_FIELDS; i++) {
+		toks[i] = next_token(rest, " \t");
+	}
+
+	// Rule options
+	rest = trim(rest);
+	STATS_LAP(PHASE_TOKENIZE, lap);
+
+	if (toks[RULE_HEADER_FIELDS - 1].empty() || rest.empty()) {
+		report(result.diags, DIAG_BAD_RULE, string_view(), rule);
+		result.diags.back().column = 1;
+		return result.status = RULE_HAS_ERRORS;
 	}
 
-	message = "";
+	result.action = toks[0];
+	result.proto = toks[1];
+	result.src_addr = toks[2];
+	result.src_port = toks[3];
+	result.direction = toks[4];
+	result.dst_addr = toks[5];
+	result.dst_port = toks[6];
 
-	vector<string> toks = my_split(rule, " \t", 8);
+	result.status = (this->*check_dialect_options)(rest, result);
 
-	if (toks.size() < 8) {
-		cout << "Bad rule: " << rule << endl;
-		return RULE_HAS_ERRORS;
+	for (type_diagnostic &diag : result.diags) {
+		diag.column = diag.where.data() - rule.data() + 1;
 	}
 
-	// toks[0] - action
-	// toks[1] - protocol
-	// toks[2] - source address
-	// toks[3] - source port
-	// toks[4] - direction
-	// toks[5] - destination address
-	// toks[6] - destination port
-	// toks[7] - rule options
+	return result.status;
+}
+
+type_parsed_rule rule_checker::check(string_view rule) const
+{
+	type_parsed_rule result;
+
+	check(rule, result);
+
+	return result;
+}
+
+void rule_checker::check(const string_view *rules, size_t count, type_parsed_rule *results,
+	unsigned jobs) const
+{
+	parallel_for(count, effective_jobs(jobs), RULES_CHUNK_SIZE, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			check(rules[i], results[i]);
+		}
+	});
+}
+
+int process_rule(string_view rule, type_parsed_rule &result)
+{
+	static const rule_checker checker;
+
+	return checker.check(rule, result);
+}
+
+int process_rule(string_view rule, string &message)
+{
+	type_parsed_rule result;
+	int res = process_rule(rule, result);
+
+	message.clear();
 
-	int res = parse_and_analyze_rule_options(toks[1], toks[3], toks[6], toks[7], message);
+	for (const type_diagnostic &diag : result.diags) {
+		if (!message.empty()) {
+			message += "\n";
+		}
 
-	if (message[message.length() - 1] == '\n') {
-		message.erase(message.length() - 1);
+		message += "- " + format_diagnostic(diag);
 	}
 
 	return res;
@@ -1,12 +1,47 @@
 #pragma once
+#include <bitset>
+#include <climits>
+#include <cstdint>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <vector>
 #include "arg_checkers.h"
+#include "diagnostic.h"
+
+class rule_vars;
 
 #define RULE_HAS_ERRORS		-1
 #define RULE_OK			0
 #define RULE_HAS_WARNINGS	1
 
-typedef bool (*ParseArgFunc)(std::string, std::string, std::string &);
+// Bump whenever check results change in a way the option and diagnostic
+// tables do not show; this invalidates cached results.
+#define RULE_CHECKER_REVISION	6
+
+typedef bool (*ParseArgFunc)(std::string_view, std::string_view, diag_list &);
+
+// Rule dialects. DIALECT_ANY accepts the keywords of all of them, with
+// the Snort 2 meaning where they differ.
+#define DIALECT_ANY		0
+#define DIALECT_SNORT2		1
+#define DIALECT_SNORT3		2
+#define DIALECT_SURICATA	3
+#define DIALECTS_COUNT		4
+
+// Dialects an option exists in.
+#define IN_SNORT2		(1 << DIALECT_SNORT2)
+#define IN_SNORT3		(1 << DIALECT_SNORT3)
+#define IN_SURICATA		(1 << DIALECT_SURICATA)
+#define IN_SNORT		(IN_SNORT2 | IN_SNORT3)
+#define IN_ALL			(IN_SNORT2 | IN_SNORT3 | IN_SURICATA)
+
+// How an option selects the buffer contents are looked for in.
+#define BUFFER_NONE		0
+// Content modifier: the preceding content is looked for in the buffer.
+#define BUFFER_MODIFIER		1
+// Sticky buffer: the contents after it are looked for in the buffer.
+#define BUFFER_STICKY		2
 
 typedef struct rule_options
 {
@@ -14,85 +49,488 @@ typedef struct rule_options
 	bool args_required;
 	bool only_once;
 	ParseArgFunc arg_checker;
+	// IN_* mask.
+	unsigned dialects;
+	// BUFFER_*
+	int buffer;
 } type_rule_options;
 
-static const type_rule_options rule_options[] = {
+// All options of all dialects, with their Snort 2 (or only) meaning.
+// Option names must be lower case; an option's ID is its index here, in
+// every dialect.
+static constexpr type_rule_options rule_options[] = {
 	// Options with arguments
-	{ "activated_by",     true,  true,  uint_arg_checker },
-	{ "activates",        true,  true,  uint_arg_checker },
-	{ "classtype",        true,  true,  classtype_arg_checker },
-	{ "count",            true,  true,  uint_arg_checker },
-	{ "detection_filter", true,  true,  detection_filter_arg_checker },
-	{ "gid",              true,  true,  uint_arg_checker },
-	{ "logto",            true,  true,  str_arg_checker },
-	{ "metadata",         true,  false, nullptr },
-	{ "msg",              true,  true,  nullptr },
-	{ "priority",         true,  true,  uint_arg_checker },
-	{ "reference",        true,  false, reference_arg_checker },
-	{ "rev",              true,  true,  uint_arg_checker },
-	{ "sid",              true,  true,  uint_arg_checker },
-	{ "tag",              true,  true,  tag_arg_checker },
-	{ "threshold",        true,  true,  threshold_arg_checker },
-	{ "content",          true,  false, str_arg_checker },
-	{ "ttl",              true,  true,  ttl_arg_checker },
-	{ "uricontent",       true,  true,  str_arg_checker },
-	{ "pcre",             true,  true,  pcre_arg_checker },
-	{ "flow",             true,  true,  flow_arg_checker },
-	{ "flowbits",         true,  false, flowbits_arg_checker },
-	{ "distance",         true,  false, nullptr },
-	{ "within",           true,  false, nullptr },
-	{ "offset",           true,  false, nullptr },
-	{ "depth",            true,  false, uint_arg_checker },
-	{ "dsize",            true,  true,  dsize_arg_checker },
-	{ "byte_test",        true,  false, byte_test_arg_checker },
-	{ "byte_jump",        true,  true,  byte_jump_arg_checker },
-	{ "isdataat",         true,  true,  isdataat_arg_checker },
-	{ "ipopts",           true,  true,  ipopts_arg_checker },
-	{ "itype",            true,  true,  itype_arg_checker },
-	{ "icode",            true,  true,  icode_arg_checker },
-	{ "flags",            true,  true,  flags_arg_checker },
-	{ "urilen",           true,  true,  urilen_arg_checker },
-	{ "fragbits",         true,  true,  fragbits_arg_checker },
-	{ "fragoffset",       true,  true,  fragoffset_arg_checker },
-	{ "seq",              true,  true,  uint_arg_checker },
-	{ "ack",              true,  true,  uint_arg_checker },
-	{ "window",           true,  true,  uint_arg_checker },
-	{ "id",               true,  true,  uint_arg_checker },
-	{ "ip_proto",         true,  true,  ip_proto_arg_checker },
-	{ "asn1",             true,  true,  nullptr },
-	{ "dce_iface",        true,  true,  dce_iface_arg_checker },
-	{ "dce_opnum",        true,  true,  dce_opnum_arg_checker },
-	{ "icmp_id",          true,  true,  uint_arg_checker },
-	{ "icmp_seq",         true,  true,  uint_arg_checker },
-	{ "http_encode",      true,  true,  nullptr },
-	{ "ssl_version",      true,  true,  ssl_version_arg_checker },
-	{ "ssl_state",        true,  true,  ssl_state_arg_checker },
-	{ "tos",              true,  true,  tos_arg_checker },
-	{ "iprep",            true,  false, iprep_arg_checker },
-	{ "app-layer-event",  true,  true,  nullptr },
-	{ "stream-event",     true,  true,  nullptr },
-	{ "flowint",          true,  false, nullptr },
+	{ "activated_by",        true,  true,  uint_arg_checker,             IN_SNORT2,               BUFFER_NONE },
+	{ "activates",           true,  true,  uint_arg_checker,             IN_SNORT2,               BUFFER_NONE },
+	{ "classtype",           true,  true,  classtype_arg_checker,        IN_ALL,                  BUFFER_NONE },
+	{ "count",               true,  true,  uint_arg_checker,             IN_SNORT2,               BUFFER_NONE },
+	{ "detection_filter",    true,  true,  detection_filter_arg_checker, IN_ALL,                  BUFFER_NONE },
+	{ "gid",                 true,  true,  uint_arg_checker,             IN_ALL,                  BUFFER_NONE },
+	{ "logto",               true,  true,  str_arg_checker,              IN_SNORT2,               BUFFER_NONE },
+	{ "metadata",            true,  false, nullptr,                      IN_ALL,                  BUFFER_NONE },
+	{ "msg",                 true,  true,  nullptr,                      IN_ALL,                  BUFFER_NONE },
+	{ "priority",            true,  true,  uint_arg_checker,             IN_ALL,                  BUFFER_NONE },
+	{ "reference",           true,  false, reference_arg_checker,        IN_ALL,                  BUFFER_NONE },
+	{ "rev",                 true,  true,  uint_arg_checker,             IN_ALL,                  BUFFER_NONE },
+	{ "sid",                 true,  true,  uint_arg_checker,             IN_ALL,                  BUFFER_NONE },
+	{ "tag",                 true,  true,  tag_arg_checker,              IN_ALL,                  BUFFER_NONE },
+	{ "threshold",           true,  true,  threshold_arg_checker,        IN_SNORT2 | IN_SURICATA, BUFFER_NONE },
+	{ "content",             true,  false, pattern_arg_checker,          IN_ALL,                  BUFFER_NONE },
+	{ "ttl",                 true,  true,  ttl_arg_checker,              IN_ALL,                  BUFFER_NONE },
+	{ "uricontent",          true,  true,  pattern_arg_checker,          IN_SNORT2 | IN_SURICATA, BUFFER_NONE },
+	{ "pcre",                true,  true,  pcre_arg_checker,             IN_ALL,                  BUFFER_NONE },
+	{ "flow",                true,  true,  flow_arg_checker,             IN_ALL,                  BUFFER_NONE },
+	{ "flowbits",            true,  false, flowbits_arg_checker,         IN_ALL,                  BUFFER_NONE },
+	{ "distance",            true,  false, distance_arg_checker,         IN_SNORT2 | IN_SURICATA, BUFFER_NONE },
+	{ "within",              true,  false, within_arg_checker,           IN_SNORT2 | IN_SURICATA, BUFFER_NONE },
+	{ "offset",              true,  false, offset_arg_checker,           IN_SNORT2 | IN_SURICATA, BUFFER_NONE },
+	{ "depth",               true,  false, depth_arg_checker,            IN_SNORT2 | IN_SURICATA, BUFFER_NONE },
+	{ "dsize",               true,  true,  dsize_arg_checker,            IN_ALL,                  BUFFER_NONE },
+	{ "byte_test",           true,  false, byte_test_arg_checker,        IN_ALL,                  BUFFER_NONE },
+	{ "byte_jump",           true,  true,  byte_jump_arg_checker,        IN_ALL,                  BUFFER_NONE },
+	{ "isdataat",            true,  true,  isdataat_arg_checker,         IN_ALL,                  BUFFER_NONE },
+	{ "ipopts",              true,  true,  ipopts_arg_checker,           IN_ALL,                  BUFFER_NONE },
+	{ "itype",               true,  true,  itype_arg_checker,            IN_ALL,                  BUFFER_NONE },
+	{ "icode",               true,  true,  icode_arg_checker,            IN_ALL,                  BUFFER_NONE },
+	{ "flags",               true,  true,  flags_arg_checker,            IN_ALL,                  BUFFER_NONE },
+	{ "urilen",              true,  true,  urilen_arg_checker,           IN_SNORT2 | IN_SURICATA, BUFFER_NONE },
+	{ "fragbits",            true,  true,  fragbits_arg_checker,         IN_ALL,                  BUFFER_NONE },
+	{ "fragoffset",          true,  true,  fragoffset_arg_checker,       IN_ALL,                  BUFFER_NONE },
+	{ "seq",                 true,  true,  uint_arg_checker,             IN_ALL,                  BUFFER_NONE },
+	{ "ack",                 true,  true,  uint_arg_checker,             IN_ALL,                  BUFFER_NONE },
+	{ "window",              true,  true,  uint_arg_checker,             IN_ALL,                  BUFFER_NONE },
+	{ "id",                  true,  true,  uint_arg_checker,             IN_ALL,                  BUFFER_NONE },
+	{ "ip_proto",            true,  true,  ip_proto_arg_checker,         IN_ALL,                  BUFFER_NONE },
+	{ "asn1",                true,  true,  nullptr,                      IN_ALL,                  BUFFER_NONE },
+	{ "dce_iface",           true,  true,  dce_iface_arg_checker,        IN_ALL,                  BUFFER_NONE },
+	{ "dce_opnum",           true,  true,  dce_opnum_arg_checker,        IN_ALL,                  BUFFER_NONE },
+	{ "icmp_id",             true,  true,  uint_arg_checker,             IN_ALL,                  BUFFER_NONE },
+	{ "icmp_seq",            true,  true,  uint_arg_checker,             IN_ALL,                  BUFFER_NONE },
+	{ "http_encode",         true,  true,  nullptr,                      IN_SNORT2,               BUFFER_NONE },
+	{ "ssl_version",         true,  true,  ssl_version_arg_checker,      IN_ALL,                  BUFFER_NONE },
+	{ "ssl_state",           true,  true,  ssl_state_arg_checker,        IN_ALL,                  BUFFER_NONE },
+	{ "tos",                 true,  true,  tos_arg_checker,              IN_ALL,                  BUFFER_NONE },
+	{ "iprep",               true,  false, iprep_arg_checker,            IN_SURICATA,             BUFFER_NONE },
+	{ "app-layer-event",     true,  true,  nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "stream-event",        true,  true,  nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "flowint",             true,  false, nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "byte_extract",        true,  false, nullptr,                      IN_ALL,                  BUFFER_NONE },
+	{ "byte_math",           true,  false, nullptr,                      IN_ALL,                  BUFFER_NONE },
+	{ "base64_decode",       true,  true,  nullptr,                      IN_ALL,                  BUFFER_NONE },
+	{ "sd_pattern",          true,  true,  nullptr,                      IN_SNORT,                BUFFER_NONE },
+	{ "service",             true,  true,  nullptr,                      IN_SNORT3,               BUFFER_NONE },
+	{ "rem",                 true,  false, nullptr,                      IN_SNORT3,               BUFFER_NONE },
+	{ "bufferlen",           true,  false, nullptr,                      IN_SNORT3,               BUFFER_NONE },
+	{ "regex",               true,  false, nullptr,                      IN_SNORT3,               BUFFER_NONE },
+	{ "http_param",          true,  false, nullptr,                      IN_SNORT3,               BUFFER_STICKY },
+	{ "app-layer-protocol",  true,  false, nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "bsize",               true,  false, nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "dataset",             true,  false, nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "datarep",             true,  false, nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "xbits",               true,  false, nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "target",              true,  true,  nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "tls.version",         true,  true,  nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "filemagic",           true,  false, str_arg_checker,              IN_SURICATA,             BUFFER_NONE },
+	{ "filename",            true,  false, str_arg_checker,              IN_SURICATA,             BUFFER_NONE },
+	{ "fileext",             true,  false, str_arg_checker,              IN_SURICATA,             BUFFER_NONE },
+	{ "pcrexform",           true,  false, pcre_arg_checker,             IN_SURICATA,             BUFFER_NONE },
 
 	// Argless options
-	{ "http_method",      false, true,  nullptr },
-	{ "ftpbounce",        false, true,  nullptr },
-	{ "file_data",        false, true,  nullptr },
-	{ "nocase",           false, false, nullptr },
-	{ "rawbytes",         false, true,  nullptr },
-	{ "dce_stub_data",    false, true,  nullptr },
-	{ "fast_pattern",     false, true,  nullptr },
-	{ "http_client_body", false, false, nullptr },
-	{ "http_header",      false, false, nullptr },
-	{ "http_raw_cookie",  false, true,  nullptr },
-	{ "http_raw_header",  false, true,  nullptr },
-	{ "http_uri",         false, false, nullptr },
-	{ "http_stat_code",   false, true,  nullptr },
-	{ "http_stat_msg",    false, true,  nullptr },
-	{ "http_cookie",      false, true,  nullptr },
-	{ "sameip",           false, true,  nullptr },
-	{ "noalert",          false, false, nullptr },
-
-	{ nullptr,            false, false, nullptr }
+	{ "http_method",         false, true,  nullptr,                      IN_ALL,                  BUFFER_MODIFIER },
+	{ "ftpbounce",           false, true,  nullptr,                      IN_SNORT2,               BUFFER_NONE },
+	{ "file_data",           false, true,  nullptr,                      IN_ALL,                  BUFFER_NONE },
+	{ "nocase",              false, false, nullptr,                      IN_SNORT2 | IN_SURICATA, BUFFER_NONE },
+	{ "rawbytes",            false, true,  nullptr,                      IN_SNORT2 | IN_SURICATA, BUFFER_NONE },
+	{ "dce_stub_data",       false, true,  nullptr,                      IN_ALL,                  BUFFER_NONE },
+	{ "fast_pattern",        false, true,  nullptr,                      IN_SNORT2 | IN_SURICATA, BUFFER_NONE },
+	{ "http_client_body",    false, false, nullptr,                      IN_ALL,                  BUFFER_MODIFIER },
+	{ "http_header",         false, false, nullptr,                      IN_ALL,                  BUFFER_MODIFIER },
+	{ "http_raw_cookie",     false, true,  nullptr,                      IN_ALL,                  BUFFER_MODIFIER },
+	{ "http_raw_header",     false, true,  nullptr,                      IN_ALL,                  BUFFER_MODIFIER },
+	{ "http_uri",            false, false, nullptr,                      IN_ALL,                  BUFFER_MODIFIER },
+	{ "http_stat_code",      false, true,  nullptr,                      IN_ALL,                  BUFFER_MODIFIER },
+	{ "http_stat_msg",       false, true,  nullptr,                      IN_ALL,                  BUFFER_MODIFIER },
+	{ "http_cookie",         false, true,  nullptr,                      IN_ALL,                  BUFFER_MODIFIER },
+	{ "sameip",              false, true,  nullptr,                      IN_ALL,                  BUFFER_NONE },
+	{ "noalert",             false, false, nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "http_raw_uri",        false, false, nullptr,                      IN_ALL,                  BUFFER_MODIFIER },
+	{ "http_user_agent",     false, false, nullptr,                      IN_SURICATA,             BUFFER_MODIFIER },
+	{ "http_host",           false, false, nullptr,                      IN_SURICATA,             BUFFER_MODIFIER },
+	{ "http_server_body",    false, false, nullptr,                      IN_SURICATA,             BUFFER_MODIFIER },
+	{ "startswith",          false, false, nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "endswith",            false, false, nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "base64_data",         false, true,  nullptr,                      IN_ALL,                  BUFFER_STICKY },
+	{ "pkt_data",            false, false, nullptr,                      IN_SNORT | IN_SURICATA,  BUFFER_STICKY },
+	{ "raw_data",            false, false, nullptr,                      IN_SNORT3,               BUFFER_STICKY },
+	{ "js_data",             false, false, nullptr,                      IN_SNORT3,               BUFFER_STICKY },
+	{ "http_raw_body",       false, false, nullptr,                      IN_SNORT3,               BUFFER_STICKY },
+	{ "http_version",        false, false, nullptr,                      IN_SNORT3,               BUFFER_STICKY },
+	{ "http_true_ip",        false, false, nullptr,                      IN_SNORT3,               BUFFER_STICKY },
+	{ "to_lowercase",        false, false, nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "dotprefix",           false, false, nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "strip_whitespace",    false, false, nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "compress_whitespace", false, false, nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "url_decode",          false, false, nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "to_sha256",           false, false, nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "prefilter",           false, true,  nullptr,                      IN_SURICATA,             BUFFER_NONE },
+	{ "filestore",           false, true,  nullptr,                      IN_SURICATA,             BUFFER_NONE },
+
+	// Suricata sticky buffers
+	{ "http.uri",            false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.uri.raw",        false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.method",         false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.request_line",   false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.request_body",   false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.response_body",  false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.response_line",  false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.header",         false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.header.raw",     false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.header_names",   false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.cookie",         false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.user_agent",     false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.host",           false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.host.raw",       false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.accept",         false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.referer",        false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.content_type",   false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.content_len",    false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.server",         false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.location",       false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.protocol",       false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.stat_code",      false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "http.stat_msg",       false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "file.data",           false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "tls.sni",             false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "tls.cert_subject",    false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "tls.cert_issuer",     false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "tls.cert_serial",     false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "ja3.hash",            false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "ja3s.hash",           false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "dns.query",           false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "ssh.software",        false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "smb.named_pipe",      false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+	{ "smb.share",           false, false, nullptr,                      IN_SURICATA,             BUFFER_STICKY },
+
+	{ nullptr,               false, false, nullptr,                      0,                       BUFFER_NONE }
+};
+
+// Where a dialect gives an option other properties than rule_options[].
+typedef struct dialect_override
+{
+	int dialect;
+	type_rule_options option;
+} type_dialect_override;
+
+static constexpr type_dialect_override dialect_overrides[] = {
+	// Snort 2: payload options may repeat.
+	{ DIALECT_SNORT2,   { "uricontent",       true,  false, pattern_arg_checker,   IN_SNORT2,   BUFFER_NONE } },
+	{ DIALECT_SNORT2,   { "pcre",             true,  false, pcre_arg_checker,      IN_SNORT2,   BUFFER_NONE } },
+	{ DIALECT_SNORT2,   { "byte_jump",        true,  false, byte_jump_arg_checker, IN_SNORT2,   BUFFER_NONE } },
+	{ DIALECT_SNORT2,   { "isdataat",         true,  false, isdataat_arg_checker,  IN_SNORT2,   BUFFER_NONE } },
+
+	// Snort 3: content modifiers follow the pattern ("abc", nocase,
+	// depth 4), HTTP buffers are sticky, options may repeat.
+	{ DIALECT_SNORT3,   { "content",          true,  false, content_arg_checker,   IN_SNORT3,   BUFFER_NONE } },
+	{ DIALECT_SNORT3,   { "pcre",             true,  false, pcre_arg_checker,      IN_SNORT3,   BUFFER_NONE } },
+	{ DIALECT_SNORT3,   { "byte_jump",        true,  false, byte_jump_arg_checker, IN_SNORT3,   BUFFER_NONE } },
+	{ DIALECT_SNORT3,   { "isdataat",         true,  false, isdataat_arg_checker,  IN_SNORT3,   BUFFER_NONE } },
+	{ DIALECT_SNORT3,   { "file_data",        false, false, nullptr,               IN_SNORT3,   BUFFER_STICKY } },
+	{ DIALECT_SNORT3,   { "dce_stub_data",    false, false, nullptr,               IN_SNORT3,   BUFFER_STICKY } },
+	{ DIALECT_SNORT3,   { "http_client_body", false, false, nullptr,               IN_SNORT3,   BUFFER_STICKY } },
+	{ DIALECT_SNORT3,   { "http_cookie",      false, false, nullptr,               IN_SNORT3,   BUFFER_STICKY } },
+	{ DIALECT_SNORT3,   { "http_header",      false, false, nullptr,               IN_SNORT3,   BUFFER_STICKY } },
+	{ DIALECT_SNORT3,   { "http_method",      false, false, nullptr,               IN_SNORT3,   BUFFER_STICKY } },
+	{ DIALECT_SNORT3,   { "http_raw_cookie",  false, false, nullptr,               IN_SNORT3,   BUFFER_STICKY } },
+	{ DIALECT_SNORT3,   { "http_raw_header",  false, false, nullptr,               IN_SNORT3,   BUFFER_STICKY } },
+	{ DIALECT_SNORT3,   { "http_raw_uri",     false, false, nullptr,               IN_SNORT3,   BUFFER_STICKY } },
+	{ DIALECT_SNORT3,   { "http_stat_code",   false, false, nullptr,               IN_SNORT3,   BUFFER_STICKY } },
+	{ DIALECT_SNORT3,   { "http_stat_msg",    false, false, nullptr,               IN_SNORT3,   BUFFER_STICKY } },
+	{ DIALECT_SNORT3,   { "http_uri",         false, false, nullptr,               IN_SNORT3,   BUFFER_STICKY } },
+
+	// Suricata: 'file_data' and 'dce_stub_data' are sticky, payload
+	// options may repeat.
+	{ DIALECT_SURICATA, { "uricontent",       true,  false, pattern_arg_checker,   IN_SURICATA, BUFFER_NONE } },
+	{ DIALECT_SURICATA, { "pcre",             true,  false, pcre_arg_checker,      IN_SURICATA, BUFFER_NONE } },
+	{ DIALECT_SURICATA, { "byte_jump",        true,  false, byte_jump_arg_checker, IN_SURICATA, BUFFER_NONE } },
+	{ DIALECT_SURICATA, { "isdataat",         true,  false, isdataat_arg_checker,  IN_SURICATA, BUFFER_NONE } },
+	{ DIALECT_SURICATA, { "file_data",        false, false, nullptr,               IN_SURICATA, BUFFER_STICKY } },
+	{ DIALECT_SURICATA, { "dce_stub_data",    false, false, nullptr,               IN_SURICATA, BUFFER_STICKY } },
+};
+
+#define OPTION_UNKNOWN		-1
+#define OPTION_HASH_SLOTS	512
+#define OPTION_MAX_PROBES	4
+
+constexpr size_t rule_options_count()
+{
+	size_t n = 0;
+
+	while (rule_options[n].name != nullptr) {
+		n++;
+	}
+
+	return n;
+}
+
+#define RULE_OPTIONS_COUNT	rule_options_count()
+
+constexpr char fold_case(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+// Case-insensitive FNV-1a.
+constexpr uint32_t option_hash(std::string_view name)
+{
+	uint32_t h = 2166136261u;
+
+	for (char c : name) {
+		h = (h ^ static_cast<unsigned char>(fold_case(c))) * 16777619u;
+	}
+
+	return h;
+}
+
+constexpr bool option_name_equals(const char *name, std::string_view s)
+{
+	size_t i = 0;
+
+	for (; i < s.length(); i++) {
+		if (name[i] == '\0' || name[i] != fold_case(s[i])) {
+			return false;
+		}
+	}
+
+	return name[i] == '\0';
+}
+
+typedef struct option_hash_table
+{
+	int16_t slots[OPTION_HASH_SLOTS];
+	size_t max_probes;
+} type_option_hash_table;
+
+// Options of a dialect: their properties by ID (no name for options the
+// dialect doesn't have) and an open addressing table over their names.
+typedef struct dialect_table
+{
+	type_rule_options options[RULE_OPTIONS_COUNT];
+	type_option_hash_table hash;
+} type_dialect_table;
+
+// Built by the compiler, once per dialect.
+constexpr type_dialect_table build_dialect_table(int dialect)
+{
+	type_dialect_table table = {};
+
+	for (size_t i = 0; i < OPTION_HASH_SLOTS; i++) {
+		table.hash.slots[i] = OPTION_UNKNOWN;
+	}
+
+	for (size_t id = 0; id < RULE_OPTIONS_COUNT; id++) {
+		if (dialect == DIALECT_ANY || (rule_options[id].dialects & (1 << dialect))) {
+			table.options[id] = rule_options[id];
+		}
+	}
+
+	for (const type_dialect_override &o : dialect_overrides) {
+		for (size_t id = 0; id < RULE_OPTIONS_COUNT; id++) {
+			if (o.dialect == dialect && option_name_equals(rule_options[id].name, o.option.name)) {
+				table.options[id] = o.option;
+			}
+		}
+	}
+
+	for (size_t id = 0; id < RULE_OPTIONS_COUNT; id++) {
+		if (table.options[id].name == nullptr) {
+			continue;
+		}
+
+		size_t slot = option_hash(table.options[id].name) % OPTION_HASH_SLOTS;
+		size_t probes = 1;
+
+		while (table.hash.slots[slot] != OPTION_UNKNOWN) {
+			slot = (slot + 1) % OPTION_HASH_SLOTS;
+			probes++;
+		}
+
+		table.hash.slots[slot] = static_cast<int16_t>(id);
+
+		if (probes > table.hash.max_probes) {
+			table.hash.max_probes = probes;
+		}
+	}
+
+	return table;
+}
+
+static constexpr type_dialect_table dialect_tables[DIALECTS_COUNT] = {
+	build_dialect_table(DIALECT_ANY),
+	build_dialect_table(DIALECT_SNORT2),
+	build_dialect_table(DIALECT_SNORT3),
+	build_dialect_table(DIALECT_SURICATA),
+};
+
+static_assert(RULE_OPTIONS_COUNT * 2 <= OPTION_HASH_SLOTS, "Option hash table is too small");
+static_assert(dialect_tables[DIALECT_ANY].hash.max_probes <= OPTION_MAX_PROBES &&
+	dialect_tables[DIALECT_SNORT2].hash.max_probes <= OPTION_MAX_PROBES &&
+	dialect_tables[DIALECT_SNORT3].hash.max_probes <= OPTION_MAX_PROBES &&
+	dialect_tables[DIALECT_SURICATA].hash.max_probes <= OPTION_MAX_PROBES, "Too many option hash collisions");
+
+// Option ID (index into rule_options[]) or OPTION_UNKNOWN, for the
+// options of 'table'.
+constexpr int find_option(const type_dialect_table &table, std::string_view name)
+{
+	size_t slot = option_hash(name) % OPTION_HASH_SLOTS;
+
+	for (size_t i = 0; i < table.hash.max_probes; i++) {
+		int id = table.hash.slots[slot];
+
+		if (id == OPTION_UNKNOWN) {
+			break;
+		}
+
+		if (option_name_equals(table.options[id].name, name)) {
+			return id;
+		}
+
+		slot = (slot + 1) % OPTION_HASH_SLOTS;
+	}
+
+	return OPTION_UNKNOWN;
+}
+
+// Same for the options of any dialect.
+constexpr int find_option(std::string_view name)
+{
+	return find_option(dialect_tables[DIALECT_ANY], name);
+}
+
+// ID of an option known at compile time. Does not compile for names
+// missing from rule_options[].
+constexpr int option_id(std::string_view name)
+{
+	return (find_option(name) != OPTION_UNKNOWN) ? find_option(name) :
+		throw std::invalid_argument("unknown rule option");
+}
+
+// Dialect ID by name ("snort2", "snort3" or "suricata") or -1.
+int find_dialect(std::string_view name);
+
+// Options present in a rule.
+typedef struct configured_options
+{
+	std::bitset<RULE_OPTIONS_COUNT> present;
+
+	bool has(int id) const
+	{
+		return present.test(id);
+	}
+
+	void add(int id)
+	{
+		present.set(id);
+	}
+} type_configured_options;
+
+#define FLOWBIT_SET		0
+#define FLOWBIT_UNSET		1
+#define FLOWBIT_TOGGLE		2
+#define FLOWBIT_ISSET		3
+#define FLOWBIT_ISNOTSET	4
+
+typedef struct flowbit_ref
+{
+	int op;
+	std::string_view name;
+} type_flowbit_ref;
+
+typedef struct parsed_option
+{
+	// Index into rule_options[].
+	int id;
+	std::string_view name;
+	std::string_view arg;
+	bool has_arg;
+	// Byte offsets of name and argument within the rule.
+	uint32_t offset;
+	uint32_t arg_offset;
+	// BUFFER_* in the dialect the rule was checked in.
+	int buffer;
+} type_parsed_option;
+
+// Result of checking a rule. All views point into the checked rule
+// text, which must outlive the result.
+typedef struct parsed_rule
+{
+	std::string_view text;
+
+	std::string_view action;
+	std::string_view proto;
+	std::string_view src_addr;
+	std::string_view src_port;
+	std::string_view direction;
+	std::string_view dst_addr;
+	std::string_view dst_port;
+
+	// Known options in rule order.
+	std::vector<type_parsed_option> options;
+
+	int status;
+	// 0 if the rule has no valid 'sid'.
+	uint32_t sid;
+	uint32_t gid;
+	uint32_t rev;
+	diag_list diags;
+	std::vector<type_flowbit_ref> flowbits;
+} type_parsed_rule;
+
+typedef struct checker_config
+{
+	// Performance heuristics (warnings), on top of the syntax checks.
+	bool performance_checks = true;
+	// Address and port variables used to resolve rule headers, not owned.
+	// Without them fields referring to variables are not checked.
+	const rule_vars *vars = nullptr;
+	// DIALECT_*: which options are known and how they are checked.
+	int dialect = DIALECT_ANY;
+} type_checker_config;
+
+// Rule checker for library use. Configuration is fixed at construction;
+// a const rule_checker holds no mutable state and can be shared by any
+// number of threads.
+class rule_checker
+{
+public:
+	explicit rule_checker(const type_checker_config &config = type_checker_config());
+
+	const type_checker_config &config() const
+	{
+		return cfg;
+	}
+
+	// Parse and check a rule. 'result' may be reused between calls to
+	// avoid allocations.
+	int check(std::string_view rule, type_parsed_rule &result) const;
+	type_parsed_rule check(std::string_view rule) const;
+	// Check 'count' rules on up to 'jobs' threads, results[i] belongs to rules[i].
+	void check(const std::string_view *rules, size_t count, type_parsed_rule *results,
+		unsigned jobs = 1) const;
+
+private:
+	// Specialised per dialect, so that looking up and checking an option
+	// is a hit in that dialect's table; chosen once at construction.
+	template <int dialect>
+	int check_options(std::string_view options, type_parsed_rule &result) const;
+	int analyze(std::string_view options, const type_configured_options &configured,
+		const diag_list &hazards, type_parsed_rule &result) const;
+
+	type_checker_config cfg;
+	int (rule_checker::*check_dialect_options)(std::string_view, type_parsed_rule &) const;
 };
 
-int process_rule(const std::string rule, std::string &message);
+// Check a single rule with the default configuration. Safe to call from
+// several threads at once.
+int process_rule(std::string_view rule, type_parsed_rule &result);
+// Same as above, findings are formatted one per line into 'message'.
+int process_rule(std::string_view rule, std::string &message);
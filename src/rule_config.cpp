@@ -0,0 +1,262 @@
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <boost/algorithm/string.hpp>
+#include "rule_config.h"
+#include "rule_reader.h"
+#include "string_utils.h"
+
+using namespace std;
+
+#define RULES_SUFFIX	".rules"
+
+static bool is_name_char(char c)
+{
+	return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// Directory part of a path, with its trailing slash; empty if none.
+static string directory(const string &path)
+{
+	size_t slash = path.rfind('/');
+
+	return (slash == string::npos) ? "" : path.substr(0, slash + 1);
+}
+
+// YAML comments start with '#' at the start or after a space.
+static string_view strip_comment(string_view line)
+{
+	char quote = 0;
+
+	for (size_t i = 0; i < line.length(); i++) {
+		if (quote) {
+			quote = (line[i] == quote) ? 0 : quote;
+		} else if (line[i] == '"' || line[i] == '\'') {
+			quote = line[i];
+		} else if (line[i] == '#' && (i == 0 || is_space(line[i - 1]))) {
+			return line.substr(0, i);
+		}
+	}
+
+	return line;
+}
+
+static string_view unquote(string_view value)
+{
+	if (value.length() >= 2 && (value[0] == '"' || value[0] == '\'') && value.back() == value[0]) {
+		return value.substr(1, value.length() - 2);
+	}
+
+	return value;
+}
+
+bool rule_config::load(const string &filename, rule_vars &vars)
+{
+	char buf[PATH_MAX];
+
+	if (!realpath(filename.c_str(), buf) || !ifstream(filename)) {
+		return false;
+	}
+
+	this->vars = &vars;
+	seen.insert(buf);
+	read(filename);
+
+	return true;
+}
+
+void rule_config::read(const string &filename)
+{
+	vars->load(filename);
+
+	if (is_yaml_config(filename)) {
+		load_yaml(filename);
+	} else {
+		load_conf(filename);
+	}
+}
+
+void rule_config::load_conf(const string &filename)
+{
+	rule_reader reader;
+	type_rule_line line;
+
+	if (!reader.open(filename)) {
+		return;
+	}
+
+	while (reader.next(line)) {
+		string_view rest = line.text;
+
+		if (next_token(rest, " \t") == "include") {
+			string_view target = trim(rest);
+
+			include(target, directory(filename), filename + ":" + to_string(line.first_line) + ": ",
+				boost::ends_with(target, RULES_SUFFIX));
+		}
+	}
+
+	if (reader.error()) {
+		messages.push_back(filename + ": Can't read: " + strerror(reader.error()));
+	}
+}
+
+// Only the top level keys that lead to rule files:
+//
+// default-rule-path: /etc/suricata/rules
+// rule-files:
+//   - suricata.rules
+// include: local.yaml
+//
+// 'include' may be a list too. Relative paths are taken from the
+// directory of the file.
+void rule_config::load_yaml(const string &filename)
+{
+	ifstream in(filename);
+	string raw;
+	size_t line_no = 0;
+	string dir = directory(filename);
+	string rule_path;
+	// Key of the list being read, if any.
+	string list;
+	// The default rule path may come after the rule files, they are
+	// followed once the whole file is read.
+	vector<pair<string, string>> rules;
+
+	while (getline(in, raw)) {
+		string_view line = strip_comment(raw);
+		size_t indent = line.find_first_not_of(' ');
+		string_view text = trim(line);
+		string where = filename + ":" + to_string(++line_no) + ": ";
+
+		if (text.empty() || text[0] == '%' || text == "---") {
+			continue;
+		}
+
+		if (!list.empty() && text[0] == '-') {
+			string_view item = unquote(trim(text.substr(1)));
+
+			if (list == "include") {
+				include(item, dir, where, boost::ends_with(item, RULES_SUFFIX));
+			} else {
+				rules.push_back({ string(item), where });
+			}
+
+			continue;
+		}
+
+		list.clear();
+
+		size_t colon = text.find(':');
+
+		if (indent || colon == string_view::npos) {
+			continue;
+		}
+
+		string_view key = trim(text.substr(0, colon));
+		string_view value = unquote(trim(text.substr(colon + 1)));
+
+		if (key == "default-rule-path") {
+			rule_path = string(value);
+		} else if (key == "rule-files" || key == "include") {
+			if (value.empty()) {
+				list = string(key);
+			} else if (key == "include") {
+				include(value, dir, where, boost::ends_with(value, RULES_SUFFIX));
+			} else {
+				rules.push_back({ string(value), where });
+			}
+		}
+	}
+
+	if (!rule_path.empty() && rule_path[0] != '/') {
+		rule_path = dir + rule_path;
+	}
+
+	if (!rule_path.empty() && rule_path.back() != '/') {
+		rule_path += '/';
+	}
+
+	for (const auto &rule : rules) {
+		// Listed rule files are rule files whatever their name.
+		include(rule.first, rule_path.empty() ? dir : rule_path, rule.second, true);
+	}
+}
+
+// Expand '$VAR' and '$(VAR)'.
+bool rule_config::expand(string_view target, const string &where, string &path)
+{
+	path.clear();
+
+	for (size_t i = 0; i < target.length(); i++) {
+		if (target[i] != '$') {
+			path += target[i];
+			continue;
+		}
+
+		size_t start = i + 1;
+		size_t end = start;
+
+		if (start < target.length() && target[start] == '(') {
+			end = target.find(')', ++start);
+
+			if (end == string_view::npos) {
+				messages.push_back(where + "Unterminated variable in include '" + string(target) + "'");
+				return false;
+			}
+
+			i = end;
+		} else {
+			while (end < target.length() && is_name_char(target[end])) {
+				end++;
+			}
+
+			i = end - 1;
+		}
+
+		string_view name = target.substr(start, end - start);
+		const type_rule_var *var = vars->find(name);
+
+		if (!var) {
+			messages.push_back(where + "Unknown variable $" + string(name) + " in include '" + string(target) + "'");
+			return false;
+		}
+
+		path += var->value;
+	}
+
+	return true;
+}
+
+void rule_config::include(string_view target, const string &dir, const string &where, bool rule_file)
+{
+	string path;
+	char buf[PATH_MAX];
+
+	if (target.empty() || !expand(target, where, path) || path.empty()) {
+		return;
+	}
+
+	if (path[0] != '/') {
+		path = filesystem::path(dir + path).lexically_normal().string();
+	}
+
+	if (!realpath(path.c_str(), buf)) {
+		messages.push_back(where + "Can't include '" + path + "': " + strerror(errno));
+		return;
+	}
+
+	if (!seen.insert(buf).second) {
+		return;
+	}
+
+	if (rule_file) {
+		files.push_back(path);
+	} else {
+		read(path);
+	}
+}
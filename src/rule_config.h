@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include "rule_vars.h"
+
+// Rule files of a deployment, found from its top-level configuration:
+//
+// - snort.conf: 'include' lines, '$VAR' and '$(VAR)' expanded from the
+//   'var' definitions, relative paths from the including file's
+//   directory.
+// - suricata.yaml: 'rule-files' under 'default-rule-path' and 'include'.
+//
+// Included files ending in '.rules' are rule files, any other one is
+// read as configuration too. A file included twice is read once.
+class rule_config
+{
+public:
+	// Variables of every configuration file read are loaded into 'vars'.
+	// Returns false if the top-level file can't be read (errno tells why).
+	bool load(const std::string &filename, rule_vars &vars);
+
+	// In include order.
+	const std::vector<std::string> &rule_files() const
+	{
+		return files;
+	}
+
+	// "file:line: message" for each include that can't be followed.
+	const std::vector<std::string> &problems() const
+	{
+		return messages;
+	}
+
+private:
+	void read(const std::string &filename);
+	void load_conf(const std::string &filename);
+	void load_yaml(const std::string &filename);
+	void include(std::string_view target, const std::string &dir, const std::string &where, bool rule_file);
+	bool expand(std::string_view target, const std::string &where, std::string &path);
+
+	rule_vars *vars = nullptr;
+	std::vector<std::string> files;
+	std::vector<std::string> messages;
+	// Real paths of the files included so far.
+	std::unordered_set<std::string> seen;
+};
@@ -0,0 +1,549 @@
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include "content.h"
+#include "cost_model.h"
+#include "pcre_parser.h"
+#include "rule_fixer.h"
+#include "string_utils.h"
+
+using namespace std;
+
+static constexpr int OPTION_CONTENT      = option_id("content");
+static constexpr int OPTION_URICONTENT   = option_id("uricontent");
+static constexpr int OPTION_FAST_PATTERN = option_id("fast_pattern");
+static constexpr int OPTION_DISTANCE     = option_id("distance");
+static constexpr int OPTION_WITHIN       = option_id("within");
+static constexpr int OPTION_FLOW         = option_id("flow");
+static constexpr int OPTION_FLOWBITS     = option_id("flowbits");
+static constexpr int OPTION_FLAGS        = option_id("flags");
+static constexpr int OPTION_IP_PROTO     = option_id("ip_proto");
+static constexpr int OPTION_MSG          = option_id("msg");
+static constexpr int OPTION_PCRE         = option_id("pcre");
+static constexpr int OPTION_BYTE_TEST    = option_id("byte_test");
+static constexpr int OPTION_BYTE_JUMP    = option_id("byte_jump");
+static constexpr int OPTION_ISDATAAT     = option_id("isdataat");
+
+// Options applying to the preceding content.
+static const int content_modifiers[] = {
+	option_id("nocase"),
+	option_id("rawbytes"),
+	option_id("fast_pattern"),
+	option_id("distance"),
+	option_id("within"),
+	option_id("depth"),
+	option_id("offset"),
+	option_id("http_client_body"),
+	option_id("http_cookie"),
+	option_id("http_header"),
+	option_id("http_method"),
+	option_id("http_raw_cookie"),
+	option_id("http_raw_header"),
+	option_id("http_stat_code"),
+	option_id("http_stat_msg"),
+	option_id("http_uri"),
+};
+
+// Options only HTTP rules have, so TCP ones.
+static const int http_options[] = {
+	option_id("uricontent"),
+	option_id("urilen"),
+	option_id("http_client_body"),
+	option_id("http_cookie"),
+	option_id("http_header"),
+	option_id("http_method"),
+	option_id("http_raw_cookie"),
+	option_id("http_raw_header"),
+	option_id("http_stat_code"),
+	option_id("http_stat_msg"),
+	option_id("http_uri"),
+};
+
+// Tests on the packet or the flow, cheaper than any payload option.
+static const int cheap_options[] = {
+	option_id("flow"),
+	option_id("flags"),
+	option_id("dsize"),
+	option_id("ttl"),
+	option_id("tos"),
+	option_id("id"),
+	option_id("seq"),
+	option_id("ack"),
+	option_id("window"),
+	option_id("itype"),
+	option_id("icode"),
+	option_id("icmp_id"),
+	option_id("icmp_seq"),
+	option_id("ipopts"),
+	option_id("fragbits"),
+	option_id("fragoffset"),
+	option_id("ip_proto"),
+	option_id("sameip"),
+	option_id("urilen"),
+	option_id("ssl_version"),
+	option_id("ssl_state"),
+};
+
+// Options that don't take part in detection.
+static const int info_options[] = {
+	option_id("msg"),
+	option_id("reference"),
+	option_id("classtype"),
+	option_id("sid"),
+	option_id("rev"),
+	option_id("gid"),
+	option_id("priority"),
+	option_id("metadata"),
+};
+
+// Buffers a fast pattern may be taken from.
+static const char *const fast_pattern_buffers[] = {
+	"",
+	"http_uri",
+	"http_header",
+	"http_client_body",
+};
+
+// Kinds of the units options are moved by.
+#define UNIT_CHEAP		0
+#define UNIT_PAYLOAD		1
+#define UNIT_INFO		2
+// Anything else: nothing is moved across it.
+#define UNIT_BARRIER		3
+
+typedef struct fix_option
+{
+	int id;
+	// "name:arg;" as written.
+	std::string text;
+	// Argument, a view into the rule; empty for added options.
+	std::string_view arg;
+} type_fix_option;
+
+// A content with its modifiers, or a single option.
+typedef std::vector<type_fix_option> type_fix_unit;
+
+template <size_t N>
+static bool is_one_of(int id, const int (&ids)[N])
+{
+	return find(begin(ids), end(ids), id) != end(ids);
+}
+
+static bool has_diag(const type_parsed_rule &rule, type_diag_code code)
+{
+	for (const type_diagnostic &diag : rule.diags) {
+		if (diag.code == code) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static int count_errors(const type_parsed_rule &rule)
+{
+	int errors = 0;
+
+	for (const type_diagnostic &diag : rule.diags) {
+		errors += diag_severity(diag) == SEVERITY_ERROR;
+	}
+
+	return errors;
+}
+
+static bool has_flag(string_view arg, string_view flag)
+{
+	for (string_view tok = next_token(arg, ", \t"); !tok.empty(); tok = next_token(arg, ", \t")) {
+		if (boost::iequals(tok, flag)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static int unit_kind(const type_fix_unit &unit)
+{
+	const type_fix_option &opt = unit.front();
+
+	if (opt.id == OPTION_FLOWBITS) {
+		string_view op = trim(opt.arg.substr(0, opt.arg.find(',')));
+
+		return (boost::iequals(op, "isset") || boost::iequals(op, "isnotset")) ? UNIT_CHEAP : UNIT_BARRIER;
+	}
+
+	if (is_one_of(opt.id, cheap_options)) {
+		return UNIT_CHEAP;
+	}
+
+	if (is_one_of(opt.id, info_options)) {
+		return UNIT_INFO;
+	}
+
+	if (opt.id == OPTION_CONTENT || opt.id == OPTION_URICONTENT || opt.id == OPTION_PCRE ||
+		opt.id == OPTION_BYTE_TEST || opt.id == OPTION_BYTE_JUMP || opt.id == OPTION_ISDATAAT) {
+		return UNIT_PAYLOAD;
+	}
+
+	return UNIT_BARRIER;
+}
+
+// Placed after the previous payload match rather than in the buffer.
+static bool is_relative(const type_fix_unit &unit)
+{
+	const type_fix_option &opt = unit.front();
+
+	if (opt.id == OPTION_CONTENT || opt.id == OPTION_URICONTENT) {
+		for (const type_fix_option &modifier : unit) {
+			if (modifier.id == OPTION_DISTANCE || modifier.id == OPTION_WITHIN) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	if (opt.id == OPTION_PCRE) {
+		pcre_expression expr;
+
+		// Unparsed: taken as relative, so it stays in place.
+		return !expr.parse(opt.arg) || (expr.flags() & PCRE_RELATIVE);
+	}
+
+	return has_flag(opt.arg, "relative");
+}
+
+static string option_text(const type_parsed_rule &rule, const type_parsed_option &opt)
+{
+	size_t end = opt.has_arg ? opt.arg_offset + opt.arg.length() : opt.offset + opt.name.length();
+
+	return string(rule.text.substr(opt.offset, end - opt.offset)) + ';';
+}
+
+// Position in 'opts' of the option at 'index' in the rule, or -1.
+static int find_index(const vector<size_t> &indexes, size_t index)
+{
+	auto it = find(indexes.begin(), indexes.end(), index);
+
+	return (it != indexes.end()) ? it - indexes.begin() : -1;
+}
+
+// 'ip' with ports or flow: TCP or UDP if ip_proto or HTTP options tell.
+static void switch_protocol(const type_parsed_rule &rule, string &proto, vector<type_fix_option> &opts,
+	vector<size_t> &indexes, vector<string> &changes)
+{
+	if (!has_diag(rule, DIAG_IP_WITH_PORTS) && !has_diag(rule, DIAG_IP_WITH_FLOW)) {
+		return;
+	}
+
+	const char *to = nullptr;
+	int ip_proto = -1;
+	bool http = false;
+
+	for (size_t i = 0; i < opts.size(); i++) {
+		if (opts[i].id == OPTION_IP_PROTO) {
+			string_view arg = trim(opts[i].arg);
+
+			if (boost::iequals(arg, "tcp") || arg == "6") {
+				to = "tcp";
+			} else if (boost::iequals(arg, "udp") || arg == "17") {
+				to = "udp";
+			} else {
+				return;
+			}
+
+			ip_proto = i;
+		}
+
+		http = http || is_one_of(opts[i].id, http_options);
+	}
+
+	if (!to && http) {
+		to = "tcp";
+	}
+
+	if (!to) {
+		return;
+	}
+
+	// Implied by the protocol now.
+	if (ip_proto != -1) {
+		opts.erase(opts.begin() + ip_proto);
+		indexes.erase(indexes.begin() + ip_proto);
+	}
+
+	proto = to;
+	changes.push_back("protocol 'ip' -> '" + proto + "'");
+}
+
+// TCP rules inspecting payload without flow. Rules testing TCP flags
+// look at single packets (scans) and are left alone.
+static void add_flow(const type_parsed_rule &rule, const string &proto, vector<type_fix_option> &opts,
+	vector<size_t> &indexes, vector<string> &changes)
+{
+	if (!boost::iequals(proto, "tcp")) {
+		return;
+	}
+
+	bool payload = false;
+	size_t at = 0;
+
+	for (size_t i = 0; i < opts.size(); i++) {
+		if (opts[i].id == OPTION_FLOW || opts[i].id == OPTION_FLAGS) {
+			return;
+		}
+
+		if (opts[i].id == OPTION_MSG) {
+			at = i + 1;
+		}
+
+		payload = payload || opts[i].id == OPTION_CONTENT || opts[i].id == OPTION_URICONTENT ||
+			opts[i].id == OPTION_PCRE;
+	}
+
+	if (!payload) {
+		return;
+	}
+
+	// Server ports are the ones given, the client's are usually 'any'.
+	// Without ports either side may be the server.
+	string flow = "flow:established";
+	bool src_any = boost::iequals(rule.src_port, "any");
+	bool dst_any = boost::iequals(rule.dst_port, "any");
+
+	if (rule.direction != "<>" && !(src_any && dst_any)) {
+		flow += (dst_any && !src_any) ? ",to_client" : ",to_server";
+	}
+
+	opts.insert(opts.begin() + at, { OPTION_FLOW, flow + ';', string_view() });
+	indexes.insert(indexes.begin() + at, SIZE_MAX);
+	changes.push_back("added '" + flow + "'");
+}
+
+// 'fast_pattern' on the most selective content if the engine would take
+// a weaker one. An explicit fast_pattern with arguments is kept.
+static void place_fast_pattern(const type_parsed_rule &rule, vector<type_fix_option> &opts,
+	vector<size_t> &indexes, vector<string> &changes)
+{
+	vector<type_content_match> contents;
+
+	collect_contents(rule, contents);
+
+	const type_content_match *current = select_fast_pattern(contents);
+	const type_content_match *best = nullptr;
+
+	for (const type_content_match &content : contents) {
+		if (content.negated || find(begin(fast_pattern_buffers), end(fast_pattern_buffers),
+			content.buffer) == end(fast_pattern_buffers)) {
+			continue;
+		}
+
+		if (!best || pattern_bits(content) > pattern_bits(*best)) {
+			best = &content;
+		}
+	}
+
+	if (!current || !best || best == current || pattern_bits(*best) <= pattern_bits(*current)) {
+		return;
+	}
+
+	if (current->fast_pattern) {
+		int pos = -1;
+
+		for (size_t i = current->option + 1; i < rule.options.size() && pos == -1; i++) {
+			const type_parsed_option &opt = rule.options[i];
+
+			if (opt.id == OPTION_CONTENT || opt.id == OPTION_URICONTENT) {
+				break;
+			}
+
+			if (opt.id == OPTION_FAST_PATTERN) {
+				if (opt.has_arg) {
+					return;
+				}
+
+				pos = find_index(indexes, i);
+			}
+		}
+
+		if (pos == -1) {
+			return;
+		}
+
+		opts.erase(opts.begin() + pos);
+		indexes.erase(indexes.begin() + pos);
+	}
+
+	int pos = find_index(indexes, best->option);
+
+	if (pos == -1) {
+		return;
+	}
+
+	opts.insert(opts.begin() + pos + 1, { OPTION_FAST_PATTERN, "fast_pattern;", string_view() });
+	indexes.insert(indexes.begin() + pos + 1, SIZE_MAX);
+	changes.push_back("fast_pattern on " + string(rule.options[best->option].arg) + " instead of " +
+		string(rule.options[current->option].arg));
+}
+
+// Cheap tests before the payload options, pcre and byte_test after the
+// absolute contents that follow them.
+static void reorder(vector<type_fix_option> &opts, vector<string> &changes)
+{
+	vector<type_fix_unit> units;
+
+	for (type_fix_option &opt : opts) {
+		if (is_one_of(opt.id, content_modifiers)) {
+			int id = units.empty() ? -1 : units.back().front().id;
+
+			// Modifiers away from their content: left as they are.
+			if (id != OPTION_CONTENT && id != OPTION_URICONTENT) {
+				return;
+			}
+
+			units.back().push_back(move(opt));
+		} else {
+			units.push_back({ move(opt) });
+		}
+	}
+
+	vector<string> hoisted;
+	vector<string> sunk;
+	size_t target = SIZE_MAX;
+
+	for (size_t i = 0; i < units.size(); i++) {
+		int kind = unit_kind(units[i]);
+
+		if (kind == UNIT_BARRIER) {
+			target = SIZE_MAX;
+		} else if (kind == UNIT_PAYLOAD && target == SIZE_MAX) {
+			target = i;
+		} else if (kind == UNIT_CHEAP && target != SIZE_MAX) {
+			type_fix_unit unit = move(units[i]);
+
+			hoisted.push_back(unit.front().text.substr(0, unit.front().text.find_first_of(":;")));
+			units.erase(units.begin() + i);
+			units.insert(units.begin() + target, move(unit));
+			target++;
+		}
+	}
+
+	for (size_t i = 0; i < units.size(); i++) {
+		int id = units[i].front().id;
+
+		if ((id != OPTION_PCRE && id != OPTION_BYTE_TEST) || is_relative(units[i])) {
+			continue;
+		}
+
+		// Contents after it, the first one absolute (the others may be
+		// relative to it).
+		size_t j = i + 1;
+
+		while (j < units.size() && (units[j].front().id == OPTION_CONTENT ||
+			units[j].front().id == OPTION_URICONTENT) && (j > i + 1 || !is_relative(units[j]))) {
+			j++;
+		}
+
+		size_t next = j;
+
+		while (next < units.size() && unit_kind(units[next]) != UNIT_PAYLOAD) {
+			next++;
+		}
+
+		// The next payload option must not become relative to it.
+		if (j == i + 1 || (next < units.size() && is_relative(units[next]))) {
+			continue;
+		}
+
+		type_fix_unit unit = move(units[i]);
+
+		sunk.push_back(unit.front().text.substr(0, unit.front().text.find_first_of(":;")));
+		units.erase(units.begin() + i);
+		units.insert(units.begin() + j - 1, move(unit));
+	}
+
+	opts.clear();
+
+	for (type_fix_unit &unit : units) {
+		for (type_fix_option &opt : unit) {
+			opts.push_back(move(opt));
+		}
+	}
+
+	if (!hoisted.empty()) {
+		changes.push_back("moved " + boost::join(hoisted, ", ") + " before the payload options");
+	}
+
+	if (!sunk.empty()) {
+		changes.push_back("moved " + boost::join(sunk, ", ") + " after the contents");
+	}
+}
+
+rule_fixer::rule_fixer(const rule_checker &checker)
+	: checker(checker)
+{
+}
+
+bool rule_fixer::fix(const type_parsed_rule &rule, type_rule_fix &fix) const
+{
+	fix.text.clear();
+	fix.summary.clear();
+
+	// Only rules whose errors are fixed here.
+	for (const type_diagnostic &diag : rule.diags) {
+		if (diag_severity(diag) == SEVERITY_ERROR && diag.code != DIAG_IP_WITH_PORTS) {
+			return false;
+		}
+	}
+
+	size_t open = rule.text.find('(');
+	size_t close = rule.text.rfind(')');
+
+	if (rule.proto.empty() || open == string_view::npos || close == string_view::npos || close < open) {
+		return false;
+	}
+
+	vector<type_fix_option> opts;
+	// Index of each option in the rule, SIZE_MAX for added ones.
+	vector<size_t> indexes;
+	vector<string> changes;
+	string proto(rule.proto);
+
+	for (size_t i = 0; i < rule.options.size(); i++) {
+		opts.push_back({ rule.options[i].id, option_text(rule, rule.options[i]), rule.options[i].arg });
+		indexes.push_back(i);
+	}
+
+	switch_protocol(rule, proto, opts, indexes, changes);
+	add_flow(rule, proto, opts, indexes, changes);
+	place_fast_pattern(rule, opts, indexes, changes);
+	reorder(opts, changes);
+
+	if (changes.empty()) {
+		return false;
+	}
+
+	size_t proto_start = rule.proto.data() - rule.text.data();
+	size_t proto_end = proto_start + rule.proto.length();
+
+	fix.text.append(rule.text.substr(0, proto_start));
+	fix.text.append(proto);
+	fix.text.append(rule.text.substr(proto_end, open + 1 - proto_end));
+
+	for (size_t i = 0; i < opts.size(); i++) {
+		fix.text.append(i ? " " : "");
+		fix.text.append(opts[i].text);
+	}
+
+	fix.text.append(rule.text.substr(close));
+
+	type_parsed_rule result;
+
+	if (checker.check(fix.text, result) == RULE_HAS_ERRORS && count_errors(result) > count_errors(rule)) {
+		fix.text.clear();
+		return false;
+	}
+
+	fix.summary = boost::join(changes, ", ");
+
+	return true;
+}
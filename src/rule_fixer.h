@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include "rule_checker.h"
+
+// A rule rewritten for performance.
+typedef struct rule_fix
+{
+	std::string text;
+	// What was changed, comma separated.
+	std::string summary;
+} type_rule_fix;
+
+// Rewrites of performance problems the checker finds, on checked rules:
+//
+// - 'ip' rules with ports or flow (DP201, DP305) become 'tcp' or 'udp'
+//   rules when ip_proto or HTTP buffers tell which;
+// - TCP rules with contents and without flow (DP304) get
+//   'flow:established' in the direction the ports show, if any;
+// - 'fast_pattern' is put on the most selective content (see
+//   pattern_bits()) when the engine would pick a weaker one;
+// - cheap tests (flow, flowbits checks, flags, dsize, ...) are moved
+//   before the payload options, and pcre and byte_test past the absolute
+//   contents that follow them, without changing what a relative option
+//   is relative to.
+//
+// Options are rebuilt from their text, one space apart. A rewritten rule
+// is checked again and dropped if it has more errors than the original.
+// A const rule_fixer can be shared between threads.
+class rule_fixer
+{
+public:
+	// 'checker' checks the rewritten rules and must outlive the fixer.
+	explicit rule_fixer(const rule_checker &checker);
+
+	// Returns false if the rule was left as it is.
+	bool fix(const type_parsed_rule &rule, type_rule_fix &fix) const;
+
+private:
+	const rule_checker &checker;
+};
@@ -0,0 +1,293 @@
+#include "rule_generator.h"
+
+using namespace std;
+
+#define GENERATOR_FIRST_SID	1000000
+
+static const char *words[] = {
+	"admin", "login", "cmd", "exec", "shell", "upload", "config", "backup", "update",
+	"install", "panel", "gate", "bot", "task", "report", "query", "search", "debug",
+	"wp-admin", "phpmyadmin", "cgi-bin", "servlet", "api", "session", "token", "user",
+};
+
+static const char *tlds[] = { "com", "net", "org", "info", "ru", "biz", "top", "xyz" };
+
+static const char *classtypes[] = {
+	"web-application-attack", "trojan-activity", "attempted-recon", "misc-activity",
+	"policy-violation", "attempted-admin", "bad-unknown", "network-scan",
+};
+
+static const char *http_buffers[] = { "http_uri", "http_header", "http_client_body", "http_cookie" };
+
+static void append_hex(string &out, uint64_t bytes, size_t count)
+{
+	static const char digits[] = "0123456789ABCDEF";
+
+	for (size_t i = 0; i < count; i++) {
+		unsigned char b = bytes >> (8 * (i % 8));
+
+		if (i) {
+			out += ' ';
+		}
+
+		out += digits[b >> 4];
+		out += digits[b & 15];
+	}
+}
+
+static string domain(random_source &rnd)
+{
+	string name = rnd.pick(words);
+
+	for (size_t i = 0, n = 4 + rnd.below(8); i < n; i++) {
+		name += static_cast<char>('a' + rnd.below(26));
+	}
+
+	return name;
+}
+
+static string ip_address(random_source &rnd)
+{
+	uint64_t v = rnd.next();
+
+	return to_string(1 + (v & 0xdf)) + "." + to_string((v >> 8) & 0xff) + "." +
+		to_string((v >> 16) & 0xff) + "." + to_string(1 + ((v >> 24) & 0xfd));
+}
+
+static void http_rule(random_source &rnd, string &out)
+{
+	string word = rnd.pick(words);
+
+	out += "alert tcp $EXTERNAL_NET any -> $HTTP_SERVERS $HTTP_PORTS (msg:\"WEB-ATTACK ";
+	out += word;
+	out += " access attempt\"; flow:to_server,established; content:\"/";
+	out += word;
+	out += ".php\"; http_uri; nocase; fast_pattern; content:\"";
+	out += rnd.pick(words);
+	out += "=\"; ";
+	out += rnd.pick(http_buffers);
+	out += "; pcre:\"/";
+	out += word;
+	out += "\\.php\\?[^\\r\\n]*";
+	out += rnd.pick(words);
+	out += "=[^&]{" + to_string(16 + rnd.below(200)) + ",}/Ui\"; reference:url,www.example.com/advisory/";
+	out += to_string(rnd.below(100000));
+	out += "; classtype:web-application-attack;";
+}
+
+static void dns_rule(random_source &rnd, string &out)
+{
+	string name = domain(rnd);
+	string tld = rnd.pick(tlds);
+
+	out += "alert udp $HOME_NET any -> any 53 (msg:\"DNS query for ";
+	out += name + "." + tld;
+	out += "\"; content:\"|01 00 00 01 00 00 00 00 00 00|\"; depth:10; offset:2; content:\"|";
+	append_hex(out, name.length(), 1);
+	out += "|" + name + "|";
+	append_hex(out, tld.length(), 1);
+	out += "|" + tld + "|00|\"; nocase; distance:0; fast_pattern; classtype:";
+	out += rnd.pick(classtypes);
+	out += ";";
+}
+
+static void cnc_rule(random_source &rnd, string &out, size_t sid)
+{
+	string bit = "ET.cnc." + to_string(rnd.below(32));
+
+	out += "alert tcp $HOME_NET any -> $EXTERNAL_NET ";
+	out += to_string(1024 + rnd.below(60000));
+	out += " (msg:\"TROJAN CnC beacon\"; flow:established,to_server; dsize:<";
+	out += to_string(64 + rnd.below(512));
+	out += "; content:\"|";
+	append_hex(out, rnd.next(), 4 + rnd.below(8));
+	out += "|\"; depth:16; byte_test:4,>,";
+	out += to_string(rnd.below(65536));
+	out += ",0,relative,little; byte_jump:2,4,relative,align; flowbits:";
+	out += (sid & 1) ? "isset," : "set,";
+	out += bit;
+	out += "; threshold: type limit, track by_src, count 1, seconds ";
+	out += to_string(60 * (1 + rnd.below(60)));
+	out += "; classtype:trojan-activity;";
+}
+
+static void icmp_rule(random_source &rnd, string &out)
+{
+	out += "alert icmp $EXTERNAL_NET any -> $HOME_NET any (msg:\"ICMP large echo\"; itype:";
+	out += to_string(rnd.below(2) * 8);
+	out += "; icode:0; dsize:>";
+	out += to_string(800 + rnd.below(700));
+	out += "; classtype:misc-activity;";
+}
+
+static void scan_rule(random_source &rnd, string &out)
+{
+	static const char *flags[] = { "S,12", "SF", "0", "FPU", "A", "*SA" };
+
+	out += "alert tcp $EXTERNAL_NET any -> $HOME_NET ";
+	out += to_string(1 + rnd.below(1024));
+	out += " (msg:\"SCAN probe\"; flags:";
+	out += rnd.pick(flags);
+	out += "; window:";
+	out += to_string(1024 * (1 + rnd.below(64)));
+	out += "; ttl:>";
+	out += to_string(rnd.below(255));
+	out += "; classtype:attempted-recon;";
+}
+
+static void iprep_rule(random_source &rnd, string &out)
+{
+	out += "alert ip [";
+
+	for (size_t i = 0, n = 1 + rnd.below(12); i < n; i++) {
+		out += (i ? "," : "") + ip_address(rnd);
+	}
+
+	out += "] any -> $HOME_NET any (msg:\"Known compromised host\"; ip_proto:";
+	out += (rnd.below(2) ? "tcp" : "udp");
+	out += "; threshold: type both, track by_src, count 5, seconds 600; classtype:bad-unknown;";
+}
+
+static void long_pcre_rule(random_source &rnd, string &out)
+{
+	out += "alert tcp $EXTERNAL_NET any -> $HOME_NET $HTTP_PORTS (msg:\"Long pcre\"; "
+		"flow:to_server,established; content:\"POST\"; http_method; pcre:\"/^(?:";
+
+	for (size_t i = 0, n = 40 + rnd.below(80); i < n; i++) {
+		out += (i ? "|" : "") + string(rnd.pick(words)) + "[\\x2f\\x5c]" + domain(rnd) +
+			"\\.(?:php|asp|jsp)[^\\n]{" + to_string(rnd.below(64)) + "}";
+	}
+
+	out += ")(?:\\?[a-z0-9_]{1,32}=[^&]*)*$/Pi\"; classtype:web-application-attack;";
+}
+
+static void many_contents_rule(random_source &rnd, string &out)
+{
+	out += "alert tcp $EXTERNAL_NET any -> $HOME_NET any (msg:\"Many contents\"; flow:established;";
+
+	for (size_t i = 0, n = 30 + rnd.below(40); i < n; i++) {
+		out += " content:\"";
+
+		if (rnd.below(3) == 0) {
+			out += "|";
+			append_hex(out, rnd.next(), 2 + rnd.below(6));
+			out += "|";
+		} else {
+			out += rnd.pick(words);
+		}
+
+		out += "\";";
+
+		if (i) {
+			out += " distance:" + to_string(rnd.below(16)) + "; within:" + to_string(16 + rnd.below(64)) + ";";
+		}
+	}
+
+	out += " classtype:bad-unknown;";
+}
+
+static void semicolons_rule(random_source &rnd, string &out)
+{
+	out += "alert tcp any any -> $HOME_NET 21 (msg:\"FTP \\\"";
+	out += rnd.pick(words);
+	out += "\\\"\\; quoted; semicolons\"; flow:to_server,established; content:\"SITE EXEC;";
+	out += rnd.pick(words);
+	out += "\\;\"; nocase; content:\"|3B|rm -rf /;\"; distance:0; metadata:policy balanced-ips drop; "
+		"classtype:attempted-admin;";
+}
+
+static void broken_rule(random_source &rnd, string &out, size_t sid)
+{
+	switch (rnd.below(5)) {
+	case 0:
+		// Unterminated quote.
+		out += "alert tcp any any -> any 80 (msg:\"Broken; content:\"x\"; sid:" + to_string(sid) + "; rev:1;";
+		break;
+	case 1:
+		// Unknown option, no classtype.
+		out += "alert tcp any any -> any 80 (msg:\"Unknown\"; frobnicate:3; sid:" + to_string(sid) + "; rev:1;";
+		break;
+	case 2:
+		// Bad flow and threshold.
+		out += "alert tcp any any -> any 80 (msg:\"Bad args\"; flow:to_server established; "
+			"threshold: type sometimes; classtype:misc-activity; sid:" + to_string(sid) + "; rev:1;";
+		break;
+	case 3:
+		// IP rule with ports and no revision.
+		out += "alert ip any 80 -> any any (msg:\"Ports\"; classtype:misc-activity; sid:" + to_string(sid) + ";";
+		break;
+	default:
+		// Truncated header.
+		out += "alert tcp $HOME_NET any ->";
+		return;
+	}
+
+	out += ")";
+}
+
+void generate_rules(size_t count, uint64_t seed, string &out)
+{
+	random_source rnd(seed);
+
+	out += "# Generated rules, seed " + to_string(seed) + "\n\n";
+
+	for (size_t i = 0; i < count; i++) {
+		size_t sid = GENERATOR_FIRST_SID + i;
+		size_t kind = rnd.below(1000);
+		size_t start = out.length();
+
+		if (rnd.below(200) == 0) {
+			out += "\n# " + string(rnd.pick(words)) + " rules\n";
+			start = out.length();
+		}
+
+		if (kind < GENERATOR_BROKEN) {
+			broken_rule(rnd, out, sid);
+			out += '\n';
+			continue;
+		}
+
+		kind -= GENERATOR_BROKEN;
+
+		if (kind < GENERATOR_LONG_PCRE) {
+			long_pcre_rule(rnd, out);
+		} else if ((kind -= GENERATOR_LONG_PCRE) < GENERATOR_MANY_CONTENTS) {
+			many_contents_rule(rnd, out);
+		} else if ((kind -= GENERATOR_MANY_CONTENTS) < GENERATOR_SEMICOLONS) {
+			semicolons_rule(rnd, out);
+		} else {
+			switch (rnd.below(6)) {
+			case 0:
+				http_rule(rnd, out);
+				break;
+			case 1:
+				dns_rule(rnd, out);
+				break;
+			case 2:
+				cnc_rule(rnd, out, sid);
+				break;
+			case 3:
+				icmp_rule(rnd, out);
+				break;
+			case 4:
+				scan_rule(rnd, out);
+				break;
+			default:
+				iprep_rule(rnd, out);
+			}
+		}
+
+		out += " sid:" + to_string(sid) + "; rev:" + to_string(1 + rnd.below(9)) + ";)";
+
+		if (rnd.below(1000) < GENERATOR_CONTINUED) {
+			// Break the rule before a few options.
+			for (size_t pos = start; (pos = out.find("; ", pos)) != string::npos; pos += 4) {
+				if (rnd.below(4) == 0) {
+					out.replace(pos, 2, "; \\\n\t");
+				}
+			}
+		}
+
+		out += '\n';
+	}
+}
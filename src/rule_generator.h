@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Synthetic Snort/Suricata rule corpus for benchmarks. Most rules look
+// like the usual community/ET rules (HTTP, DNS, CnC, ICMP, scans, IP
+// reputation); a share of them is deliberately nasty: long pcre, dozens
+// of contents, quoted and escaped semicolons, continuation lines and
+// plain broken rules. The output depends on 'seed' only.
+
+// Per mille of rules of each nasty kind.
+#define GENERATOR_LONG_PCRE		20
+#define GENERATOR_MANY_CONTENTS		20
+#define GENERATOR_SEMICOLONS		30
+#define GENERATOR_CONTINUED		10
+#define GENERATOR_BROKEN		20
+
+// splitmix64, small and good enough for test data.
+class random_source
+{
+public:
+	explicit random_source(uint64_t seed) : state(seed)
+	{
+	}
+
+	uint64_t next()
+	{
+		uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+		return z ^ (z >> 31);
+	}
+
+	// Uniform in [0, n).
+	size_t below(size_t n)
+	{
+		return next() % n;
+	}
+
+	template <typename T, size_t N>
+	const T &pick(const T (&items)[N])
+	{
+		return items[below(N)];
+	}
+
+private:
+	uint64_t state;
+};
+
+// Append 'count' rules, one per line (continued rules span several
+// lines), plus a few comments and blank lines.
+void generate_rules(size_t count, uint64_t seed, std::string &out);
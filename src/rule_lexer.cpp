@@ -0,0 +1,99 @@
+#include <boost/algorithm/string/predicate.hpp>
+#include "rule_lexer.h"
+#include "string_utils.h"
+
+using namespace std;
+
+// Options whose quoted arguments may contain '|hex|' blocks.
+static bool has_hex_blocks(string_view name)
+{
+	return boost::iequals(name, "content") || boost::iequals(name, "uricontent");
+}
+
+option_lexer::option_lexer(string_view rule, string_view body)
+	: body(body), base(body.data() - rule.data()), pos(0), err(LEX_OK), err_offset(0)
+{
+}
+
+bool option_lexer::next(type_option_span &opt)
+{
+	enum { NORMAL, QUOTED, HEX } state;
+
+	while (err == LEX_OK && pos < body.length()) {
+		size_t start = pos;
+		size_t colon = string_view::npos;
+		size_t mark = 0;
+		bool hex = false;
+
+		state = NORMAL;
+
+		for (; pos < body.length(); pos++) {
+			char c = body[pos];
+
+			if (state == HEX) {
+				if (c == '|') {
+					state = QUOTED;
+				} else if (c == '"') {
+					err = LEX_UNTERMINATED_HEX;
+					err_offset = base + mark;
+					return false;
+				}
+			} else if (c == '\\') {
+				if (++pos == body.length()) {
+					err = LEX_DANGLING_ESCAPE;
+					err_offset = base + pos - 1;
+					return false;
+				}
+			} else if (state == QUOTED) {
+				if (c == '"') {
+					state = NORMAL;
+				} else if (c == '|' && hex) {
+					state = HEX;
+					mark = pos;
+				}
+			} else if (c == '"') {
+				state = QUOTED;
+				mark = pos;
+			} else if (c == ':' && colon == string_view::npos) {
+				colon = pos;
+				hex = has_hex_blocks(trim(body.substr(start, colon - start)));
+			} else if (c == ';') {
+				break;
+			}
+		}
+
+		if (state != NORMAL) {
+			err = (state == HEX) ? LEX_UNTERMINATED_HEX : LEX_UNTERMINATED_QUOTE;
+			err_offset = base + mark;
+			return false;
+		}
+
+		string_view text = body.substr(start, pos - start);
+
+		// Skip the separator.
+		pos++;
+
+		size_t name_len = (colon == string_view::npos) ? text.length() : colon - start;
+
+		opt.name = trim(text.substr(0, name_len));
+
+		if (opt.name.empty()) {
+			continue;
+		}
+
+		opt.offset = base + (opt.name.data() - body.data());
+		opt.has_arg = (colon != string_view::npos);
+
+		if (opt.has_arg) {
+			opt.arg = trim(text.substr(name_len + 1));
+			opt.arg_offset = base + (opt.arg.data() - body.data());
+		} else {
+			opt.arg = string_view();
+			opt.arg_offset = opt.offset + opt.name.length();
+		}
+
+		return true;
+	}
+
+	return false;
+}
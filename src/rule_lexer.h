@@ -0,0 +1,49 @@
+#pragma once
+#include <string_view>
+
+#define LEX_OK			0
+#define LEX_UNTERMINATED_QUOTE	1
+#define LEX_UNTERMINATED_HEX	2
+#define LEX_DANGLING_ESCAPE	3
+
+typedef struct option_span
+{
+	std::string_view name;
+	std::string_view arg;
+	bool has_arg;
+	// Byte offsets of name and argument within the whole rule.
+	size_t offset;
+	size_t arg_offset;
+} type_option_span;
+
+// Single pass lexer over the rule body (the text between the braces).
+// Semicolons and colons inside quotes or escaped with a backslash do
+// not split options, and '|hex|' blocks of content arguments are
+// tracked. Spans are views into the rule, nothing is copied.
+class option_lexer
+{
+public:
+	// 'body' must be a view into 'rule'.
+	option_lexer(std::string_view rule, std::string_view body);
+
+	// Returns false at the end of the body or on a syntax error.
+	bool next(type_option_span &opt);
+
+	int error() const
+	{
+		return err;
+	}
+
+	// Offset within the rule where the erroneous construct starts.
+	size_t error_offset() const
+	{
+		return err_offset;
+	}
+
+private:
+	std::string_view body;
+	size_t base;
+	size_t pos;
+	int err;
+	size_t err_offset;
+};
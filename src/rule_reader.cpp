@@ -0,0 +1,113 @@
+#include <algorithm>
+#include "rule_reader.h"
+#include "string_utils.h"
+
+using namespace std;
+
+// First input line of each file (line numbers are 1-based, so lines
+// before plus one) and its name.
+static deque<pair<size_t, string>> input_files;
+
+void add_input_file(const string &name, size_t base)
+{
+	input_files.push_back({ base + 1, name });
+}
+
+const string *locate_input_line(size_t &line)
+{
+	auto it = upper_bound(input_files.begin(), input_files.end(), line,
+		[](size_t l, const pair<size_t, string> &file) { return l < file.first; });
+
+	if (it == input_files.begin()) {
+		return nullptr;
+	}
+
+	--it;
+	line -= it->first - 1;
+
+	return &it->second;
+}
+
+string describe_input_line(size_t line)
+{
+	const string *file = locate_input_line(line);
+
+	return file ? *file + ":" + to_string(line) : "line " + to_string(line);
+}
+
+rule_reader::rule_reader()
+	: line_no(0), comments(false)
+{
+}
+
+bool rule_reader::open(const string &filename)
+{
+	return source.open(filename);
+}
+
+static bool is_continued(string_view line)
+{
+	return !line.empty() && line.back() == '\\';
+}
+
+bool rule_reader::next(type_rule_line &rule)
+{
+	string_view line;
+
+	while (source.next_line(line)) {
+		string_view raw = line;
+
+		line = trim(line);
+		line_no++;
+		rule.first_line = line_no;
+		rule.last_line = line_no;
+		rule.comment = line.empty() || line[0] == '#';
+
+		if (rule.comment) {
+			if (comments) {
+				rule.text = raw;
+				return true;
+			}
+
+			continue;
+		}
+
+		if (!is_continued(line)) {
+			rule.text = line;
+			return true;
+		}
+
+		// Glue continuation lines together without the backslashes.
+		joined.emplace_back(line.substr(0, line.length() - 1));
+		string &text = joined.back();
+
+		while (source.next_line(line)) {
+			line = trim(line);
+			line_no++;
+			rule.last_line = line_no;
+
+			if (!is_continued(line)) {
+				text.append(line);
+				break;
+			}
+
+			text.append(line.substr(0, line.length() - 1));
+		}
+
+		rule.text = trim(text);
+
+		if (rule.text.empty()) {
+			continue;
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+void rule_reader::release()
+{
+	source.release();
+	joined.clear();
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <deque>
+#include <string>
+#include <string_view>
+#include "rule_source.h"
+
+typedef struct rule_line
+{
+	std::string_view text;
+	// Physical line numbers (1-based) where the rule starts and ends.
+	size_t first_line;
+	size_t last_line;
+	// A comment or blank line as it is in the input, see
+	// rule_reader::keep_comments().
+	bool comment;
+} type_rule_line;
+
+// Inputs of several files are numbered as one: the lines of each file
+// follow those of the files before it, so that rules of all of them are
+// indexed together. Files are registered in order with the number of
+// lines before them; a single input registers nothing. Registering is
+// not thread-safe, looking up is.
+void add_input_file(const std::string &name, size_t base);
+// File of an input line, which becomes the line in that file; nullptr
+// for a single input.
+const std::string *locate_input_line(size_t &line);
+// "line N", or "file:N" for an input of several files.
+std::string describe_input_line(size_t line);
+
+// Logical rule reader. Skips blank lines and '#' comments (unless told
+// to keep them), joins lines ending with a backslash and trims
+// surrounding whitespace. Rules are
+// views into the input unless they had to be joined; in both cases they
+// stay valid until release() is called.
+class rule_reader
+{
+public:
+	rule_reader();
+
+	// Use dash (-) for stdin. On failure errno tells why.
+	bool open(const std::string &filename);
+	// Return blank lines and comments (disabled rules included) too,
+	// untrimmed, so the input can be written out again in full.
+	void keep_comments(bool keep)
+	{
+		comments = keep;
+	}
+
+	bool next(type_rule_line &rule);
+	// errno of a failed read, see rule_source::error().
+	int error() const
+	{
+		return source.error();
+	}
+	// Rules returned so far are not used anymore.
+	void release();
+	// Physical lines read so far.
+	size_t lines() const
+	{
+		return line_no;
+	}
+
+private:
+	rule_source source;
+	size_t line_no;
+	bool comments;
+	std::deque<std::string> joined;
+};
@@ -0,0 +1,166 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rule_source.h"
+
+using namespace std;
+
+#define READ_BLOCK_SIZE		(1 << 20)
+// Mapped pages behind the reader are dropped in steps of this size to
+// keep the resident set small on huge files.
+#define MAP_RELEASE_STEP	(64 << 20)
+
+rule_source::rule_source()
+	: fd(-1), eof(false), err(0), map(nullptr), map_size(0), map_released(0), pos(0)
+{
+}
+
+rule_source::~rule_source()
+{
+	if (map) {
+		munmap(const_cast<char *>(map), map_size);
+	}
+
+	if (fd > STDIN_FILENO) {
+		close(fd);
+	}
+}
+
+bool rule_source::open(const string &filename)
+{
+	struct stat st;
+
+	if (filename == "-") {
+		fd = STDIN_FILENO;
+	} else {
+		fd = ::open(filename.c_str(), O_RDONLY);
+	}
+
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		return false;
+	}
+
+	if (S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (addr != MAP_FAILED) {
+			map = static_cast<const char *>(addr);
+			map_size = st.st_size;
+			madvise(addr, map_size, MADV_SEQUENTIAL);
+			return true;
+		}
+	}
+
+	// Not mappable, read it in blocks.
+	return true;
+}
+
+bool rule_source::next_line(string_view &line)
+{
+	if (map) {
+		if (pos >= map_size) {
+			return false;
+		}
+
+		const char *start = map + pos;
+		const char *nl = static_cast<const char *>(memchr(start, '\n', map_size - pos));
+		size_t len = nl ? nl - start : map_size - pos;
+
+		line = string_view(start, len);
+		pos += len + 1;
+
+		return true;
+	}
+
+	for (;;) {
+		if (!blocks.empty()) {
+			type_block &b = blocks.back();
+			const char *start = b.data.get() + pos;
+			const char *nl = static_cast<const char *>(memchr(start, '\n', b.used - pos));
+
+			if (nl) {
+				line = string_view(start, nl - start);
+				pos += line.length() + 1;
+				return true;
+			}
+
+			if (eof && pos < b.used) {
+				line = string_view(start, b.used - pos);
+				pos = b.used;
+				return true;
+			}
+		}
+
+		if (eof || !read_more()) {
+			return false;
+		}
+	}
+}
+
+// Read the next chunk of a non-mapped input. A line is never split
+// across blocks: an incomplete tail moves to the start of a new block.
+bool rule_source::read_more()
+{
+	if (blocks.empty() || blocks.back().used == blocks.back().size) {
+		size_t tail = blocks.empty() ? 0 : blocks.back().used - pos;
+		type_block b;
+
+		b.size = max(static_cast<size_t>(READ_BLOCK_SIZE), tail * 2);
+		b.data.reset(new char[b.size]);
+		b.used = tail;
+
+		if (tail) {
+			memcpy(b.data.get(), blocks.back().data.get() + pos, tail);
+		}
+
+		blocks.push_back(move(b));
+		pos = 0;
+	}
+
+	type_block &b = blocks.back();
+	ssize_t n;
+
+	do {
+		n = read(fd, b.data.get() + b.used, b.size - b.used);
+	} while (n < 0 && errno == EINTR);
+
+	if (n < 0) {
+		err = errno;
+	}
+
+	if (n <= 0) {
+		eof = true;
+		return n == 0;
+	}
+
+	b.used += n;
+
+	return true;
+}
+
+void rule_source::release()
+{
+	if (map) {
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t end = (pos / page) * page;
+
+		if (end >= map_released + MAP_RELEASE_STEP) {
+			madvise(const_cast<char *>(map) + map_released, end - map_released, MADV_DONTNEED);
+			map_released = end;
+		}
+
+		return;
+	}
+
+	if (blocks.size() > 1) {
+		blocks.erase(blocks.begin(), blocks.end() - 1);
+	}
+
+	if (!blocks.empty() && pos == blocks.back().used) {
+		blocks.back().used = 0;
+		pos = 0;
+	}
+}
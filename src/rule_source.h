@@ -0,0 +1,50 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Line source over a rules file. Regular files are memory mapped and
+// lines are handed out as views into the mapping; other inputs (stdin,
+// pipes) are read in large blocks. A returned line stays valid until
+// release() is called.
+class rule_source
+{
+public:
+	rule_source();
+	~rule_source();
+
+	rule_source(const rule_source &) = delete;
+	rule_source &operator=(const rule_source &) = delete;
+
+	// Use dash (-) for stdin. On failure errno tells why.
+	bool open(const std::string &filename);
+	bool next_line(std::string_view &line);
+	// errno of a failed read, 0 if the input was read without errors.
+	// next_line() returns false after one, as at the end of the input.
+	int error() const
+	{
+		return err;
+	}
+	// Lines returned so far are not used anymore.
+	void release();
+
+private:
+	typedef struct block
+	{
+		std::unique_ptr<char[]> data;
+		size_t size;
+		size_t used;
+	} type_block;
+
+	bool read_more();
+
+	int fd;
+	bool eof;
+	int err;
+	const char *map;
+	size_t map_size;
+	size_t map_released;
+	size_t pos;
+	std::vector<type_block> blocks;
+};
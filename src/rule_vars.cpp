@@ -0,0 +1,581 @@
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <boost/algorithm/string.hpp>
+#include "hash.h"
+#include "rule_reader.h"
+#include "rule_vars.h"
+#include "string_utils.h"
+
+using namespace std;
+
+// Results of evaluating an expression.
+#define EXPR_OK			0
+// Refers to a variable and no definitions are loaded.
+#define EXPR_UNRESOLVED		1
+#define EXPR_INVALID		2
+// Nesting limit of lists and negations.
+#define EXPR_MAX_DEPTH		16
+
+// Resolution states of a variable.
+#define VAR_PENDING		0
+#define VAR_RESOLVING		1
+#define VAR_RESOLVED		2
+
+typedef struct expr_context
+{
+	// Description of the field, e.g. "source address".
+	string_view field;
+	diag_list *diags;
+	diag_list *warnings;
+	// Has lists or negations.
+	bool compound;
+} type_expr_context;
+
+static const ip_set *var_value(const type_rule_var &var, const ip_set *)
+{
+	return var.is_address ? &var.addresses : nullptr;
+}
+
+static const port_set *var_value(const type_rule_var &var, const port_set *)
+{
+	return var.is_port ? &var.ports : nullptr;
+}
+
+// 'lookup(name, var)' sets 'var' to the definition of $name (nullptr if
+// there is none) and returns EXPR_OK, or returns EXPR_UNRESOLVED.
+template <typename Set, typename Lookup>
+static int eval_expr(string_view s, const Lookup &lookup, type_expr_context &ctx, Set &set, int depth);
+
+template <typename Set, typename Lookup>
+static int eval_list(string_view s, const Lookup &lookup, type_expr_context &ctx, Set &set, int depth)
+{
+	ctx.compound = true;
+
+	if (s.back() != ']') {
+		report(*ctx.diags, DIAG_INVALID_HEADER, string_view(), s, string(ctx.field));
+		return EXPR_INVALID;
+	}
+
+	string_view body = s.substr(1, s.length() - 2);
+	vector<pair<string_view, Set>> negations;
+	Set plus;
+	Set minus;
+	bool has_plus = false;
+	int res = EXPR_OK;
+	int nesting = 0;
+
+	for (size_t i = 0, start = 0; i <= body.length(); i++) {
+		if (i < body.length()) {
+			nesting += (body[i] == '[') - (body[i] == ']');
+
+			if (body[i] != ',' || nesting) {
+				continue;
+			}
+		}
+
+		string_view item = trim(body.substr(start, i - start));
+		bool negated = !item.empty() && item[0] == '!';
+		Set value;
+
+		start = i + 1;
+
+		// Literals go straight into the result; uniting them one by one
+		// would copy it for every item of a long address list.
+		if (!item.empty() && !negated && item[0] != '[' && item[0] != '$' && !boost::iequals(item, "any")) {
+			if (!plus.add(item)) {
+				report(*ctx.diags, DIAG_INVALID_HEADER, string_view(), item, string(ctx.field));
+				res = EXPR_INVALID;
+			}
+
+			has_plus = true;
+			continue;
+		}
+
+		int r = eval_expr(negated ? item.substr(1) : item, lookup, ctx, value, depth + 1);
+
+		res = max(res, r);
+
+		if (r != EXPR_OK) {
+			continue;
+		}
+
+		if (negated) {
+			minus.unite(value);
+			negations.push_back({ item, move(value) });
+		} else {
+			plus.unite(value);
+			has_plus = true;
+		}
+	}
+
+	if (res != EXPR_OK) {
+		return res;
+	}
+
+	if (!has_plus) {
+		plus = Set::any();
+	}
+
+	for (const pair<string_view, Set> &negation : negations) {
+		Set excluded = plus;
+
+		excluded.intersect(negation.second);
+
+		if (excluded.empty()) {
+			report(*ctx.warnings, DIAG_USELESS_NEGATION, string_view(), negation.first, string(ctx.field));
+		}
+	}
+
+	if (!negations.empty()) {
+		minus.complement();
+		plus.intersect(minus);
+	}
+
+	set = move(plus);
+
+	return EXPR_OK;
+}
+
+template <typename Set, typename Lookup>
+static int eval_expr(string_view s, const Lookup &lookup, type_expr_context &ctx, Set &set, int depth)
+{
+	s = trim(s);
+
+	if (s.empty() || depth > EXPR_MAX_DEPTH) {
+		report(*ctx.diags, DIAG_INVALID_HEADER, string_view(), s, string(ctx.field));
+		return EXPR_INVALID;
+	}
+
+	if (s[0] == '!') {
+		ctx.compound = true;
+
+		if (trim(s.substr(1)).substr(0, 1) == "!") {
+			report(*ctx.warnings, DIAG_USELESS_NEGATION, string_view(), s, string(ctx.field));
+		}
+
+		int res = eval_expr(s.substr(1), lookup, ctx, set, depth + 1);
+
+		set.complement();
+
+		return res;
+	}
+
+	if (s[0] == '[') {
+		return eval_list(s, lookup, ctx, set, depth);
+	}
+
+	if (boost::iequals(s, "any")) {
+		set = Set::any();
+		return EXPR_OK;
+	}
+
+	if (s[0] == '$') {
+		const type_rule_var *var = nullptr;
+		int res = lookup(s.substr(1), var);
+
+		if (res != EXPR_OK) {
+			return res;
+		}
+
+		if (!var) {
+			report(*ctx.diags, DIAG_UNKNOWN_VARIABLE, string_view(), s, string(ctx.field));
+			return EXPR_INVALID;
+		}
+
+		const Set *value = var_value(*var, &set);
+
+		if (!value) {
+			report(*ctx.diags, DIAG_INVALID_HEADER, string_view(), s, string(ctx.field));
+			return EXPR_INVALID;
+		}
+
+		set = *value;
+
+		return EXPR_OK;
+	}
+
+	set = Set();
+
+	if (!set.add(s)) {
+		report(*ctx.diags, DIAG_INVALID_HEADER, string_view(), s, string(ctx.field));
+		return EXPR_INVALID;
+	}
+
+	return EXPR_OK;
+}
+
+// Returns true if the field covers everything.
+template <typename Set, typename Lookup>
+static bool check_field(string_view field, const char *name, const Lookup &lookup, diag_list &diags,
+	diag_list &warnings)
+{
+	if (boost::iequals(field, "any")) {
+		return true;
+	}
+
+	Set value;
+	const Set *set = &value;
+
+	// A single variable is the common case; use its value in place.
+	if (field[0] == '$' && field.find_first_of("[],!") == string_view::npos) {
+		const type_rule_var *var = nullptr;
+
+		if (lookup(field.substr(1), var) != EXPR_OK) {
+			return false;
+		}
+
+		if (!var) {
+			report(diags, DIAG_UNKNOWN_VARIABLE, string_view(), field, name);
+			return false;
+		}
+
+		if (!(set = var_value(*var, set))) {
+			report(diags, DIAG_INVALID_HEADER, string_view(), field, name);
+			return false;
+		}
+	} else {
+		type_expr_context ctx = { name, &diags, &warnings, false };
+
+		if (eval_expr(field, lookup, ctx, value, 0) != EXPR_OK) {
+			return false;
+		}
+
+		if (ctx.compound && value.full()) {
+			report(warnings, DIAG_HEADER_ANY, string_view(), field, name);
+		}
+	}
+
+	if (set->empty()) {
+		report(diags, DIAG_EMPTY_HEADER, string_view(), field, name);
+	}
+
+	return set->full();
+}
+
+void check_header(const type_parsed_rule &rule, const rule_vars *vars, type_header_info &info,
+	diag_list &diags, diag_list &warnings)
+{
+	auto lookup = [vars](string_view name, const type_rule_var *&var) {
+		if (!vars) {
+			return EXPR_UNRESOLVED;
+		}
+
+		var = vars->find(name);
+
+		return EXPR_OK;
+	};
+
+	check_field<ip_set>(rule.src_addr, "source address", lookup, diags, warnings);
+	info.src_port_any = check_field<port_set>(rule.src_port, "source port", lookup, diags, warnings);
+	check_field<ip_set>(rule.dst_addr, "destination address", lookup, diags, warnings);
+	info.dst_port_any = check_field<port_set>(rule.dst_port, "destination port", lookup, diags, warnings);
+}
+
+template <typename Set, typename Lookup>
+static bool resolve_field(string_view field, const Lookup &lookup, Set &set)
+{
+	diag_list diags;
+	diag_list warnings;
+	type_expr_context ctx = { string_view(), &diags, &warnings, false };
+
+	if (boost::iequals(field, "any")) {
+		set = Set::any();
+		return true;
+	}
+
+	switch (eval_expr(field, lookup, ctx, set, 0)) {
+	case EXPR_OK:
+		return true;
+	case EXPR_UNRESOLVED:
+		set = Set::any();
+		return true;
+	}
+
+	return false;
+}
+
+bool resolve_header(const type_parsed_rule &rule, const rule_vars *vars, type_header_sets &sets)
+{
+	auto lookup = [vars](string_view name, const type_rule_var *&var) {
+		if (!vars) {
+			return EXPR_UNRESOLVED;
+		}
+
+		var = vars->find(name);
+
+		return EXPR_OK;
+	};
+
+	return resolve_field(rule.src_addr, lookup, sets.src_addr) &&
+		resolve_field(rule.src_port, lookup, sets.src_port) &&
+		resolve_field(rule.dst_addr, lookup, sets.dst_addr) &&
+		resolve_field(rule.dst_port, lookup, sets.dst_port);
+}
+
+const type_rule_var *rule_vars::find(string_view name) const
+{
+	auto it = ids.find(name);
+
+	return (it != ids.end()) ? &vars[it->second] : nullptr;
+}
+
+uint64_t rule_vars::hash() const
+{
+	uint64_t h = hash_mix(vars.size());
+
+	for (const type_rule_var &var : vars) {
+		h = hash_step(h, hash_string(var.name));
+		h = hash_step(h, hash_string(var.value, var.kind));
+	}
+
+	return h;
+}
+
+void rule_vars::define(string_view name, string_view value, int kind, const string &file, size_t line)
+{
+	auto it = ids.emplace(string(name), vars.size());
+
+	if (it.second) {
+		vars.push_back(type_rule_var());
+	}
+
+	type_rule_var &var = vars[it.first->second];
+
+	var.name = string(name);
+	var.value = string(value);
+	var.kind = kind;
+	var.file = file;
+	var.line = line;
+}
+
+// ipvar/portvar/var NAME VALUE, with '#' comments and '\' continuations.
+// On a read error errno tells why.
+bool rule_vars::load_conf(const string &filename)
+{
+	rule_reader reader;
+	type_rule_line line;
+
+	if (!reader.open(filename)) {
+		return false;
+	}
+
+	while (reader.next(line)) {
+		string_view rest = line.text;
+		string_view keyword = next_token(rest, " \t");
+		string_view name = next_token(rest, " \t");
+		int kind;
+
+		if (keyword == "ipvar") {
+			kind = VAR_ADDRESS;
+		} else if (keyword == "portvar") {
+			kind = VAR_PORT;
+		} else if (keyword == "var") {
+			kind = VAR_ANY;
+		} else {
+			continue;
+		}
+
+		define(name, trim(rest), kind, filename, line.first_line);
+	}
+
+	if (reader.error()) {
+		errno = reader.error();
+		return false;
+	}
+
+	return true;
+}
+
+// Only what is needed for the 'vars' section:
+//
+// vars:
+//   address-groups:
+//     HOME_NET: "[192.168.0.0/16,10.0.0.0/8]"
+//   port-groups:
+//     HTTP_PORTS: "80"
+void rule_vars::load_yaml(istream &in, const string &filename)
+{
+	string raw;
+	size_t line_no = 0;
+	size_t vars_indent = string::npos;
+	size_t group_indent = string::npos;
+	int kind = VAR_ANY;
+
+	while (getline(in, raw)) {
+		string_view line = raw;
+		char quote = 0;
+
+		line_no++;
+
+		// Comments start with '#' at the start or after a space.
+		for (size_t i = 0; i < line.length(); i++) {
+			if (quote) {
+				quote = (line[i] == quote) ? 0 : quote;
+			} else if (line[i] == '"' || line[i] == '\'') {
+				quote = line[i];
+			} else if (line[i] == '#' && (i == 0 || is_space(line[i - 1]))) {
+				line = line.substr(0, i);
+				break;
+			}
+		}
+
+		size_t indent = line.find_first_not_of(' ');
+		string_view text = trim(line);
+
+		if (text.empty() || text[0] == '%' || text == "---") {
+			continue;
+		}
+
+		if (vars_indent != string::npos && indent <= vars_indent) {
+			vars_indent = group_indent = string::npos;
+		}
+
+		if (vars_indent == string::npos) {
+			if (text == "vars:") {
+				vars_indent = indent;
+			}
+
+			continue;
+		}
+
+		if (group_indent != string::npos && indent <= group_indent) {
+			group_indent = string::npos;
+		}
+
+		if (group_indent == string::npos) {
+			if (text == "address-groups:" || text == "port-groups:") {
+				kind = (text[0] == 'a') ? VAR_ADDRESS : VAR_PORT;
+				group_indent = indent;
+			}
+
+			continue;
+		}
+
+		size_t colon = text.find(':');
+
+		if (colon == string_view::npos) {
+			continue;
+		}
+
+		string_view value = trim(text.substr(colon + 1));
+
+		if (value.length() >= 2 && (value[0] == '"' || value[0] == '\'') && value.back() == value[0]) {
+			value = value.substr(1, value.length() - 2);
+		}
+
+		define(trim(text.substr(0, colon)), value, kind, filename, line_no);
+	}
+}
+
+bool is_yaml_config(const string &filename)
+{
+	ifstream in(filename);
+	string first;
+
+	getline(in, first);
+
+	return boost::ends_with(filename, ".yaml") || boost::ends_with(filename, ".yml") ||
+		boost::starts_with(first, "%YAML");
+}
+
+bool rule_vars::load(const string &filename)
+{
+	ifstream in(filename);
+
+	if (!in) {
+		return false;
+	}
+
+	if (is_yaml_config(filename)) {
+		load_yaml(in, filename);
+	} else {
+		in.close();
+
+		if (!load_conf(filename)) {
+			return false;
+		}
+	}
+
+	resolve();
+
+	return true;
+}
+
+// Values are resolved once, here, so rules only look them up.
+void rule_vars::resolve()
+{
+	vector<int> states(vars.size(), VAR_PENDING);
+
+	messages.clear();
+
+	for (size_t i = 0; i < vars.size(); i++) {
+		resolve(i, states);
+	}
+}
+
+// Returns false if the variable is being resolved, a cycle.
+bool rule_vars::resolve(size_t index, vector<int> &states)
+{
+	if (states[index] != VAR_PENDING) {
+		return states[index] == VAR_RESOLVED;
+	}
+
+	states[index] = VAR_RESOLVING;
+
+	type_rule_var &var = vars[index];
+	string where = var.file + ":" + to_string(var.line) + ": ";
+	bool cycle = false;
+	diag_list diags;
+	diag_list warnings;
+
+	auto lookup = [&](string_view name, const type_rule_var *&ref) {
+		auto it = ids.find(name);
+
+		if (it != ids.end() && !resolve(it->second, states)) {
+			cycle = true;
+		} else if (it != ids.end()) {
+			ref = &vars[it->second];
+		}
+
+		return EXPR_OK;
+	};
+
+	string field = "value of " + var.name;
+	type_expr_context ctx = { field, &diags, &warnings, false };
+
+	var.addresses = ip_set();
+	var.ports = port_set();
+	var.is_address = var.kind != VAR_PORT && eval_expr(string_view(var.value), lookup, ctx, var.addresses, 0) == EXPR_OK;
+
+	// A plain 'var' is kept as whichever it parses as, quietly.
+	if (var.kind == VAR_ANY) {
+		diags.clear();
+		warnings.clear();
+	}
+
+	var.is_port = var.kind != VAR_ADDRESS && eval_expr(string_view(var.value), lookup, ctx, var.ports, 0) == EXPR_OK;
+
+	if (var.kind == VAR_ANY) {
+		diags.clear();
+		warnings.clear();
+	}
+
+	if (cycle) {
+		messages.push_back(where + var.name + " refers to itself");
+	} else {
+		for (const diag_list *list : { &diags, &warnings }) {
+			for (const type_diagnostic &diag : *list) {
+				messages.push_back(where + format_diagnostic(diag));
+			}
+		}
+
+		if ((var.is_address && var.addresses.empty()) || (var.is_port && var.ports.empty())) {
+			messages.push_back(where + var.name + " matches nothing");
+		}
+	}
+
+	states[index] = VAR_RESOLVED;
+
+	return true;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <map>
+#include <vector>
+#include "address_set.h"
+#include "diagnostic.h"
+#include "rule_checker.h"
+
+// Address and port variables ($HOME_NET, $HTTP_PORTS, ...) and the
+// values of rule header fields.
+//
+// Header fields are expressions of 'any', variables, literals (addresses
+// with an optional /prefix, ports and lo:hi ranges), negations '!x' and
+// lists '[a,b,...]'. A list is the union of its plain items (or any
+// address if there are none) minus the union of its negated ones, so
+// "[!$HOME_NET,10.0.0.0/8]" is 10.0.0.0/8 outside of $HOME_NET.
+
+#define VAR_ANY			0	// var: whichever of the two it parses as
+#define VAR_ADDRESS		1	// ipvar, address-groups
+#define VAR_PORT		2	// portvar, port-groups
+
+typedef struct rule_var
+{
+	std::string name;
+	std::string value;
+	int kind;
+	// Where it is defined.
+	std::string file;
+	size_t line;
+	// Resolved values; false if the value is not an address (port) list.
+	bool is_address;
+	bool is_port;
+	ip_set addresses;
+	port_set ports;
+} type_rule_var;
+
+// A suricata.yaml style file rather than a snort.conf one: a .yaml/.yml
+// name or a leading "%YAML".
+bool is_yaml_config(const std::string &filename);
+
+class rule_vars
+{
+public:
+	// Load definitions from a snort.conf style file ('ipvar', 'portvar' and
+	// 'var' lines; anything else is skipped) or a suricata.yaml style one
+	// ('vars:' with 'address-groups:' and 'port-groups:'), told apart by
+	// a .yaml/.yml name or a leading "%YAML". May be called for several
+	// files; later definitions replace earlier ones. Returns false if the
+	// file can't be read (errno tells why). Definitions that don't
+	// resolve are listed in problems().
+	bool load(const std::string &filename);
+
+	// nullptr if not defined.
+	const type_rule_var *find(std::string_view name) const;
+
+	// "file:line: message" for each bad definition.
+	const std::vector<std::string> &problems() const
+	{
+		return messages;
+	}
+
+	size_t size() const
+	{
+		return vars.size();
+	}
+
+	// Changes whenever a definition does.
+	uint64_t hash() const;
+
+private:
+	void define(std::string_view name, std::string_view value, int kind, const std::string &file,
+		size_t line);
+	bool load_conf(const std::string &filename);
+	void load_yaml(std::istream &in, const std::string &filename);
+	void resolve();
+	bool resolve(size_t index, std::vector<int> &states);
+
+	std::vector<type_rule_var> vars;
+	// Transparent, so lookups by string_view build no string.
+	std::map<std::string, size_t, std::less<>> ids;
+	std::vector<std::string> messages;
+};
+
+typedef struct header_info
+{
+	// The port field covers every port: 'any' or a value resolving to
+	// all of them. Variables without definitions loaded are assumed not to.
+	bool src_port_any;
+	bool dst_port_any;
+} type_header_info;
+
+// Resolve the address and port fields of a rule. Without 'vars',
+// fields referring to variables are not checked.
+//
+// Errors, into 'diags': fields that match nothing (e.g. "!any" or
+// "[1.2.3.0/24,!1.2.0.0/16]"), invalid literals, unknown variables.
+// Warnings, into 'warnings': lists and negations covering everything
+// (same as 'any'), negations that exclude nothing and double negations.
+void check_header(const type_parsed_rule &rule, const rule_vars *vars, type_header_info &info,
+	diag_list &diags, diag_list &warnings);
+
+typedef struct header_sets
+{
+	ip_set src_addr;
+	port_set src_port;
+	ip_set dst_addr;
+	port_set dst_port;
+} type_header_sets;
+
+// Values of the address and port fields of a rule, for matching packets
+// against it. Fields referring to variables are taken as 'any' without
+// 'vars'. Returns false if a field is invalid or refers to an unknown
+// variable.
+bool resolve_header(const type_parsed_rule &rule, const rule_vars *vars, type_header_sets &sets);
@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "rule_checker.h"
+#include "rule_reader.h"
+#include "stats.h"
+
+using namespace std;
+
+typedef struct phase_stats
+{
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t buckets[STATS_BUCKETS];
+} type_phase_stats;
+
+typedef struct option_stats
+{
+	uint64_t calls;
+	uint64_t total_ns;
+} type_option_stats;
+
+typedef struct rule_time
+{
+	uint64_t ns;
+	size_t line;
+
+	bool operator>(const rule_time &other) const
+	{
+		return ns > other.ns || (ns == other.ns && line < other.line);
+	}
+} type_rule_time;
+
+typedef struct stats
+{
+	type_phase_stats phases[PHASES_COUNT];
+	type_option_stats options[RULE_OPTIONS_COUNT];
+	// Min-heap of the slowest rules seen.
+	vector<type_rule_time> slowest;
+} type_stats;
+
+static const char *phase_names[PHASES_COUNT] = { "read", "tokenize", "check", "analyze", "output", "fix" };
+
+bool stats_enabled = false;
+static size_t slowest_count = 0;
+
+static mutex merged_lock;
+static type_stats merged;
+
+static void push_rule(vector<type_rule_time> &heap, const type_rule_time &rule)
+{
+	if (heap.size() < slowest_count) {
+		heap.push_back(rule);
+		push_heap(heap.begin(), heap.end(), greater<type_rule_time>());
+	} else if (!heap.empty() && rule > heap.front()) {
+		pop_heap(heap.begin(), heap.end(), greater<type_rule_time>());
+		heap.back() = rule;
+		push_heap(heap.begin(), heap.end(), greater<type_rule_time>());
+	}
+}
+
+static void merge(type_stats &from)
+{
+	lock_guard<mutex> lock(merged_lock);
+
+	for (size_t i = 0; i < PHASES_COUNT; i++) {
+		merged.phases[i].count += from.phases[i].count;
+		merged.phases[i].total_ns += from.phases[i].total_ns;
+		merged.phases[i].max_ns = max(merged.phases[i].max_ns, from.phases[i].max_ns);
+
+		for (size_t j = 0; j < STATS_BUCKETS; j++) {
+			merged.phases[i].buckets[j] += from.phases[i].buckets[j];
+		}
+	}
+
+	for (size_t i = 0; i < RULE_OPTIONS_COUNT; i++) {
+		merged.options[i].calls += from.options[i].calls;
+		merged.options[i].total_ns += from.options[i].total_ns;
+	}
+
+	for (const type_rule_time &rule : from.slowest) {
+		push_rule(merged.slowest, rule);
+	}
+
+	from = type_stats();
+}
+
+// Samples of one thread, merged when the thread exits.
+typedef struct local_stats
+{
+	type_stats data = type_stats();
+	// Inside stats_fix_start()/stats_fix_end().
+	bool muted = false;
+
+	~local_stats()
+	{
+		merge(data);
+	}
+} type_local_stats;
+
+static thread_local type_local_stats local;
+
+void stats_enable(size_t slowest)
+{
+	stats_enabled = true;
+	slowest_count = slowest;
+}
+
+static void add_phase(int phase, uint64_t ns)
+{
+	type_phase_stats &p = local.data.phases[phase];
+	size_t bucket = 0;
+
+	while ((ns >> (bucket + 1)) && bucket < STATS_BUCKETS - 1) {
+		bucket++;
+	}
+
+	p.count++;
+	p.total_ns += ns;
+	p.max_ns = max(p.max_ns, ns);
+	p.buckets[bucket]++;
+}
+
+void stats_phase(int phase, uint64_t ns)
+{
+	if (!local.muted) {
+		add_phase(phase, ns);
+	}
+}
+
+void stats_option(int id, uint64_t ns)
+{
+	if (local.muted) {
+		return;
+	}
+
+	local.data.options[id].calls++;
+	local.data.options[id].total_ns += ns;
+}
+
+void stats_rule(size_t line, uint64_t ns)
+{
+	push_rule(local.data.slowest, { ns, line });
+}
+
+uint64_t stats_fix_start()
+{
+	local.muted = true;
+
+	return stats_clock();
+}
+
+void stats_fix_end(uint64_t start)
+{
+	local.muted = false;
+	add_phase(PHASE_FIX, stats_clock() - start);
+}
+
+// Upper bound of the bucket holding the given quantile.
+static uint64_t quantile(const type_phase_stats &p, double q)
+{
+	uint64_t rank = p.count * q;
+	uint64_t seen = 0;
+
+	for (size_t i = 0; i < STATS_BUCKETS; i++) {
+		seen += p.buckets[i];
+
+		if (seen > rank) {
+			return min(uint64_t(2) << i, p.max_ns);
+		}
+	}
+
+	return p.max_ns;
+}
+
+void stats_report(FILE *out, bool summary)
+{
+	merge(local.data);
+
+	lock_guard<mutex> lock(merged_lock);
+
+	if (summary) {
+		fprintf(out, "Phases (per rule, ns; percentiles are histogram bucket bounds):\n");
+		fprintf(out, "%-10s %12s %12s %10s %10s %10s %10s\n",
+			"phase", "count", "total ms", "p50", "p90", "p99", "max");
+
+		for (size_t i = 0; i < PHASES_COUNT; i++) {
+			const type_phase_stats &p = merged.phases[i];
+
+			fprintf(out, "%-10s %12llu %12.1f %10llu %10llu %10llu %10llu\n", phase_names[i],
+				(unsigned long long)p.count, p.total_ns / 1e6,
+				(unsigned long long)quantile(p, 0.5), (unsigned long long)quantile(p, 0.9),
+				(unsigned long long)quantile(p, 0.99), (unsigned long long)p.max_ns);
+		}
+
+		for (size_t i = 0; i < PHASES_COUNT; i++) {
+			const type_phase_stats &p = merged.phases[i];
+
+			if (!p.count) {
+				continue;
+			}
+
+			fprintf(out, "\nHistogram of '%s' (ns):\n", phase_names[i]);
+
+			for (size_t j = 0; j < STATS_BUCKETS; j++) {
+				if (p.buckets[j]) {
+					fprintf(out, "  %12llu - %-12llu %12llu\n", 1ULL << j, (2ULL << j) - 1,
+						(unsigned long long)p.buckets[j]);
+				}
+			}
+		}
+
+		vector<size_t> order;
+
+		for (size_t i = 0; i < RULE_OPTIONS_COUNT; i++) {
+			if (merged.options[i].calls) {
+				order.push_back(i);
+			}
+		}
+
+		sort(order.begin(), order.end(), [](size_t a, size_t b) {
+			return merged.options[a].total_ns > merged.options[b].total_ns;
+		});
+
+		fprintf(out, "\nOptions (by total time):\n");
+		fprintf(out, "%-18s %12s %12s %10s\n", "option", "calls", "total ms", "avg ns");
+
+		for (size_t i : order) {
+			const type_option_stats &o = merged.options[i];
+
+			fprintf(out, "%-18s %12llu %12.1f %10llu\n", rule_options[i].name,
+				(unsigned long long)o.calls, o.total_ns / 1e6,
+				(unsigned long long)(o.total_ns / o.calls));
+		}
+	}
+
+	if (slowest_count) {
+		vector<type_rule_time> slowest = merged.slowest;
+
+		sort(slowest.begin(), slowest.end(), greater<type_rule_time>());
+
+		fprintf(out, "%sSlowest rules:\n", summary ? "\n" : "");
+
+		for (const type_rule_time &rule : slowest) {
+			size_t line = rule.line;
+			const string *file = locate_input_line(line);
+
+			if (file) {
+				fprintf(out, "- %s:%zu: %.1f us\n", file->c_str(), line, rule.ns / 1e3);
+			} else {
+				fprintf(out, "- Line %zu: %.1f us\n", line, rule.ns / 1e3);
+			}
+		}
+	}
+
+	fflush(out);
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+
+// Timing instrumentation behind --stats and --slowest. Built only with
+// the DUMBPIG_STATS option; otherwise the STATS_* macros expand to
+// nothing and no instrumentation code is compiled in. When built but
+// not enabled at run time, each probe costs one predictable branch.
+//
+// Samples go to per-thread counters that are merged when a thread
+// exits, so probes never take locks.
+
+#define PHASE_READ		0
+#define PHASE_TOKENIZE		1
+#define PHASE_CHECK		2
+#define PHASE_ANALYZE		3
+#define PHASE_OUTPUT		4
+// Rewriting a rule for --fix, the re-check of the rewritten rule included.
+#define PHASE_FIX		5
+#define PHASES_COUNT		6
+
+// Latency histogram bucket i counts samples of [2^i, 2^(i+1)) ns.
+#define STATS_BUCKETS		40
+
+#ifdef DUMBPIG_STATS
+
+#include <chrono>
+
+// Set once, before any checker thread starts.
+extern bool stats_enabled;
+
+// Start collecting; keep the 'slowest' slowest rules.
+void stats_enable(size_t slowest);
+
+inline uint64_t stats_clock()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void stats_phase(int phase, uint64_t ns);
+void stats_option(int id, uint64_t ns);
+void stats_rule(size_t line, uint64_t ns);
+// Samples of the calling thread between the two are not counted, only
+// the time in between, as PHASE_FIX.
+uint64_t stats_fix_start();
+void stats_fix_end(uint64_t start);
+
+// Merge the samples of all threads and print them; the per-phase and
+// per-option tables only if 'summary' is set.
+void stats_report(FILE *out, bool summary);
+
+// Take a timestamp into a new variable 'var'.
+#define STATS_START(var) \
+	uint64_t var = stats_enabled ? stats_clock() : 0
+// Account the time since 'var' to 'phase' and restart 'var'.
+#define STATS_LAP(phase, var) \
+	do { \
+		if (stats_enabled) { \
+			uint64_t now_ = stats_clock(); \
+			stats_phase(phase, now_ - var); \
+			var = now_; \
+		} \
+	} while (0)
+#define STATS_OPTION(id, var) \
+	do { \
+		if (stats_enabled) { \
+			stats_option(id, stats_clock() - var); \
+		} \
+	} while (0)
+#define STATS_RULE(line, var) \
+	do { \
+		if (stats_enabled) { \
+			stats_rule(line, stats_clock() - var); \
+		} \
+	} while (0)
+#define STATS_FIX_START(var) \
+	uint64_t var = stats_enabled ? stats_fix_start() : 0
+#define STATS_FIX_END(var) \
+	do { \
+		if (stats_enabled) { \
+			stats_fix_end(var); \
+		} \
+	} while (0)
+
+#else
+
+#define STATS_START(var)
+#define STATS_LAP(phase, var)
+#define STATS_OPTION(id, var)
+#define STATS_RULE(line, var)
+#define STATS_FIX_START(var)
+#define STATS_FIX_END(var)
+
+#endif
@@ -0,0 +1,44 @@
+#pragma once
+#include <string_view>
+
+// Same character class as ECMAScript '\s' in the "C" locale.
+constexpr bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+inline std::string_view trim(std::string_view s)
+{
+	while (!s.empty() && is_space(s.front())) {
+		s.remove_prefix(1);
+	}
+
+	while (!s.empty() && is_space(s.back())) {
+		s.remove_suffix(1);
+	}
+
+	return s;
+}
+
+// Split off the next token delimited by any of 'separators'. Leading
+// separators are skipped. Returns an empty view when 's' is exhausted.
+inline std::string_view next_token(std::string_view &s, std::string_view separators)
+{
+	size_t start = s.find_first_not_of(separators);
+
+	if (start == std::string_view::npos) {
+		s = std::string_view();
+		return s;
+	}
+
+	size_t end = s.find_first_of(separators, start);
+
+	if (end == std::string_view::npos) {
+		end = s.length();
+	}
+
+	std::string_view tok = s.substr(start, end - start);
+	s.remove_prefix(end);
+
+	return tok;
+}
@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <boost/algorithm/string.hpp>
+#include "corpus_checker.h"
+#include "report_writer.h"
+#include "rule_reader.h"
+#include "watch_server.h"
+
+using namespace std;
+
+#define RULES_SUFFIX		".rules"
+#define WATCH_EVENTS		(IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE | \
+				 IN_DELETE_SELF)
+#define EVENTS_BUFFER_SIZE	(64 * 1024)
+#define REQUEST_MAX		4096
+// Old rules looked at for each rule of a changed file.
+#define WATCH_LOOKAHEAD		16
+#define LISTEN_BACKLOG		16
+// A client has this long to send its request.
+#define REQUEST_TIMEOUT_MS	1000
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int)
+{
+	stop_requested = 1;
+}
+
+static bool is_rules_file(const string &name)
+{
+	return boost::ends_with(name, RULES_SUFFIX);
+}
+
+static string real_path(const string &path)
+{
+	char buf[PATH_MAX];
+
+	return realpath(path.c_str(), buf) ? string(buf) : path;
+}
+
+watch_server::watch_server(const rule_checker &checker, int format, unsigned jobs)
+	: checker(checker), format(format), jobs(jobs), inotify_fd(-1), socket_fd(-1),
+	reloads(0), rechecked(0), last_reload_ms(0)
+{
+}
+
+watch_server::~watch_server()
+{
+	if (inotify_fd >= 0) {
+		close(inotify_fd);
+	}
+
+	if (socket_fd >= 0) {
+		close(socket_fd);
+		unlink(socket_path.c_str());
+	}
+}
+
+bool watch_server::watch(const string &dir)
+{
+	if (inotify_fd < 0 && (inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+		return false;
+	}
+
+	return add_watch(real_path(dir));
+}
+
+bool watch_server::add_watch(const string &dir)
+{
+	int wd = inotify_add_watch(inotify_fd, dir.c_str(), WATCH_EVENTS | IN_ONLYDIR);
+
+	if (wd < 0) {
+		return false;
+	}
+
+	dirs[wd] = dir;
+
+	DIR *d = opendir(dir.c_str());
+
+	if (!d) {
+		return false;
+	}
+
+	while (struct dirent *entry = readdir(d)) {
+		string name = entry->d_name;
+		string path = dir + "/" + name;
+		struct stat st;
+
+		if (name == "." || name == ".." || stat(path.c_str(), &st) < 0) {
+			continue;
+		}
+
+		if (S_ISDIR(st.st_mode)) {
+			add_watch(path);
+		} else if (S_ISREG(st.st_mode) && is_rules_file(name)) {
+			load(path);
+		}
+	}
+
+	closedir(d);
+
+	return true;
+}
+
+// Read a file again; rules seen before keep their results. Old and new
+// rules are matched in order like a diff: an edited rule is checked
+// again, rules removed are skipped over within a short window. Rules
+// moved further than that are simply checked again.
+void watch_server::load(const string &path)
+{
+	auto start = chrono::steady_clock::now();
+	rule_reader reader;
+
+	if (!reader.open(path)) {
+		files.erase(path);
+		return;
+	}
+
+	type_watched_file &file = files[path];
+	vector<unique_ptr<type_watched_rule>> old;
+	vector<type_watched_rule *> fresh;
+	type_rule_line line;
+	size_t cursor = 0;
+
+	old.swap(file.rules);
+	file.rules.reserve(old.size());
+
+	while (reader.next(line)) {
+		size_t end = min(old.size(), cursor + WATCH_LOOKAHEAD);
+		size_t found = cursor;
+
+		while (found < end && old[found]->text != line.text) {
+			found++;
+		}
+
+		if (found < end) {
+			file.rules.push_back(move(old[found]));
+			cursor = found + 1;
+		} else {
+			file.rules.push_back(make_unique<type_watched_rule>());
+			file.rules.back()->text = string(line.text);
+			fresh.push_back(file.rules.back().get());
+		}
+
+		file.rules.back()->first_line = line.first_line;
+		file.rules.back()->last_line = line.last_line;
+	}
+
+	// Served as if the file could not be opened.
+	if (reader.error()) {
+		cerr << path << ": " << strerror(reader.error()) << endl;
+		files.erase(path);
+		return;
+	}
+
+	vector<string_view> texts;
+	vector<type_parsed_rule> reports(fresh.size());
+
+	for (type_watched_rule *rule : fresh) {
+		texts.push_back(rule->text);
+	}
+
+	checker.check(texts.data(), texts.size(), reports.data(), jobs);
+
+	for (size_t i = 0; i < fresh.size(); i++) {
+		fresh[i]->report = move(reports[i]);
+	}
+
+	reloads++;
+	rechecked += fresh.size();
+	last_reload_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+	cerr << path << ": " << file.rules.size() << " rules, " << fresh.size() << " checked in "
+		<< last_reload_ms << " ms" << endl;
+}
+
+// Returns false on a fatal error.
+bool watch_server::handle_events()
+{
+	alignas(struct inotify_event) char buf[EVENTS_BUFFER_SIZE];
+	ssize_t len;
+
+	while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+		const struct inotify_event *event;
+
+		for (char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + event->len) {
+			event = reinterpret_cast<const struct inotify_event *>(p);
+
+			auto dir = dirs.find(event->wd);
+
+			if (dir == dirs.end()) {
+				continue;
+			}
+
+			if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+				dirs.erase(dir);
+				continue;
+			}
+
+			string name = event->len ? event->name : "";
+			string path = dir->second + "/" + name;
+
+			if (event->mask & IN_ISDIR) {
+				if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+					add_watch(path);
+				}
+			} else if (is_rules_file(name)) {
+				if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+					files.erase(path);
+				} else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+					load(path);
+				}
+			}
+		}
+	}
+
+	return len == 0 || errno == EAGAIN || errno == EINTR;
+}
+
+bool watch_server::listen(const string &path)
+{
+	struct sockaddr_un addr;
+
+	if (path.length() >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return false;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path.c_str(), path.length());
+
+	if ((socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		return false;
+	}
+
+	unlink(path.c_str());
+
+	if (bind(socket_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0 ||
+		::listen(socket_fd, LISTEN_BACKLOG) < 0) {
+		close(socket_fd);
+		socket_fd = -1;
+		return false;
+	}
+
+	socket_path = path;
+
+	return true;
+}
+
+void watch_server::report(const string &path, bool all, FILE *out)
+{
+	const type_watched_file &file = files.at(path);
+	report_writer output(format, path, out);
+	corpus_checker corpus;
+
+	output.begin();
+
+	for (const unique_ptr<type_watched_rule> &rule : file.rules) {
+		type_rule_line line = { rule->text, rule->first_line, rule->last_line };
+
+		if (all || !rule->report.diags.empty()) {
+			output.rule(line, rule->report);
+		}
+
+		corpus.add(line, rule->report);
+	}
+
+	output.findings(corpus.finish());
+	output.end();
+}
+
+void watch_server::serve(int client)
+{
+	char request[REQUEST_MAX];
+	size_t len = 0;
+	struct pollfd pfd = { client, POLLIN, 0 };
+
+	while (len < sizeof(request) && poll(&pfd, 1, REQUEST_TIMEOUT_MS) > 0) {
+		ssize_t n = read(client, request + len, sizeof(request) - len);
+
+		if (n <= 0) {
+			break;
+		}
+
+		len += n;
+
+		if (memchr(request, '\n', len)) {
+			break;
+		}
+	}
+
+	FILE *out = fdopen(client, "w");
+
+	if (!out) {
+		close(client);
+		return;
+	}
+
+	string_view text(request, len);
+	size_t nl = text.find('\n');
+	string line = boost::trim_copy(string(text.substr(0, nl)));
+	string command = line.substr(0, line.find(' '));
+	string arg = (command.length() < line.length()) ? boost::trim_copy(line.substr(command.length())) : "";
+
+	// Changes saved just before the request are picked up first.
+	handle_events();
+
+	if (command == "CHECK" || command == "DIAGS") {
+		string path = real_path(arg);
+
+		if (files.count(path)) {
+			report(path, command == "CHECK", out);
+		} else {
+			fprintf(out, "ERROR %s is not a watched rules file\n", arg.c_str());
+		}
+	} else if (command == "STATUS") {
+		size_t rules = 0;
+		size_t errors = 0;
+		size_t warnings = 0;
+
+		for (const auto &file : files) {
+			for (const unique_ptr<type_watched_rule> &rule : file.second.rules) {
+				rules++;
+				errors += rule->report.status == RULE_HAS_ERRORS;
+				warnings += rule->report.status == RULE_HAS_WARNINGS;
+			}
+		}
+
+		fprintf(out, "files %zu rules %zu errors %zu warnings %zu reloads %zu rechecked %zu last_reload_ms %.3f\n",
+			files.size(), rules, errors, warnings, reloads, rechecked, last_reload_ms);
+	} else if (command == "FILES") {
+		for (const auto &file : files) {
+			fprintf(out, "%s\n", file.first.c_str());
+		}
+	} else {
+		fprintf(out, "ERROR unknown request '%s', expected CHECK <file>, DIAGS <file>, STATUS or FILES\n", command.c_str());
+	}
+
+	fclose(out);
+}
+
+bool watch_server::run()
+{
+	struct pollfd fds[2] = {
+		{ inotify_fd, POLLIN, 0 },
+		{ socket_fd, POLLIN, 0 },
+	};
+
+	signal(SIGINT, request_stop);
+	signal(SIGTERM, request_stop);
+	signal(SIGPIPE, SIG_IGN);
+
+	while (!stop_requested) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return false;
+		}
+
+		// Events first, so that a request sees the latest saves.
+		if ((fds[0].revents & POLLIN) && !handle_events()) {
+			return false;
+		}
+
+		if (fds[1].revents & POLLIN) {
+			int client = accept4(socket_fd, nullptr, nullptr, SOCK_CLOEXEC);
+
+			if (client >= 0) {
+				serve(client);
+			}
+		}
+	}
+
+	return true;
+}
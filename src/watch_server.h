@@ -0,0 +1,75 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "rule_checker.h"
+
+// Watch mode (Linux only): rule directories are watched with inotify and
+// the checked rules of every '*.rules' file in them are kept in memory.
+// When a file is written or replaced it is read again and only rules
+// whose text changed are checked; the others keep their results.
+//
+// Results are served over a Unix stream socket, one request line per
+// connection, the response follows until the server closes it:
+//
+//   CHECK <file>   report of the file in the output format, as dumbpig
+//                  would print it for that file alone
+//   DIAGS <file>   the same, only rules with diagnostics
+//   STATUS         one line of counters
+//   FILES          watched files, one per line
+//
+// Failed requests get "ERROR <reason>".
+class watch_server
+{
+public:
+	watch_server(const rule_checker &checker, int format, unsigned jobs);
+	~watch_server();
+
+	watch_server(const watch_server &) = delete;
+	watch_server &operator=(const watch_server &) = delete;
+
+	// Watch a directory and its subdirectories and check the rule files
+	// in them. On failure errno tells why.
+	bool watch(const std::string &dir);
+	// Bind the socket, replacing a stale one. On failure errno tells why.
+	bool listen(const std::string &path);
+	// Serve until SIGINT or SIGTERM. Returns false on a fatal error.
+	bool run();
+
+private:
+	typedef struct watched_rule
+	{
+		std::string text;
+		size_t first_line;
+		size_t last_line;
+		// Views into 'text'.
+		type_parsed_rule report;
+	} type_watched_rule;
+
+	typedef struct watched_file
+	{
+		// Never moved, so reports stay valid and reloads only move pointers.
+		std::vector<std::unique_ptr<type_watched_rule>> rules;
+	} type_watched_file;
+
+	bool add_watch(const std::string &dir);
+	void load(const std::string &path);
+	bool handle_events();
+	void serve(int client);
+	void report(const std::string &path, bool all, FILE *out);
+
+	const rule_checker &checker;
+	int format;
+	unsigned jobs;
+	int inotify_fd;
+	int socket_fd;
+	std::string socket_path;
+	// Watched directories by watch descriptor.
+	std::unordered_map<int, std::string> dirs;
+	// By real path.
+	std::unordered_map<std::string, type_watched_file> files;
+	size_t reloads;
+	size_t rechecked;
+	double last_reload_ms;
+};